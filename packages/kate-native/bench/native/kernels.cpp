@@ -0,0 +1,270 @@
+/**
+ * Native kernel benchmarks
+ *
+ * Times the parts of the addon that don't need Qt or a JavaScript engine:
+ * newline scanning, the compact line index, packed edit parsing, line
+ * diffs and column encoding tables. Built only on request:
+ *
+ *   node-gyp rebuild -- -Dbuild_benchmarks=1
+ *   ./build/Release/kate_native_bench [--json] [--filter=substring]
+ *
+ * With --json the results are printed in Google Benchmark's JSON layout,
+ * so the same tooling can compare runs.
+ */
+
+#include "../../src/column_table.h"
+#include "../../src/edit_batch.h"
+#include "../../src/line_diff.h"
+#include "../../src/line_offsets.h"
+#include "../../src/line_scanner.h"
+#include "../../src/worker_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace KateNative;
+
+namespace {
+
+struct Benchmark {
+    std::string name;
+    // Bytes processed per iteration, for throughput; 0 when meaningless
+    uint64_t bytes;
+    std::function<void()> run;
+};
+
+struct Result {
+    std::string name;
+    uint64_t iterations;
+    double nanosecondsPerIteration;
+    double bytesPerSecond;
+};
+
+// Source-like text: lines of 0 to 120 characters, a few of them CRLF
+std::string SyntheticText(uint64_t size) {
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> lineLength(0, 120);
+    std::string text;
+    text.reserve(size);
+    while (text.size() < size) {
+        int length = lineLength(random);
+        for (int i = 0; i < length; i++) {
+            text.push_back(static_cast<char>('a' + (i * 7 + length) % 26));
+        }
+        if (random() % 16 == 0) {
+            text.push_back('\r');
+        }
+        text.push_back('\n');
+    }
+    text.resize(size);
+    return text;
+}
+
+// An EditBatch buffer of `count` single-character replaces
+std::vector<uint8_t> SyntheticEdits(uint32_t count) {
+    size_t headerFields = 1 + count * EditBatch::FieldsPerEdit;
+    std::vector<uint8_t> buffer(headerFields * sizeof(uint32_t) + count * sizeof(char16_t));
+    std::vector<uint32_t> fields(headerFields);
+    fields[0] = count;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t* edit = &fields[1 + i * EditBatch::FieldsPerEdit];
+        edit[0] = EditBatch::OpReplace;
+        edit[1] = i;
+        edit[2] = 0;
+        edit[3] = i;
+        edit[4] = 1;
+        edit[5] = i;
+        edit[6] = 1;
+    }
+    std::memcpy(buffer.data(), fields.data(), fields.size() * sizeof(uint32_t));
+    return buffer;
+}
+
+// Repeats `run` until it has taken at least `minimum`, after one warmup call
+Result Measure(const Benchmark& benchmark, std::chrono::nanoseconds minimum) {
+    using Clock = std::chrono::steady_clock;
+    benchmark.run();
+
+    uint64_t iterations = 1;
+    for (;;) {
+        Clock::time_point start = Clock::now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            benchmark.run();
+        }
+        std::chrono::nanoseconds elapsed = Clock::now() - start;
+
+        if (elapsed >= minimum || iterations >= (uint64_t(1) << 30)) {
+            double perIteration = static_cast<double>(elapsed.count()) / iterations;
+            double bytesPerSecond = benchmark.bytes ? benchmark.bytes * 1e9 / perIteration : 0;
+            return {benchmark.name, iterations, perIteration, bytesPerSecond};
+        }
+
+        // Aim a little past the minimum on the next round
+        double scale = elapsed.count() > 0 ? 1.4 * minimum.count() / elapsed.count() : 10;
+        iterations = std::max(iterations + 1, static_cast<uint64_t>(iterations * std::min(scale, 10.0)));
+    }
+}
+
+void PrintJson(const std::vector<Result>& results) {
+    std::printf("{\n  \"context\": {\n");
+    std::printf("    \"num_cpus\": %d,\n", WorkerPool::ThreadCount());
+    std::printf("    \"line_scanner_kernel\": \"%s\"\n", LineScanner::Kernel());
+    std::printf("  },\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& result = results[i];
+        std::printf("    {\"name\": \"%s\", \"iterations\": %llu, \"real_time\": %.1f, \"time_unit\": \"ns\"",
+                    result.name.c_str(), static_cast<unsigned long long>(result.iterations),
+                    result.nanosecondsPerIteration);
+        if (result.bytesPerSecond > 0) {
+            std::printf(", \"bytes_per_second\": %.0f", result.bytesPerSecond);
+        }
+        std::printf("}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    std::printf("  ]\n}\n");
+}
+
+void PrintTable(const std::vector<Result>& results) {
+    std::printf("%-40s %14s %12s %12s\n", "Benchmark", "Time/iter", "Iterations", "Throughput");
+    for (const Result& result : results) {
+        char throughput[32] = "";
+        if (result.bytesPerSecond > 0) {
+            std::snprintf(throughput, sizeof(throughput), "%.2f GB/s", result.bytesPerSecond / 1e9);
+        }
+        std::printf("%-40s %11.3f ms %12llu %12s\n", result.name.c_str(), result.nanosecondsPerIteration / 1e6,
+                    static_cast<unsigned long long>(result.iterations), throughput);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool json = false;
+    std::string filter;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (std::strncmp(argv[i], "--filter=", 9) == 0) {
+            filter = argv[i] + 9;
+        } else {
+            std::fprintf(stderr, "Usage: %s [--json] [--filter=substring]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const uint64_t sizes[] = {uint64_t(1) << 20, uint64_t(64) << 20, uint64_t(256) << 20};
+    std::vector<std::string> texts;
+    for (uint64_t size : sizes) {
+        texts.push_back(SyntheticText(size));
+    }
+
+    std::vector<Benchmark> benchmarks;
+    for (const std::string& text : texts) {
+        std::string suffix = "/" + std::to_string(text.size() >> 20) + "MiB";
+        benchmarks.push_back({"LineScanner::Scan" + suffix, text.size(), [&text]() {
+            std::vector<LineBreakChunk> chunks = LineScanner::Scan(text.data(), text.size());
+            if (chunks.empty() && !text.empty()) {
+                std::abort();
+            }
+        }});
+        benchmarks.push_back({"LineOffsets::Build" + suffix, text.size(), [&text]() {
+            LineOffsets offsets;
+            offsets.Build(text.data(), text.size());
+        }});
+    }
+
+    // Random lookups in the largest index; 4096 per iteration
+    LineOffsets offsets;
+    offsets.Build(texts.back().data(), texts.back().size());
+    std::vector<uint64_t> probes(4096);
+    std::mt19937_64 random(7);
+    for (uint64_t& probe : probes) {
+        probe = random() % texts.back().size();
+    }
+    benchmarks.push_back({"LineOffsets::LineAt/4096", 0, [&offsets, &probes]() {
+        int64_t sum = 0;
+        for (uint64_t probe : probes) {
+            sum += offsets.LineAt(probe);
+        }
+        if (sum < 0) {
+            std::abort();
+        }
+    }});
+    benchmarks.push_back({"LineOffsets::LineStart/4096", 0, [&offsets, &probes]() {
+        uint64_t sum = 0;
+        for (uint64_t probe : probes) {
+            sum += offsets.LineStart(static_cast<int64_t>(probe % offsets.LineCount()));
+        }
+        if (sum == 1) {
+            std::abort();
+        }
+    }});
+
+    for (uint32_t count : {1000u, 100000u}) {
+        std::vector<uint8_t> buffer = SyntheticEdits(count);
+        benchmarks.push_back({"EditBatch::Parse/" + std::to_string(count), buffer.size(), [buffer]() {
+            std::vector<PackedEdit> edits;
+            std::string error;
+            if (!EditBatch::Parse(buffer.data(), buffer.size(), edits, error)) {
+                std::abort();
+            }
+        }});
+    }
+
+    // A 100k-line file against itself with 100 scattered line edits
+    std::vector<uint64_t> baseHashes(100000);
+    for (uint64_t& hash : baseHashes) {
+        hash = random();
+    }
+    std::vector<uint64_t> editedHashes = baseHashes;
+    for (int i = 0; i < 100; i++) {
+        editedHashes[random() % editedHashes.size()] = random();
+    }
+    benchmarks.push_back({"LineDiff::Compute/100000/edits100", 0, [&baseHashes, &editedHashes]() {
+        if (LineDiff::Compute(baseHashes, editedHashes).empty()) {
+            std::abort();
+        }
+    }});
+
+    // A line of CJK text with some ASCII, as in comments of such repositories
+    std::u16string cjkLine;
+    for (int i = 0; i < 240; i++) {
+        cjkLine.push_back(i % 5 == 0 ? u' ' : static_cast<char16_t>(0x4E00 + i));
+    }
+    benchmarks.push_back({"ColumnTable::Build/240", cjkLine.size() * sizeof(char16_t), [&cjkLine]() {
+        ColumnTable table;
+        if (!table.Build(cjkLine.data(), cjkLine.size())) {
+            std::abort();
+        }
+    }});
+    ColumnTable cjkTable;
+    cjkTable.Build(cjkLine.data(), cjkLine.size());
+    benchmarks.push_back({"ColumnTable::FromUtf16+ToUtf16/240", 0, [&cjkLine, &cjkTable]() {
+        uint32_t sum = 0;
+        for (uint32_t column = 0; column <= cjkLine.size(); column++) {
+            uint32_t utf8 = cjkTable.FromUtf16(cjkLine.data(), column, ColumnEncoding::Utf8);
+            sum += cjkTable.ToUtf16(cjkLine.data(), utf8, ColumnEncoding::Utf8);
+        }
+        if (sum == 0) {
+            std::abort();
+        }
+    }});
+
+    std::vector<Result> results;
+    for (const Benchmark& benchmark : benchmarks) {
+        if (filter.empty() || benchmark.name.find(filter) != std::string::npos) {
+            results.push_back(Measure(benchmark, std::chrono::milliseconds(500)));
+        }
+    }
+
+    if (json) {
+        PrintJson(results);
+    } else {
+        PrintTable(results);
+    }
+    return 0;
+}
@@ -0,0 +1,234 @@
+/**
+ * Kate Native Document Benchmarks
+ *
+ * Times the document hot paths through the JavaScript API: text transfer,
+ * syntax tokens, folding, search, replace and edit storms, on generated
+ * documents of several sizes and modes.
+ *
+ * Usage:
+ *   node bench/run.js [--sizes=10000,100000,1000000] [--modes=JavaScript,Python]
+ *                     [--filter=substring] [--min-time=500] [--json]
+ *
+ * --json prints one JSON object ({ context, benchmarks }) for tooling;
+ * otherwise a table is printed. Without KTextEditor the JavaScript mock
+ * is measured, which only shows the binding overhead.
+ */
+
+const os = require('os');
+const kate = require('../index.js');
+
+const DEFAULT_SIZES = [10000, 100000, 1000000];
+const DEFAULT_MODES = ['JavaScript', 'Python', 'C++', 'Normal'];
+const VIEWPORT_LINES = 60;
+const INSERT_STORM_EDITS = 1000;
+
+function parseArgs(argv) {
+    const args = {
+        sizes: DEFAULT_SIZES,
+        modes: DEFAULT_MODES,
+        filter: '',
+        minTimeMs: 500,
+        json: false,
+    };
+
+    for (const arg of argv) {
+        const [key, value] = arg.split(/=(.*)/s);
+        switch (key) {
+            case '--sizes':
+                args.sizes = value.split(',').map(Number).filter(n => n > 0);
+                break;
+            case '--modes':
+                args.modes = value.split(',').filter(Boolean);
+                break;
+            case '--filter':
+                args.filter = value;
+                break;
+            case '--min-time':
+                args.minTimeMs = Number(value);
+                break;
+            case '--json':
+                args.json = true;
+                break;
+            default:
+                console.error(`Unknown argument: ${arg}`);
+                process.exit(2);
+        }
+    }
+    return args;
+}
+
+// Line generators that give each highlighter something to do
+const LINE_GENERATORS = {
+    'JavaScript': i => [
+        `function item${i}(value) {`,
+        `    const total = value * ${i} + 'text'; // comment ${i}`,
+        `    return total > ${i} ? [total, "${i}"] : null;`,
+        `}`,
+    ],
+    'Python': i => [
+        `def item_${i}(value):`,
+        `    total = value * ${i}  # comment ${i}`,
+        `    return f"{total} {value}" if total > ${i} else None`,
+        ``,
+    ],
+    'C++': i => [
+        `int item${i}(int value) {`,
+        `    auto total = value * ${i}; /* comment ${i} */`,
+        `    return total > ${i} ? total : static_cast<int>(sizeof(value));`,
+        `}`,
+    ],
+    'Normal': i => [
+        `Line ${i} of plain text with a needle in it.`,
+        `Some more words on line ${i} to fill the document up.`,
+        `The quick brown fox ${i} jumps over the lazy dog.`,
+        ``,
+    ],
+};
+
+function generateText(mode, lineCount) {
+    const generate = LINE_GENERATORS[mode] || LINE_GENERATORS['Normal'];
+    const lines = [];
+    for (let i = 0; lines.length < lineCount; i++) {
+        for (const line of generate(i)) {
+            lines.push(line);
+        }
+    }
+    lines.length = lineCount;
+    return lines.join('\n');
+}
+
+function percentile(sorted, fraction) {
+    const index = Math.min(sorted.length - 1, Math.floor(sorted.length * fraction));
+    return sorted[index];
+}
+
+/**
+ * Run `fn` until `minTimeMs` has passed (at least 3 times, at most 1000)
+ * after one warmup call; `setup` runs untimed before every call.
+ */
+async function measure(fn, setup, minTimeMs) {
+    if (setup) await setup();
+    await fn();
+
+    const samples = [];
+    let total = 0;
+    while ((total < minTimeMs || samples.length < 3) && samples.length < 1000) {
+        if (setup) await setup();
+        const start = process.hrtime.bigint();
+        await fn();
+        const elapsed = Number(process.hrtime.bigint() - start) / 1e6;
+        samples.push(elapsed);
+        total += elapsed;
+    }
+
+    samples.sort((a, b) => a - b);
+    return {
+        iterations: samples.length,
+        meanMs: total / samples.length,
+        p50Ms: percentile(samples, 0.5),
+        p95Ms: percentile(samples, 0.95),
+        minMs: samples[0],
+    };
+}
+
+/**
+ * Benchmarks for one document; each has a name, the timed function and
+ * an optional untimed setup run before every iteration
+ */
+function documentBenchmarks(doc, text, lineCount) {
+    const middle = Math.max(0, Math.floor(lineCount / 2) - VIEWPORT_LINES / 2);
+    const viewportEnd = Math.min(lineCount - 1, middle + VIEWPORT_LINES - 1);
+    const resetText = () => doc.setText(text);
+
+    const stormEdits = [];
+    for (let i = 0; i < INSERT_STORM_EDITS; i++) {
+        stormEdits.push({ op: kate.EditOp.Insert, startLine: middle, startColumn: 0, text: 'x' });
+    }
+    const stormBuffer = kate.encodeEdits(stormEdits);
+
+    return [
+        { name: 'setText', fn: () => doc.setText(text) },
+        { name: 'getText', fn: () => doc.getText() },
+        { name: 'getTextBuffer', fn: () => doc.getTextBuffer() },
+        { name: 'getTextAsync', fn: () => doc.getTextAsync() },
+        { name: 'getSyntaxTokens/viewport', fn: () => doc.getSyntaxTokens(middle, viewportEnd) },
+        { name: 'getSyntaxTokensPacked/viewport', fn: () => doc.getSyntaxTokensPacked(middle, viewportEnd) },
+        { name: 'getSyntaxTokensPacked/all', fn: () => doc.getSyntaxTokensPacked(0, lineCount - 1) },
+        { name: 'getFoldingRegions/all', fn: () => doc.getFoldingRegions(0, lineCount - 1) },
+        { name: 'getFoldingRegionsPacked/all', fn: () => doc.getFoldingRegionsPacked(0, lineCount - 1) },
+        { name: 'search/plain', fn: () => doc.search('total', { caseSensitive: true }) },
+        { name: 'search/regex', fn: () => doc.search('item_?\\d+', { regex: true }) },
+        { name: 'searchAsync/plain', fn: () => doc.searchAsync('total', { caseSensitive: true }) },
+        { name: 'replaceAll', fn: () => doc.replaceAll('total', 'sum', { caseSensitive: true }), setup: resetText },
+        { name: 'replaceAllAsync', fn: () => doc.replaceAllAsync('total', 'sum', { caseSensitive: true }), setup: resetText },
+        {
+            name: `insertText/storm${INSERT_STORM_EDITS}`,
+            fn: () => {
+                for (let i = 0; i < INSERT_STORM_EDITS; i++) {
+                    doc.insertText(middle, 0, 'x');
+                }
+            },
+            setup: resetText,
+        },
+        { name: `applyEdits/storm${INSERT_STORM_EDITS}`, fn: () => doc.applyEdits(stormBuffer), setup: resetText },
+    ];
+}
+
+function printTable(results) {
+    const header = ['Benchmark', 'Mode', 'Lines', 'Iter', 'Mean ms', 'p50 ms', 'p95 ms'];
+    const rows = results.map(r => [
+        r.name, r.mode, String(r.lines), String(r.iterations),
+        r.meanMs.toFixed(3), r.p50Ms.toFixed(3), r.p95Ms.toFixed(3),
+    ]);
+    const widths = header.map((h, i) => Math.max(h.length, ...rows.map(row => row[i].length)));
+    const format = row => row.map((cell, i) => (i < 2 ? cell.padEnd(widths[i]) : cell.padStart(widths[i]))).join('  ');
+
+    console.log(format(header));
+    for (const row of rows) {
+        console.log(format(row));
+    }
+}
+
+async function main() {
+    const args = parseArgs(process.argv.slice(2));
+    const results = [];
+
+    for (const mode of args.modes) {
+        for (const lines of args.sizes) {
+            const text = generateText(mode, lines);
+            const doc = kate.createDocument({ mode });
+            doc.setText(text);
+
+            for (const benchmark of documentBenchmarks(doc, text, lines)) {
+                const fullName = `${benchmark.name}/${mode}/${lines}`;
+                if (args.filter && !fullName.includes(args.filter)) continue;
+
+                const timing = await measure(benchmark.fn, benchmark.setup, args.minTimeMs);
+                results.push({ name: benchmark.name, mode, lines, ...timing });
+                if (!args.json) {
+                    process.stderr.write(`  ${fullName}: ${timing.meanMs.toFixed(3)} ms\n`);
+                }
+            }
+        }
+    }
+
+    if (args.json) {
+        const context = {
+            date: new Date().toISOString(),
+            kateAvailable: kate.isKateAvailable(),
+            node: process.version,
+            platform: `${process.platform}-${process.arch}`,
+            cpus: os.cpus().length,
+            cpuModel: os.cpus()[0] ? os.cpus()[0].model : '',
+        };
+        console.log(JSON.stringify({ context, benchmarks: results }, null, 2));
+    } else {
+        console.log();
+        printTable(results);
+    }
+}
+
+main().catch(error => {
+    console.error(error);
+    process.exit(1);
+});
@@ -1,11 +1,52 @@
 {
+  "variables": {
+    "build_benchmarks%": 0
+  },
   "targets": [{
     "target_name": "kate_native",
     "sources": [
       "src/addon.cpp",
       "src/qt_runner.cpp",
+      "src/js_dispatcher.cpp",
       "src/document_wrapper.cpp",
-      "src/editor_wrapper.cpp"
+      "src/document_events.cpp",
+      "src/document_anchors.cpp",
+      "src/document_pool.cpp",
+      "src/document_snapshot.cpp",
+      "src/hibernation.cpp",
+      "src/syntax_tokens.cpp",
+      "src/highlight_scheduler.cpp",
+      "src/folding_index.cpp",
+      "src/line_index.cpp",
+      "src/line_hashes.cpp",
+      "src/column_map.cpp",
+      "src/column_table.cpp",
+      "src/line_diff.cpp",
+      "src/search_pattern.cpp",
+      "src/edit_batch.cpp",
+      "src/edit_journal.cpp",
+      "src/file_writer.cpp",
+      "src/background_search.cpp",
+      "src/worker_pool.cpp",
+      "src/search_session_wrapper.cpp",
+      "src/shared_channel.cpp",
+      "src/shared_channel_wrapper.cpp",
+      "src/text_index.cpp",
+      "src/text_index_wrapper.cpp",
+      "src/large_document_wrapper.cpp",
+      "src/line_offsets.cpp",
+      "src/line_scanner.cpp",
+      "src/line_index_builder.cpp",
+      "src/line_metadata.cpp",
+      "src/mapped_file.cpp",
+      "src/mode_catalog.cpp",
+      "src/js_convert.cpp",
+      "src/stats.cpp",
+      "src/editor_wrapper.cpp",
+      "src/piece_table.cpp",
+      "src/text_pattern.cpp",
+      "src/text_regex.cpp",
+      "src/fallback_document.cpp"
     ],
     "include_dirs": [
       "<!@(node -p \"require('node-addon-api').include\")"
@@ -16,15 +57,19 @@
     "cflags_cc": [ "-fPIC", "-std=c++17" ],
     "defines": [ 
       "NAPI_CPP_EXCEPTIONS",
+      "NODE_ADDON_API_CPP_EXCEPTIONS_ALL",
       "QT_NO_KEYWORDS"
     ],
     "conditions": [
       ['OS=="linux"', {
         "include_dirs": [
-          "<!@(pkg-config --cflags-only-I Qt5Core Qt5Gui KF5TextEditor 2>/dev/null | sed 's/-I//g' || echo '')"
+          "<!@(pkg-config --cflags-only-I Qt5Core Qt5Gui KF5TextEditor 2>/dev/null | sed 's/-I//g' || echo '')",
+          "<!@(pkg-config --cflags-only-I KF5SyntaxHighlighting 2>/dev/null | sed 's/-I//g' || echo '')"
         ],
         "libraries": [
-          "<!@(pkg-config --libs Qt5Core Qt5Gui KF5TextEditor 2>/dev/null || echo '-lQt5Core -lQt5Gui -lKF5TextEditor')"
+          "<!@(pkg-config --libs Qt5Core Qt5Gui KF5TextEditor 2>/dev/null || echo '')",
+          "<!@(pkg-config --libs KF5SyntaxHighlighting 2>/dev/null || echo '')",
+          "-lrt"
         ],
         "defines": [
           "<!@(pkg-config --exists KF5TextEditor 2>/dev/null && echo 'HAVE_KTEXTEDITOR' || echo '')"
@@ -32,10 +77,12 @@
       }],
       ['OS=="mac"', {
         "include_dirs": [
-          "<!@(pkg-config --cflags-only-I Qt5Core Qt5Gui KF5TextEditor 2>/dev/null | sed 's/-I//g' || echo '')"
+          "<!@(pkg-config --cflags-only-I Qt5Core Qt5Gui KF5TextEditor 2>/dev/null | sed 's/-I//g' || echo '')",
+          "<!@(pkg-config --cflags-only-I KF5SyntaxHighlighting 2>/dev/null | sed 's/-I//g' || echo '')"
         ],
         "libraries": [
-          "<!@(pkg-config --libs Qt5Core Qt5Gui KF5TextEditor 2>/dev/null || echo '')"
+          "<!@(pkg-config --libs Qt5Core Qt5Gui KF5TextEditor 2>/dev/null || echo '')",
+          "<!@(pkg-config --libs KF5SyntaxHighlighting 2>/dev/null || echo '')"
         ]
       }],
       ['OS=="win"', {
@@ -46,5 +93,39 @@
         }
       }]
     ]
-  }]
+  }],
+  "conditions": [
+    ['build_benchmarks==1', {
+      "targets": [{
+        "target_name": "kate_native_bench",
+        "type": "executable",
+        "sources": [
+          "bench/native/kernels.cpp",
+          "src/line_scanner.cpp",
+          "src/line_offsets.cpp",
+          "src/worker_pool.cpp",
+          "src/edit_batch.cpp",
+          "src/line_diff.cpp",
+          "src/mapped_file.cpp",
+          "src/column_table.cpp",
+          "src/piece_table.cpp"
+        ],
+        "cflags!": [ "-fno-exceptions" ],
+        "cflags_cc!": [ "-fno-exceptions" ],
+        "cflags_cc": [ "-std=c++17", "-O2" ],
+        "conditions": [
+          ['OS!="win"', {
+            "libraries": [ "-pthread" ],
+            "ldflags": [ "-pthread" ]
+          }],
+          ['OS=="mac"', {
+            "xcode_settings": {
+              "CLANG_CXX_LANGUAGE_STANDARD": "c++17",
+              "GCC_ENABLE_CPP_EXCEPTIONS": "YES"
+            }
+          }]
+        ]
+      }]
+    }]
+  ]
 }
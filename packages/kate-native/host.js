@@ -0,0 +1,154 @@
+/**
+ * Kate Native Module - Document Host Process
+ *
+ * Started by a HostPool as `node host.js <channel name>`. Opens the shared
+ * memory channel the pool created, keeps the pool's documents and answers
+ * its calls on this process's own Qt thread. Exits when the channel closes,
+ * so a host never outlives its pool.
+ */
+
+const kate = require('./index');
+const { DOCUMENT_ARG, CALLBACK_ARG, SIGNAL_ARG, encode, decode } = require('./host_pool');
+
+const name = process.argv[2];
+const options = JSON.parse(process.env.KATE_NATIVE_HOST_OPTIONS || '{}');
+
+if (options.documentPool) {
+    kate.configureDocumentPool(options.documentPool);
+}
+if (options.hibernation) {
+    kate.configureHibernation(options.hibernation);
+}
+
+const channel = new kate.KateSharedChannel(name);
+channel.unlink();
+
+const documents = new Map();
+const subscriptions = new Map();
+const aborts = new Map();
+
+function errorToHost(error) {
+    return { error: { name: error && error.name || 'Error', message: error && error.message || String(error) } };
+}
+
+function reply(tag, message) {
+    if (!channel.isClosed()) {
+        channel.send(tag, encode(message));
+    }
+}
+
+function documentFor(id) {
+    const document = documents.get(id);
+    if (!document) {
+        throw new Error('The document was released');
+    }
+    return document;
+}
+
+function decodeArgs(call, args) {
+    return args.map((arg) => {
+        if (!arg || typeof arg !== 'object') {
+            return arg;
+        }
+        if (DOCUMENT_ARG in arg) {
+            return documentFor(arg[DOCUMENT_ARG]);
+        }
+        if (CALLBACK_ARG in arg) {
+            const index = arg[CALLBACK_ARG];
+            return (...values) => channel.send(0, encode({ op: 'batch', call, index, args: values }));
+        }
+        if (SIGNAL_ARG in arg) {
+            const { [SIGNAL_ARG]: aborted, ...rest } = arg;
+            const controller = new AbortController();
+            if (aborted) {
+                controller.abort();
+            }
+            aborts.set(call, controller);
+            return { ...rest, signal: controller.signal };
+        }
+        return arg;
+    });
+}
+
+function invoke(tag, message) {
+    const document = documentFor(message.id);
+    const result = document[message.method](...decodeArgs(message.call || tag, message.args));
+    if (!(result instanceof Promise)) {
+        reply(tag, { value: result });
+        return;
+    }
+
+    result.then(
+        (value) => reply(tag, { value }),
+        (error) => reply(tag, errorToHost(error)),
+    ).finally(() => aborts.delete(message.call));
+}
+
+function subscribe(id, event) {
+    const key = `${id}:${event}`;
+    if (!subscriptions.has(key)) {
+        const listener = (payload) => channel.send(0, encode({ op: 'event', id, event, payload }));
+        documentFor(id).on(event, listener);
+        subscriptions.set(key, listener);
+    }
+}
+
+function unsubscribe(id, event) {
+    const key = `${id}:${event}`;
+    const listener = subscriptions.get(key);
+    if (listener) {
+        subscriptions.delete(key);
+        const document = documents.get(id);
+        if (document) {
+            document.off(event, listener);
+        }
+    }
+}
+
+function release(id) {
+    for (const key of [...subscriptions.keys()]) {
+        if (key.startsWith(`${id}:`)) {
+            unsubscribe(id, key.slice(key.indexOf(':') + 1));
+        }
+    }
+    documents.delete(id);
+}
+
+function onMessage(tag, buffer) {
+    const message = decode(buffer);
+    try {
+        switch (message.op) {
+        case 'create':
+            documents.set(message.id, kate.createDocument(message.options));
+            reply(tag, { value: true });
+            break;
+        case 'call':
+            invoke(tag, message);
+            break;
+        case 'subscribe':
+            subscribe(message.id, message.event);
+            reply(tag, { value: true });
+            break;
+        case 'unsubscribe':
+            unsubscribe(message.id, message.event);
+            break;
+        case 'release':
+            release(message.id);
+            break;
+        case 'abort': {
+            const controller = aborts.get(message.call);
+            if (controller) {
+                controller.abort();
+            }
+            break;
+        }
+        }
+    } catch (error) {
+        // Messages without a caller waiting on them (tag 0) have nowhere to report to
+        if (tag !== 0) {
+            reply(tag, errorToHost(error));
+        }
+    }
+}
+
+channel.listen(onMessage, () => process.exit(0));
@@ -0,0 +1,326 @@
+/**
+ * Kate Native Module - Out-of-Process Document Hosts
+ *
+ * KTextEditor runs on a single Qt thread per process, so one process does
+ * at most one core's worth of editor work. A HostPool starts several host
+ * processes (host.js), each with its own Qt thread, and places documents
+ * on them by id. Each host is reached through a KateSharedChannel: calls,
+ * replies and events are v8-serialized messages in shared memory rings,
+ * so typed arrays such as packed edits and packed tokens travel as raw
+ * bytes.
+ *
+ * A RemoteDocument has every KateDocument method. Synchronous methods
+ * block until the host has answered, like they block on the Qt thread in
+ * process; the async ones only wait for their reply message, so work on
+ * different hosts runs in parallel.
+ */
+
+const path = require('path');
+const v8 = require('v8');
+const { spawn } = require('child_process');
+
+const HOST_SCRIPT = path.join(__dirname, 'host.js');
+
+// Markers for arguments that can't be serialized as they are
+const DOCUMENT_ARG = '__kateDocument';
+const CALLBACK_ARG = '__kateCallback';
+const SIGNAL_ARG = '__kateSignal';
+
+let nextPoolId = 1;
+
+function encode(message) {
+    return v8.serialize(message);
+}
+
+function decode(buffer) {
+    return v8.deserialize(buffer);
+}
+
+// Rebuild an error thrown in the host, keeping its class and name
+function errorFromHost(error) {
+    const Type = { TypeError, RangeError }[error.name] || Error;
+    const result = new Type(error.message);
+    result.name = error.name;
+    return result;
+}
+
+class Host {
+    constructor(native, name, options) {
+        this.name = name;
+        this.documents = new Map();
+        this.pending = new Map();
+        this.nextCall = 1;
+        this.closed = false;
+
+        this.channel = new native.KateSharedChannel(name, { create: true, ringBytes: options.ringBytes });
+        this.channel.listen((tag, buffer) => this.onMessage(tag, buffer), () => this.onClose());
+        this.channel.unref();
+
+        this.child = spawn(process.execPath, [...options.execArgv, HOST_SCRIPT, name], {
+            stdio: 'inherit',
+            env: { ...process.env, KATE_NATIVE_HOST_OPTIONS: JSON.stringify(options.hostOptions) },
+        });
+        this.child.unref();
+        this.child.on('exit', () => this.onClose());
+
+        // A host that dies before it opens the channel ends waits as well
+        if (this.child.pid) {
+            this.channel.expectPeer(this.child.pid);
+        }
+    }
+
+    callId() {
+        const id = this.nextCall;
+        this.nextCall = this.nextCall === 0xffffffff ? 1 : this.nextCall + 1;
+        return id;
+    }
+
+    // Synchronous round trip; returns the reply's value or throws its error
+    call(message, timeoutMs) {
+        if (this.closed) {
+            throw new Error('The document host has exited');
+        }
+        const reply = decode(this.channel.call(this.callId(), encode(message), timeoutMs));
+        if (reply.error) {
+            throw errorFromHost(reply.error);
+        }
+        return reply.value;
+    }
+
+    // Resolved by the matching reply; `callbacks` receive the host's batch messages
+    callAsync(message, callbacks, signal) {
+        if (this.closed) {
+            return Promise.reject(new Error('The document host has exited'));
+        }
+
+        const call = this.callId();
+        return new Promise((resolve, reject) => {
+            const onAbort = () => this.post({ op: 'abort', call });
+            const settle = () => {
+                this.pending.delete(call);
+                if (this.pending.size === 0) {
+                    this.channel.unref();
+                }
+                if (signal) {
+                    signal.removeEventListener('abort', onAbort);
+                }
+            };
+
+            if (this.pending.size === 0) {
+                this.channel.ref();
+            }
+            this.pending.set(call, { resolve, reject, callbacks, settle });
+            if (signal) {
+                signal.addEventListener('abort', onAbort);
+            }
+            try {
+                this.channel.send(call, encode({ ...message, call }));
+            } catch (error) {
+                settle();
+                reject(error);
+            }
+        });
+    }
+
+    post(message) {
+        if (!this.closed) {
+            this.channel.send(0, encode(message));
+        }
+    }
+
+    onMessage(tag, buffer) {
+        const message = decode(buffer);
+        if (message.op === 'event') {
+            const document = this.documents.get(message.id);
+            const target = document && document.deref();
+            if (target) {
+                target._emit(message.event, message.payload);
+            }
+            return;
+        }
+
+        const pending = this.pending.get(message.op === 'batch' ? message.call : tag);
+        if (!pending) {
+            return;
+        }
+        if (message.op === 'batch') {
+            pending.callbacks[message.index](...message.args);
+        } else if (message.error) {
+            pending.settle();
+            pending.reject(errorFromHost(message.error));
+        } else {
+            pending.settle();
+            pending.resolve(message.value);
+        }
+    }
+
+    onClose() {
+        if (this.closed) {
+            return;
+        }
+        this.closed = true;
+        this.channel.unlink();
+        this.channel.close();
+        for (const pending of [...this.pending.values()]) {
+            pending.settle();
+            pending.reject(new Error('The document host has exited'));
+        }
+    }
+
+    close() {
+        // The host exits once it sees the channel close
+        this.onClose();
+    }
+}
+
+/**
+ * A KateDocument living in a host process
+ */
+class RemoteDocument {
+    constructor(pool, host, id) {
+        this._pool = pool;
+        this._host = host;
+        this._id = id;
+        this._listeners = new Map();
+    }
+
+    _call(method, args) {
+        return this._host.call({ op: 'call', id: this._id, method, args: this._encodeArgs(args) }, this._pool.timeoutMs);
+    }
+
+    _callAsync(method, args) {
+        const callbacks = [];
+        let signal = null;
+        const encoded = this._encodeArgs(args).map((arg, i) => {
+            if (typeof args[i] === 'function') {
+                callbacks.push(args[i]);
+                return { [CALLBACK_ARG]: callbacks.length - 1 };
+            }
+            if (args[i] && typeof args[i] === 'object' && args[i].signal && typeof args[i].signal.aborted === 'boolean') {
+                signal = args[i].signal;
+                const { signal: omitted, ...options } = args[i];
+                return { ...options, [SIGNAL_ARG]: signal.aborted };
+            }
+            return arg;
+        });
+        return this._host.callAsync({ op: 'call', id: this._id, method, args: encoded }, callbacks, signal);
+    }
+
+    // Documents on the same host are passed by id, others by their text
+    _encodeArgs(args) {
+        return args.map((arg) => {
+            if (!(arg instanceof RemoteDocument)) {
+                return typeof arg === 'function' ? null : arg;
+            }
+            return arg._host === this._host ? { [DOCUMENT_ARG]: arg._id } : arg.getTextBuffer();
+        });
+    }
+
+    on(event, callback) {
+        if (typeof callback !== 'function') {
+            throw new TypeError('Expected an event name and a callback');
+        }
+        let listeners = this._listeners.get(event);
+        if (!listeners) {
+            this._host.call({ op: 'subscribe', id: this._id, event }, this._pool.timeoutMs);
+            listeners = new Set();
+            this._listeners.set(event, listeners);
+        }
+        listeners.add(callback);
+    }
+
+    off(event, callback) {
+        const listeners = this._listeners.get(event);
+        if (!listeners) {
+            return;
+        }
+        callback === undefined ? listeners.clear() : listeners.delete(callback);
+        if (listeners.size === 0) {
+            this._listeners.delete(event);
+            this._host.post({ op: 'unsubscribe', id: this._id, event });
+        }
+    }
+
+    _emit(event, payload) {
+        const listeners = this._listeners.get(event);
+        if (listeners) {
+            for (const listener of [...listeners]) {
+                listener(payload);
+            }
+        }
+    }
+}
+
+/**
+ * Pool of document host processes
+ * Options are { hosts, ringBytes?, timeoutMs?, documentPool?, hibernation?, execArgv? }.
+ */
+class HostPool {
+    constructor(native, options) {
+        const count = Math.max(1, Math.floor(options.hosts));
+        this.timeoutMs = options.timeoutMs || 0;
+        this._nextDocument = 1;
+        this._released = new FinalizationRegistry(({ host, id }) => {
+            host.documents.delete(id);
+            host.post({ op: 'release', id });
+        });
+
+        const poolId = nextPoolId++;
+        const hostOptions = { documentPool: options.documentPool, hibernation: options.hibernation };
+        this._hosts = [];
+        for (let i = 0; i < count; i++) {
+            this._hosts.push(new Host(native, `/kate-native-${process.pid}-${poolId}-${i}`, {
+                ringBytes: options.ringBytes || 0,
+                execArgv: options.execArgv || [],
+                hostOptions,
+            }));
+        }
+
+        // Every KateDocument method, synchronous unless its name ends in Async
+        for (const method of Object.getOwnPropertyNames(native.KateDocument.prototype)) {
+            if (method === 'constructor' || method === 'on' || method === 'off' || method.startsWith('_')
+                || RemoteDocument.prototype.hasOwnProperty(method)) {
+                continue;
+            }
+            RemoteDocument.prototype[method] = method.endsWith('Async')
+                ? function (...args) { return this._callAsync(method, args); }
+                : function (...args) { return this._call(method, args); };
+        }
+    }
+
+    createDocument(options) {
+        const id = this._nextDocument++;
+        const host = this._hosts[id % this._hosts.length];
+        host.call({ op: 'create', id, options: options || {} }, this.timeoutMs);
+
+        const document = new RemoteDocument(this, host, id);
+        host.documents.set(id, new WeakRef(document));
+        this._released.register(document, { host, id });
+        return document;
+    }
+
+    status() {
+        return {
+            hosts: this._hosts.length,
+            running: this._hosts.filter((host) => !host.closed).length,
+            documents: this._hosts.map((host) => host.documents.size),
+            pids: this._hosts.map((host) => host.child.pid || 0),
+        };
+    }
+
+    close() {
+        for (const host of this._hosts) {
+            host.close();
+        }
+    }
+}
+
+module.exports = {
+    HostPool,
+    RemoteDocument,
+    DOCUMENT_ARG,
+    CALLBACK_ARG,
+    SIGNAL_ARG,
+    encode,
+    decode,
+};
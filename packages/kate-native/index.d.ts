@@ -1,20 +1,563 @@
+export interface SyntaxToken {
+  line: number;
+  startColumn: number;
+  endColumn: number;
+  tokenType: string;
+}
+
+/**
+ * Packed syntax tokens, four values per token:
+ * line delta, start delta, length, legend index.
+ * Start deltas are relative to the previous token on the same line.
+ */
+export interface PackedSyntaxTokens {
+  data: Uint32Array;
+  mode: string;
+  /** Version of the legend the indexes refer to; pass it back to skip `legend` */
+  legendVersion: number;
+  /** Present only when the caller passed another legend version */
+  legend?: string[];
+}
+
+/**
+ * Lines whose tokens changed since a revision.
+ * The tokens of lines[i] are (start column, length, legend index) triples
+ * in data.subarray(offsets[i], offsets[i + 1]).
+ */
+export interface SyntaxTokenDelta {
+  revision: number;
+  lineCount: number;
+  /** The shifts since the revision are unknown; drop every line not in this result */
+  reset: boolean;
+  /**
+   * (line, delta) pairs, oldest first, for the edits that added or removed
+   * lines: a positive delta inserts that many lines before `line`, a
+   * negative one removes -delta lines starting at `line`. Apply them before
+   * `lines`, which use the current numbering.
+   */
+  shifts: Int32Array;
+  lines: Uint32Array;
+  offsets: Uint32Array;
+  data: Uint32Array;
+  mode: string;
+  /** Version of the legend the indexes refer to; pass it back to skip `legend` */
+  legendVersion: number;
+  /** Present only when the caller passed another legend version */
+  legend?: string[];
+}
+
+export interface FoldingRegion {
+  startLine: number;
+  endLine: number;
+  kind: string;
+}
+
+/**
+ * Packed folding regions, three values per region:
+ * start line, end line, index into `kinds`.
+ */
+export interface PackedFoldingRegions {
+  data: Uint32Array;
+  kinds: string[];
+}
+
+export interface SearchOptions {
+  caseSensitive?: boolean;
+  wholeWords?: boolean;
+  regex?: boolean;
+}
+
+export interface SearchAsyncOptions extends SearchOptions {
+  /** Aborting stops the scan and rejects with an AbortError */
+  signal?: AbortSignal;
+}
+
+export type LineMetadataField = 'indent' | 'length' | 'firstNonWhitespace' | 'hash';
+
+/** Units of a column, as LSP's PositionEncodingKind names them */
+export type PositionEncoding = 'utf-8' | 'utf-16' | 'utf-32';
+
+/** How anchored ranges treat text inserted at their ends */
+export interface AnchorBehavior {
+  /** Text inserted at the start goes inside the range */
+  expandLeft?: boolean;
+  /** Text inserted at the end goes inside the range */
+  expandRight?: boolean;
+  /** A range whose text is all removed becomes invalid instead of empty */
+  invalidateIfEmpty?: boolean;
+}
+
+/**
+ * Struct-of-arrays metadata for lineCount lines from lineStart; only the
+ * requested fields are present. hash holds two values per line, the low
+ * and high 32 bits of a 64-bit content hash.
+ */
+export interface LineMetadata {
+  lineStart: number;
+  lineCount: number;
+  tabWidth: number;
+  indent?: Int32Array;
+  length?: Int32Array;
+  /** -1 for blank lines */
+  firstNonWhitespace?: Int32Array;
+  hash?: Int32Array;
+}
+
+export interface IndentStyle {
+  insertSpaces: boolean;
+  indentWidth: number;
+  tabWidth: number;
+  /** False when no line was indented and the configured style was returned */
+  detected: boolean;
+  sampledLines: number;
+}
+
+export interface SearchResult {
+  line: number;
+  column: number;
+  length: number;
+  text: string;
+}
+
+/**
+ * The edits made since the previous event, in order, in the applyEdits()
+ * buffer layout; decodeEdits() unpacks them
+ */
+export interface TextChangeEvent {
+  buffer: ArrayBuffer;
+  count: number;
+  /** Document revision after the last of the edits */
+  revision: number;
+}
+
+export interface DocumentOptions {
+  /** Syntax mode to start in, by name or id; a pooled document already in it is preferred */
+  mode?: string | number;
+}
+
+export interface DocumentPoolOptions {
+  /** Idle documents kept for reuse (default 8) */
+  capacity?: number;
+  /** Modes to create idle documents for ahead of time, one per entry */
+  modes?: string[];
+}
+
+export interface DocumentPoolStatus {
+  idle: number;
+  capacity: number;
+  hits: number;
+  misses: number;
+}
+
+export interface HibernationOptions {
+  /** Estimated bytes of live documents past which idle ones hibernate; 0 turns hibernation off (default) */
+  memoryBudget?: number;
+  /** Documents used more recently than this stay live (default 30000) */
+  idleMs?: number;
+}
+
+export interface HibernationStatus {
+  memoryBudget: number;
+  idleMs: number;
+  live: number;
+  hibernated: number;
+  /** Estimated size of the live documents */
+  liveBytes: number;
+  snapshotBytes: number;
+  hibernations: number;
+  wakes: number;
+}
+
+export interface ModeCatalogOptions {
+  /** File the catalog is loaded from and written back to when it changes */
+  cachePath?: string;
+}
+
+export interface ModeQuery {
+  /** A path or file name, matched against the modes' wildcards */
+  fileName?: string;
+  mimeType?: string;
+  /** The file's first line, for its "#!" interpreter */
+  firstLine?: string;
+}
+
+export interface ModeCatalogEntry {
+  /** Interned; the same for this name for the life of the process */
+  id: number;
+  name: string;
+  section: string;
+  wildcards: string[];
+  mimeTypes: string[];
+  priority: number;
+}
+
+export interface HostPoolOptions {
+  /** Host processes to place documents in; 0 goes back to in-process documents */
+  hosts: number;
+  /** Bytes of each direction's shared memory ring (default 4 MiB) */
+  ringBytes?: number;
+  /** Synchronous calls fail after this many ms; 0 waits for as long as the host is alive (default) */
+  timeoutMs?: number;
+  /** Applied in every host */
+  documentPool?: DocumentPoolOptions;
+  hibernation?: HibernationOptions;
+}
+
+export interface HostPoolStatus {
+  hosts: number;
+  running: number;
+  /** Documents per host */
+  documents: number[];
+  pids: number[];
+}
+
+/** Counts per power-of-two bucket; bucket i holds samples up to bucketBoundsMs[i], the last one the rest */
+export interface LatencyHistogram {
+  count: number;
+  sumMs: number;
+  buckets: number[];
+}
+
+export interface MethodStats {
+  calls: number;
+  /** JavaScript-thread time outside Qt: argument parsing, conversion, N-API */
+  marshal: LatencyHistogram;
+  /** Time running on the Qt thread inside KTextEditor */
+  work: LatencyHistogram;
+  /** Converting the result of a promise-returning call */
+  settle: LatencyHistogram;
+}
+
+export interface NativeStats {
+  enabled: boolean;
+  sinceResetMs: number;
+  bucketBoundsMs: number[];
+  /** Keyed by 'KateDocument.<method>'; methods never called are left out */
+  methods: Record<string, MethodStats>;
+  conversions: {
+    textBytesToJs: number;
+    textBytesFromJs: number;
+    objectsCreated: number;
+    typedArraysCreated: number;
+    typedArrayBytes: number;
+  };
+  qt: {
+    /** Tasks queued for the Qt thread that haven't started */
+    queueDepth: number;
+    maxQueueDepth: number;
+    tasks: number;
+    /** Time from queueing a task to it starting */
+    wait: LatencyHistogram;
+  };
+}
+
 export class KateDocument {
-  constructor();
+  constructor(options?: DocumentOptions);
   getText(): string;
-  setText(text: string): void;
+  /** UTF-16LE text sharing the document's copy; decode with buffer.toString('utf16le') */
+  getTextBuffer(): Buffer;
+  /** Strings, Uint16Arrays of code units or Buffers of UTF-16LE */
+  setText(text: string | Uint16Array | Buffer): void;
   insertText(line: number, column: number, text: string): void;
   removeText(startLine: number, startCol: number, endLine: number, endCol: number): void;
+  /** Applies packed edits (see encodeEdits) in one transaction; returns the new revision */
+  applyEdits(edits: ArrayBuffer | ArrayBufferView): number;
   line(lineNumber: number): string;
+  /** Lines lineStart to lineEnd, inclusive, in one call */
+  lines(lineStart: number, lineEnd: number): string[];
   readonly lineCount: number;
-  setMode(mode: string): void;
+  /** Text length in UTF-16 code units, line breaks included */
+  length(): number;
+  
+  // Offsets count UTF-16 code units of getText(); out of range positions are clamped
+  offsetAt(line: number, column: number): number;
+  positionAt(offset: number): { line: number; column: number };
+  /** One offset per (line, column) pair */
+  offsetsAt(positions: Int32Array | Uint32Array): Uint32Array;
+  /** One (line, column) pair per offset */
+  positionsAt(offsets: Int32Array | Uint32Array): Uint32Array;
+  /**
+   * (line, column) pairs with columns in `from` units, as pairs in `to`
+   * units; ranges are two pairs each
+   */
+  convertPositions(positions: Int32Array | Uint32Array, from: PositionEncoding, to: PositionEncoding): Uint32Array;
+  /** Anchor (startLine, startColumn, endLine, endColumn) ranges; returns the set's handle */
+  createAnchors(ranges: Int32Array | Uint32Array, behavior?: AnchorBehavior): number;
+  /** Current ranges of a set, -1 fields for invalidated ones; null for an unknown handle */
+  getAnchors(handle: number): Int32Array | null;
+  releaseAnchors(handle: number): boolean;
+  /** A mode name, or an id from detectMode() or getModeId() */
+  setMode(mode: string | number): void;
   readonly mode: string;
   save(): boolean;
   readonly isModified: boolean;
+  /**
+   * Write the text on a background thread, atomically (temporary file and
+   * rename); without a path, to the document's own file
+   */
+  saveAsync(path?: string, options?: { lineEnding?: '\n' | '\r\n' }): Promise<void>;
+  /**
+   * Journal edits to `path` from now on; null stops journaling. Throws for
+   * a path unless the KTextEditor engine is in use
+   */
+  setJournal(path: string | null): void;
+  /** Append the edits since the last flush; resolves with their number */
+  flushJournalAsync(): Promise<number>;
+  /** Replay a journal onto the text it was based on; returns the records replayed */
+  recoverJournal(path: string): number;
+  
+  // Syntax tokens
+  getSyntaxTokens(lineStart: number, lineEnd: number): SyntaxToken[];
+  /** `legendVersion` is the one from an earlier result whose legend the caller kept */
+  getSyntaxTokensPacked(lineStart: number, lineEnd: number, legendVersion?: number): PackedSyntaxTokens;
+  getSyntaxTokensSince(revision: number, lineStart?: number, lineEnd?: number, legendVersion?: number): SyntaxTokenDelta;
+  getSyntaxLegend(): string[];
+  /**
+   * Lines `client` shows (inclusive); they are highlighted ahead of the rest
+   * of the document and their tokens pushed through 'tokensChanged'
+   */
+  setViewport(first: number, last: number, client?: string): void;
+  clearViewport(client?: string): void;
+  
+  // Folding regions starting in the optional inclusive line range
+  getFoldingRegions(lineStart?: number, lineEnd?: number): FoldingRegion[];
+  getFoldingRegionsPacked(lineStart?: number, lineEnd?: number): PackedFoldingRegions;
+  
+  // Search and replace; replaceAll is a single undo step and returns the count
+  search(query: string, options?: SearchOptions): SearchResult[];
+  replaceAll(searchText: string, replacementText: string, options?: SearchOptions): number;
   
-  // Events
-  on(event: 'textChanged', callback: () => void): void;
+  // Async variants - run on the Qt thread without blocking the event loop
+  getTextAsync(): Promise<string>;
+  getTextBufferAsync(): Promise<Buffer>;
+  openUrlAsync(path: string): Promise<boolean>;
+  getSyntaxTokensAsync(lineStart: number, lineEnd: number): Promise<SyntaxToken[]>;
+  getSyntaxTokensPackedAsync(lineStart: number, lineEnd: number, legendVersion?: number): Promise<PackedSyntaxTokens>;
+  getFoldingRegionsAsync(lineStart?: number, lineEnd?: number): Promise<FoldingRegion[]>;
+  searchAsync(query: string, options?: SearchAsyncOptions): Promise<SearchResult[]>;
+  /** Streams (line, column, length) triples per batch; resolves with the total count */
+  searchAsync(query: string, options: SearchAsyncOptions | undefined,
+              onBatch: (matches: Int32Array) => void): Promise<number>;
+  replaceAllAsync(searchText: string, replacementText: string, options?: SearchOptions): Promise<number>;
+  
+  // Indentation and line metadata
+  getIndentation(line: number): number;
+  getLineMetadata(lineStart?: number, lineEnd?: number, fields?: LineMetadataField[]): LineMetadata;
+  detectIndentation(): IndentStyle;
+  
+  /**
+   * Line diff from `base` to this document, as Int32Array quadruples
+   * (base start, base count, start, count); a count of 0 marks a pure
+   * insertion or removal. Lines are compared by 64-bit hash.
+   */
+  diff(base: KateDocument | string | Uint16Array | Buffer, options?: { ignoreWhitespace?: boolean }): Int32Array;
+  /** Lines changed since the document was created, opened or saved, as diff() hunks */
+  getDirtyLines(): Int32Array;
+  
+  // Events, delivered at most once per event loop tick
+  on(event: 'textChanged', callback: (change: TextChangeEvent) => void): void;
   on(event: 'modeChanged', callback: (mode: string) => void): void;
+  /** Tokens highlighted in the background, viewports first; throws unless the KTextEditor engine is in use */
+  on(event: 'tokensChanged', callback: (tokens: SyntaxTokenDelta) => void): void;
+  /** Without a callback, removes every listener of the event */
+  off(event: 'textChanged' | 'modeChanged' | 'tokensChanged', callback?: (...args: any[]) => void): void;
+  
+  /**
+   * Release the KTextEditor document into a compressed snapshot until the
+   * next call; false while the document is in use. Undo history is lost.
+   */
+  hibernate(): boolean;
+  /** Doesn't wake the document */
+  isHibernated(): boolean;
+}
+
+/**
+ * Reusable search over one document. The pattern is compiled once;
+ * matches are Int32Array triples (line, column, length).
+ */
+export class KateSearchSession {
+  constructor(document: KateDocument, pattern: string, options?: SearchOptions);
+  /** Returns whether the new pattern is valid */
+  setPattern(pattern: string, options?: SearchOptions): boolean;
+  isValid(): boolean;
+  errorString(): string;
+  /** Default match cap for findInRange/findAll; 0 means no limit */
+  limit(): number;
+  setLimit(limit: number): void;
+  /** Next match after the previous one (or after line/column), wrapping around */
+  findNext(line?: number, column?: number): Int32Array | null;
+  findInRange(lineStart: number, lineEnd: number, limit?: number): Int32Array;
+  findAll(limit?: number): Int32Array;
+  count(): number;
+}
+
+export interface TextIndexOptions {
+  /** Estimated index size in bytes past which documents stay unindexed; 0 means no limit (default 256 MiB) */
+  memoryLimit?: number;
+}
+
+export interface TextIndexStats {
+  documents: number;
+  /** Documents covered by the index; the others are scanned line by line */
+  indexedDocuments: number;
+  blocks: number;
+  trigrams: number;
+  postings: number;
+  /** Estimated size of the index */
+  memoryBytes: number;
+  memoryLimit: number;
+}
+
+/**
+ * Trigram index over several documents that follows their edits.
+ * Matches are Int32Array quadruples (document id, line, column, length),
+ * ordered by document id, with the ids add() returns.
+ */
+export class KateTextIndex {
+  constructor(options?: TextIndexOptions);
+  /** Returns the document's id, the existing one when already added */
+  add(document: KateDocument): number;
+  remove(documentOrId: KateDocument | number): boolean;
+  search(query: string, options?: LargeSearchOptions): Int32Array;
+  stats(): TextIndexStats;
+}
+
+export interface LargeSearchOptions extends SearchOptions {
+  /** Match cap; 0 means no limit (default 10000) */
+  limit?: number;
+}
+
+/**
+ * Read-only view of a memory-mapped file, for files too large to load
+ * into a KateDocument. Everything but ready(), isReady(), path() and
+ * byteLength() throws until ready() has resolved.
+ */
+export interface IndexProgressOptions {
+  /** Called as the scan goes, at most once per percent */
+  onProgress?: (scanned: number, total: number) => void;
+}
+
+export interface LineIndexOptions extends IndexProgressOptions {
+  /** Defaults to 'uint32' below 4 GiB and 'uint64' from there */
+  format?: 'uint32' | 'uint64';
+}
+
+export interface LineIndex {
+  /** Byte offset of every line start; the first is always 0 */
+  offsets: Uint32Array | BigUint64Array;
+  lineCount: number;
+  byteLength: number;
+  /** Scanning kernel used: 'avx2', 'sse2', 'neon' or 'scalar' */
+  kernel: string;
+}
+
+export class KateLargeDocument {
+  constructor(path: string, options?: IndexProgressOptions);
+  /** Resolves once the line index is built */
+  ready(): Promise<void>;
+  isReady(): boolean;
+  path(): string;
+  byteLength(): number;
+  /** Memory taken by the line index */
+  indexBytes(): number;
+  /** Unmaps the file once running searches are done */
+  close(): void;
+  lineCount(): number;
+  line(lineNum: number): string;
+  /** Lines lineStart to lineEnd, inclusive */
+  lines(lineStart: number, lineEnd: number): string[];
+  /** Byte offset of the start of a line in the file */
+  byteOffset(lineNum: number): number;
+  /** Matches as Int32Array triples (line, column, length), columns in UTF-16 code units */
+  search(query: string, options?: LargeSearchOptions): Promise<Int32Array>;
 }
 
+/**
+ * Message channel over POSIX shared memory, as used between a host pool
+ * and its hosts. Messages are a uint32 tag and bytes.
+ */
+export class KateSharedChannel {
+  /** Creates the named segment (e.g. "/kate-1") with `create`, otherwise opens it */
+  constructor(name: string, options?: { create?: boolean; ringBytes?: number });
+  send(tag: number, bytes: ArrayBuffer | ArrayBufferView): void;
+  /** Sends and blocks until the peer's message with the same, non-zero, tag */
+  call(tag: number, bytes: ArrayBuffer | ArrayBufferView, timeoutMs?: number): Buffer;
+  /** The event loop stays alive while listening, unless unref()'d */
+  listen(onMessage: (tag: number, bytes: Buffer) => void, onClose?: () => void): void;
+  ref(): this;
+  unref(): this;
+  /** The process that will open the channel; waits end should it exit first */
+  expectPeer(pid: number): void;
+  /** Removes the name; both ends keep the channel */
+  unlink(): void;
+  close(): void;
+  isClosed(): boolean;
+  name(): string;
+}
+
+export const EditOp: {
+  readonly Insert: 0;
+  readonly Remove: 1;
+  readonly Replace: 2;
+};
+
+export interface Edit {
+  op: number;
+  startLine: number;
+  startColumn: number;
+  /** Defaults to the start position; ignored for inserts */
+  endLine?: number;
+  endColumn?: number;
+  /** Ignored for removes */
+  text?: string;
+}
+
+/** Packs edits into the buffer layout taken by KateDocument.applyEdits() */
+export function encodeEdits(edits: Edit[]): ArrayBuffer;
+export function decodeEdits(buffer: ArrayBuffer): Required<Edit>[];
+
+export function createDocument(options?: DocumentOptions): KateDocument;
+export function configureDocumentPool(options?: DocumentPoolOptions): void;
+export function getDocumentPoolStatus(): DocumentPoolStatus;
+export function configureHibernation(options?: HibernationOptions): void;
+export function getHibernationStatus(): HibernationStatus;
+/** Returns whether the catalog was loaded from the cache file */
+export function configureModeCatalog(options?: ModeCatalogOptions): boolean;
+/** The id of the mode for the query, or -1 */
+export function detectMode(query: ModeQuery): number;
+export function getModeId(name: string): number;
+export function getModeName(id: number): string | null;
+export function getModeCatalog(): ModeCatalogEntry[];
+/**
+ * Make createDocument() place documents in host processes, each with its
+ * own Qt thread; returns whether a pool is running
+ */
+export function configureHostPool(options: HostPoolOptions): boolean;
+export function getHostPoolStatus(): HostPoolStatus;
+
+/** Instrumentation is off unless turned on here or with KATE_NATIVE_STATS=1 */
+export function setStatsEnabled(enabled?: boolean): void;
+export function getStats(): NativeStats;
+export function resetStats(): void;
+
+/**
+ * Search every document in one parallel scan. Resolves with one result
+ * array per document, or with the total count when onBatch is given.
+ */
+export function searchDocuments(documents: KateDocument[], query: string, options?: SearchAsyncOptions): Promise<SearchResult[][]>;
+export function searchDocuments(documents: KateDocument[], query: string, options: SearchAsyncOptions | undefined,
+  onBatch: (matches: Int32Array, documentIndex: number) => void): Promise<number>;
+
+export function openLargeDocument(path: string, options?: IndexProgressOptions): Promise<KateLargeDocument>;
+export function buildLineIndex(source: string | ArrayBuffer | ArrayBufferView, options?: LineIndexOptions): Promise<LineIndex>;
+
+export function createSearchSession(document: KateDocument, pattern: string, options?: SearchOptions): KateSearchSession;
+export function createTextIndex(options?: TextIndexOptions): KateTextIndex;
+
 export const version: string;
 export function isKateAvailable(): boolean;
+/**
+ * What backs KateDocument: KTextEditor, the piece-table engine of a native
+ * build without it, or the mock used when the native module is missing
+ */
+export function getDocumentEngine(): 'ktexteditor' | 'fallback' | 'mock';
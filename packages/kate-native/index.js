@@ -5,52 +5,236 @@
  * This module gracefully handles cases where the native module is not available.
  */
 
+const { HostPool } = require('./host_pool');
+
 let nativeModule = null;
 let kateAvailable = false;
+let documentEngine = 'mock';
+let hostPool = null;
 
 try {
     // Try to load the native module
     nativeModule = require('./build/Release/kate_native.node');
     kateAvailable = nativeModule.isKateAvailable || false;
+    documentEngine = nativeModule.documentEngine || (kateAvailable ? 'ktexteditor' : 'fallback');
 } catch (error) {
     // Native module not available - provide fallback
     console.warn('[Kate Native] Native module not available:', error.message);
-    console.warn('[Kate Native] Running in fallback mode without KTextEditor support');
+    console.warn('[Kate Native] Running with mock documents');
     
     // Provide mock implementations
+    let mockStatsEnabled = ['1', 'true'].includes(process.env.KATE_NATIVE_STATS);
     nativeModule = {
         isKateAvailable: false,
         qtRunning: () => false,
+        configureDocumentPool: () => {},
+        documentPoolStatus: () => ({ idle: 0, capacity: 0, hits: 0, misses: 0 }),
+        configureHibernation: () => {},
+        configureModeCatalog: () => false,
+        detectMode: () => -1,
+        modeId: () => -1,
+        modeName: () => null,
+        modeCatalog: () => [],
+        hibernationStatus: () => ({
+            memoryBudget: 0, idleMs: 30000, live: 0, hibernated: 0, liveBytes: 0, snapshotBytes: 0, hibernations: 0, wakes: 0,
+        }),
+        setStatsEnabled: (enabled) => { mockStatsEnabled = enabled !== false; },
+        getStats: () => ({
+            enabled: mockStatsEnabled,
+            sinceResetMs: 0,
+            bucketBoundsMs: Array.from({ length: 23 }, (_, i) => 2 ** i / 1000),
+            methods: {},
+            conversions: { textBytesToJs: 0, textBytesFromJs: 0, objectsCreated: 0, typedArraysCreated: 0, typedArrayBytes: 0 },
+            qt: { queueDepth: 0, maxQueueDepth: 0, tasks: 0, wait: { count: 0, sumMs: 0, buckets: new Array(24).fill(0) } },
+        }),
+        resetStats: () => {},
+        searchDocuments: (documents) => Promise.resolve(documents.map(() => [])),
+        buildLineIndex: (source, options) => {
+            const bytes = typeof source === 'string' ? require('fs').readFileSync(source)
+                : ArrayBuffer.isView(source) ? new Uint8Array(source.buffer, source.byteOffset, source.byteLength)
+                : new Uint8Array(source);
+            const offsets = [0];
+            for (let i = bytes.indexOf(10); i !== -1; i = bytes.indexOf(10, i + 1)) {
+                offsets.push(i + 1);
+            }
+            if (options && options.onProgress) {
+                options.onProgress(bytes.length, bytes.length);
+            }
+            return Promise.resolve({
+                offsets: Uint32Array.from(offsets),
+                lineCount: offsets.length,
+                byteLength: bytes.length,
+                kernel: 'scalar',
+            });
+        },
         KateDocument: class MockDocument {
             constructor() {
                 console.warn('[Kate Native] Using mock document (KTextEditor not available)');
+                this._anchors = new Map();
+                this._nextAnchors = 0;
             }
             getText() { return ''; }
+            getTextAsync() { return Promise.resolve(''); }
+            getTextBuffer() { return Buffer.alloc(0); }
+            getTextBufferAsync() { return Promise.resolve(Buffer.alloc(0)); }
             setText(text) {}
             line(num) { return ''; }
+            lines(lineStart, lineEnd) { return []; }
             insertText(line, col, text) {}
             removeText(startLine, startCol, endLine, endCol) {}
+            applyEdits(buffer) { return 0; }
             lineCount() { return 0; }
             length() { return 0; }
+            offsetAt(line, column) { return 0; }
+            positionAt(offset) { return { line: 0, column: 0 }; }
+            offsetsAt(positions) { return new Uint32Array(positions.length / 2); }
+            positionsAt(offsets) { return new Uint32Array(offsets.length * 2); }
+            convertPositions(positions, from, to) { return Uint32Array.from(positions); }
+            createAnchors(ranges, behavior) {
+                this._anchors.set(++this._nextAnchors, Int32Array.from(ranges));
+                return this._nextAnchors;
+            }
+            getAnchors(handle) {
+                const ranges = this._anchors.get(handle);
+                return ranges ? Int32Array.from(ranges) : null;
+            }
+            releaseAnchors(handle) { return this._anchors.delete(handle); }
             isModified() { return false; }
             mode() { return ''; }
             setMode(mode) {}
             modes() { return []; }
             openUrl(url) { return false; }
+            openUrlAsync(url) { return Promise.resolve(false); }
             saveUrl() { return false; }
+            saveAsync(path, options) { return Promise.reject(new Error('KTextEditor library not available')); }
+            setJournal(path) {}
+            flushJournalAsync() { return Promise.reject(new Error('The document has no journal')); }
+            recoverJournal(path) { return 0; }
             url() { return ''; }
             undo() {}
             redo() {}
             getSyntaxTokens(lineStart, lineEnd) { return []; }
-            getFoldingRegions() { return []; }
+            getSyntaxTokensAsync(lineStart, lineEnd) { return Promise.resolve([]); }
+            getSyntaxTokensPacked(lineStart, lineEnd, legendVersion) { return { data: new Uint32Array(0), mode: '', legendVersion: 0 }; }
+            getSyntaxTokensPackedAsync(lineStart, lineEnd, legendVersion) { return Promise.resolve(this.getSyntaxTokensPacked(lineStart, lineEnd)); }
+            getSyntaxTokensSince(revision, lineStart, lineEnd, legendVersion) {
+                return { revision: 0, lineCount: 0, reset: true, shifts: new Int32Array(0), lines: new Uint32Array(0), offsets: new Uint32Array(1), data: new Uint32Array(0), mode: '', legendVersion: 0 };
+            }
+            getSyntaxLegend() { return []; }
+            getFoldingRegions(lineStart, lineEnd) { return []; }
+            getFoldingRegionsAsync(lineStart, lineEnd) { return Promise.resolve([]); }
+            getFoldingRegionsPacked(lineStart, lineEnd) { return { data: new Uint32Array(0), kinds: ['region', 'comment'] }; }
+            setViewport(first, last, client) {}
+            clearViewport(client) {}
             // Phase 8: Advanced editing features
             search(query, options) { return []; }
+            searchAsync(query, options, onBatch) {
+                if (options && options.signal && options.signal.aborted) {
+                    const error = new Error('The search was aborted');
+                    error.name = 'AbortError';
+                    return Promise.reject(error);
+                }
+                return Promise.resolve(typeof onBatch === 'function' ? 0 : []);
+            }
             replace(line, column, length, replacement) { return false; }
             replaceAll(searchText, replacementText, options) { return 0; }
+            replaceAllAsync(searchText, replacementText, options) { return Promise.resolve(0); }
             getIndentation(line) { return 0; }
             setIndentation(line, spaces) {}
             indentLine(line) {}
             indentLines(startLine, endLine) {}
+            getLineMetadata(lineStart, lineEnd, fields) {
+                const result = { lineStart: 0, lineCount: 0, tabWidth: 4 };
+                for (const field of fields || ['indent', 'length', 'firstNonWhitespace', 'hash']) {
+                    if (!['indent', 'length', 'firstNonWhitespace', 'hash'].includes(field)) {
+                        throw new TypeError(`Unknown line metadata field: ${field}`);
+                    }
+                    result[field] = new Int32Array(0);
+                }
+                return result;
+            }
+            diff(base, options) {
+                if (typeof base !== 'string' && !ArrayBuffer.isView(base) && (typeof base !== 'object' || base === null)) {
+                    throw new TypeError('Expected a document or text to diff against');
+                }
+                return new Int32Array(0);
+            }
+            getDirtyLines() { return new Int32Array(0); }
+            detectIndentation() {
+                return { insertSpaces: true, indentWidth: 4, tabWidth: 4, detected: false, sampledLines: 0 };
+            }
+            hibernate() { return false; }
+            isHibernated() { return false; }
+            // The mock never changes, so listeners are stored but never called
+            on(event, callback) { this._listeners(event).add(callback); }
+            off(event, callback) {
+                const listeners = this._listeners(event);
+                callback === undefined ? listeners.clear() : listeners.delete(callback);
+            }
+            _listeners(event) {
+                if (event !== 'textChanged' && event !== 'modeChanged' && event !== 'tokensChanged') {
+                    throw new TypeError(`Unknown event: ${event}`);
+                }
+                this._events = this._events || { textChanged: new Set(), modeChanged: new Set(), tokensChanged: new Set() };
+                return this._events[event];
+            }
+        },
+        KateSearchSession: class MockSearchSession {
+            constructor(document, pattern, options) { this._limit = 10000; }
+            setPattern(pattern, options) { return true; }
+            isValid() { return true; }
+            errorString() { return ''; }
+            limit() { return this._limit; }
+            setLimit(limit) { this._limit = limit; }
+            findNext(line, column) { return null; }
+            findInRange(lineStart, lineEnd, limit) { return new Int32Array(0); }
+            findAll(limit) { return new Int32Array(0); }
+            count() { return 0; }
+        },
+        KateTextIndex: class MockTextIndex {
+            constructor(options) {
+                this._memoryLimit = options && typeof options.memoryLimit === 'number' ? options.memoryLimit : 256 * 1024 * 1024;
+                this._ids = new Map();
+                this._nextId = 1;
+            }
+            add(document) {
+                if (typeof document !== 'object' || document === null) {
+                    throw new TypeError('Expected an initialized document');
+                }
+                if (!this._ids.has(document)) {
+                    this._ids.set(document, this._nextId++);
+                }
+                return this._ids.get(document);
+            }
+            remove(documentOrId) {
+                for (const [document, id] of this._ids) {
+                    if (document === documentOrId || id === documentOrId) {
+                        return this._ids.delete(document);
+                    }
+                }
+                return false;
+            }
+            search(query, options) { return new Int32Array(0); }
+            stats() {
+                return {
+                    documents: this._ids.size, indexedDocuments: this._ids.size, blocks: 0, trigrams: 0,
+                    postings: 0, memoryBytes: 0, memoryLimit: this._memoryLimit,
+                };
+            }
+        },
+        KateLargeDocument: class MockLargeDocument {
+            constructor(path, options) { this._path = path; }
+            ready() { return Promise.resolve(); }
+            isReady() { return true; }
+            path() { return this._path; }
+            byteLength() { return 0; }
+            indexBytes() { return 0; }
+            close() {}
+            lineCount() { return 1; }
+            line(lineNum) { return ''; }
+            lines(lineStart, lineEnd) { return lineStart <= 0 && lineEnd >= 0 ? [''] : []; }
+            byteOffset(lineNum) { return 0; }
+            search(query, options) { return Promise.resolve(new Int32Array(0)); }
         },
         KateEditor: class MockEditor {
             constructor() {
@@ -70,6 +254,14 @@ function isKateAvailable() {
     return kateAvailable;
 }
 
+/**
+ * What backs KateDocument: 'ktexteditor', the native 'fallback' piece
+ * table of a build without KTextEditor, or 'mock' without the native module
+ */
+function getDocumentEngine() {
+    return documentEngine;
+}
+
 /**
  * Check if Qt event loop is running
  */
@@ -79,12 +271,276 @@ function isQtRunning() {
 
 /**
  * Create a new Kate document
+ * Options are { mode? }; a pooled document already in that mode is reused.
+ * With a host pool configured, the document lives in one of its hosts.
  */
-function createDocument() {
+function createDocument(options) {
     if (!nativeModule || !nativeModule.KateDocument) {
         throw new Error('Kate native module not available');
     }
-    return new nativeModule.KateDocument();
+    if (hostPool) {
+        return hostPool.createDocument(options);
+    }
+    return new nativeModule.KateDocument(options);
+}
+
+/**
+ * Place documents made by createDocument() in host processes from now on
+ * Options are { hosts, ringBytes?, timeoutMs?, documentPool?, hibernation? };
+ * 0 hosts goes back to in-process documents. Replaces any previous pool,
+ * whose documents stop working. Returns whether a pool is running.
+ */
+function configureHostPool(options) {
+    const hosts = options && options.hosts ? options.hosts : 0;
+    if (hosts > 0 && (!kateAvailable || !nativeModule.KateSharedChannel)) {
+        throw new Error('Document hosts need the native module with KTextEditor support');
+    }
+    if (hostPool) {
+        hostPool.close();
+        hostPool = null;
+    }
+    if (hosts > 0) {
+        hostPool = new HostPool(nativeModule, options);
+    }
+    return hostPool !== null;
+}
+
+/**
+ * Get { hosts, running, documents, pids } for the host pool
+ */
+function getHostPoolStatus() {
+    if (!hostPool) {
+        return { hosts: 0, running: 0, documents: [], pids: [] };
+    }
+    return hostPool.status();
+}
+
+/**
+ * Size the document pool and fill it ahead of time, one document per mode
+ * Options are { capacity?, modes? }. This starts Qt if it isn't running.
+ */
+function configureDocumentPool(options) {
+    if (nativeModule && nativeModule.configureDocumentPool) {
+        nativeModule.configureDocumentPool(options || {});
+    }
+}
+
+/**
+ * Get { idle, capacity, hits, misses } for the document pool
+ */
+function getDocumentPoolStatus() {
+    if (!nativeModule || !nativeModule.documentPoolStatus) {
+        return { idle: 0, capacity: 0, hits: 0, misses: 0 };
+    }
+    return nativeModule.documentPoolStatus();
+}
+
+/**
+ * Turn the native instrumentation on or off (default on when called without arguments)
+ * Off unless enabled here or with KATE_NATIVE_STATS=1.
+ */
+function setStatsEnabled(enabled) {
+    if (nativeModule && nativeModule.setStatsEnabled) {
+        nativeModule.setStatsEnabled(enabled !== false);
+    }
+}
+
+/**
+ * Get call counts, latency histograms, conversion counters and Qt queue
+ * figures recorded since the last resetStats()
+ */
+function getStats() {
+    return nativeModule.getStats();
+}
+
+/**
+ * Zero everything getStats() reports
+ */
+function resetStats() {
+    if (nativeModule && nativeModule.resetStats) {
+        nativeModule.resetStats();
+    }
+}
+
+/**
+ * Map a large file read-only and resolve once its line index is built
+ * Options are { onProgress?(scanned, total) }.
+ */
+function openLargeDocument(path, options) {
+    if (!nativeModule || !nativeModule.KateLargeDocument) {
+        return Promise.reject(new Error('Kate native module not available'));
+    }
+    const document = new nativeModule.KateLargeDocument(path, options || {});
+    return document.ready().then(() => document);
+}
+
+/**
+ * Find the byte offset of every line start in a file or buffer
+ * Options are { format?: 'uint32' | 'uint64', onProgress?(scanned, total) }.
+ */
+function buildLineIndex(source, options) {
+    if (!nativeModule || !nativeModule.buildLineIndex) {
+        return Promise.reject(new Error('Kate native module not available'));
+    }
+    return nativeModule.buildLineIndex(source, options || {});
+}
+
+/**
+ * Hibernate idle documents while live ones are estimated above a budget
+ * Options are { memoryBudget?, idleMs? }; a budget of 0 turns it off.
+ */
+function configureHibernation(options) {
+    if (nativeModule && nativeModule.configureHibernation) {
+        nativeModule.configureHibernation(options || {});
+    }
+}
+
+/**
+ * Get the hibernation budget, document counts and sizes
+ */
+function getHibernationStatus() {
+    if (!nativeModule || !nativeModule.hibernationStatus) {
+        return { memoryBudget: 0, idleMs: 0, live: 0, hibernated: 0, liveBytes: 0, snapshotBytes: 0, hibernations: 0, wakes: 0 };
+    }
+    return nativeModule.hibernationStatus();
+}
+
+/**
+ * Keep the mode catalog in `cachePath` between runs, so a warm start
+ * resolves modes without starting Qt; returns whether it was loaded
+ */
+function configureModeCatalog(options) {
+    if (!nativeModule || !nativeModule.configureModeCatalog) {
+        return false;
+    }
+    return nativeModule.configureModeCatalog(options || {});
+}
+
+/**
+ * The id of the mode for { fileName?, mimeType?, firstLine? }, tried in
+ * that order, or -1; setMode() and createDocument() take it for a name
+ */
+function detectMode(query) {
+    if (!nativeModule || !nativeModule.detectMode) {
+        return -1;
+    }
+    return nativeModule.detectMode(query || {});
+}
+
+function getModeId(name) {
+    return nativeModule && nativeModule.modeId ? nativeModule.modeId(name) : -1;
+}
+
+function getModeName(id) {
+    return nativeModule && nativeModule.modeName ? nativeModule.modeName(id) : null;
+}
+
+/**
+ * Every mode with its id, section, file name wildcards and mimetypes
+ */
+function getModeCatalog() {
+    return nativeModule && nativeModule.modeCatalog ? nativeModule.modeCatalog() : [];
+}
+
+/**
+ * Create a reusable search session over a document
+ */
+function createSearchSession(document, pattern, options) {
+    if (!nativeModule || !nativeModule.KateSearchSession) {
+        throw new Error('Kate native module not available');
+    }
+    return new nativeModule.KateSearchSession(document, pattern, options);
+}
+
+/**
+ * Create a trigram index for repeated searches over many documents
+ */
+function createTextIndex(options) {
+    if (!nativeModule || !nativeModule.KateTextIndex) {
+        throw new Error('Kate native module not available');
+    }
+    return new nativeModule.KateTextIndex(options || {});
+}
+
+/**
+ * Search several documents at once on the native worker pool
+ * Resolves with one array of results per document, or with the total count
+ * when onBatch(matches, documentIndex) streams the matches instead.
+ */
+function searchDocuments(documents, query, options, onBatch) {
+    if (!nativeModule || !nativeModule.searchDocuments) {
+        return Promise.reject(new Error('Kate native module not available'));
+    }
+    return nativeModule.searchDocuments(documents, query, options || {}, onBatch);
+}
+
+/**
+ * Edit ops understood by KateDocument.applyEdits()
+ */
+const EditOp = Object.freeze({ Insert: 0, Remove: 1, Replace: 2 });
+
+const FIELDS_PER_EDIT = 7;
+const utf16Decoder = new TextDecoder('utf-16le');
+
+/**
+ * Pack edits for KateDocument.applyEdits()
+ * Each edit is { op, startLine, startColumn, endLine?, endColumn?, text? }.
+ */
+function encodeEdits(edits) {
+    let payloadLength = 0;
+    for (const edit of edits) {
+        payloadLength += edit.text ? edit.text.length : 0;
+    }
+    
+    const headerLength = 1 + edits.length * FIELDS_PER_EDIT;
+    const buffer = new ArrayBuffer(headerLength * 4 + payloadLength * 2);
+    const fields = new Uint32Array(buffer, 0, headerLength);
+    const payload = new Uint16Array(buffer, headerLength * 4, payloadLength);
+    
+    fields[0] = edits.length;
+    let offset = 0;
+    edits.forEach((edit, i) => {
+        const text = edit.text || '';
+        const field = 1 + i * FIELDS_PER_EDIT;
+        fields[field] = edit.op;
+        fields[field + 1] = edit.startLine;
+        fields[field + 2] = edit.startColumn;
+        fields[field + 3] = edit.endLine !== undefined ? edit.endLine : edit.startLine;
+        fields[field + 4] = edit.endColumn !== undefined ? edit.endColumn : edit.startColumn;
+        fields[field + 5] = offset;
+        fields[field + 6] = text.length;
+        for (let c = 0; c < text.length; c++) {
+            payload[offset + c] = text.charCodeAt(c);
+        }
+        offset += text.length;
+    });
+    
+    return buffer;
+}
+
+/**
+ * Unpack a buffer in the applyEdits() layout, such as a textChanged event's
+ */
+function decodeEdits(buffer) {
+    const count = new Uint32Array(buffer, 0, 1)[0];
+    const headerLength = 1 + count * FIELDS_PER_EDIT;
+    const fields = new Uint32Array(buffer, 0, headerLength);
+    const payload = new Uint16Array(buffer, headerLength * 4);
+    
+    const edits = [];
+    for (let i = 0; i < count; i++) {
+        const field = 1 + i * FIELDS_PER_EDIT;
+        const offset = fields[field + 5];
+        edits.push({
+            op: fields[field],
+            startLine: fields[field + 1],
+            startColumn: fields[field + 2],
+            endLine: fields[field + 3],
+            endColumn: fields[field + 4],
+            text: utf16Decoder.decode(payload.subarray(offset, offset + fields[field + 6])),
+        });
+    }
+    return edits;
 }
 
 /**
@@ -103,6 +559,7 @@ function getEditor() {
 function getStatus() {
     return {
         available: kateAvailable,
+        engine: documentEngine,
         qtRunning: isQtRunning(),
         version: kateAvailable ? getEditor().version() : 'unavailable'
     };
@@ -112,14 +569,55 @@ function getStatus() {
 module.exports = {
     // Status
     isKateAvailable,
+    getDocumentEngine,
     isQtRunning,
     getStatus,
     
     // Factory functions
     createDocument,
+    createSearchSession,
+    createTextIndex,
+    openLargeDocument,
+    buildLineIndex,
     getEditor,
     
+    // Workspace search
+    searchDocuments,
+    
+    // Document pool
+    configureDocumentPool,
+    getDocumentPoolStatus,
+    
+    // Hibernation
+    configureHibernation,
+    getHibernationStatus,
+    
+    // Mode catalog
+    configureModeCatalog,
+    detectMode,
+    getModeId,
+    getModeName,
+    getModeCatalog,
+    
+    // Document hosts
+    configureHostPool,
+    getHostPoolStatus,
+    
+    // Instrumentation
+    setStatsEnabled,
+    getStats,
+    resetStats,
+    
+    // Batched edits
+    EditOp,
+    encodeEdits,
+    decodeEdits,
+    
     // Direct access to native classes (for advanced usage)
     KateDocument: nativeModule.KateDocument,
     KateEditor: nativeModule.KateEditor,
+    KateSearchSession: nativeModule.KateSearchSession,
+    KateTextIndex: nativeModule.KateTextIndex,
+    KateLargeDocument: nativeModule.KateLargeDocument,
+    KateSharedChannel: nativeModule.KateSharedChannel,
 };
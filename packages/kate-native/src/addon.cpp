@@ -1,20 +1,136 @@
 #include <napi.h>
-#include "qt_runner.h"
+#include "addon_data.h"
 #include "document_wrapper.h"
 #include "editor_wrapper.h"
+#include "hibernation.h"
+#include "js_convert.h"
+#include "large_document_wrapper.h"
+#include "line_index_builder.h"
+#include "mode_catalog.h"
+#include "search_session_wrapper.h"
+#include "shared_channel_wrapper.h"
+#include "stats.h"
+#include "text_index_wrapper.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "background_search.h"
+
+#ifdef HAVE_KTEXTEDITOR
+#include <QStringList>
+#include "document_pool.h"
+#include "qt_runner.h"
+#endif
 
 namespace KateNative {
 
+namespace {
+
+// Parameters: documents, query, optional options (may carry `signal`), optional onBatch
+Napi::Value SearchDocuments(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsArray() || !info[1].IsString()) {
+        Napi::TypeError::New(env, "Expected an array of documents and a search string").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    std::vector<std::shared_ptr<KTextEditor::Document>> documents;
+#else
+    std::vector<std::shared_ptr<FallbackDocument>> documents;
+#endif
+    Napi::Array list = info[0].As<Napi::Array>();
+    documents.reserve(list.Length());
+    for (uint32_t i = 0; i < list.Length(); i++) {
+        Napi::Value value = list.Get(i);
+        DocumentWrapper* document = value.IsObject()
+            ? Napi::ObjectWrap<DocumentWrapper>::Unwrap(value.As<Napi::Object>()) : nullptr;
+#ifdef HAVE_KTEXTEDITOR
+        documents.push_back(document ? document->Document() : nullptr);
+#else
+        documents.push_back(document ? document->Fallback() : nullptr);
+#endif
+        if (!documents.back()) {
+            Napi::TypeError::New(env, "Document " + std::to_string(i) + " is not initialized").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+    }
+    
+    SearchOptions options = ParseSearchOptions(info, 2);
+    
+    Napi::Value signal = env.Undefined();
+    if (info.Length() > 2 && info[2].IsObject()) {
+        signal = info[2].As<Napi::Object>().Get("signal");
+    }
+    Napi::Value onBatch = info.Length() > 3 ? info[3] : env.Undefined();
+    
+#ifdef HAVE_KTEXTEDITOR
+    QString query = QString::fromStdString(info[1].As<Napi::String>().Utf8Value());
+    return BackgroundSearch::StartMany(env, documents, query, options, onBatch, signal);
+#else
+    return BackgroundSearch::StartMany(env, documents, Utf16FromJs(info[1]), options, onBatch, signal);
+#endif
+}
+
+// The catalog modes are looked up in; built from the syntax definitions when no cache file had one
+std::shared_ptr<const ModeCatalog> Modes() {
+#ifdef HAVE_KTEXTEDITOR
+    return ModeCatalog::Ensure();
+#else
+    return ModeCatalog::Current();
+#endif
+}
+
+std::string StringOption(Napi::Object options, const char* name) {
+    Napi::Value value = options.Get(name);
+    return value.IsString() ? value.As<Napi::String>().Utf8Value() : std::string();
+}
+
+// Parameters: { fileName?, mimeType?, firstLine? }; tried in that order
+Napi::Value DetectMode(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Expected { fileName?, mimeType?, firstLine? }").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    Napi::Object query = info[0].As<Napi::Object>();
+    std::shared_ptr<const ModeCatalog> catalog = Modes();
+    int id = ModeCatalog::None;
+    std::string fileName = StringOption(query, "fileName");
+    if (!fileName.empty()) {
+        id = catalog->ForFileName(fileName);
+    }
+    std::string mimeType = StringOption(query, "mimeType");
+    if (id == ModeCatalog::None && !mimeType.empty()) {
+        id = catalog->ForMimeType(mimeType);
+    }
+    std::string firstLine = StringOption(query, "firstLine");
+    if (id == ModeCatalog::None && !firstLine.empty()) {
+        id = catalog->ForFirstLine(firstLine);
+    }
+    return Napi::Number::New(env, id);
+}
+
+} // namespace
+
 /**
  * Initialize the Kate native module
  */
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
-    // Initialize Qt event loop
-    QtRunner::Initialize();
+    // Qt starts with the first document or editor, not on require(); every
+    // worker thread loading the module shares it, but has its own AddonData
+    AddonData::Create(env);
     
     // Register classes
     DocumentWrapper::Init(env, exports);
     EditorWrapper::Init(env, exports);
+    SearchSessionWrapper::Init(env, exports);
+    LargeDocumentWrapper::Init(env, exports);
+    TextIndexWrapper::Init(env, exports);
+    SharedChannelWrapper::Init(env, exports);
     
     // Export utility functions
     exports.Set("isKateAvailable", Napi::Boolean::New(env, 
@@ -25,8 +141,162 @@ Napi::Object Init(Napi::Env env, Napi::Object exports) {
 #endif
     ));
     
+    // What KateDocument keeps its text in: KTextEditor, or the piece table of FallbackDocument
+    exports.Set("documentEngine", Napi::String::New(env,
+#ifdef HAVE_KTEXTEDITOR
+        "ktexteditor"
+#else
+        "fallback"
+#endif
+    ));
+    
     exports.Set("qtRunning", Napi::Function::New(env, [](const Napi::CallbackInfo& info) {
+#ifdef HAVE_KTEXTEDITOR
         return Napi::Boolean::New(info.Env(), QtRunner::IsRunning());
+#else
+        return Napi::Boolean::New(info.Env(), false);
+#endif
+    }));
+    
+    // Parameters: { capacity?, modes? }; starts Qt and fills the pool in the background
+    exports.Set("configureDocumentPool", Napi::Function::New(env, [](const Napi::CallbackInfo& info) {
+#ifdef HAVE_KTEXTEDITOR
+        int capacity = DocumentPool::DefaultCapacity;
+        QStringList modes;
+        if (info.Length() > 0 && info[0].IsObject()) {
+            Napi::Object options = info[0].As<Napi::Object>();
+            if (options.Get("capacity").IsNumber()) {
+                capacity = options.Get("capacity").As<Napi::Number>().Int32Value();
+            }
+            Napi::Value modeList = options.Get("modes");
+            if (modeList.IsArray()) {
+                Napi::Array array = modeList.As<Napi::Array>();
+                for (uint32_t i = 0; i < array.Length(); i++) {
+                    Napi::Value mode = array.Get(i);
+                    if (mode.IsString()) {
+                        modes.append(QString::fromStdString(mode.As<Napi::String>().Utf8Value()));
+                    }
+                }
+            }
+        }
+        
+        QtRunner::Initialize();
+        QtRunner::RunSync([capacity, &modes]() { DocumentPool::Configure(capacity, modes); });
+#endif
+        return info.Env().Undefined();
+    }));
+    
+    // Parameters: { memoryBudget?, idleMs? }; a budget of 0 turns hibernation off
+    exports.Set("configureHibernation", Napi::Function::New(env, [](const Napi::CallbackInfo& info) {
+#ifdef HAVE_KTEXTEDITOR
+        size_t memoryBudget = 0;
+        int64_t idleMs = Hibernation::DefaultIdleMs;
+        if (info.Length() > 0 && info[0].IsObject()) {
+            Napi::Object options = info[0].As<Napi::Object>();
+            if (options.Get("memoryBudget").IsNumber()) {
+                memoryBudget = static_cast<size_t>(std::max(options.Get("memoryBudget").As<Napi::Number>().DoubleValue(), 0.0));
+            }
+            if (options.Get("idleMs").IsNumber()) {
+                idleMs = options.Get("idleMs").As<Napi::Number>().Int64Value();
+            }
+        }
+        Hibernation::Configure(info.Env(), memoryBudget, idleMs);
+#endif
+        return info.Env().Undefined();
+    }));
+    
+    exports.Set("hibernationStatus", Napi::Function::New(env, [](const Napi::CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        Napi::Object result = Napi::Object::New(env);
+        HibernationStatus status;
+#ifdef HAVE_KTEXTEDITOR
+        status = Hibernation::Status(env);
+#endif
+        result.Set("memoryBudget", Napi::Number::New(env, static_cast<double>(status.memoryBudget)));
+        result.Set("idleMs", Napi::Number::New(env, static_cast<double>(status.idleMs)));
+        result.Set("live", Napi::Number::New(env, status.live));
+        result.Set("hibernated", Napi::Number::New(env, status.hibernated));
+        result.Set("liveBytes", Napi::Number::New(env, static_cast<double>(status.liveBytes)));
+        result.Set("snapshotBytes", Napi::Number::New(env, static_cast<double>(status.snapshotBytes)));
+        result.Set("hibernations", Napi::Number::New(env, static_cast<double>(status.hibernations)));
+        result.Set("wakes", Napi::Number::New(env, static_cast<double>(status.wakes)));
+        return result;
+    }));
+    
+    // Parameters: { cachePath? }; returns whether the catalog was loaded from the cache file
+    exports.Set("configureModeCatalog", Napi::Function::New(env, [](const Napi::CallbackInfo& info) {
+        std::string cachePath;
+        if (info.Length() > 0 && info[0].IsObject()) {
+            cachePath = StringOption(info[0].As<Napi::Object>(), "cachePath");
+        }
+        return Napi::Boolean::New(info.Env(), !cachePath.empty() && ModeCatalog::ConfigureCache(cachePath));
+    }));
+    
+    exports.Set("detectMode", Napi::Function::New(env, DetectMode));
+    
+    exports.Set("modeId", Napi::Function::New(env, [](const Napi::CallbackInfo& info) {
+        std::string name = info.Length() > 0 && info[0].IsString() ? info[0].As<Napi::String>().Utf8Value() : "";
+        return Napi::Number::New(info.Env(), Modes()->ForName(name));
+    }));
+    
+    exports.Set("modeName", Napi::Function::New(env, [](const Napi::CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        std::string name = info.Length() > 0 && info[0].IsNumber()
+            ? ModeCatalog::NameOf(info[0].As<Napi::Number>().Int32Value()) : std::string();
+        return name.empty() ? env.Null() : Napi::String::New(env, name);
+    }));
+    
+    exports.Set("modeCatalog", Napi::Function::New(env, [](const Napi::CallbackInfo& info) {
+        return ModeCatalogToJs(info.Env(), *Modes());
+    }));
+    
+    exports.Set("searchDocuments", Napi::Function::New(env, SearchDocuments));
+    
+    // Parameters: path or buffer, optional { format, onProgress }
+    exports.Set("buildLineIndex", Napi::Function::New(env, [](const Napi::CallbackInfo& info) {
+        return LineIndexBuilder::Start(info.Env(), info[0], info[1]);
+    }));
+    
+    exports.Set("documentPoolStatus", Napi::Function::New(env, [](const Napi::CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        Napi::Object result = Napi::Object::New(env);
+        int idle = 0;
+        int capacity = 0;
+        double hits = 0;
+        double misses = 0;
+#ifdef HAVE_KTEXTEDITOR
+        // Nothing is pooled before Qt starts
+        if (QtRunner::IsRunning()) {
+            DocumentPoolStatus status;
+            QtRunner::RunSync([&status]() { status = DocumentPool::Status(); });
+            idle = status.idle;
+            capacity = status.capacity;
+            hits = static_cast<double>(status.hits);
+            misses = static_cast<double>(status.misses);
+        } else {
+            capacity = DocumentPool::DefaultCapacity;
+        }
+#endif
+        result.Set("idle", Napi::Number::New(env, idle));
+        result.Set("capacity", Napi::Number::New(env, capacity));
+        result.Set("hits", Napi::Number::New(env, hits));
+        result.Set("misses", Napi::Number::New(env, misses));
+        return result;
+    }));
+    
+    // Instrumentation; see stats.h
+    exports.Set("setStatsEnabled", Napi::Function::New(env, [](const Napi::CallbackInfo& info) {
+        Stats::SetEnabled(info.Length() == 0 || info[0].ToBoolean().Value());
+        return info.Env().Undefined();
+    }));
+    
+    exports.Set("getStats", Napi::Function::New(env, [](const Napi::CallbackInfo& info) {
+        return Stats::ToJs(info.Env());
+    }));
+    
+    exports.Set("resetStats", Napi::Function::New(env, [](const Napi::CallbackInfo& info) {
+        Stats::Reset();
+        return info.Env().Undefined();
     }));
     
     return exports;
@@ -0,0 +1,49 @@
+#ifndef ADDON_DATA_H
+#define ADDON_DATA_H
+
+#include <napi.h>
+#include "hibernation.h"
+
+namespace KateNative {
+
+/**
+ * Per-Environment Addon State
+ *
+ * The main thread and every worker_threads Worker that loads the module
+ * run in their own environment, and each gets its own AddonData as the
+ * environment's instance data: the class constructors, its KateEditor
+ * and the hibernation bookkeeping of the documents created there.
+ *
+ * Everything else is shared by all environments and safe to use from
+ * any of their threads: the one Qt thread, started by whichever needs it
+ * first, the document pool and worker pool behind it, and the stats.
+ * Results get back to the right thread through each environment's own
+ * JsDispatcher.
+ *
+ * Only touched on the environment's JavaScript thread; freed with the
+ * environment, after its objects have been finalized.
+ */
+struct AddonData {
+    Napi::FunctionReference documentConstructor;
+    Napi::FunctionReference editorConstructor;
+    
+    // Created by the first GetInstance()
+    Napi::ObjectReference editor;
+    
+#ifdef HAVE_KTEXTEDITOR
+    HibernationState hibernation;
+#endif
+    
+    // Install a fresh AddonData as the instance data of `env`; called once from Init
+    static AddonData* Create(Napi::Env env) {
+        AddonData* data = new AddonData();
+        env.SetInstanceData(data);
+        return data;
+    }
+    
+    static AddonData* Get(Napi::Env env) { return env.GetInstanceData<AddonData>(); }
+};
+
+} // namespace KateNative
+
+#endif // ADDON_DATA_H
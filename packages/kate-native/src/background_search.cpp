@@ -0,0 +1,370 @@
+#include "background_search.h"
+#include <algorithm>
+#include <atomic>
+#include <tuple>
+#include <vector>
+#include "js_convert.h"
+#include "js_dispatcher.h"
+#include "worker_pool.h"
+
+#ifdef HAVE_KTEXTEDITOR
+#include <KTextEditor/Document>
+#include "qt_runner.h"
+#else
+#include "fallback_document.h"
+#endif
+
+namespace KateNative {
+
+namespace {
+
+#ifdef HAVE_KTEXTEDITOR
+using LineText = QString;
+using LinePattern = SearchPattern;
+using SearchDocument = std::shared_ptr<KTextEditor::Document>;
+
+std::string PatternError(const SearchPattern& pattern) {
+    return pattern.ErrorString().toStdString();
+}
+#else
+using LineText = std::u16string;
+using LinePattern = TextPattern;
+using SearchDocument = std::shared_ptr<FallbackDocument>;
+
+std::string PatternError(const TextPattern& pattern) {
+    return pattern.ErrorString();
+}
+#endif
+
+const int CHUNK_LINES = 4096;
+const int CANCEL_CHECK_LINES = 256;
+const int FIELDS_PER_MATCH = 3;
+
+// A block of lines of one document
+struct ScanChunk {
+    int document;
+    int lineStart;
+    int lineEnd;
+};
+
+/**
+ * Scan state shared by the Qt thread, the workers and the JavaScript thread
+ */
+struct SearchScan {
+    SearchScan(const LineText& query, const SearchOptions& options)
+        : pattern(query, options) {}
+        
+    const LinePattern pattern;
+    std::vector<std::vector<LineText>> documents;
+    std::vector<ScanChunk> chunks;
+    int chunkCount = 0;
+    std::atomic<int> nextChunk{0};
+    std::atomic<int> pendingChunks{0};
+    std::atomic<bool> cancelled{false};
+};
+
+/**
+ * JavaScript side of a search; only touched on the JavaScript thread
+ * Deleted by Finish(), which is always the last task posted for a search.
+ */
+struct SearchCallbacks {
+    explicit SearchCallbacks(Napi::Env env)
+        : deferred(Napi::Promise::Deferred::New(env)) {}
+        
+    Napi::Promise::Deferred deferred;
+    Napi::FunctionReference onBatch;
+    std::shared_ptr<SearchScan> scan;
+    std::vector<std::vector<int32_t>> collected;
+    int64_t total = 0;
+    bool settled = false;
+    
+    // Searching several documents: batches and results say which one
+    bool perDocument = false;
+};
+
+Napi::Value AbortError(Napi::Env env) {
+    Napi::Error error = Napi::Error::New(env, "The search was aborted");
+    error.Value().Set("name", Napi::String::New(env, "AbortError"));
+    return error.Value();
+}
+
+void Reject(SearchCallbacks* callbacks, Napi::Value error) {
+    if (!callbacks->settled) {
+        callbacks->settled = true;
+        callbacks->deferred.Reject(error);
+    }
+}
+
+// Runs on a worker thread
+void ScanLines(const SearchScan& scan, const ScanChunk& chunk, std::vector<int32_t>& batch) {
+    const std::vector<LineText>& lines = scan.documents[chunk.document];
+    for (int line = chunk.lineStart; line < chunk.lineEnd; line++) {
+        if ((line - chunk.lineStart) % CANCEL_CHECK_LINES == 0 && scan.cancelled.load()) {
+            return;
+        }
+        
+        scan.pattern.ForEachMatch(lines[line], [&batch, line](int column, int length) {
+            batch.push_back(line);
+            batch.push_back(column);
+            batch.push_back(length);
+            return true;
+        });
+    }
+}
+
+void DeliverBatch(Napi::Env env, SearchCallbacks* callbacks, int document, const std::vector<int32_t>& batch) {
+    if (callbacks->settled || callbacks->scan->cancelled.load()) {
+        return;
+    }
+    
+    callbacks->total += batch.size() / FIELDS_PER_MATCH;
+    
+    if (callbacks->onBatch.IsEmpty()) {
+        std::vector<int32_t>& collected = callbacks->collected[document];
+        collected.insert(collected.end(), batch.begin(), batch.end());
+        return;
+    }
+    
+    try {
+        if (callbacks->perDocument) {
+            callbacks->onBatch.Call({Int32ArrayToJs(env, batch), Napi::Number::New(env, document)});
+        } else {
+            callbacks->onBatch.Call({Int32ArrayToJs(env, batch)});
+        }
+    } catch (const Napi::Error& e) {
+        // A throwing callback ends the search
+        callbacks->scan->cancelled = true;
+        Reject(callbacks, e.Value());
+    }
+}
+
+// Chunks finish out of order; report matches by position
+Napi::Value SortedMatches(Napi::Env env, const std::vector<LineText>& lines, const std::vector<int32_t>& values) {
+#ifdef HAVE_KTEXTEDITOR
+    std::vector<SearchMatch> matches;
+#else
+    std::vector<TextMatch> matches;
+#endif
+    matches.reserve(values.size() / FIELDS_PER_MATCH);
+    for (size_t i = 0; i < values.size(); i += FIELDS_PER_MATCH) {
+        const LineText& lineText = lines[values[i]];
+#ifdef HAVE_KTEXTEDITOR
+        matches.push_back({values[i], values[i + 1], values[i + 2], lineText.mid(values[i + 1], values[i + 2])});
+#else
+        matches.push_back({values[i], values[i + 1], values[i + 2], lineText.substr(values[i + 1], values[i + 2])});
+#endif
+    }
+    std::sort(matches.begin(), matches.end(), [](const auto& a, const auto& b) {
+        return std::tie(a.line, a.column) < std::tie(b.line, b.column);
+    });
+#ifdef HAVE_KTEXTEDITOR
+    return SearchMatchesToJs(env, matches);
+#else
+    return TextMatchesToJs(env, matches);
+#endif
+}
+
+void Finish(Napi::Env env, SearchCallbacks* callbacks) {
+    const SearchScan& scan = *callbacks->scan;
+    
+    if (scan.cancelled.load()) {
+        Reject(callbacks, AbortError(env));
+    } else if (!callbacks->settled) {
+        callbacks->settled = true;
+        
+        if (!callbacks->onBatch.IsEmpty()) {
+            callbacks->deferred.Resolve(Napi::Number::New(env, static_cast<double>(callbacks->total)));
+        } else if (!callbacks->perDocument) {
+            callbacks->deferred.Resolve(SortedMatches(env, scan.documents[0], callbacks->collected[0]));
+        } else {
+            Napi::Array results = Napi::Array::New(env, scan.documents.size());
+            for (size_t i = 0; i < scan.documents.size(); i++) {
+                results.Set(static_cast<uint32_t>(i), SortedMatches(env, scan.documents[i], callbacks->collected[i]));
+            }
+            callbacks->deferred.Resolve(results);
+        }
+    }
+    
+    delete callbacks;
+}
+
+// Runs on a worker thread; pulls chunks until none are left
+void RunWorker(std::shared_ptr<SearchScan> scan, std::shared_ptr<JsDispatcher> dispatcher,
+               SearchCallbacks* callbacks) {
+    for (;;) {
+        int chunk = scan->nextChunk++;
+        if (chunk >= scan->chunkCount) {
+            return;
+        }
+        
+        std::vector<int32_t> batch;
+        if (!scan->cancelled.load()) {
+            ScanLines(*scan, scan->chunks[chunk], batch);
+        }
+        
+        if (!batch.empty()) {
+            int document = scan->chunks[chunk].document;
+            dispatcher->Post([callbacks, document, batch](Napi::Env env) {
+                DeliverBatch(env, callbacks, document, batch);
+            });
+        }
+        
+        // Every batch is queued before the last chunk reports in
+        if (--scan->pendingChunks == 0) {
+            dispatcher->Post([callbacks, dispatcher](Napi::Env env) {
+                Finish(env, callbacks);
+                dispatcher->Unref();
+            });
+        }
+    }
+}
+
+// Split the snapshot into chunks and start the workers
+void ScheduleChunks(std::shared_ptr<SearchScan> scan, std::shared_ptr<JsDispatcher> dispatcher,
+                    SearchCallbacks* callbacks) {
+    // Chunks never span documents, so every batch belongs to one
+    for (size_t i = 0; i < scan->documents.size(); i++) {
+        int lineCount = static_cast<int>(scan->documents[i].size());
+        for (int lineStart = 0; lineStart < lineCount; lineStart += CHUNK_LINES) {
+            scan->chunks.push_back({static_cast<int>(i), lineStart, std::min(lineStart + CHUNK_LINES, lineCount)});
+        }
+    }
+    
+    scan->chunkCount = static_cast<int>(scan->chunks.size());
+    scan->pendingChunks = scan->chunkCount;
+    
+    if (scan->chunkCount == 0) {
+        dispatcher->Post([callbacks, dispatcher](Napi::Env env) {
+            Finish(env, callbacks);
+            dispatcher->Unref();
+        });
+        return;
+    }
+    
+    int workers = std::min(WorkerPool::ThreadCount(), scan->chunkCount);
+    for (int i = 0; i < workers; i++) {
+        WorkerPool::Post([scan, dispatcher, callbacks]() { RunWorker(scan, dispatcher, callbacks); });
+    }
+}
+
+Napi::Promise StartScan(Napi::Env env, const std::vector<SearchDocument>& documents,
+                        const LineText& query, const SearchOptions& options,
+                        Napi::Value onBatch, Napi::Value signal, bool perDocument) {
+    auto* callbacks = new SearchCallbacks(env);
+    Napi::Promise promise = callbacks->deferred.Promise();
+    
+    std::shared_ptr<SearchScan> scan = std::make_shared<SearchScan>(query, options);
+    callbacks->scan = scan;
+    callbacks->collected.resize(documents.size());
+    callbacks->perDocument = perDocument;
+    if (onBatch.IsFunction()) {
+        callbacks->onBatch = Napi::Persistent(onBatch.As<Napi::Function>());
+    }
+    
+    if (!scan->pattern.IsValid()) {
+        Reject(callbacks, Napi::Error::New(env, "Invalid search pattern: " + PatternError(scan->pattern)).Value());
+        delete callbacks;
+        return promise;
+    }
+    
+    // AbortSignal support
+    if (signal.IsObject()) {
+        Napi::Object signalObject = signal.As<Napi::Object>();
+        if (signalObject.Get("aborted").ToBoolean().Value()) {
+            Reject(callbacks, AbortError(env));
+            delete callbacks;
+            return promise;
+        }
+        
+        Napi::Value addEventListener = signalObject.Get("addEventListener");
+        if (addEventListener.IsFunction()) {
+            // Weak, so a long-lived signal doesn't keep the snapshot alive
+            std::weak_ptr<SearchScan> weakScan = scan;
+            Napi::Function onAbort = Napi::Function::New(env, [weakScan](const Napi::CallbackInfo&) {
+                if (std::shared_ptr<SearchScan> scan = weakScan.lock()) {
+                    scan->cancelled = true;
+                }
+            });
+            Napi::Object listenerOptions = Napi::Object::New(env);
+            listenerOptions.Set("once", Napi::Boolean::New(env, true));
+            addEventListener.As<Napi::Function>().Call(signalObject,
+                {Napi::String::New(env, "abort"), onAbort, listenerOptions});
+        }
+    }
+    
+    std::shared_ptr<JsDispatcher> dispatcher = JsDispatcher::ForEnv(env);
+    dispatcher->Ref();
+    
+#ifdef HAVE_KTEXTEDITOR
+    bool posted = QtRunner::Post([documents, scan, dispatcher, callbacks]() {
+        // Line strings are implicitly shared, so this copies no text
+        scan->documents.resize(documents.size());
+        for (size_t i = 0; i < documents.size(); i++) {
+            int lineCount = documents[i]->lines();
+            std::vector<QString>& lines = scan->documents[i];
+            lines.reserve(lineCount);
+            for (int line = 0; line < lineCount; line++) {
+                lines.push_back(documents[i]->line(line));
+            }
+        }
+        ScheduleChunks(scan, dispatcher, callbacks);
+    });
+    
+    if (!posted) {
+        dispatcher->Unref();
+        Reject(callbacks, Napi::Error::New(env, "Qt event loop is not running").Value());
+        delete callbacks;
+    }
+#else
+    // The documents live on this thread, so their lines are copied here
+    scan->documents.resize(documents.size());
+    for (size_t i = 0; i < documents.size(); i++) {
+        std::u16string text = documents[i]->Text().Text();
+        std::vector<std::u16string>& lines = scan->documents[i];
+        lines.reserve(documents[i]->Text().Lines());
+        size_t lineStart = 0;
+        while (true) {
+            size_t lineBreak = text.find(u'\n', lineStart);
+            lines.push_back(text.substr(lineStart, lineBreak == std::u16string::npos ? std::u16string::npos
+                                                                                    : lineBreak - lineStart));
+            if (lineBreak == std::u16string::npos) {
+                break;
+            }
+            lineStart = lineBreak + 1;
+        }
+    }
+    ScheduleChunks(scan, dispatcher, callbacks);
+#endif
+    
+    return promise;
+}
+
+} // namespace
+
+#ifdef HAVE_KTEXTEDITOR
+Napi::Promise BackgroundSearch::Start(Napi::Env env, std::shared_ptr<KTextEditor::Document> document,
+                                      const QString& query, const SearchOptions& options,
+                                      Napi::Value onBatch, Napi::Value signal) {
+    return StartScan(env, {document}, query, options, onBatch, signal, false);
+}
+
+Napi::Promise BackgroundSearch::StartMany(Napi::Env env, const std::vector<std::shared_ptr<KTextEditor::Document>>& documents,
+                                          const QString& query, const SearchOptions& options,
+                                          Napi::Value onBatch, Napi::Value signal) {
+    return StartScan(env, documents, query, options, onBatch, signal, true);
+}
+#else
+Napi::Promise BackgroundSearch::Start(Napi::Env env, std::shared_ptr<FallbackDocument> document,
+                                      const std::u16string& query, const SearchOptions& options,
+                                      Napi::Value onBatch, Napi::Value signal) {
+    return StartScan(env, {document}, query, options, onBatch, signal, false);
+}
+
+Napi::Promise BackgroundSearch::StartMany(Napi::Env env, const std::vector<std::shared_ptr<FallbackDocument>>& documents,
+                                          const std::u16string& query, const SearchOptions& options,
+                                          Napi::Value onBatch, Napi::Value signal) {
+    return StartScan(env, documents, query, options, onBatch, signal, true);
+}
+#endif
+
+} // namespace KateNative
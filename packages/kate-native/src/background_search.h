@@ -0,0 +1,81 @@
+#ifndef BACKGROUND_SEARCH_H
+#define BACKGROUND_SEARCH_H
+
+#include <napi.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "search_pattern.h"
+
+#ifdef HAVE_KTEXTEDITOR
+#include <QString>
+
+namespace KTextEditor {
+    class Document;
+}
+#endif
+
+namespace KateNative {
+
+#ifndef HAVE_KTEXTEDITOR
+class FallbackDocument;
+#endif
+
+/**
+ * Background Document Search
+ *
+ * Snapshots the lines of a document on the Qt thread, which only bumps
+ * the reference counts of the implicitly shared line strings, and scans
+ * the snapshot on the worker pool in chunks of lines. Matches are sent
+ * to the JavaScript thread through the environment's JsDispatcher as
+ * soon as each chunk finishes, so the first results show up long before
+ * the whole document has been scanned.
+ *
+ * Without KTextEditor the documents are FallbackDocuments, whose lines
+ * are copied on the JavaScript thread, and matched with a TextPattern.
+ */
+class BackgroundSearch {
+public:
+#ifdef HAVE_KTEXTEDITOR
+    /**
+     * Start a search and return a promise for its outcome
+     *
+     * With an onBatch function, each batch is passed to it as an
+     * Int32Array of (line, column, length) triples, in the order chunks
+     * finish, and the promise resolves with the total match count.
+     * Without one, the promise resolves with SearchResult objects sorted
+     * by position. `signal` may be an AbortSignal; aborting stops the
+     * workers, drops undelivered batches and rejects with an AbortError.
+     */
+    static Napi::Promise Start(Napi::Env env, std::shared_ptr<KTextEditor::Document> document,
+                               const QString& query, const SearchOptions& options,
+                               Napi::Value onBatch, Napi::Value signal);
+    
+    /**
+     * Search several documents in one scan
+     *
+     * Chunks of every document are spread over the same workers, so a
+     * workspace of many files keeps every core busy. onBatch also gets the
+     * index of the batch's document, and without it the promise resolves
+     * with one array of SearchResult objects per document, in order.
+     */
+    static Napi::Promise StartMany(Napi::Env env, const std::vector<std::shared_ptr<KTextEditor::Document>>& documents,
+                                   const QString& query, const SearchOptions& options,
+                                   Napi::Value onBatch, Napi::Value signal);
+#else
+    static Napi::Promise Start(Napi::Env env, std::shared_ptr<FallbackDocument> document,
+                               const std::u16string& query, const SearchOptions& options,
+                               Napi::Value onBatch, Napi::Value signal);
+    static Napi::Promise StartMany(Napi::Env env, const std::vector<std::shared_ptr<FallbackDocument>>& documents,
+                                   const std::u16string& query, const SearchOptions& options,
+                                   Napi::Value onBatch, Napi::Value signal);
+#endif
+
+private:
+    BackgroundSearch() = delete;
+    ~BackgroundSearch() = delete;
+};
+
+} // namespace KateNative
+
+#endif // BACKGROUND_SEARCH_H
@@ -0,0 +1,105 @@
+#include "column_map.h"
+
+#ifdef HAVE_KTEXTEDITOR
+#include <KTextEditor/Document>
+#include <KTextEditor/Cursor>
+#include <KTextEditor/Range>
+#include <algorithm>
+
+namespace KateNative {
+
+ColumnMap::ColumnMap(KTextEditor::Document* document)
+    : QObject(document)
+    , m_document(document)
+{
+    connect(document, &KTextEditor::Document::textInserted, this,
+        [this](KTextEditor::Document*, const KTextEditor::Cursor& position, const QString& text) {
+            OnTextInserted(position, text);
+        });
+    connect(document, &KTextEditor::Document::textRemoved, this,
+        [this](KTextEditor::Document*, const KTextEditor::Range& range, const QString&) {
+            OnTextRemoved(range);
+        });
+        
+    // Loading a file replaces the content without textInserted/textRemoved
+    connect(document, &KTextEditor::Document::aboutToInvalidateMovingInterfaceContent, this,
+        [this](KTextEditor::Document*) { m_stale = true; });
+    connect(document, &KTextEditor::Document::reloaded, this,
+        [this](KTextEditor::Document*) { m_stale = true; });
+}
+
+void ColumnMap::OnTextInserted(const KTextEditor::Cursor& position, const QString& text) {
+    if (m_stale) {
+        return;
+    }
+    
+    int line = position.line();
+    int added = text.count(QLatin1Char('\n'));
+    if (line < 0 || line >= static_cast<int>(m_lines.size())) {
+        m_stale = true;
+        return;
+    }
+    
+    m_lines.insert(m_lines.begin() + line + 1, added, Line());
+    m_lines[line] = Line();
+}
+
+void ColumnMap::OnTextRemoved(const KTextEditor::Range& range) {
+    if (m_stale) {
+        return;
+    }
+    
+    int line = range.start().line();
+    int removed = range.end().line() - line;
+    if (line < 0 || line + removed >= static_cast<int>(m_lines.size())) {
+        m_stale = true;
+        return;
+    }
+    
+    m_lines.erase(m_lines.begin() + line + 1, m_lines.begin() + line + 1 + removed);
+    m_lines[line] = Line();
+}
+
+const ColumnMap::Line& ColumnMap::Prepare(int line) {
+    Line& entry = m_lines[line];
+    if (entry.state != Line::Unknown) {
+        return entry;
+    }
+    
+    QString text = m_document->line(line);
+    const char16_t* units = reinterpret_cast<const char16_t*>(text.utf16());
+    auto table = std::make_shared<ColumnTable>();
+    entry.length = static_cast<uint32_t>(text.length());
+    if (table->Build(units, text.length())) {
+        entry.state = Line::Mapped;
+        entry.table = std::move(table);
+        entry.text = text;
+    } else {
+        entry.state = Line::Ascii;
+    }
+    return entry;
+}
+
+uint32_t ColumnMap::Convert(int& line, uint32_t column, ColumnEncoding from, ColumnEncoding to) {
+    // Never answer from a map that has a different number of lines
+    int lineCount = qMax(m_document->lines(), 1);
+    if (m_stale || static_cast<int>(m_lines.size()) != lineCount) {
+        m_lines.clear();
+        m_lines.resize(lineCount);
+        m_stale = false;
+    }
+    
+    line = std::clamp(line, 0, lineCount - 1);
+    const Line& entry = Prepare(line);
+    if (entry.state == Line::Ascii) {
+        return std::min(column, entry.length);
+    }
+    
+    const char16_t* units = reinterpret_cast<const char16_t*>(entry.text.utf16());
+    uint32_t utf16 = entry.table->ToUtf16(units, column, from);
+    return entry.table->FromUtf16(units, utf16, to);
+}
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
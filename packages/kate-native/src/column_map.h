@@ -0,0 +1,69 @@
+#ifndef COLUMN_MAP_H
+#define COLUMN_MAP_H
+
+#ifdef HAVE_KTEXTEDITOR
+#include "column_table.h"
+#include <QObject>
+#include <QString>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace KTextEditor {
+    class Document;
+    class Cursor;
+    class Range;
+}
+
+namespace KateNative {
+
+/**
+ * Column Encoding Map
+ *
+ * Converts (line, column) positions of one document between UTF-16 code
+ * units, which KTextEditor counts in, and the UTF-8 or UTF-32 columns a
+ * language server may use. Each line is measured the first time it is
+ * asked about: an ASCII line is only marked as such, any other line keeps
+ * a ColumnTable and its text, which the document's buffer shares until
+ * the line changes. Edits drop what was known about the lines they touch.
+ *
+ * Lines outside the document are clamped to it, and columns to their line,
+ * like LineIndex does. The map is a child of its document and lives on the
+ * Qt thread.
+ */
+class ColumnMap : public QObject {
+public:
+    explicit ColumnMap(KTextEditor::Document* document);
+    
+    // Clamps `line` and returns `column` (in `from` units) in `to` units
+    uint32_t Convert(int& line, uint32_t column, ColumnEncoding from, ColumnEncoding to);
+
+private:
+    struct Line {
+        enum State : uint8_t { Unknown, Ascii, Mapped };
+        State state = Unknown;
+        uint32_t length = 0;
+        
+        // Mapped lines only
+        std::shared_ptr<ColumnTable> table;
+        QString text;
+    };
+    
+    void OnTextInserted(const KTextEditor::Cursor& position, const QString& text);
+    void OnTextRemoved(const KTextEditor::Range& range);
+    
+    // Measure `line` if it isn't yet
+    const Line& Prepare(int line);
+    
+    KTextEditor::Document* m_document;
+    std::vector<Line> m_lines;
+    
+    // Set when the whole content is about to be replaced
+    bool m_stale = true;
+};
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
+
+#endif // COLUMN_MAP_H
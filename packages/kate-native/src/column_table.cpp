@@ -0,0 +1,265 @@
+#include "column_table.h"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define KATE_COLUMNS_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define KATE_COLUMNS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace KateNative {
+
+namespace {
+
+constexpr size_t BLOCK = ColumnTable::BlockUnits;
+
+/**
+ * UTF-8 bytes above one per unit in a whole block, i.e. one for every unit
+ * from U+0080 and another from U+0800; sets `surrogates` when the block
+ * holds any, whose sizes depend on their neighbours
+ */
+using BlockKernel = uint32_t (*)(const char16_t* block, bool& surrogates);
+
+inline bool IsHighSurrogate(char16_t unit) {
+    return (unit & 0xFC00) == 0xD800;
+}
+
+inline bool IsLowSurrogate(char16_t unit) {
+    return (unit & 0xFC00) == 0xDC00;
+}
+
+// A pair is counted at its low half, so the column of the high half is the character's start
+inline void Weigh(const char16_t* text, size_t length, size_t i, uint32_t& bytes, uint32_t& points) {
+    char16_t unit = text[i];
+    if (unit < 0x80) {
+        bytes = 1;
+        points = 1;
+    } else if (unit < 0x800) {
+        bytes = 2;
+        points = 1;
+    } else if (IsHighSurrogate(unit) && i + 1 < length && IsLowSurrogate(text[i + 1])) {
+        bytes = 0;
+        points = 0;
+    } else if (IsLowSurrogate(unit) && i > 0 && IsHighSurrogate(text[i - 1])) {
+        bytes = 4;
+        points = 1;
+    } else {
+        bytes = 3;
+        points = 1;
+    }
+}
+
+void WeighRange(const char16_t* text, size_t length, size_t begin, size_t end, uint32_t& utf8, uint32_t& utf32) {
+    for (size_t i = begin; i < end; i++) {
+        uint32_t bytes;
+        uint32_t points;
+        Weigh(text, length, i, bytes, points);
+        utf8 += bytes;
+        utf32 += points;
+    }
+}
+
+#if !KATE_COLUMNS_X86 && !KATE_COLUMNS_NEON
+uint32_t MeasureScalar(const char16_t* block, bool& surrogates) {
+    uint32_t extra = 0;
+    surrogates = false;
+    for (size_t i = 0; i < BLOCK; i++) {
+        char16_t unit = block[i];
+        extra += (unit >= 0x80) + (unit >= 0x800);
+        surrogates |= (unit & 0xF800) == 0xD800;
+    }
+    return extra;
+}
+#endif
+
+#if KATE_COLUMNS_X86
+// SSE2 only compares signed 16-bit lanes, so both sides are biased by 0x8000
+uint32_t MeasureSse2(const char16_t* block, bool& surrogates) {
+    const __m128i bias = _mm_set1_epi16(static_cast<int16_t>(0x8000));
+    const __m128i above7F = _mm_set1_epi16(static_cast<int16_t>(0x807F));
+    const __m128i above7FF = _mm_set1_epi16(static_cast<int16_t>(0x87FF));
+    const __m128i surrogateBits = _mm_set1_epi16(static_cast<int16_t>(0xF800));
+    const __m128i surrogate = _mm_set1_epi16(static_cast<int16_t>(0xD800));
+    __m128i counts = _mm_setzero_si128();
+    __m128i found = _mm_setzero_si128();
+    for (size_t i = 0; i < BLOCK; i += 8) {
+        __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+        __m128i biased = _mm_xor_si128(units, bias);
+        // Matching lanes are -1
+        counts = _mm_sub_epi16(counts, _mm_cmpgt_epi16(biased, above7F));
+        counts = _mm_sub_epi16(counts, _mm_cmpgt_epi16(biased, above7FF));
+        found = _mm_or_si128(found, _mm_cmpeq_epi16(_mm_and_si128(units, surrogateBits), surrogate));
+    }
+    __m128i sums = _mm_madd_epi16(counts, _mm_set1_epi16(1));
+    sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(1, 0, 3, 2)));
+    sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(2, 3, 0, 1)));
+    surrogates = _mm_movemask_epi8(found) != 0;
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(sums));
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx2")))
+uint32_t MeasureAvx2(const char16_t* block, bool& surrogates) {
+    const __m256i bias = _mm256_set1_epi16(static_cast<int16_t>(0x8000));
+    const __m256i above7F = _mm256_set1_epi16(static_cast<int16_t>(0x807F));
+    const __m256i above7FF = _mm256_set1_epi16(static_cast<int16_t>(0x87FF));
+    const __m256i surrogateBits = _mm256_set1_epi16(static_cast<int16_t>(0xF800));
+    const __m256i surrogate = _mm256_set1_epi16(static_cast<int16_t>(0xD800));
+    __m256i counts = _mm256_setzero_si256();
+    __m256i found = _mm256_setzero_si256();
+    for (size_t i = 0; i < BLOCK; i += 16) {
+        __m256i units = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+        __m256i biased = _mm256_xor_si256(units, bias);
+        counts = _mm256_sub_epi16(counts, _mm256_cmpgt_epi16(biased, above7F));
+        counts = _mm256_sub_epi16(counts, _mm256_cmpgt_epi16(biased, above7FF));
+        found = _mm256_or_si256(found, _mm256_cmpeq_epi16(_mm256_and_si256(units, surrogateBits), surrogate));
+    }
+    __m256i wide = _mm256_madd_epi16(counts, _mm256_set1_epi16(1));
+    __m128i sums = _mm_add_epi32(_mm256_castsi256_si128(wide), _mm256_extracti128_si256(wide, 1));
+    sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(1, 0, 3, 2)));
+    sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(2, 3, 0, 1)));
+    surrogates = _mm256_movemask_epi8(found) != 0;
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(sums));
+}
+#endif
+#endif
+
+#if KATE_COLUMNS_NEON
+uint32_t MeasureNeon(const char16_t* block, bool& surrogates) {
+    const uint16x8_t above7F = vdupq_n_u16(0x7F);
+    const uint16x8_t above7FF = vdupq_n_u16(0x7FF);
+    const uint16x8_t surrogateBits = vdupq_n_u16(0xF800);
+    const uint16x8_t surrogate = vdupq_n_u16(0xD800);
+    uint16x8_t counts = vdupq_n_u16(0);
+    uint16x8_t found = vdupq_n_u16(0);
+    for (size_t i = 0; i < BLOCK; i += 8) {
+        uint16x8_t units = vld1q_u16(reinterpret_cast<const uint16_t*>(block + i));
+        // Matching lanes are 0xFFFF, i.e. -1
+        counts = vsubq_u16(counts, vcgtq_u16(units, above7F));
+        counts = vsubq_u16(counts, vcgtq_u16(units, above7FF));
+        found = vorrq_u16(found, vceqq_u16(vandq_u16(units, surrogateBits), surrogate));
+    }
+    surrogates = vmaxvq_u16(found) != 0;
+    return vaddvq_u16(counts);
+}
+#endif
+
+struct SelectedKernel {
+    BlockKernel measure;
+    const char* name;
+};
+
+SelectedKernel SelectKernel() {
+#if KATE_COLUMNS_X86
+#if defined(__GNUC__) || defined(__clang__)
+    if (__builtin_cpu_supports("avx2")) {
+        return {MeasureAvx2, "avx2"};
+    }
+#endif
+    return {MeasureSse2, "sse2"};
+#elif KATE_COLUMNS_NEON
+    return {MeasureNeon, "neon"};
+#else
+    return {MeasureScalar, "scalar"};
+#endif
+}
+
+const SelectedKernel& CurrentKernel() {
+    static const SelectedKernel kernel = SelectKernel();
+    return kernel;
+}
+
+} // namespace
+
+bool ColumnTable::Build(const char16_t* text, size_t length) {
+    const BlockKernel measure = CurrentKernel().measure;
+    size_t blocks = length / BLOCK;
+    m_length = static_cast<uint32_t>(length);
+    m_utf8.resize(blocks + 1);
+    m_utf32.resize(blocks + 1);
+    
+    uint32_t utf8 = 0;
+    uint32_t utf32 = 0;
+    for (size_t block = 0; block < blocks; block++) {
+        m_utf8[block] = utf8;
+        m_utf32[block] = utf32;
+        bool surrogates = false;
+        uint32_t extra = measure(text + block * BLOCK, surrogates);
+        if (surrogates) {
+            WeighRange(text, length, block * BLOCK, (block + 1) * BLOCK, utf8, utf32);
+        } else {
+            utf8 += static_cast<uint32_t>(BLOCK) + extra;
+            utf32 += static_cast<uint32_t>(BLOCK);
+        }
+    }
+    m_utf8[blocks] = utf8;
+    m_utf32[blocks] = utf32;
+    WeighRange(text, length, blocks * BLOCK, length, utf8, utf32);
+    
+    m_utf8Length = utf8;
+    m_utf32Length = utf32;
+    return utf8 != m_length;
+}
+
+uint32_t ColumnTable::Length(ColumnEncoding encoding) const {
+    switch (encoding) {
+    case ColumnEncoding::Utf8:
+        return m_utf8Length;
+    case ColumnEncoding::Utf32:
+        return m_utf32Length;
+    default:
+        return m_length;
+    }
+}
+
+uint32_t ColumnTable::FromUtf16(const char16_t* text, uint32_t column, ColumnEncoding to) const {
+    column = std::min(column, m_length);
+    if (to == ColumnEncoding::Utf16) {
+        return column;
+    }
+    
+    size_t block = column / BLOCK;
+    uint32_t utf8 = m_utf8[block];
+    uint32_t utf32 = m_utf32[block];
+    WeighRange(text, m_length, block * BLOCK, column, utf8, utf32);
+    return to == ColumnEncoding::Utf8 ? utf8 : utf32;
+}
+
+uint32_t ColumnTable::ToUtf16(const char16_t* text, uint32_t column, ColumnEncoding from) const {
+    if (from == ColumnEncoding::Utf16) {
+        return std::min(column, m_length);
+    }
+    if (column >= Length(from)) {
+        return m_length;
+    }
+    
+    // Last block starting at or before the column; every block adds to both counts
+    const std::vector<uint32_t>& starts = from == ColumnEncoding::Utf8 ? m_utf8 : m_utf32;
+    size_t block = static_cast<size_t>(std::upper_bound(starts.begin(), starts.end(), column) - starts.begin()) - 1;
+    uint32_t counted = starts[block];
+    size_t unit = block * BLOCK;
+    for (; unit < m_length; unit++) {
+        uint32_t bytes;
+        uint32_t points;
+        Weigh(text, m_length, unit, bytes, points);
+        uint32_t weight = from == ColumnEncoding::Utf8 ? bytes : points;
+        if (counted + weight > column) {
+            break;
+        }
+        counted += weight;
+    }
+    
+    // Stopped on the low half of a pair: the character starts one unit earlier
+    if (unit > 0 && unit < m_length && IsLowSurrogate(text[unit]) && IsHighSurrogate(text[unit - 1])) {
+        unit--;
+    }
+    return static_cast<uint32_t>(unit);
+}
+
+const char* ColumnTable::Kernel() {
+    return CurrentKernel().name;
+}
+
+} // namespace KateNative
@@ -0,0 +1,67 @@
+#ifndef COLUMN_TABLE_H
+#define COLUMN_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace KateNative {
+
+// Units a column is counted in, as LSP's position encodings name them
+enum class ColumnEncoding {
+    Utf8,
+    Utf16,
+    Utf32
+};
+
+/**
+ * Column Conversion Table
+ *
+ * Maps columns of one line between UTF-16 code units and UTF-8 bytes or
+ * code points. The table holds the UTF-8 and UTF-32 column at the start of
+ * every BlockUnits UTF-16 units, so a conversion walks at most one block
+ * of the line. Blocks are measured 8 or 16 units at a time with SSE2, AVX2
+ * (picked at runtime) or NEON, and a plain loop elsewhere; only blocks
+ * holding surrogates are walked unit by unit.
+ *
+ * A column between the two halves of a surrogate pair is the start of its
+ * character, and so is a UTF-8 column inside a character's bytes. A lone
+ * surrogate counts as one character of three bytes, the size of the
+ * U+FFFD it is encoded as. Columns past the end of the line are its end.
+ *
+ * The table doesn't keep the text; every call gets the line it was built
+ * from.
+ */
+class ColumnTable {
+public:
+    static constexpr size_t BlockUnits = 64;
+    
+    /**
+     * Measure `length` UTF-16 units
+     * Returns false when they are all ASCII, where every column is the same
+     * in each encoding and the table isn't needed.
+     */
+    bool Build(const char16_t* text, size_t length);
+    
+    // Length of the line, in `encoding`
+    uint32_t Length(ColumnEncoding encoding) const;
+    
+    uint32_t FromUtf16(const char16_t* text, uint32_t column, ColumnEncoding to) const;
+    uint32_t ToUtf16(const char16_t* text, uint32_t column, ColumnEncoding from) const;
+    
+    // Name of the kernel in use: "avx2", "sse2", "neon" or "scalar"
+    static const char* Kernel();
+
+private:
+    uint32_t m_length = 0;
+    uint32_t m_utf8Length = 0;
+    uint32_t m_utf32Length = 0;
+    
+    // Columns at the start of every whole block
+    std::vector<uint32_t> m_utf8;
+    std::vector<uint32_t> m_utf32;
+};
+
+} // namespace KateNative
+
+#endif // COLUMN_TABLE_H
@@ -0,0 +1,79 @@
+#include "document_anchors.h"
+
+#ifdef HAVE_KTEXTEDITOR
+#include <KTextEditor/Document>
+#include <KTextEditor/Cursor>
+#include <KTextEditor/MovingInterface>
+#include <KTextEditor/Range>
+#include <algorithm>
+
+namespace KateNative {
+
+DocumentAnchors::DocumentAnchors(KTextEditor::Document* document)
+    : QObject(document)
+    , m_document(document)
+{
+    // The document deletes the ranges still on it when it goes; the sets
+    // must not delete them again
+    connect(document, &KTextEditor::Document::aboutToDeleteMovingInterfaceContent, this,
+        [this](KTextEditor::Document*) {
+            for (auto& set : m_sets) {
+                for (auto& range : set.second) {
+                    range.release();
+                }
+            }
+            m_sets.clear();
+        });
+}
+
+int DocumentAnchors::Create(const int32_t* fields, size_t count, KTextEditor::MovingRange::InsertBehaviors insert,
+                            KTextEditor::MovingRange::EmptyBehavior empty) {
+    auto* moving = qobject_cast<KTextEditor::MovingInterface*>(m_document);
+    if (!moving) {
+        return 0;
+    }
+    
+    int lastLine = std::max(m_document->lines(), 1) - 1;
+    auto clamp = [this, lastLine](int32_t line, int32_t column) {
+        line = std::clamp(line, 0, lastLine);
+        return KTextEditor::Cursor(line, std::clamp(column, 0, m_document->lineLength(line)));
+    };
+    
+    RangeSet set;
+    set.reserve(count / 4);
+    for (size_t i = 0; i + 4 <= count; i += 4) {
+        KTextEditor::Range range(clamp(fields[i], fields[i + 1]), clamp(fields[i + 2], fields[i + 3]));
+        set.emplace_back(moving->newMovingRange(range, insert, empty));
+    }
+    
+    int handle = m_nextHandle++;
+    m_sets.emplace(handle, std::move(set));
+    return handle;
+}
+
+bool DocumentAnchors::Read(int handle, std::vector<int32_t>& fields) const {
+    auto it = m_sets.find(handle);
+    if (it == m_sets.end()) {
+        return false;
+    }
+    
+    fields.resize(it->second.size() * 4);
+    int32_t* out = fields.data();
+    for (const auto& moving : it->second) {
+        KTextEditor::Range range = moving->toRange();
+        bool valid = range.isValid();
+        *out++ = valid ? range.start().line() : -1;
+        *out++ = valid ? range.start().column() : -1;
+        *out++ = valid ? range.end().line() : -1;
+        *out++ = valid ? range.end().column() : -1;
+    }
+    return true;
+}
+
+bool DocumentAnchors::Release(int handle) {
+    return m_sets.erase(handle) > 0;
+}
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
@@ -0,0 +1,63 @@
+#ifndef DOCUMENT_ANCHORS_H
+#define DOCUMENT_ANCHORS_H
+
+#ifdef HAVE_KTEXTEDITOR
+#include <KTextEditor/MovingRange>
+#include <QObject>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace KTextEditor {
+    class Document;
+}
+
+namespace KateNative {
+
+/**
+ * Range Anchors
+ *
+ * Sets of KTextEditor::MovingRange over one document, created and read a
+ * whole set at a time, so diagnostics and decorations keep their place
+ * through edits without being remapped in JavaScript. The document moves
+ * every range as part of the edit itself, block by block, so a set of
+ * thousands costs an edit nothing beyond the ranges in the blocks it
+ * touches.
+ *
+ * Reloading the document invalidates its ranges. The anchors are a child
+ * of the document and live on the Qt thread.
+ */
+class DocumentAnchors : public QObject {
+public:
+    explicit DocumentAnchors(KTextEditor::Document* document);
+    
+    /**
+     * One range per (start line, start column, end line, end column) in
+     * `fields`, clamped to the document; returns the set's handle, or 0
+     * when the document has no moving ranges
+     */
+    int Create(const int32_t* fields, size_t count, KTextEditor::MovingRange::InsertBehaviors insert,
+               KTextEditor::MovingRange::EmptyBehavior empty);
+            
+    // Current ranges of a set as four fields each, -1 for invalid ones; false for an unknown handle
+    bool Read(int handle, std::vector<int32_t>& fields) const;
+    
+    bool Release(int handle);
+    
+    bool IsEmpty() const { return m_sets.empty(); }
+
+private:
+    using RangeSet = std::vector<std::unique_ptr<KTextEditor::MovingRange>>;
+    
+    KTextEditor::Document* m_document;
+    std::unordered_map<int, RangeSet> m_sets;
+    int m_nextHandle = 1;
+};
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
+
+#endif // DOCUMENT_ANCHORS_H
@@ -0,0 +1,367 @@
+#include "document_events.h"
+#include "edit_batch.h"
+#include "js_convert.h"
+#include "js_dispatcher.h"
+#ifndef HAVE_KTEXTEDITOR
+#include "fallback_document.h"
+#endif
+#include <algorithm>
+#include <cstring>
+
+#ifdef HAVE_KTEXTEDITOR
+#include <KTextEditor/Document>
+#include <KTextEditor/Cursor>
+#include <KTextEditor/Range>
+#endif
+
+namespace KateNative {
+
+DocumentEvents::DocumentEvents(Napi::Env env)
+    : m_dispatcher(JsDispatcher::ForEnv(env))
+{
+}
+
+DocumentEvents::Listeners* DocumentEvents::ListenersFor(const std::string& event) {
+    if (event == "textChanged") {
+        return &m_textListeners;
+    }
+    if (event == "modeChanged") {
+        return &m_modeListeners;
+    }
+    if (event == "tokensChanged") {
+        return &m_tokenListeners;
+    }
+    return nullptr;
+}
+
+bool DocumentEvents::AddListener(const std::string& event, Napi::Function callback) {
+    Listeners* listeners = ListenersFor(event);
+    if (!listeners) {
+        return false;
+    }
+    
+    listeners->push_back(std::make_shared<Napi::FunctionReference>(Napi::Persistent(callback)));
+    m_recordText = !m_textListeners.empty();
+    m_recordMode = !m_modeListeners.empty();
+    m_recordTokens = !m_tokenListeners.empty();
+    return true;
+}
+
+bool DocumentEvents::RemoveListener(const std::string& event, Napi::Value callback) {
+    Listeners* listeners = ListenersFor(event);
+    if (!listeners) {
+        return false;
+    }
+    
+    // Without a callback, every listener of the event goes
+    listeners->erase(std::remove_if(listeners->begin(), listeners->end(),
+        [&callback](const std::shared_ptr<Napi::FunctionReference>& listener) {
+            return !callback.IsFunction() || listener->Value().StrictEquals(callback);
+        }), listeners->end());
+    m_recordText = !m_textListeners.empty();
+    m_recordMode = !m_modeListeners.empty();
+    m_recordTokens = !m_tokenListeners.empty();
+    return true;
+}
+
+bool DocumentEvents::HasListeners() const {
+    return !m_textListeners.empty() || !m_modeListeners.empty() || !m_tokenListeners.empty();
+}
+
+void DocumentEvents::Clear() {
+    m_recordText = false;
+    m_recordMode = false;
+    m_recordTokens = false;
+    m_textListeners.clear();
+    m_modeListeners.clear();
+    m_tokenListeners.clear();
+}
+
+void DocumentEvents::Deliver(Napi::Env env) {
+    std::vector<uint32_t> fields;
+    uint32_t count = 0;
+    int64_t revision = -1;
+    bool modeChanged = false;
+    std::u16string text;
+    std::string mode;
+#ifdef HAVE_KTEXTEDITOR
+    SyntaxTokenDelta tokens;
+    bool tokensChanged = false;
+#endif
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        fields.swap(m_fields);
+        count = m_count;
+        revision = m_revision;
+        modeChanged = m_modeChanged;
+        text.swap(m_text);
+        mode = m_mode;
+        m_count = 0;
+        m_modeChanged = false;
+        m_scheduled = false;
+#ifdef HAVE_KTEXTEDITOR
+        std::swap(tokens, m_tokens);
+        tokensChanged = m_tokensChanged;
+        m_tokensChanged = false;
+#endif
+    }
+    
+    // Listeners may add or remove listeners while they run
+    if (count > 0 && !m_textListeners.empty()) {
+        size_t headerBytes = (1 + fields.size()) * sizeof(uint32_t);
+        size_t textBytes = text.size() * sizeof(char16_t);
+        Napi::ArrayBuffer buffer = Napi::ArrayBuffer::New(env, headerBytes + textBytes);
+        uint8_t* data = static_cast<uint8_t*>(buffer.Data());
+        std::memcpy(data, &count, sizeof(uint32_t));
+        std::memcpy(data + sizeof(uint32_t), fields.data(), fields.size() * sizeof(uint32_t));
+        std::memcpy(data + headerBytes, text.data(), textBytes);
+        
+        Napi::Object change = Napi::Object::New(env);
+        change.Set("buffer", buffer);
+        change.Set("count", Napi::Number::New(env, count));
+        change.Set("revision", Napi::Number::New(env, static_cast<double>(revision)));
+        
+        Listeners listeners = m_textListeners;
+        for (const auto& listener : listeners) {
+            listener->Call({change});
+        }
+    }
+    
+    if (modeChanged && !m_modeListeners.empty()) {
+        Napi::String modeValue = Napi::String::New(env, mode);
+        Listeners listeners = m_modeListeners;
+        for (const auto& listener : listeners) {
+            listener->Call({modeValue});
+        }
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (tokensChanged && !m_tokenListeners.empty()) {
+        Napi::Value delta = SyntaxTokenDeltaToJs(env, tokens);
+        Listeners listeners = m_tokenListeners;
+        for (const auto& listener : listeners) {
+            listener->Call({delta});
+        }
+    }
+#endif
+}
+
+#ifdef HAVE_KTEXTEDITOR
+void DocumentEvents::Attach(KTextEditor::Document* document) {
+    if (m_context) {
+        return;
+    }
+    
+    // The connections (and the references they hold) go away with the
+    // context, which goes away with the document
+    m_context = new QObject(document);
+    std::shared_ptr<DocumentEvents> self = shared_from_this();
+    QObject::connect(document, &KTextEditor::Document::textInserted, m_context,
+        [self](KTextEditor::Document* document, const KTextEditor::Cursor& position, const QString& text) {
+            self->RecordInsert(position.line(), position.column(), reinterpret_cast<const char16_t*>(text.utf16()),
+                               text.length(), EditBatch::Revision(document));
+        });
+    QObject::connect(document, &KTextEditor::Document::textRemoved, m_context,
+        [self](KTextEditor::Document* document, const KTextEditor::Range& range, const QString&) {
+            self->RecordRemove(range.start().line(), range.start().column(), range.end().line(), range.end().column(),
+                               EditBatch::Revision(document));
+        });
+    QObject::connect(document, &KTextEditor::Document::modeChanged, m_context,
+        [self](KTextEditor::Document* document) {
+            if (self->m_recordMode) {
+                self->RecordMode(document->mode().toStdString());
+            }
+        });
+}
+
+void DocumentEvents::Detach() {
+    delete m_context;
+    m_context = nullptr;
+}
+#else
+void DocumentEvents::Attach(FallbackDocument& document) {
+    if (m_attached) {
+        return;
+    }
+    m_attached = true;
+    
+    // The listeners (and the references they hold) go away with the document.
+    // Each edit is told while the text is still as it was, so its positions
+    // are looked up before it moves them; the edit then makes the next revision.
+    std::shared_ptr<DocumentEvents> self = shared_from_this();
+    PieceTable* table = &document.Text();
+    table->SetEditListener([self, table](int64_t offset, int64_t removed, const char16_t* text, size_t length) {
+        if (!self->m_recordText) {
+            return;
+        }
+        
+        int line = 0;
+        int column = 0;
+        table->PositionAt(offset, line, column);
+        if (removed > 0) {
+            int endLine = 0;
+            int endColumn = 0;
+            table->PositionAt(offset + removed, endLine, endColumn);
+            self->RecordRemove(line, column, endLine, endColumn, table->Revision() + 1);
+        }
+        if (length > 0) {
+            // SetText() replaces everything in one edit, which a KTextEditor document reports as two
+            self->RecordInsert(line, column, text, length, table->Revision() + 1);
+        }
+    });
+    document.SetModeObserver([self](const std::string& mode) { self->RecordMode(mode); });
+}
+#endif
+
+void DocumentEvents::AppendEdit(uint32_t op, int startLine, int startColumn, int endLine, int endColumn,
+                                const char16_t* text, size_t length) {
+    m_fields.insert(m_fields.end(), {
+        op,
+        static_cast<uint32_t>(startLine), static_cast<uint32_t>(startColumn),
+        static_cast<uint32_t>(endLine), static_cast<uint32_t>(endColumn),
+        static_cast<uint32_t>(m_text.size()), static_cast<uint32_t>(length)
+    });
+    m_text.append(text, length);
+    m_count++;
+}
+
+void DocumentEvents::RecordInsert(int line, int column, const char16_t* text, size_t length, int64_t revision) {
+    if (!m_recordText || length == 0) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(m_mutex);
+    
+    uint32_t* last = m_count > 0 ? &m_fields[m_fields.size() - EditBatch::FieldsPerEdit] : nullptr;
+    bool continues = last && last[0] == EditBatch::OpInsert
+        && line == m_insertEndLine && column == m_insertEndColumn;
+        
+    if (continues) {
+        // Typing: the pending insert's text is the tail of m_text
+        last[6] += static_cast<uint32_t>(length);
+        m_text.append(text, length);
+    } else {
+        AppendEdit(EditBatch::OpInsert, line, column, line, column, text, length);
+        m_insertEndLine = line;
+        m_insertEndColumn = column;
+    }
+    
+    const char16_t* lastBreak = nullptr;
+    for (const char16_t* c = text; c != text + length; c++) {
+        if (*c == u'\n') {
+            m_insertEndLine++;
+            lastBreak = c;
+        }
+    }
+    if (lastBreak) {
+        m_insertEndColumn = static_cast<int>(text + length - lastBreak - 1);
+    } else {
+        m_insertEndColumn += static_cast<int>(length);
+    }
+    
+    m_revision = revision;
+    ScheduleLocked();
+}
+
+void DocumentEvents::RecordRemove(int startLine, int startColumn, int endLine, int endColumn, int64_t revision) {
+    if (!m_recordText || (startLine == endLine && startColumn == endColumn)) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(m_mutex);
+    
+    uint32_t* last = m_count > 0 ? &m_fields[m_fields.size() - EditBatch::FieldsPerEdit] : nullptr;
+    bool sameLine = last && last[0] == EditBatch::OpRemove && startLine == endLine
+        && last[1] == static_cast<uint32_t>(startLine) && last[3] == static_cast<uint32_t>(startLine);
+        
+    if (sameLine && static_cast<uint32_t>(endColumn) == last[2]) {
+        // Backspace: the new range ends where the pending one starts
+        last[2] = startColumn;
+    } else if (sameLine && static_cast<uint32_t>(startColumn) == last[2]) {
+        // Forward delete: the following text moved into the pending range
+        last[4] += endColumn - startColumn;
+    } else {
+        AppendEdit(EditBatch::OpRemove, startLine, startColumn, endLine, endColumn, nullptr, 0);
+    }
+    
+    m_revision = revision;
+    ScheduleLocked();
+}
+
+void DocumentEvents::RecordMode(std::string mode) {
+    if (!m_recordMode) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_mode = std::move(mode);
+    m_modeChanged = true;
+    ScheduleLocked();
+}
+
+#ifdef HAVE_KTEXTEDITOR
+void DocumentEvents::RecordTokens(SyntaxTokenDelta delta) {
+    if (!m_recordTokens || (delta.lines.empty() && delta.shifts.empty() && !delta.reset)) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(m_mutex);
+    
+    // Tokens of another mode or from before a reset are stale; otherwise
+    // append, so a line listed twice ends up with its later tokens
+    if (!m_tokensChanged || m_tokens.mode != delta.mode || delta.reset) {
+        m_tokens = std::move(delta);
+    } else {
+        // The pending lines are numbered from before the new shifts
+        SyntaxTokenDelta merged;
+        for (size_t i = 0; i < m_tokens.lines.size(); i++) {
+            uint32_t line = m_tokens.lines[i];
+            if (!SyntaxTokens::FollowShifts(delta.shifts, line)) {
+                continue;
+            }
+            merged.lines.push_back(line);
+            merged.offsets.push_back(static_cast<uint32_t>(merged.data.size()));
+            merged.data.insert(merged.data.end(), m_tokens.data.begin() + m_tokens.offsets[i],
+                               m_tokens.data.begin() + m_tokens.offsets[i + 1]);
+        }
+        m_tokens.lines = std::move(merged.lines);
+        m_tokens.offsets = std::move(merged.offsets);
+        m_tokens.data = std::move(merged.data);
+        
+        uint32_t base = static_cast<uint32_t>(m_tokens.data.size());
+        for (uint32_t offset : delta.offsets) {
+            m_tokens.offsets.push_back(base + offset);
+        }
+        m_tokens.shifts.insert(m_tokens.shifts.end(), delta.shifts.begin(), delta.shifts.end());
+        m_tokens.lines.insert(m_tokens.lines.end(), delta.lines.begin(), delta.lines.end());
+        m_tokens.data.insert(m_tokens.data.end(), delta.data.begin(), delta.data.end());
+        m_tokens.revision = delta.revision;
+        m_tokens.lineCount = delta.lineCount;
+        m_tokens.legendVersion = delta.legendVersion;
+        if (delta.hasLegend) {
+            m_tokens.legend = std::move(delta.legend);
+            m_tokens.hasLegend = true;
+        }
+    }
+    m_tokensChanged = true;
+    ScheduleLocked();
+}
+#endif
+
+void DocumentEvents::ScheduleLocked() {
+    if (m_scheduled) {
+        return;
+    }
+    m_scheduled = true;
+    
+    // Everything recorded until the JavaScript thread gets to this task is
+    // delivered with it
+    std::weak_ptr<DocumentEvents> weakSelf = shared_from_this();
+    m_dispatcher->Post([weakSelf](Napi::Env env) {
+        if (std::shared_ptr<DocumentEvents> self = weakSelf.lock()) {
+            self->Deliver(env);
+        }
+    });
+}
+
+} // namespace KateNative
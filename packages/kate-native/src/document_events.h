@@ -0,0 +1,132 @@
+#ifndef DOCUMENT_EVENTS_H
+#define DOCUMENT_EVENTS_H
+
+#include <napi.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_KTEXTEDITOR
+#include "syntax_tokens.h"
+#endif
+
+class QObject;
+
+namespace KTextEditor {
+    class Document;
+    class Cursor;
+    class Range;
+}
+
+namespace KateNative {
+
+class JsDispatcher;
+class FallbackDocument;
+
+/**
+ * Document Change Events
+ *
+ * Records the edits of one document on the Qt thread, or on the
+ * JavaScript thread for a FallbackDocument, and hands them to the
+ * JavaScript listeners once per event loop tick, through the
+ * environment's JsDispatcher. Each 'textChanged' event carries every edit
+ * made since the previous one, packed in the EditBatch layout, so the
+ * buffer can be passed straight to applyEdits() on another document.
+ *
+ * Consecutive typing, backspacing and forward deleting on one line are
+ * merged into a single edit. Nothing is recorded while an event has no
+ * listeners.
+ *
+ * 'tokensChanged' carries the syntax tokens the HighlightScheduler has
+ * produced since the previous event, in the getSyntaxTokensSince() form;
+ * only a KTextEditor document has them.
+ */
+class DocumentEvents : public std::enable_shared_from_this<DocumentEvents> {
+public:
+    explicit DocumentEvents(Napi::Env env);
+    
+    // JavaScript thread only; false for an unknown event name
+    bool AddListener(const std::string& event, Napi::Function callback);
+    bool RemoveListener(const std::string& event, Napi::Value callback);
+    bool HasListeners() const;
+    
+    /**
+     * Drop every listener; must be called on the JavaScript thread before
+     * the owning wrapper goes away, since the Qt side may outlive it
+     */
+    void Clear();
+    
+#ifdef HAVE_KTEXTEDITOR
+    // Connect to the document's signals once; must run on the Qt thread
+    void Attach(KTextEditor::Document* document);
+    
+    // Disconnect again, e.g. before the document is reused; Qt thread only
+    void Detach();
+    
+    // Whether 'tokensChanged' has listeners; any thread
+    bool RecordsTokens() const { return m_recordTokens; }
+    
+    // Queue tokens for the next 'tokensChanged' event; Qt thread only
+    void RecordTokens(SyntaxTokenDelta delta);
+#else
+    // Follow the document's edits and mode from now on; the document must outlive them
+    void Attach(FallbackDocument& document);
+#endif
+
+private:
+    using Listeners = std::vector<std::shared_ptr<Napi::FunctionReference>>;
+    
+    Listeners* ListenersFor(const std::string& event);
+    void Deliver(Napi::Env env);
+    
+    // On the thread that edits the document, before each edit is made
+    void RecordInsert(int line, int column, const char16_t* text, size_t length, int64_t revision);
+    void RecordRemove(int startLine, int startColumn, int endLine, int endColumn, int64_t revision);
+    void RecordMode(std::string mode);
+    void AppendEdit(uint32_t op, int startLine, int startColumn, int endLine, int endColumn,
+                    const char16_t* text, size_t length);
+    void ScheduleLocked();
+    
+    std::shared_ptr<JsDispatcher> m_dispatcher;
+    
+    // JavaScript thread only
+    Listeners m_textListeners;
+    Listeners m_modeListeners;
+    Listeners m_tokenListeners;
+    
+#ifdef HAVE_KTEXTEDITOR
+    // Qt thread only; owns the signal connections
+    QObject* m_context = nullptr;
+#else
+    bool m_attached = false;
+#endif
+    
+    std::atomic<bool> m_recordText{false};
+    std::atomic<bool> m_recordMode{false};
+    std::atomic<bool> m_recordTokens{false};
+    
+    // Pending changes, shared by both threads
+    std::mutex m_mutex;
+    std::vector<uint32_t> m_fields;
+    uint32_t m_count = 0;
+    int64_t m_revision = -1;
+    bool m_modeChanged = false;
+    bool m_scheduled = false;
+    std::u16string m_text;
+    std::string m_mode;
+    
+    // Where the text of the last pending insert ends
+    int m_insertEndLine = 0;
+    int m_insertEndColumn = 0;
+#ifdef HAVE_KTEXTEDITOR
+    SyntaxTokenDelta m_tokens;
+    bool m_tokensChanged = false;
+#endif
+};
+
+} // namespace KateNative
+
+#endif // DOCUMENT_EVENTS_H
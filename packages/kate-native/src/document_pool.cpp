@@ -0,0 +1,149 @@
+#include "document_pool.h"
+
+#ifdef HAVE_KTEXTEDITOR
+#include <KTextEditor/Document>
+#include <KTextEditor/Editor>
+#include <algorithm>
+#include <vector>
+#include "qt_runner.h"
+
+namespace KateNative {
+
+namespace {
+
+struct PoolState {
+    std::vector<KTextEditor::Document*> idle;
+    int capacity = DocumentPool::DefaultCapacity;
+    QStringList pendingModes;
+    bool prefilling = false;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+// Only touched on the Qt thread
+PoolState& State() {
+    static PoolState state;
+    return state;
+}
+
+QString NormalizedMode(const QString& mode) {
+    return mode.isEmpty() ? QStringLiteral("Normal") : mode;
+}
+
+KTextEditor::Document* CreateDocument(const QString& mode) {
+    KTextEditor::Document* document = KTextEditor::Editor::instance()->createDocument(nullptr);
+    if (document->mode() != mode) {
+        document->setMode(mode);
+    }
+    return document;
+}
+
+void PrefillNext() {
+    PoolState& state = State();
+    if (state.pendingModes.isEmpty() || static_cast<int>(state.idle.size()) >= state.capacity) {
+        state.pendingModes.clear();
+        state.prefilling = false;
+        return;
+    }
+    
+    state.idle.push_back(CreateDocument(state.pendingModes.takeFirst()));
+    
+    // One document per event loop iteration, so queued work gets in between
+    if (state.pendingModes.isEmpty() || !QtRunner::Post(PrefillNext)) {
+        state.prefilling = false;
+    }
+}
+
+} // namespace
+
+KTextEditor::Document* DocumentPool::Acquire(const QString& mode) {
+    PoolState& state = State();
+    QString wanted = NormalizedMode(mode);
+    
+    // Best is a document already in the mode, then one nobody prepared for
+    // another mode
+    auto it = std::find_if(state.idle.begin(), state.idle.end(),
+        [&wanted](KTextEditor::Document* document) { return document->mode() == wanted; });
+    if (it == state.idle.end()) {
+        it = std::find_if(state.idle.begin(), state.idle.end(),
+            [](KTextEditor::Document* document) { return document->mode() == NormalizedMode(QString()); });
+    }
+    if (it == state.idle.end() && !state.idle.empty()) {
+        it = state.idle.end() - 1;
+    }
+    
+    if (it == state.idle.end()) {
+        state.misses++;
+        return CreateDocument(wanted);
+    }
+    
+    KTextEditor::Document* document = *it;
+    state.idle.erase(it);
+    state.hits++;
+    if (document->mode() != wanted) {
+        document->setMode(wanted);
+    }
+    return document;
+}
+
+void DocumentPool::Release(KTextEditor::Document* document) {
+    PoolState& state = State();
+    if (static_cast<int>(state.idle.size()) >= state.capacity) {
+        delete document;
+        return;
+    }
+    
+    // Not modified, so closing never asks to save; this also empties the
+    // text, drops the URL and clears the undo history. The mode is kept.
+    document->setModified(false);
+    if (!document->closeUrl()) {
+        delete document;
+        return;
+    }
+    
+    state.idle.push_back(document);
+}
+
+void DocumentPool::Configure(int capacity, const QStringList& modes) {
+    PoolState& state = State();
+    state.capacity = std::max(capacity, 0);
+    
+    while (static_cast<int>(state.idle.size()) > state.capacity) {
+        delete state.idle.back();
+        state.idle.pop_back();
+    }
+    
+    // Only create what the idle documents don't already cover
+    std::vector<bool> covered(state.idle.size(), false);
+    state.pendingModes.clear();
+    for (const QString& mode : modes) {
+        QString wanted = NormalizedMode(mode);
+        bool found = false;
+        for (size_t i = 0; i < state.idle.size() && !found; i++) {
+            if (!covered[i] && state.idle[i]->mode() == wanted) {
+                covered[i] = found = true;
+            }
+        }
+        if (!found) {
+            state.pendingModes.append(wanted);
+        }
+    }
+    
+    if (!state.pendingModes.isEmpty() && !state.prefilling) {
+        state.prefilling = QtRunner::Post(PrefillNext);
+    }
+}
+
+DocumentPoolStatus DocumentPool::Status() {
+    const PoolState& state = State();
+    DocumentPoolStatus status;
+    status.idle = static_cast<int>(state.idle.size());
+    status.capacity = state.capacity;
+    status.hits = state.hits;
+    status.misses = state.misses;
+    return status;
+}
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
@@ -0,0 +1,69 @@
+#ifndef DOCUMENT_POOL_H
+#define DOCUMENT_POOL_H
+
+#ifdef HAVE_KTEXTEDITOR
+#include <QString>
+#include <QStringList>
+#include <cstdint>
+
+namespace KTextEditor {
+    class Document;
+}
+
+namespace KateNative {
+
+struct DocumentPoolStatus {
+    int idle = 0;
+    int capacity = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+/**
+ * Document Pool
+ *
+ * Creating a KTextEditor::Document loads configuration and highlighting
+ * state, which dominates the cost of opening a small file. Released
+ * documents are emptied and kept for the next KateDocument instead of
+ * being deleted, up to the pool capacity. The pool can also be filled
+ * ahead of time with documents already set to the modes that are
+ * expected to be opened most.
+ *
+ * Everything here must run on the Qt thread.
+ */
+class DocumentPool {
+public:
+    static constexpr int DefaultCapacity = 8;
+    
+    /**
+     * Take a document from the pool, preferring one already in `mode`,
+     * or create one when the pool is empty. An empty mode means the
+     * default 'Normal' mode.
+     */
+    static KTextEditor::Document* Acquire(const QString& mode = QString());
+    
+    /**
+     * Empty the document and keep it, or delete it when the pool is full.
+     * Objects attached to the document must have been removed already.
+     */
+    static void Release(KTextEditor::Document* document);
+    
+    /**
+     * Set the capacity, dropping idle documents beyond it, and create one
+     * idle document per entry of `modes` that the pool doesn't hold yet.
+     * Creation is spread over several event loop iterations.
+     */
+    static void Configure(int capacity, const QStringList& modes);
+    
+    static DocumentPoolStatus Status();
+
+private:
+    DocumentPool() = delete;
+    ~DocumentPool() = delete;
+};
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
+
+#endif // DOCUMENT_POOL_H
@@ -0,0 +1,63 @@
+#include "document_snapshot.h"
+
+#ifdef HAVE_KTEXTEDITOR
+#include <KTextEditor/Document>
+#include <QMetaObject>
+
+namespace KateNative {
+
+std::unique_ptr<DocumentSnapshot> DocumentSnapshot::Take(KTextEditor::Document* document,
+                                                         const std::vector<uint64_t>& savedHashes) {
+    std::unique_ptr<DocumentSnapshot> snapshot(new DocumentSnapshot());
+    snapshot->text = qCompress(document->text().toUtf8());
+    snapshot->mode = document->mode();
+    snapshot->highlightingMode = document->highlightingMode();
+    snapshot->encoding = document->encoding();
+    snapshot->url = document->url();
+    snapshot->modified = document->isModified();
+    
+    // An unmodified document is its saved version
+    if (snapshot->modified) {
+        snapshot->savedHashes = savedHashes;
+    }
+    return snapshot;
+}
+
+void DocumentSnapshot::Restore(KTextEditor::Document* document) const {
+    QString content = QString::fromUtf8(qUncompress(text));
+    
+    if (!encoding.isEmpty()) {
+        document->setEncoding(encoding);
+    }
+    
+    // Only a local file can be reopened without waiting for a job
+    bool loaded = false;
+    if (url.isLocalFile() && document->openUrl(url)) {
+        loaded = document->text() == content;
+    }
+    if (!loaded) {
+        document->setText(content);
+    }
+    
+    if (document->mode() != mode) {
+        document->setMode(mode);
+    }
+    if (document->highlightingMode() != highlightingMode) {
+        document->setHighlightingMode(highlightingMode);
+    }
+    document->setModified(modified);
+    
+    // The restore must not be an undo step. KatePart's document has these as
+    // slots the KTextEditor interface doesn't declare; elsewhere they are no-ops.
+    QMetaObject::invokeMethod(document, "clearUndo");
+    QMetaObject::invokeMethod(document, "clearRedo");
+}
+
+size_t DocumentSnapshot::MemoryBytes() const {
+    return sizeof(DocumentSnapshot) + static_cast<size_t>(text.size())
+        + savedHashes.size() * sizeof(uint64_t);
+}
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
@@ -0,0 +1,61 @@
+#ifndef DOCUMENT_SNAPSHOT_H
+#define DOCUMENT_SNAPSHOT_H
+
+#ifdef HAVE_KTEXTEDITOR
+#include <QByteArray>
+#include <QString>
+#include <QUrl>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace KTextEditor {
+    class Document;
+}
+
+namespace KateNative {
+
+/**
+ * Hibernated Document
+ *
+ * What it takes to bring a document back after its KTextEditor::Document
+ * was released: the text, zlib compressed as UTF-8, the mode, highlighting
+ * mode, encoding, URL and modified flag, and the line hashes of the saved
+ * version, so getDirtyLines() still diffs against what is on disk.
+ *
+ * Undo history and highlighting state are not kept. Highlighting is
+ * redone on demand; the undo history starts over at the restored text.
+ */
+struct DocumentSnapshot {
+    QByteArray text;
+    QString mode;
+    QString highlightingMode;
+    QString encoding;
+    QUrl url;
+    bool modified = false;
+    std::vector<uint64_t> savedHashes;
+    
+    // Restored token caches count on from here, so getSyntaxTokensSince()
+    // callers still get every line
+    uint64_t tokenRevision = 0;
+    
+    // Qt thread only
+    static std::unique_ptr<DocumentSnapshot> Take(KTextEditor::Document* document,
+                                                  const std::vector<uint64_t>& savedHashes);
+                                                
+    /**
+     * Put the content back into an empty document; Qt thread only
+     * A document with a URL is reopened from it, so it keeps the URL, and
+     * gets the snapshot's text on top when the file has changed since.
+     */
+    void Restore(KTextEditor::Document* document) const;
+    
+    size_t MemoryBytes() const;
+};
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
+
+#endif // DOCUMENT_SNAPSHOT_H
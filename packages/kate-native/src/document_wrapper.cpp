@@ -1,36 +1,474 @@
 #include "document_wrapper.h"
-#include "qt_runner.h"
+#include "addon_data.h"
+#include "js_convert.h"
+#include "js_dispatcher.h"
+#include "syntax_tokens.h"
+#include "folding_index.h"
+#include "line_index.h"
+#include "line_hashes.h"
+#include "column_map.h"
+#include "column_table.h"
+#include "document_anchors.h"
+#include "line_diff.h"
+#include "search_pattern.h"
+#include "background_search.h"
+#include "edit_batch.h"
+#include "edit_journal.h"
+#include "file_writer.h"
+#include "document_events.h"
+#include "document_pool.h"
+#include "document_snapshot.h"
+#include "fallback_document.h"
+#include "hibernation.h"
+#include "highlight_scheduler.h"
+#include "line_metadata.h"
+#include "mapped_file.h"
+#include "mode_catalog.h"
+#include "stats.h"
 
 #ifdef HAVE_KTEXTEDITOR
+#include "qt_runner.h"
+#include "qt_task.h"
+#include <KTextEditor/ConfigInterface>
 #include <KTextEditor/Document>
 #include <KTextEditor/Editor>
 #include <KTextEditor/Range>
 #include <KTextEditor/Cursor>
+#include <QFileInfo>
 #include <QString>
+#include <QTextCodec>
 #include <QUrl>
 #include <QRegularExpression>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#else
+#include "worker_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <cwctype>
+#include <filesystem>
+#include <fstream>
+#include <vector>
 #endif
 
 namespace KateNative {
 
 #ifdef HAVE_KTEXTEDITOR
-KTextEditor::Editor* DocumentWrapper::s_editor = nullptr;
+namespace {
+
+Napi::Value SyntaxTokensToJs(Napi::Env env, const std::vector<SyntaxTokenData>& data) {
+    Napi::Array tokens = Napi::Array::New(env, data.size());
+    Stats::Add(Stats::ObjectsCreated, data.size() + 1);
+    
+    for (size_t i = 0; i < data.size(); ++i) {
+        Napi::Object token = Napi::Object::New(env);
+        token.Set("line", Napi::Number::New(env, data[i].line));
+        token.Set("startColumn", Napi::Number::New(env, data[i].startColumn));
+        token.Set("endColumn", Napi::Number::New(env, data[i].endColumn));
+        token.Set("tokenType", Napi::String::New(env, data[i].tokenType.toStdString()));
+        tokens[i] = token;
+    }
+    
+    return tokens;
+}
+
+Napi::Value PackedSyntaxTokensToJs(Napi::Env env, const PackedSyntaxTokens& packed) {
+    Napi::Object result = Napi::Object::New(env);
+    
+    result.Set("data", Uint32ArrayToJs(env, packed.data));
+    result.Set("mode", Napi::String::New(env, packed.mode.toStdString()));
+    result.Set("legendVersion", Napi::Number::New(env, packed.legendVersion));
+    
+    // Only present when the caller holds another legend
+    if (packed.hasLegend) {
+        result.Set("legend", StringListToJs(env, packed.legend));
+    }
+    
+    return result;
+}
+
+// Optional legend version the caller holds at info[index]; 0 for none
+uint32_t LegendVersionFromJs(const Napi::CallbackInfo& info, size_t index) {
+    if (info.Length() <= index || !info[index].IsNumber()) {
+        return 0;
+    }
+    return info[index].As<Napi::Number>().Uint32Value();
+}
+
+Napi::Value FoldingRegionsToJs(Napi::Env env, const std::vector<FoldingRegionData>& data) {
+    Napi::Array regions = Napi::Array::New(env, data.size());
+    Stats::Add(Stats::ObjectsCreated, data.size() + 1);
+    QStringList kinds = FoldingIndex::Kinds();
+    
+    for (size_t i = 0; i < data.size(); ++i) {
+        Napi::Object region = Napi::Object::New(env);
+        region.Set("startLine", Napi::Number::New(env, data[i].startLine));
+        region.Set("endLine", Napi::Number::New(env, data[i].endLine));
+        region.Set("kind", Napi::String::New(env, kinds.value(static_cast<int>(data[i].kind)).toStdString()));
+        regions[i] = region;
+    }
+    
+    return regions;
+}
+
+Napi::Value PackedFoldingRegionsToJs(Napi::Env env, const std::vector<uint32_t>& data) {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("data", Uint32ArrayToJs(env, data));
+    result.Set("kinds", StringListToJs(env, FoldingIndex::Kinds()));
+    return result;
+}
+
+// Must run on the Qt thread; KatePart's default when the document has no config interface
+QVariant ConfigValue(KTextEditor::Document* document, const QString& key, const QVariant& fallback) {
+    auto* config = qobject_cast<KTextEditor::ConfigInterface*>(document);
+    QVariant value = config ? config->configValue(key) : QVariant();
+    return value.isValid() ? value : fallback;
+}
+
+int TabWidth(KTextEditor::Document* document) {
+    return ConfigValue(document, QStringLiteral("tab-width"), 4).toInt();
+}
+
+const char16_t* LineData(const QString& text) {
+    return reinterpret_cast<const char16_t*>(text.utf16());
+}
+
+// Must run on the Qt thread
+std::vector<SearchMatch> CollectSearchMatches(KTextEditor::Document* document,
+                                              const QString& searchText,
+                                              const SearchOptions& options) {
+    std::vector<SearchMatch> matches;
+    
+    // Compiled once for the whole document
+    SearchPattern pattern(searchText, options);
+    if (pattern.IsEmpty() || !pattern.IsValid()) {
+        return matches;
+    }
+    
+    int lineCount = document->lines();
+    
+    for (int line = 0; line < lineCount; line++) {
+        QString lineText = document->line(line);
+        
+        pattern.ForEachMatch(lineText, [&](int column, int length) {
+            matches.push_back({line, column, length, lineText.mid(column, length)});
+            return true;
+        });
+    }
+    
+    return matches;
+}
+
+// Must run on the Qt thread
+int ReplaceMatches(KTextEditor::Document* document,
+                   const SearchPattern& pattern,
+                   const QString& replacement) {
+    struct Replacement {
+        KTextEditor::Range range;
+        QString text;
+    };
+    std::vector<Replacement> replacements;
+    
+    int lineCount = document->lines();
+    for (int line = 0; line < lineCount; line++) {
+        QString lineText = document->line(line);
+        
+        pattern.ForEachMatch(lineText, [&](int column, int length) {
+            replacements.push_back({KTextEditor::Range(line, column, line, column + length),
+                                    pattern.Substitute(lineText, column, replacement)});
+            return true;
+        });
+    }
+    
+    if (replacements.empty()) {
+        return 0;
+    }
+    
+    // One undo step, and highlighting is only updated once at the end
+    KTextEditor::Document::EditingTransaction transaction(document);
+    
+    int replacedCount = 0;
+    
+    // Replace from end to start to maintain positions
+    for (auto it = replacements.rbegin(); it != replacements.rend(); ++it) {
+        if (document->replaceText(it->range, it->text)) {
+            replacedCount++;
+        }
+    }
+    
+    return replacedCount;
+}
+
+// A saveAsync() or flushJournalAsync() call on its way from the JavaScript
+// thread through the Qt and writer threads and back
+struct AsyncWrite {
+    AsyncWrite(Napi::Promise::Deferred deferred, std::shared_ptr<JsDispatcher> dispatcher)
+        : deferred(deferred), dispatcher(std::move(dispatcher)) {}
+    
+    Napi::Promise::Deferred deferred;
+    std::shared_ptr<JsDispatcher> dispatcher;
+    
+    // Keeps the wrapper, and with it the document's Qt objects, alive
+    Napi::ObjectReference wrapper;
+    std::shared_ptr<KTextEditor::Document> document;
+    
+    // Saves: the target, the text as taken on the Qt thread and how to write it
+    std::string path;
+    QString lineEnding;
+    QString text;
+    QByteArray encoding;
+    int64_t revision = -1;
+    bool ownFile = false;
+    std::shared_ptr<EditJournal> journal;
+    
+    // Flushes resolve with the number of edits written
+    bool resolveEdits = false;
+    uint32_t edits = 0;
+    
+    bool success = false;
+    std::string error;
+};
+
+// Settle on the JavaScript thread; may be called from any thread
+void FinishWrite(AsyncWrite* write) {
+    write->dispatcher->Post([write](Napi::Env env) {
+        if (write->success) {
+            // Unmodified unless it was edited while the write was under way
+            if (write->ownFile) {
+                QtRunner::Post([document = write->document, revision = write->revision]() {
+                    if (EditBatch::Revision(document.get()) == revision) {
+                        document->setModified(false);
+                    }
+                });
+            }
+            write->deferred.Resolve(write->resolveEdits ? Napi::Number::New(env, write->edits) : env.Undefined());
+        } else {
+            write->deferred.Reject(Napi::Error::New(env, write->error).Value());
+        }
+        
+        std::shared_ptr<JsDispatcher> dispatcher = write->dispatcher;
+        write->wrapper.Reset();
+        delete write;
+        dispatcher->Unref();
+    });
+}
+
+// The line break of a file being replaced: "\r\n" when its first one is, "\n" otherwise
+QString LineEndingOf(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    char buffer[4096];
+    file.read(buffer, sizeof(buffer));
+    std::streamsize length = file.gcount();
+    for (std::streamsize i = 1; i < length; i++) {
+        if (buffer[i] == '\n') {
+            // UTF-16 puts a zero byte between the two
+            bool crlf = buffer[i - 1] == '\r' || (i > 1 && buffer[i - 1] == '\0' && buffer[i - 2] == '\r');
+            return crlf ? QStringLiteral("\r\n") : QStringLiteral("\n");
+        }
+    }
+    return QStringLiteral("\n");
+}
+
+// Writer thread: the text in the document's encoding, with its line breaks
+bool EncodeForSave(AsyncWrite* write, std::string& bytes, std::string& error) {
+    QString lineEnding = write->lineEnding.isEmpty() ? LineEndingOf(write->path) : write->lineEnding;
+    if (lineEnding != QLatin1String("\n")) {
+        write->text.replace(QLatin1Char('\n'), lineEnding);
+    }
+    
+    QTextCodec* codec = QTextCodec::codecForName(write->encoding);
+    if (!codec) {
+        QByteArray utf8 = write->text.toUtf8();
+        bytes.assign(utf8.constData(), utf8.size());
+        return true;
+    }
+    
+    QTextCodec::ConverterState state;
+    QByteArray encoded = codec->fromUnicode(write->text.constData(), write->text.length(), &state);
+    if (state.invalidChars > 0) {
+        error = "The text can't be saved as " + write->encoding.toStdString();
+        return false;
+    }
+    bytes.assign(encoded.constData(), encoded.size());
+    return true;
+}
+
+} // namespace
+#else
+namespace {
+
+std::vector<TextMatch> CollectTextMatches(const PieceTable& text, const TextPattern& pattern) {
+    std::vector<TextMatch> matches;
+    if (pattern.IsEmpty() || !pattern.IsValid()) {
+        return matches;
+    }
+    
+    int lineCount = text.Lines();
+    for (int line = 0; line < lineCount; line++) {
+        std::u16string lineText = text.Line(line);
+        pattern.ForEachMatch(lineText, [&](int column, int length) {
+            matches.push_back({line, column, length, lineText.substr(column, length)});
+            return true;
+        });
+    }
+    
+    return matches;
+}
+
+// As ReplaceMatches(), in one undo step
+int ReplaceTextMatches(PieceTable& text, const TextPattern& pattern, const std::u16string& replacement) {
+    struct Replacement {
+        int line;
+        int column;
+        int length;
+        std::u16string text;
+    };
+    std::vector<Replacement> replacements;
+    
+    int lineCount = text.Lines();
+    for (int line = 0; line < lineCount; line++) {
+        pattern.ForEachReplacement(text.Line(line), replacement,
+            [&](int column, int length, std::u16string substituted) {
+                replacements.push_back({line, column, length, std::move(substituted)});
+                return true;
+            });
+    }
+    
+    int replacedCount = 0;
+    text.BeginStep();
+    
+    // Replace from end to start to maintain positions
+    for (auto it = replacements.rbegin(); it != replacements.rend(); ++it) {
+        if (text.Replace(it->line, it->column, it->line, it->column + it->length, it->text.data(), it->text.size())) {
+            replacedCount++;
+        }
+    }
+    
+    text.EndStep();
+    return replacedCount;
+}
+
+// Without Qt the write settles here, on the JavaScript thread
+struct AsyncWrite {
+    AsyncWrite(Napi::Promise::Deferred deferred, std::shared_ptr<JsDispatcher> dispatcher)
+        : deferred(deferred), dispatcher(std::move(dispatcher)) {}
+    
+    Napi::Promise::Deferred deferred;
+    std::shared_ptr<JsDispatcher> dispatcher;
+    
+    // Keeps the wrapper, and with it the document, alive
+    Napi::ObjectReference wrapper;
+    std::shared_ptr<FallbackDocument> document;
+    
+    std::string path;
+    std::u16string text;
+    FallbackDocument::Encoding encoding = FallbackDocument::Encoding::Utf8;
+    std::string lineEnding;
+    int64_t revision = -1;
+    bool ownFile = false;
+    
+    bool success = false;
+    std::string error;
+};
+
+// May be called from any thread
+void FinishWrite(AsyncWrite* write) {
+    write->dispatcher->Post([write](Napi::Env env) {
+        if (write->success) {
+            // Unmodified unless it was edited while the write was under way
+            if (write->ownFile && write->document->Text().Revision() == write->revision) {
+                write->document->MarkSaved();
+            }
+            write->deferred.Resolve(env.Undefined());
+        } else {
+            write->deferred.Reject(Napi::Error::New(env, write->error).Value());
+        }
+        
+        std::shared_ptr<JsDispatcher> dispatcher = write->dispatcher;
+        write->wrapper.Reset();
+        delete write;
+        dispatcher->Unref();
+    });
+}
+
+} // namespace
 #endif
 
+namespace {
+
+// The names LSP gives its position encodings
+bool EncodingFromJs(Napi::Value value, ColumnEncoding& encoding) {
+    std::string name = value.IsString() ? value.As<Napi::String>().Utf8Value() : std::string();
+    if (name == "utf-8") {
+        encoding = ColumnEncoding::Utf8;
+    } else if (name == "utf-16") {
+        encoding = ColumnEncoding::Utf16;
+    } else if (name == "utf-32") {
+        encoding = ColumnEncoding::Utf32;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// { lineStart, lineCount, tabWidth } and an Int32Array per requested field
+Napi::Value LineMetadataToJs(Napi::Env env, const LineMetadata& metadata, int lineStart, int lineCount) {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("lineStart", Napi::Number::New(env, lineStart));
+    result.Set("lineCount", Napi::Number::New(env, lineCount));
+    result.Set("tabWidth", Napi::Number::New(env, metadata.TabWidth()));
+    
+    if (metadata.Fields() & LineMetadata::Indent) {
+        result.Set("indent", Int32ArrayToJs(env, metadata.Indents()));
+    }
+    if (metadata.Fields() & LineMetadata::Length) {
+        result.Set("length", Int32ArrayToJs(env, metadata.Lengths()));
+    }
+    if (metadata.Fields() & LineMetadata::FirstNonWhitespace) {
+        result.Set("firstNonWhitespace", Int32ArrayToJs(env, metadata.FirstNonWhitespaces()));
+    }
+    if (metadata.Fields() & LineMetadata::Hash) {
+        result.Set("hash", Int32ArrayToJs(env, metadata.Hashes()));
+    }
+    
+    return result;
+}
+
+} // namespace
+
 Napi::Object DocumentWrapper::Init(Napi::Env env, Napi::Object exports) {
     Napi::Function func = DefineClass(env, "KateDocument", {
         // Document operations
         InstanceMethod("getText", &DocumentWrapper::GetText),
+        InstanceMethod("getTextAsync", &DocumentWrapper::GetTextAsync),
+        InstanceMethod("getTextBuffer", &DocumentWrapper::GetTextBuffer),
+        InstanceMethod("getTextBufferAsync", &DocumentWrapper::GetTextBufferAsync),
         InstanceMethod("setText", &DocumentWrapper::SetText),
         InstanceMethod("line", &DocumentWrapper::GetLine),
+        InstanceMethod("lines", &DocumentWrapper::GetLines),
         InstanceMethod("insertText", &DocumentWrapper::InsertText),
         InstanceMethod("removeText", &DocumentWrapper::RemoveText),
+        InstanceMethod("applyEdits", &DocumentWrapper::ApplyEdits),
         
         // Properties
         InstanceMethod("lineCount", &DocumentWrapper::GetLineCount),
         InstanceMethod("length", &DocumentWrapper::GetLength),
         InstanceMethod("isModified", &DocumentWrapper::IsModified),
         
+        // Offset <-> position conversion
+        InstanceMethod("offsetAt", &DocumentWrapper::OffsetAt),
+        InstanceMethod("positionAt", &DocumentWrapper::PositionAt),
+        InstanceMethod("offsetsAt", &DocumentWrapper::OffsetsAt),
+        InstanceMethod("positionsAt", &DocumentWrapper::PositionsAt),
+        InstanceMethod("convertPositions", &DocumentWrapper::ConvertPositions),
+        
+        // Moving range anchors
+        InstanceMethod("createAnchors", &DocumentWrapper::CreateAnchors),
+        InstanceMethod("getAnchors", &DocumentWrapper::GetAnchors),
+        InstanceMethod("releaseAnchors", &DocumentWrapper::ReleaseAnchors),
+        
         // Syntax highlighting
         InstanceMethod("mode", &DocumentWrapper::GetMode),
         InstanceMethod("setMode", &DocumentWrapper::SetMode),
@@ -38,30 +476,60 @@ Napi::Object DocumentWrapper::Init(Napi::Env env, Napi::Object exports) {
         
         // File operations
         InstanceMethod("openUrl", &DocumentWrapper::OpenUrl),
+        InstanceMethod("openUrlAsync", &DocumentWrapper::OpenUrlAsync),
         InstanceMethod("saveUrl", &DocumentWrapper::SaveUrl),
+        InstanceMethod("saveAsync", &DocumentWrapper::SaveAsync),
         InstanceMethod("url", &DocumentWrapper::GetUrl),
         
+        // Edit journal
+        InstanceMethod("setJournal", &DocumentWrapper::SetJournal),
+        InstanceMethod("flushJournalAsync", &DocumentWrapper::FlushJournalAsync),
+        InstanceMethod("recoverJournal", &DocumentWrapper::RecoverJournal),
+        
         // Undo/Redo
         InstanceMethod("undo", &DocumentWrapper::Undo),
         InstanceMethod("redo", &DocumentWrapper::Redo),
         
         // Phase 7: Advanced features
         InstanceMethod("getSyntaxTokens", &DocumentWrapper::GetSyntaxTokens),
+        InstanceMethod("getSyntaxTokensAsync", &DocumentWrapper::GetSyntaxTokensAsync),
+        InstanceMethod("getSyntaxTokensPacked", &DocumentWrapper::GetSyntaxTokensPacked),
+        InstanceMethod("getSyntaxTokensPackedAsync", &DocumentWrapper::GetSyntaxTokensPackedAsync),
+        InstanceMethod("getSyntaxTokensSince", &DocumentWrapper::GetSyntaxTokensSince),
+        InstanceMethod("getSyntaxLegend", &DocumentWrapper::GetSyntaxLegend),
         InstanceMethod("getFoldingRegions", &DocumentWrapper::GetFoldingRegions),
+        InstanceMethod("getFoldingRegionsAsync", &DocumentWrapper::GetFoldingRegionsAsync),
+        InstanceMethod("getFoldingRegionsPacked", &DocumentWrapper::GetFoldingRegionsPacked),
+        InstanceMethod("setViewport", &DocumentWrapper::SetViewport),
+        InstanceMethod("clearViewport", &DocumentWrapper::ClearViewport),
         
         // Phase 8: Advanced editing features
         InstanceMethod("search", &DocumentWrapper::Search),
+        InstanceMethod("searchAsync", &DocumentWrapper::SearchAsync),
         InstanceMethod("replace", &DocumentWrapper::Replace),
         InstanceMethod("replaceAll", &DocumentWrapper::ReplaceAll),
+        InstanceMethod("replaceAllAsync", &DocumentWrapper::ReplaceAllAsync),
         InstanceMethod("getIndentation", &DocumentWrapper::GetIndentation),
         InstanceMethod("setIndentation", &DocumentWrapper::SetIndentation),
         InstanceMethod("indentLine", &DocumentWrapper::IndentLine),
         InstanceMethod("indentLines", &DocumentWrapper::IndentLines),
+        InstanceMethod("getLineMetadata", &DocumentWrapper::GetLineMetadata),
+        InstanceMethod("detectIndentation", &DocumentWrapper::DetectIndentation),
+        
+        // Line diffs
+        InstanceMethod("diff", &DocumentWrapper::Diff),
+        InstanceMethod("getDirtyLines", &DocumentWrapper::GetDirtyLines),
+        
+        // Events
+        InstanceMethod("on", &DocumentWrapper::On),
+        InstanceMethod("off", &DocumentWrapper::Off),
+        
+        // Hibernation
+        InstanceMethod("hibernate", &DocumentWrapper::Hibernate),
+        InstanceMethod("isHibernated", &DocumentWrapper::IsHibernated),
     });
     
-    Napi::FunctionReference* constructor = new Napi::FunctionReference();
-    *constructor = Napi::Persistent(func);
-    env.SetInstanceData(constructor);
+    AddonData::Get(env)->documentConstructor = Napi::Persistent(func);
     
     exports.Set("KateDocument", func);
     return exports;
@@ -69,7 +537,7 @@ Napi::Object DocumentWrapper::Init(Napi::Env env, Napi::Object exports) {
 
 Napi::Object DocumentWrapper::NewInstance(Napi::Env env) {
     Napi::EscapableHandleScope scope(env);
-    Napi::Object obj = env.GetInstanceData<Napi::FunctionReference>()->New({});
+    Napi::Object obj = AddonData::Get(env)->documentConstructor.New({});
     return scope.Escape(napi_value(obj)).ToObject();
 }
 
@@ -82,63 +550,309 @@ DocumentWrapper::DocumentWrapper(const Napi::CallbackInfo& info)
         QtRunner::Initialize();
     }
     
-    // Initialize editor singleton if needed
-    if (!s_editor) {
-        s_editor = KTextEditor::Editor::instance();
+    // Optional { mode } lets the pool hand out a document already in that mode
+    QString mode;
+    if (info.Length() > 0 && info[0].IsObject()) {
+        Napi::Value modeValue = info[0].As<Napi::Object>().Get("mode");
+        if (modeValue.IsString()) {
+            mode = QString::fromStdString(modeValue.As<Napi::String>().Utf8Value());
+        } else if (modeValue.IsNumber()) {
+            mode = QString::fromStdString(ModeCatalog::NameOf(modeValue.As<Napi::Number>().Int32Value()));
+        }
     }
     
-    // Create document
-    m_document = std::shared_ptr<KTextEditor::Document>(
-        s_editor->createDocument(nullptr)
-    );
+    Adopt(mode, nullptr);
+    Hibernation::Register(this);
+    
+    // A catalog loaded from its cache file is checked against the real one once Qt is busy anyway
+    ModeCatalog::RefreshInBackground();
 #else
-    // Fallback when KTextEditor is not available
-    Napi::TypeError::New(info.Env(), 
-        "KTextEditor library not available. Native bindings require Qt5/KF5.")
-        .ThrowAsJavaScriptException();
+    // Without KTextEditor the text lives in a piece table on this thread
+    m_fallback = std::make_shared<FallbackDocument>();
+    if (info.Length() > 0 && info[0].IsObject()) {
+        Napi::Value modeValue = info[0].As<Napi::Object>().Get("mode");
+        std::string mode;
+        if (modeValue.IsString()) {
+            mode = modeValue.As<Napi::String>().Utf8Value();
+        } else if (modeValue.IsNumber()) {
+            mode = ModeCatalog::NameOf(modeValue.As<Napi::Number>().Int32Value());
+        }
+        if (!mode.empty()) {
+            m_fallback->SetMode(std::move(mode));
+        }
+    }
+#endif
+}
+
+void DocumentWrapper::Adopt(const QString& mode, const DocumentSnapshot* snapshot) {
+#ifdef HAVE_KTEXTEDITOR
+    // Create the document on the Qt thread so it gets the right thread affinity
+    KTextEditor::Document* document = nullptr;
+    QtRunner::RunSync([this, &document, &mode, snapshot]() {
+        document = DocumentPool::Acquire(mode);
+        
+        // Restored before the indexes exist, so they start from the final text
+        if (snapshot) {
+            snapshot->Restore(document);
+        }
+        
+        m_tokenCache = new SyntaxTokenCache(document);
+        m_foldingIndex = new FoldingIndex(document);
+        m_lineIndex = new LineIndex(document);
+        m_lineHashes = new LineHashes(document);
+        m_columnMap = new ColumnMap(document);
+        m_scheduler = new HighlightScheduler(document, m_tokenCache);
+        if (snapshot) {
+            m_tokenCache->ContinueFrom(snapshot->tokenRevision);
+            if (snapshot->modified) {
+                m_lineHashes->SetSavedHashes(snapshot->savedHashes);
+            }
+        }
+    });
+    
+    // Pending async tasks hold their own reference, so the last owner may be
+    // either thread; the document always goes back to the pool on the Qt thread
+    m_document = std::shared_ptr<KTextEditor::Document>(document, [](KTextEditor::Document* doc) {
+        if (QtRunner::IsQtThread()) {
+            DocumentPool::Release(doc);
+        } else {
+            QtRunner::Post([doc]() { DocumentPool::Release(doc); });
+        }
+    });
 #endif
 }
 
 DocumentWrapper::~DocumentWrapper() {
+#ifdef HAVE_KTEXTEDITOR
+    Hibernation::Unregister(this);
+#endif
+    
+    // The Qt side may still hold the events; the listeners must go now
+    if (m_events) {
+        m_events->Clear();
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    // Take this wrapper's objects off the document so a pooled document comes
+    // back clean. Queued behind any task this wrapper already posted; the
+    // task's reference keeps the document until then.
+    if (m_document) {
+        QtRunner::Post([document = m_document, tokenCache = m_tokenCache, foldingIndex = m_foldingIndex,
+                        lineIndex = m_lineIndex, lineHashes = m_lineHashes, columnMap = m_columnMap,
+                        scheduler = m_scheduler, anchors = m_anchors, journal = m_journal, events = m_events]() {
+            delete journal;
+            delete anchors;
+            delete scheduler;
+            delete tokenCache;
+            delete foldingIndex;
+            delete lineIndex;
+            delete lineHashes;
+            delete columnMap;
+            if (events) {
+                events->Detach();
+            }
+        });
+    }
+#endif
+    
+    m_document.reset();
+}
+
+std::shared_ptr<KTextEditor::Document> DocumentWrapper::Document() {
+    Awake();
+    return m_document;
+}
+
+bool DocumentWrapper::Awake() {
+#ifdef HAVE_KTEXTEDITOR
+    bool woke = false;
+    if (m_snapshot) {
+        std::shared_ptr<DocumentSnapshot> snapshot = std::move(m_snapshot);
+        Adopt(snapshot->mode, snapshot.get());
+        woke = true;
+    }
+    Hibernation::Touch(this, woke);
+    return m_document != nullptr;
+#else
+    return m_fallback != nullptr;
+#endif
+}
+
+bool DocumentWrapper::TryHibernate() {
+#ifdef HAVE_KTEXTEDITOR
+    // Anyone else holding the document (a search session, an index, a
+    // pending async call) is using it, and so is a journal
+    if (!m_document || m_document.use_count() > 1 || (m_events && m_events->HasListeners()) || m_journal) {
+        return false;
+    }
+    
+    std::shared_ptr<DocumentSnapshot> snapshot;
+    QtRunner::RunSync([&]() {
+        if (m_scheduler->HasViewports() || (m_anchors && !m_anchors->IsEmpty())) {
+            return;
+        }
+        snapshot = DocumentSnapshot::Take(m_document.get(), m_lineHashes->SavedHashes());
+        snapshot->tokenRevision = m_tokenCache->Revision();
+        
+        // Same as the destructor: a pooled document must come back clean
+        delete m_anchors;
+        delete m_scheduler;
+        delete m_tokenCache;
+        delete m_foldingIndex;
+        delete m_lineIndex;
+        delete m_lineHashes;
+        delete m_columnMap;
+        if (m_events) {
+            m_events->Detach();
+        }
+    });
+    if (!snapshot) {
+        return false;
+    }
+    
+    m_anchors = nullptr;
+    m_scheduler = nullptr;
+    m_tokenCache = nullptr;
+    m_foldingIndex = nullptr;
+    m_lineIndex = nullptr;
+    m_lineHashes = nullptr;
+    m_columnMap = nullptr;
+    m_snapshot = std::move(snapshot);
     m_document.reset();
+    return true;
+#else
+    return false;
+#endif
+}
+
+size_t DocumentWrapper::SnapshotBytes() const {
+#ifdef HAVE_KTEXTEDITOR
+    return m_snapshot ? m_snapshot->MemoryBytes() : 0;
+#else
+    return 0;
+#endif
 }
 
 Napi::Value DocumentWrapper::GetText(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.getText");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
 #ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
+    QString text;
+    QtRunner::RunSync([&]() { text = m_document->text(); });
+    return QStringToJs(env, text);
+#else
+    return Utf16ToJs(env, m_fallback->Text().Text());
+#endif
+}
+
+Napi::Value DocumentWrapper::GetTextAsync(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.getTextAsync");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    std::shared_ptr<KTextEditor::Document> document = m_document;
+    return QtTask::Run<QString>(env,
+        [document]() { return document->text(); },
+        [](Napi::Env env, QString& text) -> Napi::Value {
+            return QStringToJs(env, text);
+        });
+#else
+    // The text is on this thread already
+    auto deferred = Napi::Promise::Deferred::New(env);
+    deferred.Resolve(Utf16ToJs(env, m_fallback->Text().Text()));
+    return deferred.Promise();
+#endif
+}
+
+Napi::Value DocumentWrapper::GetTextBuffer(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.getTextBuffer");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    QString text;
+    QtRunner::RunSync([&]() { text = m_document->text(); });
+    return QStringToBuffer(env, text);
+#else
+    return Utf16ToBuffer(env, m_fallback->Text().Text());
+#endif
+}
+
+Napi::Value DocumentWrapper::GetTextBufferAsync(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.getTextBufferAsync");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    if (!Awake()) {
         Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
         return env.Null();
     }
     
-    QString text = m_document->text();
-    return Napi::String::New(env, text.toStdString());
+#ifdef HAVE_KTEXTEDITOR
+    std::shared_ptr<KTextEditor::Document> document = m_document;
+    return QtTask::Run<QString>(env,
+        [document]() { return document->text(); },
+        [](Napi::Env env, QString& text) -> Napi::Value {
+            return QStringToBuffer(env, text);
+        });
 #else
-    return Napi::String::New(env, "");
+    auto deferred = Napi::Promise::Deferred::New(env);
+    deferred.Resolve(Utf16ToBuffer(env, m_fallback->Text().Text()));
+    return deferred.Promise();
 #endif
 }
 
 void DocumentWrapper::SetText(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.setText");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
-    if (info.Length() < 1 || !info[0].IsString()) {
-        Napi::TypeError::New(env, "String expected").ThrowAsJavaScriptException();
+    if (info.Length() < 1 || !IsText(info[0])) {
+        Napi::TypeError::New(env, "String or UTF-16 buffer expected").ThrowAsJavaScriptException();
         return;
     }
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
+    if (!Awake()) {
         Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
         return;
     }
     
-    std::string text = info[0].As<Napi::String>().Utf8Value();
-    m_document->setText(QString::fromStdString(text));
+#ifdef HAVE_KTEXTEDITOR
+    QString text = TextFromJs(info[0]);
+    QtRunner::RunSync([&]() { m_document->setText(text); });
+#else
+    std::u16string text = Utf16FromJs(info[0]);
+    m_fallback->Text().SetText(text.data(), text.size());
 #endif
 }
 
 Napi::Value DocumentWrapper::GetLine(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.line");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
     if (info.Length() < 1 || !info[0].IsNumber()) {
@@ -146,21 +860,66 @@ Napi::Value DocumentWrapper::GetLine(const Napi::CallbackInfo& info) {
         return env.Null();
     }
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
+    if (!Awake()) {
         Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
         return env.Null();
     }
     
+#ifdef HAVE_KTEXTEDITOR
     int lineNum = info[0].As<Napi::Number>().Int32Value();
-    QString line = m_document->line(lineNum);
-    return Napi::String::New(env, line.toStdString());
+    QString line;
+    QtRunner::RunSync([&]() { line = m_document->line(lineNum); });
+    return QStringToJs(env, line);
+#else
+    return Utf16ToJs(env, m_fallback->Text().Line(info[0].As<Napi::Number>().Int32Value()));
+#endif
+}
+
+Napi::Value DocumentWrapper::GetLines(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.lines");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    // Parameters: lineStart, lineEnd (inclusive)
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Expected lineStart and lineEnd as numbers").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    int lineStart = std::max(info[0].As<Napi::Number>().Int32Value(), 0);
+    int lineEnd = info[1].As<Napi::Number>().Int32Value();
+    
+#ifdef HAVE_KTEXTEDITOR
+    // The whole range in one trip to the Qt thread
+    QStringList lines;
+    QtRunner::RunSync([&]() {
+        int last = std::min(lineEnd, m_document->lines() - 1);
+        for (int line = lineStart; line <= last; line++) {
+            lines.append(m_document->line(line));
+        }
+    });
+    return StringListToJs(env, lines);
 #else
-    return Napi::String::New(env, "");
+    const PieceTable& text = m_fallback->Text();
+    lineEnd = std::min(lineEnd, text.Lines() - 1);
+    Napi::Array lines = Napi::Array::New(env, lineEnd >= lineStart ? lineEnd - lineStart + 1 : 0);
+    for (int line = lineStart; line <= lineEnd; line++) {
+        lines.Set(static_cast<uint32_t>(line - lineStart), Utf16ToJs(env, text.Line(line)));
+    }
+    return lines;
 #endif
 }
 
 void DocumentWrapper::InsertText(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.insertText");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
     if (info.Length() < 3) {
@@ -168,22 +927,30 @@ void DocumentWrapper::InsertText(const Napi::CallbackInfo& info) {
         return;
     }
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
+    if (!Awake()) {
         Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
         return;
     }
     
+#ifdef HAVE_KTEXTEDITOR
     int line = info[0].As<Napi::Number>().Int32Value();
     int column = info[1].As<Napi::Number>().Int32Value();
-    std::string text = info[2].As<Napi::String>().Utf8Value();
+    QString text = TextFromJs(info[2]);
     
     KTextEditor::Cursor cursor(line, column);
-    m_document->insertText(cursor, QString::fromStdString(text));
+    QtRunner::RunSync([&]() { m_document->insertText(cursor, text); });
+#else
+    int line = info[0].As<Napi::Number>().Int32Value();
+    int column = info[1].As<Napi::Number>().Int32Value();
+    std::u16string text = Utf16FromJs(info[2]);
+    m_fallback->Text().Insert(line, column, text.data(), text.size());
 #endif
 }
 
 void DocumentWrapper::RemoveText(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.removeText");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
     if (info.Length() < 4) {
@@ -193,12 +960,12 @@ void DocumentWrapper::RemoveText(const Napi::CallbackInfo& info) {
         return;
     }
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
+    if (!Awake()) {
         Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
         return;
     }
     
+#ifdef HAVE_KTEXTEDITOR
     int startLine = info[0].As<Napi::Number>().Int32Value();
     int startColumn = info[1].As<Napi::Number>().Int32Value();
     int endLine = info[2].As<Napi::Number>().Int32Value();
@@ -209,478 +976,1634 @@ void DocumentWrapper::RemoveText(const Napi::CallbackInfo& info) {
         KTextEditor::Cursor(endLine, endColumn)
     );
     
-    m_document->removeText(range);
+    QtRunner::RunSync([&]() { m_document->removeText(range); });
+#else
+    m_fallback->Text().Remove(info[0].As<Napi::Number>().Int32Value(), info[1].As<Napi::Number>().Int32Value(),
+                              info[2].As<Napi::Number>().Int32Value(), info[3].As<Napi::Number>().Int32Value());
 #endif
 }
 
-Napi::Value DocumentWrapper::GetLineCount(const Napi::CallbackInfo& info) {
+Napi::Value DocumentWrapper::ApplyEdits(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.applyEdits");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
-        return Napi::Number::New(env, 0);
+    // Parameters: ArrayBuffer or typed array view in the EditBatch layout
+    const uint8_t* data = nullptr;
+    size_t byteLength = 0;
+    if (info.Length() >= 1 && info[0].IsArrayBuffer()) {
+        Napi::ArrayBuffer buffer = info[0].As<Napi::ArrayBuffer>();
+        data = static_cast<const uint8_t*>(buffer.Data());
+        byteLength = buffer.ByteLength();
+    } else if (info.Length() >= 1 && info[0].IsTypedArray()) {
+        Napi::TypedArray view = info[0].As<Napi::TypedArray>();
+        data = static_cast<const uint8_t*>(view.ArrayBuffer().Data()) + view.ByteOffset();
+        byteLength = view.ByteLength();
+    } else {
+        Napi::TypeError::New(env, "Expected an ArrayBuffer of packed edits").ThrowAsJavaScriptException();
+        return env.Null();
     }
     
-    return Napi::Number::New(env, m_document->lines());
-#else
-    return Napi::Number::New(env, 0);
-#endif
-}
-
-Napi::Value DocumentWrapper::GetLength(const Napi::CallbackInfo& info) {
-    Napi::Env env = info.Env();
+    std::vector<PackedEdit> edits;
+    std::string error;
+    if (!EditBatch::Parse(data, byteLength, edits, error)) {
+        Napi::RangeError::New(env, error).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
     
 #ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
-        return Napi::Number::New(env, 0);
+    // The buffer stays alive while this thread waits, so the text is read in place
+    int failed = -1;
+    int64_t revision = -1;
+    QtRunner::RunSync([&]() {
+        failed = EditBatch::Apply(m_document.get(), edits);
+        revision = EditBatch::Revision(m_document.get());
+    });
+    
+    if (failed >= 0) {
+        Napi::RangeError::New(env, "Edit " + std::to_string(failed) + " could not be applied").ThrowAsJavaScriptException();
+        return env.Null();
     }
     
-    return Napi::Number::New(env, m_document->text().length());
+    return Napi::Number::New(env, static_cast<double>(revision));
 #else
-    return Napi::Number::New(env, 0);
+    // The text is read from the buffer in place
+    int failed = EditBatch::Apply(m_fallback->Text(), edits);
+    if (failed >= 0) {
+        Napi::RangeError::New(env, "Edit " + std::to_string(failed) + " could not be applied").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    return Napi::Number::New(env, static_cast<double>(m_fallback->Text().Revision()));
 #endif
 }
 
-Napi::Value DocumentWrapper::IsModified(const Napi::CallbackInfo& info) {
+Napi::Value DocumentWrapper::GetLineCount(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.lineCount");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
-        return Napi::Boolean::New(env, false);
+    if (!Awake()) {
+        return Napi::Number::New(env, 0);
     }
     
-    return Napi::Boolean::New(env, m_document->isModified());
+#ifdef HAVE_KTEXTEDITOR
+    int lines = 0;
+    QtRunner::RunSync([&]() { lines = m_document->lines(); });
+    return Napi::Number::New(env, lines);
 #else
-    return Napi::Boolean::New(env, false);
+    return Napi::Number::New(env, m_fallback->Text().Lines());
 #endif
 }
 
-Napi::Value DocumentWrapper::GetMode(const Napi::CallbackInfo& info) {
+Napi::Value DocumentWrapper::GetLength(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.length");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
-        return Napi::String::New(env, "");
+    if (!Awake()) {
+        return Napi::Number::New(env, 0);
     }
     
-    QString mode = m_document->mode();
-    return Napi::String::New(env, mode.toStdString());
+#ifdef HAVE_KTEXTEDITOR
+    int64_t length = 0;
+    QtRunner::RunSync([&]() { length = m_lineIndex->Length(); });
+    return Napi::Number::New(env, static_cast<double>(length));
 #else
-    return Napi::String::New(env, "");
+    return Napi::Number::New(env, static_cast<double>(m_fallback->Text().Length()));
 #endif
 }
 
-void DocumentWrapper::SetMode(const Napi::CallbackInfo& info) {
+Napi::Value DocumentWrapper::OffsetAt(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.offsetAt");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
-    if (info.Length() < 1 || !info[0].IsString()) {
-        Napi::TypeError::New(env, "String expected").ThrowAsJavaScriptException();
-        return;
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Expected (line, column)").ThrowAsJavaScriptException();
+        return env.Null();
     }
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
+    if (!Awake()) {
         Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
-        return;
+        return env.Null();
     }
     
-    std::string mode = info[0].As<Napi::String>().Utf8Value();
-    m_document->setMode(QString::fromStdString(mode));
+#ifdef HAVE_KTEXTEDITOR
+    int line = info[0].As<Napi::Number>().Int32Value();
+    int column = info[1].As<Napi::Number>().Int32Value();
+    int64_t offset = 0;
+    QtRunner::RunSync([&]() { offset = m_lineIndex->OffsetAt(line, column); });
+    return Napi::Number::New(env, static_cast<double>(offset));
+#else
+    int64_t offset = m_fallback->Text().OffsetAt(info[0].As<Napi::Number>().Int32Value(),
+                                                 info[1].As<Napi::Number>().Int32Value());
+    return Napi::Number::New(env, static_cast<double>(offset));
 #endif
 }
 
-Napi::Value DocumentWrapper::GetModes(const Napi::CallbackInfo& info) {
+Napi::Value DocumentWrapper::PositionAt(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.positionAt");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
-    Napi::Array modes = Napi::Array::New(env);
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
-        return modes;
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Expected offset as number").ThrowAsJavaScriptException();
+        return env.Null();
     }
     
-    QStringList modeList = m_document->modes();
-    for (int i = 0; i < modeList.size(); ++i) {
-        modes[i] = Napi::String::New(env, modeList[i].toStdString());
+    int line = 0;
+    int column = 0;
+    
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
     }
+    
+#ifdef HAVE_KTEXTEDITOR
+    int64_t offset = info[0].As<Napi::Number>().Int64Value();
+    QtRunner::RunSync([&]() { m_lineIndex->PositionAt(offset, line, column); });
+#else
+    m_fallback->Text().PositionAt(info[0].As<Napi::Number>().Int64Value(), line, column);
 #endif
     
-    return modes;
+    Napi::Object position = Napi::Object::New(env);
+    position.Set("line", Napi::Number::New(env, line));
+    position.Set("column", Napi::Number::New(env, column));
+    return position;
 }
 
-Napi::Value DocumentWrapper::OpenUrl(const Napi::CallbackInfo& info) {
+Napi::Value DocumentWrapper::OffsetsAt(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.offsetsAt");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
-    if (info.Length() < 1 || !info[0].IsString()) {
-        Napi::TypeError::New(env, "String expected").ThrowAsJavaScriptException();
-        return Napi::Boolean::New(env, false);
+    // Parameters: Int32Array or Uint32Array of (line, column) pairs
+    const int32_t* positions = nullptr;
+    size_t count = 0;
+    if (info.Length() < 1 || !Int32ElementsFromJs(info[0], positions, count) || count % 2 != 0) {
+        Napi::TypeError::New(env, "Expected an Int32Array of (line, column) pairs").ThrowAsJavaScriptException();
+        return env.Null();
     }
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
+    Napi::Uint32Array offsets = Napi::Uint32Array::New(env, count / 2);
+    
+    if (!Awake()) {
         Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
-        return Napi::Boolean::New(env, false);
+        return env.Null();
     }
     
-    std::string url = info[0].As<Napi::String>().Utf8Value();
-    bool success = m_document->openUrl(QUrl::fromLocalFile(QString::fromStdString(url)));
-    return Napi::Boolean::New(env, success);
+#ifdef HAVE_KTEXTEDITOR
+    // Both arrays stay alive while this thread waits, so they are used in place
+    uint32_t* output = offsets.Data();
+    QtRunner::RunSync([&]() {
+        for (size_t i = 0; i < count / 2; i++) {
+            output[i] = static_cast<uint32_t>(m_lineIndex->OffsetAt(positions[2 * i], positions[2 * i + 1]));
+        }
+    });
 #else
-    return Napi::Boolean::New(env, false);
+    uint32_t* output = offsets.Data();
+    const PieceTable& text = m_fallback->Text();
+    for (size_t i = 0; i < count / 2; i++) {
+        output[i] = static_cast<uint32_t>(text.OffsetAt(positions[2 * i], positions[2 * i + 1]));
+    }
 #endif
+    
+    return offsets;
 }
 
-Napi::Value DocumentWrapper::SaveUrl(const Napi::CallbackInfo& info) {
+Napi::Value DocumentWrapper::PositionsAt(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.positionsAt");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
-        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
-        return Napi::Boolean::New(env, false);
+    // Parameters: Int32Array or Uint32Array of offsets
+    const int32_t* offsets = nullptr;
+    size_t count = 0;
+    if (info.Length() < 1 || !Int32ElementsFromJs(info[0], offsets, count)) {
+        Napi::TypeError::New(env, "Expected an Int32Array of offsets").ThrowAsJavaScriptException();
+        return env.Null();
     }
     
-    bool success = m_document->save();
-    return Napi::Boolean::New(env, success);
-#else
-    return Napi::Boolean::New(env, false);
-#endif
-}
-
-Napi::Value DocumentWrapper::GetUrl(const Napi::CallbackInfo& info) {
-    Napi::Env env = info.Env();
+    bool isUnsigned = info[0].As<Napi::TypedArray>().TypedArrayType() == napi_uint32_array;
+    Napi::Uint32Array positions = Napi::Uint32Array::New(env, count * 2);
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
-        return Napi::String::New(env, "");
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
     }
     
-    QUrl url = m_document->url();
-    return Napi::String::New(env, url.toLocalFile().toStdString());
-#else
-    return Napi::String::New(env, "");
-#endif
-}
-
-void DocumentWrapper::Undo(const Napi::CallbackInfo& info) {
 #ifdef HAVE_KTEXTEDITOR
-    if (m_document) {
-        m_document->undo();
-    }
-#endif
-}
-
-void DocumentWrapper::Redo(const Napi::CallbackInfo& info) {
-#ifdef HAVE_KTEXTEDITOR
-    if (m_document) {
-        m_document->redo();
+    // Both arrays stay alive while this thread waits, so they are used in place
+    uint32_t* output = positions.Data();
+    QtRunner::RunSync([&]() {
+        int line = 0;
+        int column = 0;
+        for (size_t i = 0; i < count; i++) {
+            int64_t offset = isUnsigned ? static_cast<uint32_t>(offsets[i]) : offsets[i];
+            m_lineIndex->PositionAt(offset, line, column);
+            output[2 * i] = static_cast<uint32_t>(line);
+            output[2 * i + 1] = static_cast<uint32_t>(column);
+        }
+    });
+#else
+    uint32_t* output = positions.Data();
+    const PieceTable& text = m_fallback->Text();
+    int line = 0;
+    int column = 0;
+    for (size_t i = 0; i < count; i++) {
+        int64_t offset = isUnsigned ? static_cast<uint32_t>(offsets[i]) : offsets[i];
+        text.PositionAt(offset, line, column);
+        output[2 * i] = static_cast<uint32_t>(line);
+        output[2 * i + 1] = static_cast<uint32_t>(column);
     }
 #endif
+    
+    return positions;
 }
 
-Napi::Value DocumentWrapper::GetSyntaxTokens(const Napi::CallbackInfo& info) {
+Napi::Value DocumentWrapper::ConvertPositions(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.convertPositions");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
-        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+    // Parameters: Int32Array or Uint32Array of (line, column) pairs, from, to
+    const int32_t* positions = nullptr;
+    size_t count = 0;
+    if (info.Length() < 3 || !Int32ElementsFromJs(info[0], positions, count) || count % 2 != 0) {
+        Napi::TypeError::New(env, "Expected an Int32Array of (line, column) pairs and two encodings")
+            .ThrowAsJavaScriptException();
         return env.Null();
     }
     
-    // Parameters: lineStart, lineEnd
-    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
-        Napi::TypeError::New(env, "Expected lineStart and lineEnd as numbers").ThrowAsJavaScriptException();
+    ColumnEncoding from;
+    ColumnEncoding to;
+    if (!EncodingFromJs(info[1], from) || !EncodingFromJs(info[2], to)) {
+        Napi::TypeError::New(env, "Encodings must be 'utf-8', 'utf-16' or 'utf-32'").ThrowAsJavaScriptException();
         return env.Null();
     }
     
-    int lineStart = info[0].As<Napi::Number>().Int32Value();
-    int lineEnd = info[1].As<Napi::Number>().Int32Value();
-    
-    Napi::Array tokens = Napi::Array::New(env);
-    uint32_t tokenIndex = 0;
+    bool isUnsigned = info[0].As<Napi::TypedArray>().TypedArrayType() == napi_uint32_array;
+    Napi::Uint32Array converted = Napi::Uint32Array::New(env, count);
     
-    const int MAX_SCAN_LENGTH = 10000; // Prevent excessive scanning
-    
-    // Extract syntax tokens for each line
-    for (int line = lineStart; line <= lineEnd && line < m_document->lines(); line++) {
-        QString lineText = m_document->line(line);
-        int lineLength = qMin(lineText.length(), MAX_SCAN_LENGTH);
-        
-        // Iterate through each character to get highlighting
-        for (int col = 0; col < lineLength; ) {
-            auto attr = m_document->attributeAt(KTextEditor::Cursor(line, col));
-            
-            // Find the extent of this attribute
-            int startCol = col;
-            int endCol = col + 1;
-            
-            // Extend while attribute is the same (with limit)
-            while (endCol < lineLength && (endCol - startCol) < 1000) {
-                auto nextAttr = m_document->attributeAt(KTextEditor::Cursor(line, endCol));
-                if (nextAttr != attr) break;
-                endCol++;
-            }
-            
-            // Create token object
-            Napi::Object token = Napi::Object::New(env);
-            token.Set("line", Napi::Number::New(env, line));
-            token.Set("startColumn", Napi::Number::New(env, startCol));
-            token.Set("endColumn", Napi::Number::New(env, endCol));
-            
-            // Get token type from attribute name
-            QString tokenType = attr ? attr->name() : QString("text");
-            token.Set("tokenType", Napi::String::New(env, tokenType.toStdString()));
-            
-            tokens[tokenIndex++] = token;
-            col = endCol;
-        }
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
     }
     
-    return tokens;
+#ifdef HAVE_KTEXTEDITOR
+    // Both arrays stay alive while this thread waits, so they are used in place
+    uint32_t* output = converted.Data();
+    QtRunner::RunSync([&]() {
+        for (size_t i = 0; i < count; i += 2) {
+            int line = isUnsigned && positions[i] < 0 ? INT32_MAX : positions[i];
+            uint32_t column = isUnsigned ? static_cast<uint32_t>(positions[i + 1])
+                                         : static_cast<uint32_t>(std::max(positions[i + 1], 0));
+            output[i + 1] = m_columnMap->Convert(line, column, from, to);
+            output[i] = static_cast<uint32_t>(line);
+        }
+    });
 #else
-    // Fallback: return empty array
-    return Napi::Array::New(env);
+    uint32_t* output = converted.Data();
+    for (size_t i = 0; i < count; i += 2) {
+        int line = isUnsigned && positions[i] < 0 ? INT32_MAX : positions[i];
+        uint32_t column = isUnsigned ? static_cast<uint32_t>(positions[i + 1])
+                                     : static_cast<uint32_t>(std::max(positions[i + 1], 0));
+        output[i + 1] = m_fallback->ConvertColumn(line, column, from, to);
+        output[i] = static_cast<uint32_t>(line);
+    }
 #endif
+    
+    return converted;
 }
 
-Napi::Value DocumentWrapper::GetFoldingRegions(const Napi::CallbackInfo& info) {
+Napi::Value DocumentWrapper::CreateAnchors(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.createAnchors");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
-        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+    // Parameters: Int32Array or Uint32Array of ranges, behavior?
+    const int32_t* fields = nullptr;
+    size_t count = 0;
+    if (info.Length() < 1 || !Int32ElementsFromJs(info[0], fields, count) || count % 4 != 0) {
+        Napi::TypeError::New(env, "Expected an Int32Array of (startLine, startColumn, endLine, endColumn) ranges")
+            .ThrowAsJavaScriptException();
         return env.Null();
     }
     
-    Napi::Array regions = Napi::Array::New(env);
-    uint32_t regionIndex = 0;
+    bool expandLeft = false;
+    bool expandRight = false;
+    bool invalidateIfEmpty = false;
+    if (info.Length() > 1 && info[1].IsObject()) {
+        Napi::Object behavior = info[1].As<Napi::Object>();
+        expandLeft = behavior.Get("expandLeft").ToBoolean();
+        expandRight = behavior.Get("expandRight").ToBoolean();
+        invalidateIfEmpty = behavior.Get("invalidateIfEmpty").ToBoolean();
+    }
     
-    const int MAX_LINES = 50000; // Limit for performance
-    int maxLine = qMin(m_document->lines(), MAX_LINES);
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
     
-    // Iterate through lines to find folding regions
-    // Note: In a real implementation, we'd use Kate's folding API more efficiently
-    for (int line = 0; line < maxLine; line++) {
-        // Check if this line starts a foldable region
-        if (m_document->isLineVisible(line)) {
-            // Get folding range starting at this line
-            auto foldingRange = m_document->foldingRegionAt(KTextEditor::Cursor(line, 0));
-            
-            if (foldingRange.isValid() && foldingRange.start().line() == line) {
-                Napi::Object region = Napi::Object::New(env);
-                region.Set("startLine", Napi::Number::New(env, foldingRange.start().line()));
-                region.Set("endLine", Napi::Number::New(env, foldingRange.end().line()));
-                
-                // Use default kind - proper classification would require language-specific logic
-                region.Set("kind", Napi::String::New(env, "region"));
-                
-                regions[regionIndex++] = region;
-            }
+    // Uint32Array values past INT32_MAX are past the end, not negative
+    std::vector<int32_t> unsignedFields;
+    if (info[0].As<Napi::TypedArray>().TypedArrayType() == napi_uint32_array) {
+        unsignedFields.assign(fields, fields + count);
+        for (int32_t& field : unsignedFields) {
+            field = field < 0 ? INT32_MAX : field;
         }
+        fields = unsignedFields.data();
     }
     
-    return regions;
+#ifdef HAVE_KTEXTEDITOR
+    KTextEditor::MovingRange::InsertBehaviors insert(KTextEditor::MovingRange::DoNotExpand);
+    if (expandLeft) {
+        insert |= KTextEditor::MovingRange::ExpandLeft;
+    }
+    if (expandRight) {
+        insert |= KTextEditor::MovingRange::ExpandRight;
+    }
+    KTextEditor::MovingRange::EmptyBehavior empty = invalidateIfEmpty
+        ? KTextEditor::MovingRange::InvalidateIfEmpty : KTextEditor::MovingRange::AllowEmpty;
+    
+    int handle = 0;
+    QtRunner::RunSync([&]() {
+        if (!m_anchors) {
+            m_anchors = new DocumentAnchors(m_document.get());
+        }
+        handle = m_anchors->Create(fields, count, insert, empty);
+    });
+    if (handle == 0) {
+        Napi::Error::New(env, "The document doesn't support moving ranges").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    return Napi::Number::New(env, handle);
 #else
-    // Fallback: return empty array
-    return Napi::Array::New(env);
+    return Napi::Number::New(env, m_fallback->CreateAnchors(fields, count, expandLeft, expandRight, invalidateIfEmpty));
 #endif
 }
 
-// Phase 8: Search and Replace Methods
-
-Napi::Value DocumentWrapper::Search(const Napi::CallbackInfo& info) {
+Napi::Value DocumentWrapper::GetAnchors(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.getAnchors");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
-        Napi::TypeError::New(env, "Document not initialized").ThrowAsJavaScriptException();
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Expected an anchor handle").ThrowAsJavaScriptException();
         return env.Null();
     }
+    int handle = info[0].As<Napi::Number>().Int32Value();
     
-    if (info.Length() < 1 || !info[0].IsString()) {
-        Napi::TypeError::New(env, "First argument must be a search string").ThrowAsJavaScriptException();
+#ifdef HAVE_KTEXTEDITOR
+    if (!Awake()) {
         return env.Null();
     }
     
-    std::string searchText = info[0].As<Napi::String>().Utf8Value();
-    
-    // Parse options
-    bool caseSensitive = false;
-    bool wholeWords = false;
-    bool useRegex = false;
+    std::vector<int32_t> fields;
+    bool found = false;
+    QtRunner::RunSync([&]() { found = m_anchors && m_anchors->Read(handle, fields); });
+    if (!found) {
+        return env.Null();
+    }
     
-    if (info.Length() >= 2 && info[1].IsObject()) {
-        Napi::Object options = info[1].As<Napi::Object>();
-        
-        if (options.Has("caseSensitive") && options.Get("caseSensitive").IsBoolean()) {
-            caseSensitive = options.Get("caseSensitive").As<Napi::Boolean>().Value();
-        }
-        
-        if (options.Has("wholeWords") && options.Get("wholeWords").IsBoolean()) {
-            wholeWords = options.Get("wholeWords").As<Napi::Boolean>().Value();
-        }
-        
-        if (options.Has("regex") && options.Get("regex").IsBoolean()) {
-            useRegex = options.Get("regex").As<Napi::Boolean>().Value();
-        }
+    Napi::Int32Array ranges = Napi::Int32Array::New(env, fields.size());
+    std::copy(fields.begin(), fields.end(), ranges.Data());
+    return ranges;
+#else
+    std::vector<int32_t> fields;
+    if (!Awake() || !m_fallback->ReadAnchors(handle, fields)) {
+        return env.Null();
     }
+    return Int32ArrayToJs(env, fields);
+#endif
+}
+
+Napi::Value DocumentWrapper::ReleaseAnchors(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.releaseAnchors");
+    StatsScope scope(stats);
     
-    // Search through document
-    Napi::Array results = Napi::Array::New(env);
-    uint32_t resultIndex = 0;
+    Napi::Env env = info.Env();
     
-    QString qSearchText = QString::fromStdString(searchText);
-    int lineCount = m_document->lines();
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Expected an anchor handle").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    int handle = info[0].As<Napi::Number>().Int32Value();
     
-    for (int line = 0; line < lineCount; line++) {
-        QString lineText = m_document->line(line);
-        
-        if (useRegex) {
-            QRegularExpression regex(qSearchText, caseSensitive ? QRegularExpression::NoPatternOption : QRegularExpression::CaseInsensitiveOption);
-            QRegularExpressionMatchIterator matches = regex.globalMatch(lineText);
-            
-            while (matches.hasNext()) {
-                QRegularExpressionMatch match = matches.next();
-                Napi::Object result = Napi::Object::New(env);
-                result.Set("line", Napi::Number::New(env, line));
-                result.Set("column", Napi::Number::New(env, match.capturedStart()));
-                result.Set("length", Napi::Number::New(env, match.capturedLength()));
-                result.Set("text", Napi::String::New(env, match.captured().toStdString()));
-                results[resultIndex++] = result;
-            }
-        } else {
-            Qt::CaseSensitivity cs = caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive();
-            int startPos = 0;
-            
-            while (true) {
-                int pos = lineText.indexOf(qSearchText, startPos, cs);
-                if (pos < 0) break;
-                
-                // Check whole word match if requested
-                if (wholeWords) {
-                    bool isWordStart = (pos == 0 || !lineText[pos - 1].isLetterOrNumber());
-                    bool isWordEnd = (pos + qSearchText.length() >= lineText.length() || 
-                                     !lineText[pos + qSearchText.length()].isLetterOrNumber());
-                    if (!isWordStart || !isWordEnd) {
-                        startPos = pos + 1;
-                        continue;
-                    }
-                }
-                
-                Napi::Object result = Napi::Object::New(env);
-                result.Set("line", Napi::Number::New(env, line));
-                result.Set("column", Napi::Number::New(env, pos));
-                result.Set("length", Napi::Number::New(env, qSearchText.length()));
-                result.Set("text", Napi::String::New(env, qSearchText.toStdString()));
-                results[resultIndex++] = result;
-                
-                startPos = pos + 1;
-            }
-        }
+#ifdef HAVE_KTEXTEDITOR
+    if (!m_document) {
+        return Napi::Boolean::New(env, false);
     }
     
-    return results;
+    bool released = false;
+    QtRunner::RunSync([&]() { released = m_anchors && m_anchors->Release(handle); });
+    return Napi::Boolean::New(env, released);
 #else
-    return Napi::Array::New(env);
+    return Napi::Boolean::New(env, m_fallback && m_fallback->ReleaseAnchors(handle));
 #endif
 }
 
-Napi::Value DocumentWrapper::Replace(const Napi::CallbackInfo& info) {
+Napi::Value DocumentWrapper::IsModified(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.isModified");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
 #ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
-        Napi::TypeError::New(env, "Document not initialized").ThrowAsJavaScriptException();
-        return Napi::Boolean::New(env, false);
-    }
-    
-    if (info.Length() < 4 || !info[0].IsNumber() || !info[1].IsNumber() || 
-        !info[2].IsNumber() || !info[3].IsString()) {
-        Napi::TypeError::New(env, "Arguments: line, column, length, replacement").ThrowAsJavaScriptException();
+    if (!Awake()) {
         return Napi::Boolean::New(env, false);
     }
     
-    int line = info[0].As<Napi::Number>().Int32Value();
-    int column = info[1].As<Napi::Number>().Int32Value();
-    int length = info[2].As<Napi::Number>().Int32Value();
-    std::string replacement = info[3].As<Napi::String>().Utf8Value();
-    
-    KTextEditor::Range range(line, column, line, column + length);
-    bool success = m_document->replaceText(range, QString::fromStdString(replacement));
-    
-    return Napi::Boolean::New(env, success);
+    bool modified = false;
+    QtRunner::RunSync([&]() { modified = m_document->isModified(); });
+    return Napi::Boolean::New(env, modified);
 #else
-    return Napi::Boolean::New(env, false);
+    return Napi::Boolean::New(env, Awake() && m_fallback->Text().IsModified());
 #endif
 }
 
-Napi::Value DocumentWrapper::ReplaceAll(const Napi::CallbackInfo& info) {
+Napi::Value DocumentWrapper::GetMode(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.mode");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
+    if (!Awake()) {
+        return Napi::String::New(env, "");
+    }
+    
 #ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
+    QString mode;
+    QtRunner::RunSync([&]() { mode = m_document->mode(); });
+    return Napi::String::New(env, mode.toStdString());
+#else
+    return Napi::String::New(env, m_fallback->Mode());
+#endif
+}
+
+void DocumentWrapper::SetMode(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.setMode");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    // A mode name, or an id from the mode catalog
+    if (info.Length() < 1 || (!info[0].IsString() && !info[0].IsNumber())) {
+        Napi::TypeError::New(env, "String or mode id expected").ThrowAsJavaScriptException();
+        return;
+    }
+    
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return;
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    QString mode = QString::fromStdString(info[0].IsNumber()
+        ? ModeCatalog::NameOf(info[0].As<Napi::Number>().Int32Value()) : info[0].As<Napi::String>().Utf8Value());
+    QtRunner::RunSync([&]() { m_document->setMode(mode); });
+#else
+    // Any name the catalog has, or any at all while there is no catalog
+    std::string mode = info[0].IsNumber()
+        ? ModeCatalog::NameOf(info[0].As<Napi::Number>().Int32Value()) : info[0].As<Napi::String>().Utf8Value();
+    std::shared_ptr<const ModeCatalog> catalog = ModeCatalog::Current();
+    if (!mode.empty() && (catalog->IsEmpty() || catalog->ForName(mode) != ModeCatalog::None)) {
+        m_fallback->SetMode(std::move(mode));
+    }
+#endif
+}
+
+Napi::Value DocumentWrapper::GetModes(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.modes");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+#ifdef HAVE_KTEXTEDITOR
+    // Every document has the same modes; the catalog has them without a trip to the Qt thread
+    return ModeNamesToJs(env, *ModeCatalog::Ensure());
+#else
+    // Whatever catalog the cache file had; empty without one
+    return ModeNamesToJs(env, *ModeCatalog::Current());
+#endif
+}
+
+Napi::Value DocumentWrapper::OpenUrl(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.openUrl");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "String expected").ThrowAsJavaScriptException();
+        return Napi::Boolean::New(env, false);
+    }
+    
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return Napi::Boolean::New(env, false);
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    QUrl url = QUrl::fromLocalFile(QString::fromStdString(info[0].As<Napi::String>().Utf8Value()));
+    bool success = false;
+    QtRunner::RunSync([&]() {
+        success = m_document->openUrl(url);
+        if (success) {
+            m_lineHashes->MarkSaved();
+        }
+    });
+    return Napi::Boolean::New(env, success);
+#else
+    std::string path = info[0].As<Napi::String>().Utf8Value();
+    FallbackDocument::File file;
+    std::string error;
+    if (!FallbackDocument::Read(path, file, error)) {
+        return Napi::Boolean::New(env, false);
+    }
+    
+    m_fallback->Load(path, std::move(file));
+    return Napi::Boolean::New(env, true);
+#endif
+}
+
+Napi::Value DocumentWrapper::OpenUrlAsync(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.openUrlAsync");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "String expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    QUrl url = QUrl::fromLocalFile(QString::fromStdString(info[0].As<Napi::String>().Utf8Value()));
+    std::shared_ptr<KTextEditor::Document> document = m_document;
+    LineHashes* lineHashes = m_lineHashes;
+    return QtTask::Run<bool>(env,
+        [document, lineHashes, url]() {
+            // The wrapper's objects are deleted behind this task, never before it
+            bool success = document->openUrl(url);
+            if (success) {
+                lineHashes->MarkSaved();
+            }
+            return success;
+        },
+        [](Napi::Env env, bool& success) -> Napi::Value {
+            return Napi::Boolean::New(env, success);
+        });
+#else
+    // Read and decoded on a worker; only taking the text in waits for this thread
+    struct AsyncRead {
+        AsyncRead(Napi::Promise::Deferred deferred, std::shared_ptr<JsDispatcher> dispatcher,
+                  std::shared_ptr<FallbackDocument> document, std::string path)
+            : deferred(deferred), dispatcher(std::move(dispatcher)), document(std::move(document)), path(std::move(path)) {}
+        
+        Napi::Promise::Deferred deferred;
+        std::shared_ptr<JsDispatcher> dispatcher;
+        std::shared_ptr<FallbackDocument> document;
+        std::string path;
+        FallbackDocument::File file;
+        bool success = false;
+    };
+    
+    Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+    Napi::Promise promise = deferred.Promise();
+    auto* read = new AsyncRead(deferred, JsDispatcher::ForEnv(env), m_fallback,
+                               info[0].As<Napi::String>().Utf8Value());
+    read->dispatcher->Ref();
+    
+    WorkerPool::Post([read]() {
+        std::string error;
+        read->success = FallbackDocument::Read(read->path, read->file, error);
+        read->dispatcher->Post([read](Napi::Env env) {
+            if (read->success) {
+                read->document->Load(read->path, std::move(read->file));
+            }
+            read->deferred.Resolve(Napi::Boolean::New(env, read->success));
+            
+            std::shared_ptr<JsDispatcher> dispatcher = read->dispatcher;
+            delete read;
+            dispatcher->Unref();
+        });
+    });
+    return promise;
+#endif
+}
+
+Napi::Value DocumentWrapper::SaveUrl(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.saveUrl");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return Napi::Boolean::New(env, false);
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    bool success = false;
+    QtRunner::RunSync([&]() { success = m_document->save(); });
+    return Napi::Boolean::New(env, success);
+#else
+    // Like KTextEditor's save(), written in place and only to the document's own file
+    if (m_fallback->Path().empty()) {
+        return Napi::Boolean::New(env, false);
+    }
+    
+    std::string bytes = FallbackDocument::Encode(m_fallback->Text().Text(), m_fallback->FileEncoding(),
+                                                 m_fallback->LineEnding());
+    std::ofstream file(std::filesystem::u8path(m_fallback->Path()), std::ios::binary | std::ios::trunc);
+    file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    file.close();
+    if (!file) {
+        return Napi::Boolean::New(env, false);
+    }
+    
+    m_fallback->MarkSaved();
+    return Napi::Boolean::New(env, true);
+#endif
+}
+
+Napi::Value DocumentWrapper::SaveAsync(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.saveAsync");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    // Parameters: optional path (default the document's file), optional { lineEnding }
+    std::string path;
+    size_t optionsIndex = 0;
+    if (info.Length() > 0 && info[0].IsString()) {
+        path = info[0].As<Napi::String>().Utf8Value();
+        optionsIndex = 1;
+    } else if (info.Length() > 0 && !info[0].IsUndefined() && !info[0].IsNull() && !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Expected a path and options").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    std::string lineEnding;
+    if (info.Length() > optionsIndex && info[optionsIndex].IsObject()) {
+        Napi::Value value = info[optionsIndex].As<Napi::Object>().Get("lineEnding");
+        if (value.IsString()) {
+            lineEnding = value.As<Napi::String>().Utf8Value();
+            if (lineEnding != "\n" && lineEnding != "\r\n") {
+                Napi::RangeError::New(env, "lineEnding must be '\\n' or '\\r\\n'").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+        }
+    }
+    
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+    Napi::Promise promise = deferred.Promise();
+    
+    auto* write = new AsyncWrite(deferred, JsDispatcher::ForEnv(env));
+    write->wrapper = Napi::Persistent(info.This().As<Napi::Object>());
+    write->document = m_document;
+    write->path = path;
+    write->lineEnding = QString::fromStdString(lineEnding);
+    write->dispatcher->Ref();
+    
+    bool posted = QtRunner::Post([write, recorder = m_journal]() {
+        // Only the text is taken here; encoding and writing happen on the writer thread
+        KTextEditor::Document* document = write->document.get();
+        QString local = document->url().toLocalFile();
+        QString target = write->path.empty()
+            ? local : QFileInfo(QString::fromStdString(write->path)).absoluteFilePath();
+        if (target.isEmpty()) {
+            write->error = "The document has no file to save to";
+            FinishWrite(write);
+            return;
+        }
+        
+        write->path = target.toStdString();
+        write->ownFile = !local.isEmpty() && target == QFileInfo(local).absoluteFilePath();
+        write->text = document->text();
+        write->encoding = document->encoding().toLatin1();
+        write->revision = EditBatch::Revision(document);
+        
+        // The journal's edits so far lead up to this text; it starts over once the text is on disk
+        uint64_t checksum = 0;
+        if (write->ownFile && recorder) {
+            recorder->Flush(nullptr);
+            write->journal = recorder->Journal();
+            checksum = EditJournal::TextChecksum(reinterpret_cast<const char16_t*>(write->text.utf16()),
+                                                 write->text.length());
+        }
+        
+        FileWriter::Write(write->path,
+            [write](FileWriter::Output& output, std::string& error) {
+                return EncodeForSave(write, output.bytes, error);
+            },
+            [write, checksum](bool success, const std::string& error) {
+                write->success = success;
+                write->error = error;
+                if (success && write->journal) {
+                    write->journal->Rebase(checksum);
+                }
+                FinishWrite(write);
+            },
+            write->journal != nullptr);
+    });
+    
+    if (!posted) {
+        write->dispatcher->Unref();
+        write->wrapper.Reset();
+        delete write;
+        deferred.Reject(Napi::Error::New(env, "Qt event loop is not running").Value());
+    }
+    return promise;
+#else
+    Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+    Napi::Promise promise = deferred.Promise();
+    
+    std::string local = m_fallback->Path();
+    std::string target = local;
+    if (!path.empty()) {
+        std::error_code error;
+        std::filesystem::path absolute = std::filesystem::absolute(std::filesystem::u8path(path), error);
+        target = error ? path : absolute.lexically_normal().u8string();
+    }
+    if (target.empty()) {
+        deferred.Reject(Napi::Error::New(env, "The document has no file to save to").Value());
+        return promise;
+    }
+    
+    // The text is taken here; encoding and writing happen on the writer thread
+    auto* write = new AsyncWrite(deferred, JsDispatcher::ForEnv(env));
+    write->wrapper = Napi::Persistent(info.This().As<Napi::Object>());
+    write->document = m_fallback;
+    write->path = target;
+    write->ownFile = target == local;
+    write->text = m_fallback->Text().Text();
+    write->encoding = m_fallback->FileEncoding();
+    write->lineEnding = lineEnding.empty() ? m_fallback->LineEnding() : lineEnding;
+    write->revision = m_fallback->Text().Revision();
+    write->dispatcher->Ref();
+    
+    FileWriter::Write(write->path,
+        [write](FileWriter::Output& output, std::string&) {
+            output.bytes = FallbackDocument::Encode(write->text, write->encoding, write->lineEnding);
+            return true;
+        },
+        [write](bool success, const std::string& error) {
+            write->success = success;
+            write->error = error;
+            FinishWrite(write);
+        });
+    return promise;
+#endif
+}
+
+void DocumentWrapper::SetJournal(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.setJournal");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    // Parameters: journal path, or null to stop journaling
+    if (info.Length() < 1 || !(info[0].IsString() || info[0].IsNull() || info[0].IsUndefined())) {
+        Napi::TypeError::New(env, "Expected a journal path or null").ThrowAsJavaScriptException();
+        return;
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return;
+    }
+    
+    std::string path = info[0].IsString() ? info[0].As<Napi::String>().Utf8Value() : std::string();
+    QtRunner::RunSync([&]() {
+        delete m_journal;
+        m_journal = nullptr;
+        if (path.empty()) {
+            return;
+        }
+        
+        // An unmodified document's text is on disk already; otherwise the journal starts with it
+        QString text = m_document->text();
+        bool textIsOnDisk = !m_document->isModified() && !m_document->url().isEmpty();
+        std::u16string content(reinterpret_cast<const char16_t*>(text.utf16()), text.length());
+        std::shared_ptr<EditJournal> journal = EditJournal::Start(path, std::move(content), textIsOnDisk, nullptr);
+        m_journal = new JournalRecorder(m_document.get(), std::move(journal));
+    });
+#else
+    // Stopping is all there is to do without a journal
+    if (info[0].IsString()) {
+        Napi::Error::New(env, "Edit journals need the KTextEditor build").ThrowAsJavaScriptException();
+    }
+#endif
+}
+
+Napi::Value DocumentWrapper::FlushJournalAsync(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.flushJournalAsync");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+    Napi::Promise promise = deferred.Promise();
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (!m_journal) {
+        deferred.Reject(Napi::Error::New(env, "The document has no journal").Value());
+        return promise;
+    }
+    
+    auto* write = new AsyncWrite(deferred, JsDispatcher::ForEnv(env));
+    write->wrapper = Napi::Persistent(info.This().As<Napi::Object>());
+    write->resolveEdits = true;
+    write->dispatcher->Ref();
+    
+    bool posted = QtRunner::Post([write, recorder = m_journal]() {
+        recorder->Flush([write](uint32_t edits, bool success, const std::string& error) {
+            write->edits = edits;
+            write->success = success;
+            write->error = error;
+            FinishWrite(write);
+        });
+    });
+    
+    if (!posted) {
+        write->dispatcher->Unref();
+        write->wrapper.Reset();
+        delete write;
+        deferred.Reject(Napi::Error::New(env, "Qt event loop is not running").Value());
+    }
+#else
+    deferred.Reject(Napi::Error::New(env, "The document has no journal").Value());
+#endif
+    return promise;
+}
+
+Napi::Value DocumentWrapper::RecoverJournal(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.recoverJournal");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    // Parameters: journal path
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "Expected a journal path").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    std::string error;
+    std::shared_ptr<MappedFile> file = MappedFile::Open(info[0].As<Napi::String>().Utf8Value(), error);
+    std::vector<EditJournal::Record> records;
+    if (!file || !EditJournal::Parse(reinterpret_cast<const uint8_t*>(file->Data()), file->Size(), records, error)) {
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    int replayed = 0;
+    QtRunner::RunSync([&]() {
+        KTextEditor::Document* document = m_document.get();
+        uint64_t base = 0;
+        std::memcpy(&base, records[0].data, sizeof(base));
+        QString text = document->text();
+        uint64_t checksum = EditJournal::TextChecksum(reinterpret_cast<const char16_t*>(text.utf16()), text.length());
+        if (base != 0 && base != checksum) {
+            error = "The edit journal belongs to another version of the text";
+            return;
+        }
+        
+        // One undo step for the whole replay; a record that fails reverts the ones before it
+        KTextEditor::Document::EditingTransaction transaction(document);
+        std::vector<EditBatch::Inverse> inverses;
+        for (size_t i = 1; i < records.size() && error.empty(); i++) {
+            const EditJournal::Record& record = records[i];
+            if (record.type == EditJournal::RecordText) {
+                QString replaced = document->text();
+                document->setText(QString(reinterpret_cast<const QChar*>(record.data),
+                                          static_cast<int>(record.length / sizeof(QChar))));
+                inverses.push_back({document->documentRange(), replaced});
+            } else if (record.type == EditJournal::RecordEdits) {
+                std::vector<PackedEdit> edits;
+                if (!EditBatch::Parse(record.data, record.length, edits, error)) {
+                    break;
+                }
+                if (EditBatch::Apply(document, edits, inverses) >= 0) {
+                    error = "An edit in the journal doesn't fit the text";
+                    break;
+                }
+            }
+            replayed++;
+        }
+        if (!error.empty()) {
+            EditBatch::Revert(document, inverses);
+        }
+    });
+    
+    if (!error.empty()) {
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    return Napi::Number::New(env, replayed);
+#else
+    std::string error;
+    std::shared_ptr<MappedFile> file = MappedFile::Open(info[0].As<Napi::String>().Utf8Value(), error);
+    std::vector<EditJournal::Record> records;
+    if (!file || !EditJournal::Parse(reinterpret_cast<const uint8_t*>(file->Data()), file->Size(), records, error)) {
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    PieceTable& text = m_fallback->Text();
+    uint64_t base = 0;
+    std::memcpy(&base, records[0].data, sizeof(base));
+    std::u16string current = text.Text();
+    if (base != 0 && base != EditJournal::TextChecksum(current.data(), current.size())) {
+        Napi::Error::New(env, "The edit journal belongs to another version of the text").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    // One undo step for the whole replay, dropped again when a record fails
+    int replayed = 0;
+    text.BeginStep();
+    for (size_t i = 1; i < records.size() && error.empty(); i++) {
+        const EditJournal::Record& record = records[i];
+        if (record.type == EditJournal::RecordText) {
+            text.SetText(reinterpret_cast<const char16_t*>(record.data), record.length / sizeof(char16_t));
+        } else if (record.type == EditJournal::RecordEdits) {
+            std::vector<PackedEdit> edits;
+            if (!EditBatch::Parse(record.data, record.length, edits, error)) {
+                break;
+            }
+            if (EditBatch::Apply(text, edits) >= 0) {
+                error = "An edit in the journal doesn't fit the text";
+                break;
+            }
+        }
+        replayed++;
+    }
+    
+    if (error.empty()) {
+        text.EndStep();
+    } else {
+        text.AbortStep();
+    }
+    
+    if (!error.empty()) {
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    return Napi::Number::New(env, replayed);
+#endif
+}
+
+Napi::Value DocumentWrapper::GetUrl(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.url");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    if (!Awake()) {
+        return Napi::String::New(env, "");
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    QUrl url;
+    QtRunner::RunSync([&]() { url = m_document->url(); });
+    return Napi::String::New(env, url.toLocalFile().toStdString());
+#else
+    return Napi::String::New(env, m_fallback->Path());
+#endif
+}
+
+void DocumentWrapper::Undo(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.undo");
+    StatsScope scope(stats);
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (Awake()) {
+        QtRunner::RunSync([&]() { m_document->undo(); });
+    }
+#else
+    if (Awake()) {
+        m_fallback->Text().Undo();
+    }
+#endif
+}
+
+void DocumentWrapper::Redo(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.redo");
+    StatsScope scope(stats);
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (Awake()) {
+        QtRunner::RunSync([&]() { m_document->redo(); });
+    }
+#else
+    if (Awake()) {
+        m_fallback->Text().Redo();
+    }
+#endif
+}
+
+Napi::Value DocumentWrapper::GetSyntaxTokens(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.getSyntaxTokens");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    // Parameters: lineStart, lineEnd
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Expected lineStart and lineEnd as numbers").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    int lineStart = info[0].As<Napi::Number>().Int32Value();
+    int lineEnd = info[1].As<Napi::Number>().Int32Value();
+    
+    std::vector<SyntaxTokenData> tokens;
+    QtRunner::RunSync([&]() {
+        tokens = SyntaxTokens::Collect(m_tokenCache, lineStart, lineEnd);
+    });
+    
+    return SyntaxTokensToJs(env, tokens);
+#else
+    // Fallback: return empty array
+    return Napi::Array::New(env);
+#endif
+}
+
+Napi::Value DocumentWrapper::GetSyntaxTokensAsync(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.getSyntaxTokensAsync");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Expected lineStart and lineEnd as numbers").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    int lineStart = info[0].As<Napi::Number>().Int32Value();
+    int lineEnd = info[1].As<Napi::Number>().Int32Value();
+    
+    std::shared_ptr<KTextEditor::Document> document = m_document;
+    SyntaxTokenCache* cache = m_tokenCache;
+    return QtTask::Run<std::vector<SyntaxTokenData>>(env,
+        [document, cache, lineStart, lineEnd]() {
+            return SyntaxTokens::Collect(cache, lineStart, lineEnd);
+        },
+        SyntaxTokensToJs);
+#else
+    auto deferred = Napi::Promise::Deferred::New(env);
+    deferred.Resolve(Napi::Array::New(env));
+    return deferred.Promise();
+#endif
+}
+
+Napi::Value DocumentWrapper::GetSyntaxTokensPacked(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.getSyntaxTokensPacked");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Expected lineStart and lineEnd as numbers").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    int lineStart = info[0].As<Napi::Number>().Int32Value();
+    int lineEnd = info[1].As<Napi::Number>().Int32Value();
+    uint32_t knownLegend = LegendVersionFromJs(info, 2);
+    
+    PackedSyntaxTokens packed;
+    QtRunner::RunSync([&]() {
+        packed = SyntaxTokens::CollectPacked(m_tokenCache, lineStart, lineEnd, knownLegend);
+    });
+    
+    return PackedSyntaxTokensToJs(env, packed);
+#else
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("data", Napi::Uint32Array::New(env, 0));
+    result.Set("mode", Napi::String::New(env, ""));
+    result.Set("legendVersion", Napi::Number::New(env, 0));
+    return result;
+#endif
+}
+
+Napi::Value DocumentWrapper::GetSyntaxTokensPackedAsync(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.getSyntaxTokensPackedAsync");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Expected lineStart and lineEnd as numbers").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    int lineStart = info[0].As<Napi::Number>().Int32Value();
+    int lineEnd = info[1].As<Napi::Number>().Int32Value();
+    uint32_t knownLegend = LegendVersionFromJs(info, 2);
+    
+    std::shared_ptr<KTextEditor::Document> document = m_document;
+    SyntaxTokenCache* cache = m_tokenCache;
+    return QtTask::Run<PackedSyntaxTokens>(env,
+        [document, cache, lineStart, lineEnd, knownLegend]() {
+            return SyntaxTokens::CollectPacked(cache, lineStart, lineEnd, knownLegend);
+        },
+        PackedSyntaxTokensToJs);
+#else
+    auto deferred = Napi::Promise::Deferred::New(env);
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("data", Napi::Uint32Array::New(env, 0));
+    result.Set("mode", Napi::String::New(env, ""));
+    result.Set("legendVersion", Napi::Number::New(env, 0));
+    deferred.Resolve(result);
+    return deferred.Promise();
+#endif
+}
+
+Napi::Value DocumentWrapper::GetSyntaxTokensSince(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.getSyntaxTokensSince");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    // Parameters: revision, optional lineStart, lineEnd (defaults to the whole document), legendVersion
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Expected revision as number").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    int64_t revision = info[0].As<Napi::Number>().Int64Value();
+    int lineStart, lineEnd;
+    ParseLineRange(info, 1, lineStart, lineEnd);
+    uint32_t knownLegend = LegendVersionFromJs(info, 3);
+    
+    SyntaxTokenDelta delta;
+    QtRunner::RunSync([&]() {
+        delta = SyntaxTokens::CollectSince(m_tokenCache, static_cast<quint64>(qMax<int64_t>(revision, 0)),
+                                           lineStart, lineEnd, knownLegend);
+    });
+    
+    return SyntaxTokenDeltaToJs(env, delta);
+#else
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("revision", Napi::Number::New(env, 0));
+    result.Set("lineCount", Napi::Number::New(env, 0));
+    result.Set("reset", Napi::Boolean::New(env, true));
+    result.Set("shifts", Napi::Int32Array::New(env, 0));
+    result.Set("lines", Napi::Uint32Array::New(env, 0));
+    result.Set("offsets", Napi::Uint32Array::New(env, 1));
+    result.Set("data", Napi::Uint32Array::New(env, 0));
+    result.Set("mode", Napi::String::New(env, ""));
+    result.Set("legendVersion", Napi::Number::New(env, 0));
+    return result;
+#endif
+}
+
+Napi::Value DocumentWrapper::GetSyntaxLegend(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.getSyntaxLegend");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (!Awake()) {
+        return Napi::Array::New(env);
+    }
+    
+    QStringList legend;
+    QtRunner::RunSync([&]() { legend = SyntaxTokens::Legend(m_document->mode()); });
+    return StringListToJs(env, legend);
+#else
+    return Napi::Array::New(env);
+#endif
+}
+
+Napi::Value DocumentWrapper::GetFoldingRegions(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.getFoldingRegions");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    // Parameters: optional lineStart, lineEnd
+    int lineStart, lineEnd;
+    ParseLineRange(info, 0, lineStart, lineEnd);
+    
+    std::vector<FoldingRegionData> regions;
+    QtRunner::RunSync([&]() { regions = m_foldingIndex->Regions(lineStart, lineEnd); });
+    
+    return FoldingRegionsToJs(env, regions);
+#else
+    // Fallback: return empty array
+    return Napi::Array::New(env);
+#endif
+}
+
+Napi::Value DocumentWrapper::GetFoldingRegionsPacked(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.getFoldingRegionsPacked");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    int lineStart, lineEnd;
+    ParseLineRange(info, 0, lineStart, lineEnd);
+    
+    std::vector<uint32_t> data;
+    QtRunner::RunSync([&]() { data = m_foldingIndex->RegionsPacked(lineStart, lineEnd); });
+    
+    return PackedFoldingRegionsToJs(env, data);
+#else
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("data", Napi::Uint32Array::New(env, 0));
+    result.Set("kinds", Napi::Array::New(env));
+    return result;
+#endif
+}
+
+void DocumentWrapper::SetViewport(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.setViewport");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    // Parameters: first, last (inclusive), optional client id
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Expected (first, last, client?)").ThrowAsJavaScriptException();
+        return;
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return;
+    }
+    
+    int first = info[0].As<Napi::Number>().Int32Value();
+    int last = info[1].As<Napi::Number>().Int32Value();
+    QString client = info.Length() > 2 && info[2].IsString()
+        ? QString::fromStdString(info[2].As<Napi::String>().Utf8Value()) : QString();
+        
+    // Nothing to wait for; the scheduler picks it up in its next slice
+    HighlightScheduler* scheduler = m_scheduler;
+    QtRunner::Post([document = m_document, scheduler, client, first, last]() {
+        scheduler->SetViewport(client, first, last);
+    });
+#endif
+}
+
+void DocumentWrapper::ClearViewport(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.clearViewport");
+    StatsScope scope(stats);
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (!Awake()) {
+        return;
+    }
+    
+    QString client = info.Length() > 0 && info[0].IsString()
+        ? QString::fromStdString(info[0].As<Napi::String>().Utf8Value()) : QString();
+    HighlightScheduler* scheduler = m_scheduler;
+    QtRunner::Post([document = m_document, scheduler, client]() { scheduler->ClearViewport(client); });
+#endif
+}
+
+Napi::Value DocumentWrapper::GetFoldingRegionsAsync(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.getFoldingRegionsAsync");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    int lineStart, lineEnd;
+    ParseLineRange(info, 0, lineStart, lineEnd);
+    
+    std::shared_ptr<KTextEditor::Document> document = m_document;
+    FoldingIndex* index = m_foldingIndex;
+    return QtTask::Run<std::vector<FoldingRegionData>>(env,
+        [document, index, lineStart, lineEnd]() { return index->Regions(lineStart, lineEnd); },
+        FoldingRegionsToJs);
+#else
+    auto deferred = Napi::Promise::Deferred::New(env);
+    deferred.Resolve(Napi::Array::New(env));
+    return deferred.Promise();
+#endif
+}
+
+// Phase 8: Search and Replace Methods
+
+Napi::Value DocumentWrapper::Search(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.search");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    if (!Awake()) {
+        Napi::TypeError::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "First argument must be a search string").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    QString searchText = QString::fromStdString(info[0].As<Napi::String>().Utf8Value());
+    SearchOptions options = ParseSearchOptions(info, 1);
+    
+    std::vector<SearchMatch> matches;
+    QtRunner::RunSync([&]() {
+        matches = CollectSearchMatches(m_document.get(), searchText, options);
+    });
+    
+    return SearchMatchesToJs(env, matches);
+#else
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "First argument must be a search string").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    TextPattern pattern(Utf16FromJs(info[0]), ParseSearchOptions(info, 1));
+    return TextMatchesToJs(env, CollectTextMatches(m_fallback->Text(), pattern));
+#endif
+}
+
+Napi::Value DocumentWrapper::SearchAsync(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.searchAsync");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    if (!Awake()) {
+        Napi::TypeError::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "First argument must be a search string").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    // Parameters: query, optional options (may carry an AbortSignal as `signal`), optional onBatch
+    SearchOptions options = ParseSearchOptions(info, 1);
+    
+    Napi::Value signal = env.Undefined();
+    if (info.Length() > 1 && info[1].IsObject()) {
+        signal = info[1].As<Napi::Object>().Get("signal");
+    }
+    Napi::Value onBatch = info.Length() > 2 ? info[2] : env.Undefined();
+    
+#ifdef HAVE_KTEXTEDITOR
+    QString searchText = QString::fromStdString(info[0].As<Napi::String>().Utf8Value());
+    return BackgroundSearch::Start(env, m_document, searchText, options, onBatch, signal);
+#else
+    return BackgroundSearch::Start(env, m_fallback, Utf16FromJs(info[0]), options, onBatch, signal);
+#endif
+}
+
+Napi::Value DocumentWrapper::Replace(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.replace");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    if (!Awake()) {
+        Napi::TypeError::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return Napi::Boolean::New(env, false);
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (info.Length() < 4 || !info[0].IsNumber() || !info[1].IsNumber() || 
+        !info[2].IsNumber() || !info[3].IsString()) {
+        Napi::TypeError::New(env, "Arguments: line, column, length, replacement").ThrowAsJavaScriptException();
+        return Napi::Boolean::New(env, false);
+    }
+    
+    int line = info[0].As<Napi::Number>().Int32Value();
+    int column = info[1].As<Napi::Number>().Int32Value();
+    int length = info[2].As<Napi::Number>().Int32Value();
+    QString replacement = TextFromJs(info[3]);
+    
+    KTextEditor::Range range(line, column, line, column + length);
+    bool success = false;
+    QtRunner::RunSync([&]() { success = m_document->replaceText(range, replacement); });
+    
+    return Napi::Boolean::New(env, success);
+#else
+    if (info.Length() < 4 || !info[0].IsNumber() || !info[1].IsNumber() || 
+        !info[2].IsNumber() || !info[3].IsString()) {
+        Napi::TypeError::New(env, "Arguments: line, column, length, replacement").ThrowAsJavaScriptException();
+        return Napi::Boolean::New(env, false);
+    }
+    
+    int line = info[0].As<Napi::Number>().Int32Value();
+    int column = info[1].As<Napi::Number>().Int32Value();
+    int length = info[2].As<Napi::Number>().Int32Value();
+    std::u16string replacement = Utf16FromJs(info[3]);
+    
+    bool success = m_fallback->Text().Replace(line, column, line, column + length, replacement.data(), replacement.size());
+    return Napi::Boolean::New(env, success);
+#endif
+}
+
+Napi::Value DocumentWrapper::ReplaceAll(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.replaceAll");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    if (!Awake()) {
         Napi::TypeError::New(env, "Document not initialized").ThrowAsJavaScriptException();
         return Napi::Number::New(env, 0);
     }
     
+#ifdef HAVE_KTEXTEDITOR
     if (info.Length() < 2 || !info[0].IsString() || !info[1].IsString()) {
         Napi::TypeError::New(env, "Arguments: searchText, replacementText").ThrowAsJavaScriptException();
         return Napi::Number::New(env, 0);
     }
     
-    std::string searchText = info[0].As<Napi::String>().Utf8Value();
-    std::string replacementText = info[1].As<Napi::String>().Utf8Value();
+    QString searchText = QString::fromStdString(info[0].As<Napi::String>().Utf8Value());
+    QString replacementText = TextFromJs(info[1]);
     
-    // Parse options
-    bool caseSensitive = false;
-    bool wholeWords = false;
+    SearchPattern pattern(searchText, ParseSearchOptions(info, 2));
+    if (!pattern.IsValid()) {
+        Napi::Error::New(env, "Invalid search pattern: " + pattern.ErrorString().toStdString()).ThrowAsJavaScriptException();
+        return Napi::Number::New(env, 0);
+    }
     
-    if (info.Length() >= 3 && info[2].IsObject()) {
-        Napi::Object options = info[2].As<Napi::Object>();
-        
-        if (options.Has("caseSensitive") && options.Get("caseSensitive").IsBoolean()) {
-            caseSensitive = options.Get("caseSensitive").As<Napi::Boolean>().Value();
-        }
-        
-        if (options.Has("wholeWords") && options.Get("wholeWords").IsBoolean()) {
-            wholeWords = options.Get("wholeWords").As<Napi::Boolean>().Value();
-        }
+    // Find and replace in a single Qt thread round trip
+    int replacedCount = 0;
+    QtRunner::RunSync([&]() {
+        replacedCount = ReplaceMatches(m_document.get(), pattern, replacementText);
+    });
+    
+    return Napi::Number::New(env, replacedCount);
+#else
+    if (info.Length() < 2 || !info[0].IsString() || !info[1].IsString()) {
+        Napi::TypeError::New(env, "Arguments: searchText, replacementText").ThrowAsJavaScriptException();
+        return Napi::Number::New(env, 0);
     }
     
-    // First, find all occurrences (in reverse order to maintain positions)
-    Napi::Value searchResults = Search(info);
-    Napi::Array results = searchResults.As<Napi::Array>();
+    TextPattern pattern(Utf16FromJs(info[0]), ParseSearchOptions(info, 2));
+    if (!pattern.IsValid()) {
+        Napi::Error::New(env, "Invalid search pattern: " + pattern.ErrorString()).ThrowAsJavaScriptException();
+        return Napi::Number::New(env, 0);
+    }
     
-    int replacedCount = 0;
+    return Napi::Number::New(env, ReplaceTextMatches(m_fallback->Text(), pattern, Utf16FromJs(info[1])));
+#endif
+}
+
+Napi::Value DocumentWrapper::ReplaceAllAsync(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.replaceAllAsync");
+    StatsScope scope(stats);
     
-    // Replace from end to start to maintain positions
-    for (int i = results.Length() - 1; i >= 0; i--) {
-        Napi::Object result = results.Get(i).As<Napi::Object>();
-        int line = result.Get("line").As<Napi::Number>().Int32Value();
-        int column = result.Get("column").As<Napi::Number>().Int32Value();
-        int length = result.Get("length").As<Napi::Number>().Int32Value();
-        
-        KTextEditor::Range range(line, column, line, column + length);
-        if (m_document->replaceText(range, QString::fromStdString(replacementText))) {
-            replacedCount++;
-        }
+    Napi::Env env = info.Env();
+    
+    if (!Awake()) {
+        Napi::TypeError::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
     }
     
-    return Napi::Number::New(env, replacedCount);
+#ifdef HAVE_KTEXTEDITOR
+    if (info.Length() < 2 || !info[0].IsString() || !info[1].IsString()) {
+        Napi::TypeError::New(env, "Arguments: searchText, replacementText").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    QString searchText = QString::fromStdString(info[0].As<Napi::String>().Utf8Value());
+    QString replacementText = TextFromJs(info[1]);
+    
+    auto pattern = std::make_shared<const SearchPattern>(searchText, ParseSearchOptions(info, 2));
+    if (!pattern->IsValid()) {
+        auto deferred = Napi::Promise::Deferred::New(env);
+        deferred.Reject(Napi::Error::New(env, "Invalid search pattern: " + pattern->ErrorString().toStdString()).Value());
+        return deferred.Promise();
+    }
+    
+    std::shared_ptr<KTextEditor::Document> document = m_document;
+    return QtTask::Run<int>(env,
+        [document, pattern, replacementText]() {
+            return ReplaceMatches(document.get(), *pattern, replacementText);
+        },
+        [](Napi::Env env, int& count) -> Napi::Value {
+            return Napi::Number::New(env, count);
+        });
 #else
-    return Napi::Number::New(env, 0);
+    if (info.Length() < 2 || !info[0].IsString() || !info[1].IsString()) {
+        Napi::TypeError::New(env, "Arguments: searchText, replacementText").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    // Edits must happen on this thread, so this only differs from replaceAll() in how it reports
+    auto deferred = Napi::Promise::Deferred::New(env);
+    TextPattern pattern(Utf16FromJs(info[0]), ParseSearchOptions(info, 2));
+    if (!pattern.IsValid()) {
+        deferred.Reject(Napi::Error::New(env, "Invalid search pattern: " + pattern.ErrorString()).Value());
+        return deferred.Promise();
+    }
+    
+    deferred.Resolve(Napi::Number::New(env, ReplaceTextMatches(m_fallback->Text(), pattern, Utf16FromJs(info[1]))));
+    return deferred.Promise();
 #endif
 }
 
 // Phase 8: Indentation Methods
 
 Napi::Value DocumentWrapper::GetIndentation(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.getIndentation");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
+    if (!Awake()) {
         Napi::TypeError::New(env, "Document not initialized").ThrowAsJavaScriptException();
         return Napi::Number::New(env, 0);
     }
     
+#ifdef HAVE_KTEXTEDITOR
     if (info.Length() < 1 || !info[0].IsNumber()) {
         Napi::TypeError::New(env, "Line number required").ThrowAsJavaScriptException();
         return Napi::Number::New(env, 0);
@@ -688,38 +2611,50 @@ Napi::Value DocumentWrapper::GetIndentation(const Napi::CallbackInfo& info) {
     
     int line = info[0].As<Napi::Number>().Int32Value();
     
-    if (line < 0 || line >= m_document->lines()) {
-        return Napi::Number::New(env, 0);
-    }
-    
-    QString lineText = m_document->line(line);
     int indentation = 0;
-    
-    for (int i = 0; i < lineText.length(); i++) {
-        if (lineText[i] == ' ') {
-            indentation++;
-        } else if (lineText[i] == '\t') {
-            indentation += 4; // Tab = 4 spaces
-        } else {
-            break;
+    QtRunner::RunSync([&]() {
+        if (line < 0 || line >= m_document->lines()) {
+            return;
         }
-    }
+        
+        // Tabs advance to the document's real tab stops
+        LineMetadata metadata(LineMetadata::Indent, TabWidth(m_document.get()));
+        QString lineText = m_document->line(line);
+        metadata.Append(LineData(lineText), lineText.length());
+        indentation = metadata.Indents().front();
+    });
     
     return Napi::Number::New(env, indentation);
 #else
-    return Napi::Number::New(env, 0);
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Line number required").ThrowAsJavaScriptException();
+        return Napi::Number::New(env, 0);
+    }
+    
+    int line = info[0].As<Napi::Number>().Int32Value();
+    if (line < 0 || line >= m_fallback->Text().Lines()) {
+        return Napi::Number::New(env, 0);
+    }
+    
+    LineMetadata metadata(LineMetadata::Indent, FallbackDocument::TabWidth);
+    std::u16string lineText = m_fallback->Text().Line(line);
+    metadata.Append(lineText.data(), lineText.size());
+    return Napi::Number::New(env, metadata.Indents().front());
 #endif
 }
 
 void DocumentWrapper::SetIndentation(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.setIndentation");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
+    if (!Awake()) {
         Napi::TypeError::New(env, "Document not initialized").ThrowAsJavaScriptException();
         return;
     }
     
+#ifdef HAVE_KTEXTEDITOR
     if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
         Napi::TypeError::New(env, "Arguments: line, spaces").ThrowAsJavaScriptException();
         return;
@@ -728,40 +2663,69 @@ void DocumentWrapper::SetIndentation(const Napi::CallbackInfo& info) {
     int line = info[0].As<Napi::Number>().Int32Value();
     int spaces = info[1].As<Napi::Number>().Int32Value();
     
-    if (line < 0 || line >= m_document->lines()) {
+    QtRunner::RunSync([&]() {
+        if (line < 0 || line >= m_document->lines()) {
+            return;
+        }
+        
+        QString lineText = m_document->line(line);
+        
+        // Find where text starts (after indentation)
+        int textStart = 0;
+        for (int i = 0; i < lineText.length(); i++) {
+            if (!lineText[i].isSpace()) {
+                textStart = i;
+                break;
+            }
+        }
+        
+        // Create new indentation
+        QString newIndent = QString(spaces, ' ');
+        QString newText = newIndent + lineText.mid(textStart);
+        
+        // Replace the line
+        KTextEditor::Range range(line, 0, line, lineText.length());
+        m_document->replaceText(range, newText);
+    });
+#else
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Arguments: line, spaces").ThrowAsJavaScriptException();
         return;
     }
     
-    QString lineText = m_document->line(line);
+    int line = info[0].As<Napi::Number>().Int32Value();
+    int spaces = info[1].As<Napi::Number>().Int32Value();
+    PieceTable& text = m_fallback->Text();
+    if (line < 0 || line >= text.Lines()) {
+        return;
+    }
     
-    // Find where text starts (after indentation)
+    // Same as above: the leading whitespace becomes `spaces` spaces
+    std::u16string lineText = text.Line(line);
     int textStart = 0;
-    for (int i = 0; i < lineText.length(); i++) {
-        if (!lineText[i].isSpace()) {
-            textStart = i;
+    for (size_t i = 0; i < lineText.size(); i++) {
+        if (!std::iswspace(static_cast<wint_t>(lineText[i]))) {
+            textStart = static_cast<int>(i);
             break;
         }
     }
-    
-    // Create new indentation
-    QString newIndent = QString(spaces, ' ');
-    QString newText = newIndent + lineText.mid(textStart);
-    
-    // Replace the line
-    KTextEditor::Range range(line, 0, line, lineText.length());
-    m_document->replaceText(range, newText);
+    std::u16string indent(static_cast<size_t>(std::max(spaces, 0)), u' ');
+    text.Replace(line, 0, line, textStart, indent.data(), indent.size());
 #endif
 }
 
 void DocumentWrapper::IndentLine(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.indentLine");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
+    if (!Awake()) {
         Napi::TypeError::New(env, "Document not initialized").ThrowAsJavaScriptException();
         return;
     }
     
+#ifdef HAVE_KTEXTEDITOR
     if (info.Length() < 1 || !info[0].IsNumber()) {
         Napi::TypeError::New(env, "Line number required").ThrowAsJavaScriptException();
         return;
@@ -769,25 +2733,60 @@ void DocumentWrapper::IndentLine(const Napi::CallbackInfo& info) {
     
     int line = info[0].As<Napi::Number>().Int32Value();
     
-    if (line < 0 || line >= m_document->lines()) {
+    QtRunner::RunSync([&]() {
+        if (line < 0 || line >= m_document->lines()) {
+            return;
+        }
+        
+        // Use Kate's smart indentation
+        KTextEditor::Range range(line, 0, line, 0);
+        m_document->indent(range, 1);
+    });
+#else
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Line number required").ThrowAsJavaScriptException();
         return;
     }
     
-    // Use Kate's smart indentation
-    KTextEditor::Range range(line, 0, line, 0);
-    m_document->indent(range, 1);
+    // No indenter here: one level of Kate's default indentation
+    int line = info[0].As<Napi::Number>().Int32Value();
+    if (line >= 0 && line < m_fallback->Text().Lines()) {
+        std::u16string indent(FallbackDocument::IndentWidth, u' ');
+        m_fallback->Text().Insert(line, 0, indent.data(), indent.size());
+    }
 #endif
 }
 
 void DocumentWrapper::IndentLines(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.indentLines");
+    StatsScope scope(stats);
+    
     Napi::Env env = info.Env();
     
-#ifdef HAVE_KTEXTEDITOR
-    if (!m_document) {
+    if (!Awake()) {
         Napi::TypeError::New(env, "Document not initialized").ThrowAsJavaScriptException();
         return;
     }
     
+#ifdef HAVE_KTEXTEDITOR
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Arguments: startLine, endLine").ThrowAsJavaScriptException();
+        return;
+    }
+    
+    int startLine = info[0].As<Napi::Number>().Int32Value();
+    int endLine = info[1].As<Napi::Number>().Int32Value();
+    
+    QtRunner::RunSync([&]() {
+        if (startLine < 0 || endLine >= m_document->lines() || startLine > endLine) {
+            return;
+        }
+        
+        // Use Kate's smart indentation for range
+        KTextEditor::Range range(startLine, 0, endLine, m_document->lineLength(endLine));
+        m_document->indent(range, 1);
+    });
+#else
     if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
         Napi::TypeError::New(env, "Arguments: startLine, endLine").ThrowAsJavaScriptException();
         return;
@@ -795,15 +2794,361 @@ void DocumentWrapper::IndentLines(const Napi::CallbackInfo& info) {
     
     int startLine = info[0].As<Napi::Number>().Int32Value();
     int endLine = info[1].As<Napi::Number>().Int32Value();
+    PieceTable& text = m_fallback->Text();
+    if (startLine < 0 || endLine >= text.Lines() || startLine > endLine) {
+        return;
+    }
     
-    if (startLine < 0 || endLine >= m_document->lines() || startLine > endLine) {
+    // One undo step, as KTextEditor's indent() is
+    std::u16string indent(FallbackDocument::IndentWidth, u' ');
+    text.BeginStep();
+    for (int line = startLine; line <= endLine; line++) {
+        text.Insert(line, 0, indent.data(), indent.size());
+    }
+    text.EndStep();
+#endif
+}
+
+Napi::Value DocumentWrapper::GetLineMetadata(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.getLineMetadata");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    // Parameters: lineStart?, lineEnd?, fields? (names; every field by default)
+    int fields = LineMetadata::AllFields;
+    if (info.Length() >= 3 && info[2].IsArray()) {
+        Napi::Array names = info[2].As<Napi::Array>();
+        fields = 0;
+        for (uint32_t i = 0; i < names.Length(); i++) {
+            Napi::Value name = names.Get(i);
+            std::string field = name.IsString() ? name.As<Napi::String>().Utf8Value() : std::string();
+            if (field == "indent") {
+                fields |= LineMetadata::Indent;
+            } else if (field == "length") {
+                fields |= LineMetadata::Length;
+            } else if (field == "firstNonWhitespace") {
+                fields |= LineMetadata::FirstNonWhitespace;
+            } else if (field == "hash") {
+                fields |= LineMetadata::Hash;
+            } else {
+                Napi::TypeError::New(env, "Unknown line metadata field: " + field).ThrowAsJavaScriptException();
+                return env.Null();
+            }
+        }
+    }
+    
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    int lineStart, lineEnd;
+    ParseLineRange(info, 0, lineStart, lineEnd);
+    
+    std::unique_ptr<LineMetadata> metadata;
+    int lineCount = 0;
+    QtRunner::RunSync([&]() {
+        metadata = std::make_unique<LineMetadata>(fields, TabWidth(m_document.get()));
+        lineStart = qMax(lineStart, 0);
+        lineEnd = qMin(lineEnd, m_document->lines() - 1);
+        if (lineStart > lineEnd) {
+            return;
+        }
+        
+        lineCount = lineEnd - lineStart + 1;
+        metadata->Reserve(lineCount);
+        for (int line = lineStart; line <= lineEnd; line++) {
+            QString lineText = m_document->line(line);
+            metadata->Append(LineData(lineText), lineText.length());
+        }
+    });
+    
+    return LineMetadataToJs(env, *metadata, lineStart, lineCount);
+#else
+    int lineStart, lineEnd;
+    ParseLineRange(info, 0, lineStart, lineEnd);
+    
+    const PieceTable& text = m_fallback->Text();
+    LineMetadata metadata(fields, FallbackDocument::TabWidth);
+    lineStart = std::max(lineStart, 0);
+    lineEnd = std::min(lineEnd, text.Lines() - 1);
+    int lineCount = lineStart > lineEnd ? 0 : lineEnd - lineStart + 1;
+    
+    metadata.Reserve(lineCount);
+    for (int line = lineStart; line <= lineEnd; line++) {
+        std::u16string lineText = text.Line(line);
+        metadata.Append(lineText.data(), lineText.size());
+    }
+    
+    return LineMetadataToJs(env, metadata, lineStart, lineCount);
+#endif
+}
+
+Napi::Value DocumentWrapper::DetectIndentation(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.detectIndentation");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    Napi::Object result = Napi::Object::New(env);
+    
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    IndentDetector detector;
+    int tabWidth = 4;
+    int configuredWidth = 4;
+    bool configuredSpaces = true;
+    QtRunner::RunSync([&]() {
+        tabWidth = TabWidth(m_document.get());
+        configuredWidth = ConfigValue(m_document.get(), QStringLiteral("indent-width"), 4).toInt();
+        configuredSpaces = ConfigValue(m_document.get(), QStringLiteral("replace-tabs"), true).toBool();
+        
+        // Large documents are sampled in evenly spread runs of consecutive lines
+        int lineCount = m_document->lines();
+        int runs = IndentDetector::SampleLines / IndentDetector::SampleRunLines;
+        if (lineCount <= IndentDetector::SampleLines) {
+            runs = 1;
+        }
+        int runLines = runs == 1 ? lineCount : IndentDetector::SampleRunLines;
+        
+        for (int run = 0; run < runs; run++) {
+            int first = runs == 1 ? 0
+                : static_cast<int>(static_cast<int64_t>(lineCount - runLines) * run / (runs - 1));
+            detector.Skip();
+            for (int line = first; line < first + runLines; line++) {
+                QString lineText = m_document->line(line);
+                detector.Add(LineData(lineText), lineText.length());
+            }
+        }
+    });
+    
+    // Without evidence, the document's configured style
+    bool detected = detector.HasEvidence() && (detector.UsesTabs() || detector.IndentWidth() > 0);
+    bool insertSpaces = detected ? !detector.UsesTabs() : configuredSpaces;
+    int indentWidth = !detected ? configuredWidth : insertSpaces ? detector.IndentWidth() : tabWidth;
+    
+    result.Set("insertSpaces", Napi::Boolean::New(env, insertSpaces));
+    result.Set("indentWidth", Napi::Number::New(env, indentWidth));
+    result.Set("tabWidth", Napi::Number::New(env, tabWidth));
+    result.Set("detected", Napi::Boolean::New(env, detected));
+    result.Set("sampledLines", Napi::Number::New(env, detector.SampledLines()));
+#else
+    // Sampled as above, against Kate's default configuration
+    const PieceTable& text = m_fallback->Text();
+    IndentDetector detector;
+    int tabWidth = FallbackDocument::TabWidth;
+    int lineCount = text.Lines();
+    int runs = IndentDetector::SampleLines / IndentDetector::SampleRunLines;
+    if (lineCount <= IndentDetector::SampleLines) {
+        runs = 1;
+    }
+    int runLines = runs == 1 ? lineCount : IndentDetector::SampleRunLines;
+    
+    for (int run = 0; run < runs; run++) {
+        int first = runs == 1 ? 0
+            : static_cast<int>(static_cast<int64_t>(lineCount - runLines) * run / (runs - 1));
+        detector.Skip();
+        for (int line = first; line < first + runLines; line++) {
+            std::u16string lineText = text.Line(line);
+            detector.Add(lineText.data(), lineText.size());
+        }
+    }
+    
+    bool detected = detector.HasEvidence() && (detector.UsesTabs() || detector.IndentWidth() > 0);
+    bool insertSpaces = detected ? !detector.UsesTabs() : true;
+    int indentWidth = !detected ? FallbackDocument::IndentWidth : insertSpaces ? detector.IndentWidth() : tabWidth;
+    
+    result.Set("insertSpaces", Napi::Boolean::New(env, insertSpaces));
+    result.Set("indentWidth", Napi::Number::New(env, indentWidth));
+    result.Set("tabWidth", Napi::Number::New(env, tabWidth));
+    result.Set("detected", Napi::Boolean::New(env, detected));
+    result.Set("sampledLines", Napi::Number::New(env, detector.SampledLines()));
+#endif
+    
+    return result;
+}
+
+// Line diffs
+
+Napi::Value DocumentWrapper::Diff(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.diff");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    // Parameters: base (a document or text), optional { ignoreWhitespace }
+    if (info.Length() < 1 || !(IsText(info[0]) || info[0].IsObject())) {
+        Napi::TypeError::New(env, "Expected a document or text to diff against").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    bool ignoreWhitespace = false;
+    if (info.Length() > 1 && info[1].IsObject()) {
+        Napi::Value value = info[1].As<Napi::Object>().Get("ignoreWhitespace");
+        ignoreWhitespace = value.IsBoolean() && value.As<Napi::Boolean>().Value();
+    }
+    
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    // Text is split and hashed here, so the Qt thread only copies hashes
+    std::vector<uint64_t> baseHashes;
+    LineHashes* baseLines = nullptr;
+    
+    // Held so neither document can hibernate while the other one wakes
+    std::shared_ptr<KTextEditor::Document> document = m_document;
+    std::shared_ptr<KTextEditor::Document> baseDocument;
+    if (IsText(info[0])) {
+        baseHashes = LineHashes::HashText(TextFromJs(info[0]), ignoreWhitespace);
+    } else {
+        DocumentWrapper* base = Napi::ObjectWrap<DocumentWrapper>::Unwrap(info[0].As<Napi::Object>());
+        baseDocument = base ? base->Document() : nullptr;
+        if (!baseDocument) {
+            Napi::Error::New(env, "Base document not initialized").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        baseLines = base->m_lineHashes;
+    }
+    
+    std::vector<uint64_t> hashes;
+    QtRunner::RunSync([&]() {
+        if (baseLines) {
+            baseHashes = ignoreWhitespace ? baseLines->HashesIgnoringWhitespace() : baseLines->Hashes();
+        }
+        hashes = ignoreWhitespace ? m_lineHashes->HashesIgnoringWhitespace() : m_lineHashes->Hashes();
+    });
+    
+    return Int32ArrayToJs(env, LineDiff::Compute(baseHashes, hashes));
+#else
+    std::vector<uint64_t> baseHashes;
+    if (IsText(info[0])) {
+        std::u16string baseText = Utf16FromJs(info[0]);
+        baseHashes = FallbackDocument::HashText(baseText.data(), baseText.size(), ignoreWhitespace);
+    } else {
+        DocumentWrapper* base = Napi::ObjectWrap<DocumentWrapper>::Unwrap(info[0].As<Napi::Object>());
+        if (!base || !base->m_fallback) {
+            Napi::Error::New(env, "Base document not initialized").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        baseHashes = base->m_fallback->Hashes(ignoreWhitespace);
+    }
+    
+    return Int32ArrayToJs(env, LineDiff::Compute(baseHashes, m_fallback->Hashes(ignoreWhitespace)));
+#endif
+}
+
+Napi::Value DocumentWrapper::GetDirtyLines(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.getDirtyLines");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    if (!Awake()) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    std::vector<int32_t> hunks;
+    QtRunner::RunSync([&]() { hunks = m_lineHashes->DirtyHunks(); });
+    return Int32ArrayToJs(env, hunks);
+#else
+    return Int32ArrayToJs(env, m_fallback->DirtyHunks());
+#endif
+}
+
+// Events
+
+void DocumentWrapper::On(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.on");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsString() || !info[1].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (event, callback)").ThrowAsJavaScriptException();
         return;
     }
     
-    // Use Kate's smart indentation for range
-    KTextEditor::Range range(startLine, 0, endLine, m_document->lineLength(endLine));
-    m_document->indent(range, 1);
+    std::string event = info[0].As<Napi::String>().Utf8Value();
+#ifndef HAVE_KTEXTEDITOR
+    if (event == "tokensChanged") {
+        Napi::Error::New(env, "Syntax tokens need the KTextEditor build").ThrowAsJavaScriptException();
+        return;
+    }
+#endif
+    
+    if (!m_events) {
+        m_events = std::make_shared<DocumentEvents>(env);
+    }
+    
+    if (!m_events->AddListener(event, info[1].As<Napi::Function>())) {
+        Napi::TypeError::New(env, "Unknown event: " + event).ThrowAsJavaScriptException();
+        return;
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    if (Awake()) {
+        std::shared_ptr<DocumentEvents> events = m_events;
+        bool tokens = event == "tokensChanged";
+        QtRunner::RunSync([&]() {
+            events->Attach(m_document.get());
+            if (tokens) {
+                m_scheduler->SetEvents(events);
+            }
+        });
+    }
+#else
+    // Edits are recorded right where they are made, on this thread
+    m_events->Attach(*m_fallback);
+#endif
+}
+
+void DocumentWrapper::Off(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.off");
+    StatsScope scope(stats);
+    
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "Expected (event, callback?)").ThrowAsJavaScriptException();
+        return;
+    }
+    
+    std::string event = info[0].As<Napi::String>().Utf8Value();
+    Napi::Value callback = info.Length() > 1 ? info[1] : env.Undefined();
+    if (m_events && !m_events->RemoveListener(event, callback)) {
+        Napi::TypeError::New(env, "Unknown event: " + event).ThrowAsJavaScriptException();
+    }
+}
+
+Napi::Value DocumentWrapper::Hibernate(const Napi::CallbackInfo& info) {
+    static MethodStats& stats = Stats::ForMethod("KateDocument.hibernate");
+    StatsScope scope(stats);
+    
+#ifdef HAVE_KTEXTEDITOR
+    // Regardless of the budget; false when the document is in use
+    bool hibernated = TryHibernate();
+    if (hibernated) {
+        Hibernation::Hibernated(this);
+    }
+    return Napi::Boolean::New(info.Env(), hibernated || HasSnapshot());
+#else
+    return Napi::Boolean::New(info.Env(), false);
 #endif
 }
 
+Napi::Value DocumentWrapper::IsHibernated(const Napi::CallbackInfo& info) {
+    // Asking doesn't wake the document
+    return Napi::Boolean::New(info.Env(), m_snapshot != nullptr);
+}
+
 } // namespace KateNative
@@ -2,9 +2,12 @@
 #define DOCUMENT_WRAPPER_H
 
 #include <napi.h>
+#include <cstddef>
 #include <memory>
 
 // Forward declarations
+class QString;
+
 namespace KTextEditor {
     class Document;
     class Editor;
@@ -12,6 +15,19 @@ namespace KTextEditor {
 
 namespace KateNative {
 
+class SyntaxTokenCache;
+class FoldingIndex;
+class LineIndex;
+class LineHashes;
+class ColumnMap;
+class DocumentAnchors;
+class DocumentEvents;
+class HighlightScheduler;
+class Hibernation;
+class JournalRecorder;
+class FallbackDocument;
+struct DocumentSnapshot;
+
 /**
  * JavaScript wrapper for KTextEditor::Document
  * 
@@ -25,20 +41,60 @@ public:
     
     DocumentWrapper(const Napi::CallbackInfo& info);
     ~DocumentWrapper();
+    
+    // Shared with objects that operate on this document (e.g. search
+    // sessions); a hibernated document is restored first
+    std::shared_ptr<KTextEditor::Document> Document();
+    
+    // The document of a build without KTextEditor; null in one with it
+    std::shared_ptr<FallbackDocument> Fallback() const { return m_fallback; }
+    
+    /**
+     * Move the content into a snapshot and release the KTextEditor
+     * document, unless something else uses it; see Hibernation
+     */
+    bool TryHibernate();
+    bool HasSnapshot() const { return m_snapshot != nullptr; }
+    size_t SnapshotBytes() const;
 
 private:
+    friend class Hibernation;
+    
+    // Restore a hibernated document and mark it used; false when there is no document
+    bool Awake();
+    
+    // Take a document from the pool, restore the snapshot into it and attach the indexes
+    void Adopt(const QString& mode, const DocumentSnapshot* snapshot);
+    
     // Document operations
     Napi::Value GetText(const Napi::CallbackInfo& info);
+    Napi::Value GetTextAsync(const Napi::CallbackInfo& info);
+    Napi::Value GetTextBuffer(const Napi::CallbackInfo& info);
+    Napi::Value GetTextBufferAsync(const Napi::CallbackInfo& info);
     void SetText(const Napi::CallbackInfo& info);
     Napi::Value GetLine(const Napi::CallbackInfo& info);
+    Napi::Value GetLines(const Napi::CallbackInfo& info);
     void InsertText(const Napi::CallbackInfo& info);
     void RemoveText(const Napi::CallbackInfo& info);
+    Napi::Value ApplyEdits(const Napi::CallbackInfo& info);
     
     // Document properties
     Napi::Value GetLineCount(const Napi::CallbackInfo& info);
     Napi::Value GetLength(const Napi::CallbackInfo& info);
+    
+    // Offset <-> position conversion
+    Napi::Value OffsetAt(const Napi::CallbackInfo& info);
+    Napi::Value PositionAt(const Napi::CallbackInfo& info);
+    Napi::Value OffsetsAt(const Napi::CallbackInfo& info);
+    Napi::Value PositionsAt(const Napi::CallbackInfo& info);
+    Napi::Value ConvertPositions(const Napi::CallbackInfo& info);
     Napi::Value IsModified(const Napi::CallbackInfo& info);
     
+    // Moving range anchors
+    Napi::Value CreateAnchors(const Napi::CallbackInfo& info);
+    Napi::Value GetAnchors(const Napi::CallbackInfo& info);
+    Napi::Value ReleaseAnchors(const Napi::CallbackInfo& info);
+    
     // Syntax highlighting
     Napi::Value GetMode(const Napi::CallbackInfo& info);
     void SetMode(const Napi::CallbackInfo& info);
@@ -46,28 +102,85 @@ private:
     
     // File operations
     Napi::Value OpenUrl(const Napi::CallbackInfo& info);
+    Napi::Value OpenUrlAsync(const Napi::CallbackInfo& info);
     Napi::Value SaveUrl(const Napi::CallbackInfo& info);
+    Napi::Value SaveAsync(const Napi::CallbackInfo& info);
     Napi::Value GetUrl(const Napi::CallbackInfo& info);
     
+    // Edit journal
+    void SetJournal(const Napi::CallbackInfo& info);
+    Napi::Value FlushJournalAsync(const Napi::CallbackInfo& info);
+    Napi::Value RecoverJournal(const Napi::CallbackInfo& info);
+    
     // Undo/Redo
     void Undo(const Napi::CallbackInfo& info);
     void Redo(const Napi::CallbackInfo& info);
     
     // Phase 7: Advanced features
     Napi::Value GetSyntaxTokens(const Napi::CallbackInfo& info);
+    Napi::Value GetSyntaxTokensAsync(const Napi::CallbackInfo& info);
+    Napi::Value GetSyntaxTokensPacked(const Napi::CallbackInfo& info);
+    Napi::Value GetSyntaxTokensPackedAsync(const Napi::CallbackInfo& info);
+    Napi::Value GetSyntaxTokensSince(const Napi::CallbackInfo& info);
+    Napi::Value GetSyntaxLegend(const Napi::CallbackInfo& info);
     Napi::Value GetFoldingRegions(const Napi::CallbackInfo& info);
+    Napi::Value GetFoldingRegionsAsync(const Napi::CallbackInfo& info);
+    Napi::Value GetFoldingRegionsPacked(const Napi::CallbackInfo& info);
+    void SetViewport(const Napi::CallbackInfo& info);
+    void ClearViewport(const Napi::CallbackInfo& info);
     
     // Phase 8: Advanced editing features
     Napi::Value Search(const Napi::CallbackInfo& info);
+    Napi::Value SearchAsync(const Napi::CallbackInfo& info);
     Napi::Value Replace(const Napi::CallbackInfo& info);
     Napi::Value ReplaceAll(const Napi::CallbackInfo& info);
+    Napi::Value ReplaceAllAsync(const Napi::CallbackInfo& info);
     Napi::Value GetIndentation(const Napi::CallbackInfo& info);
     void SetIndentation(const Napi::CallbackInfo& info);
     void IndentLine(const Napi::CallbackInfo& info);
     void IndentLines(const Napi::CallbackInfo& info);
+    Napi::Value GetLineMetadata(const Napi::CallbackInfo& info);
+    Napi::Value DetectIndentation(const Napi::CallbackInfo& info);
+    
+    // Line diffs
+    Napi::Value Diff(const Napi::CallbackInfo& info);
+    Napi::Value GetDirtyLines(const Napi::CallbackInfo& info);
+    
+    // Events
+    void On(const Napi::CallbackInfo& info);
+    void Off(const Napi::CallbackInfo& info);
     
+    // Hibernation
+    Napi::Value Hibernate(const Napi::CallbackInfo& info);
+    Napi::Value IsHibernated(const Napi::CallbackInfo& info);
+    
+    // Owned by the Qt thread; the deleter queues destruction there
     std::shared_ptr<KTextEditor::Document> m_document;
-    static KTextEditor::Editor* s_editor;
+    
+    // Created by the first on(); listeners live on the JavaScript thread
+    std::shared_ptr<DocumentEvents> m_events;
+    
+    // Children of m_document, so they live exactly as long as the document;
+    // only touched on the Qt thread
+    SyntaxTokenCache* m_tokenCache = nullptr;
+    FoldingIndex* m_foldingIndex = nullptr;
+    LineIndex* m_lineIndex = nullptr;
+    LineHashes* m_lineHashes = nullptr;
+    ColumnMap* m_columnMap = nullptr;
+    HighlightScheduler* m_scheduler = nullptr;
+    
+    // Created by the first createAnchors(); a document with anchors doesn't hibernate
+    DocumentAnchors* m_anchors = nullptr;
+    
+    // Set by setJournal(); a journaled document doesn't hibernate
+    JournalRecorder* m_journal = nullptr;
+    
+    // Set while hibernated, when m_document is empty
+    std::shared_ptr<DocumentSnapshot> m_snapshot;
+    
+    // Takes the place of all of the above when built without KTextEditor;
+    // lives on the JavaScript thread
+    std::shared_ptr<FallbackDocument> m_fallback;
 };
 
 } // namespace KateNative
@@ -0,0 +1,198 @@
+#include "edit_batch.h"
+#include <cstring>
+
+#ifdef HAVE_KTEXTEDITOR
+#include <KTextEditor/Document>
+#include <KTextEditor/MovingInterface>
+#include <KTextEditor/MovingRange>
+#include <QString>
+#include <memory>
+#include <vector>
+#else
+#include "piece_table.h"
+#endif
+
+namespace KateNative {
+
+namespace {
+
+uint32_t ReadField(const uint8_t* data, size_t index) {
+    // The records need not be 4-byte aligned inside a typed array view
+    uint32_t value;
+    std::memcpy(&value, data + index * sizeof(uint32_t), sizeof(uint32_t));
+    return value;
+}
+
+bool IsPosition(uint32_t line, uint32_t column) {
+    return line <= INT32_MAX && column <= INT32_MAX;
+}
+
+} // namespace
+
+bool EditBatch::Parse(const uint8_t* data, size_t byteLength,
+                      std::vector<PackedEdit>& edits, std::string& error) {
+    if (byteLength < sizeof(uint32_t)) {
+        error = "Edit buffer is missing its edit count";
+        return false;
+    }
+    
+    size_t count = ReadField(data, 0);
+    size_t wordCount = byteLength / sizeof(uint32_t);
+    if (count > (wordCount - 1) / FieldsPerEdit) {
+        error = "Edit buffer is shorter than its edit count";
+        return false;
+    }
+    
+    size_t payloadStart = (1 + count * FieldsPerEdit) * sizeof(uint32_t);
+    const uint8_t* payload = data + payloadStart;
+    size_t payloadLength = (byteLength - payloadStart) / sizeof(char16_t);
+    if (reinterpret_cast<uintptr_t>(payload) % alignof(char16_t) != 0) {
+        error = "Edit buffer must start at an even byte offset";
+        return false;
+    }
+    
+    edits.clear();
+    edits.reserve(count);
+    
+    for (size_t i = 0; i < count; i++) {
+        size_t field = 1 + i * FieldsPerEdit;
+        uint32_t op = ReadField(data, field);
+        uint32_t startLine = ReadField(data, field + 1);
+        uint32_t startColumn = ReadField(data, field + 2);
+        uint32_t endLine = ReadField(data, field + 3);
+        uint32_t endColumn = ReadField(data, field + 4);
+        uint32_t textOffset = ReadField(data, field + 5);
+        uint32_t textLength = ReadField(data, field + 6);
+        
+        if (op > OpReplace) {
+            error = "Edit " + std::to_string(i) + " has an unknown op";
+            return false;
+        }
+        if (op == OpInsert) {
+            endLine = startLine;
+            endColumn = startColumn;
+        }
+        if (op == OpRemove) {
+            textOffset = 0;
+            textLength = 0;
+        }
+        if (!IsPosition(startLine, startColumn) || !IsPosition(endLine, endColumn)) {
+            error = "Edit " + std::to_string(i) + " has an out of range position";
+            return false;
+        }
+        if (textOffset > payloadLength || textLength > payloadLength - textOffset) {
+            error = "Edit " + std::to_string(i) + " has text outside the payload";
+            return false;
+        }
+        
+        edits.push_back({op,
+                         static_cast<int>(startLine), static_cast<int>(startColumn),
+                         static_cast<int>(endLine), static_cast<int>(endColumn),
+                         reinterpret_cast<const char16_t*>(payload) + textOffset,
+                         static_cast<int>(textLength)});
+    }
+    
+    return true;
+}
+
+#ifdef HAVE_KTEXTEDITOR
+int EditBatch::Apply(KTextEditor::Document* document, const std::vector<PackedEdit>& edits) {
+    // One undo step, and highlighting is only updated once at the end
+    KTextEditor::Document::EditingTransaction transaction(document);
+    std::vector<Inverse> inverses;
+    int failed = Apply(document, edits, inverses);
+    if (failed >= 0) {
+        Revert(document, inverses);
+    }
+    return failed;
+}
+
+int EditBatch::Apply(KTextEditor::Document* document, const std::vector<PackedEdit>& edits,
+                     std::vector<Inverse>& inverses) {
+    KTextEditor::Document::EditingTransaction transaction(document);
+    auto* moving = qobject_cast<KTextEditor::MovingInterface*>(document);
+    inverses.reserve(inverses.size() + edits.size());
+    
+    for (size_t i = 0; i < edits.size(); i++) {
+        const PackedEdit& edit = edits[i];
+        KTextEditor::Cursor start(edit.startLine, edit.startColumn);
+        KTextEditor::Range range(start, KTextEditor::Cursor(edit.endLine, edit.endColumn));
+        QString text(reinterpret_cast<const QChar*>(edit.text), edit.textLength);
+        
+        KTextEditor::Cursor at = edit.op == OpInsert ? start : range.start();
+        QString removed = edit.op == OpInsert ? QString() : document->text(range);
+        
+        // Grows over the inserted text, including any padding the document adds before it
+        std::unique_ptr<KTextEditor::MovingRange> tracked(moving
+            ? moving->newMovingRange(KTextEditor::Range(at, at), KTextEditor::MovingRange::ExpandRight) : nullptr);
+        
+        bool applied = false;
+        switch (edit.op) {
+        case OpInsert:
+            applied = document->insertText(start, text);
+            break;
+        case OpRemove:
+            applied = document->removeText(range);
+            break;
+        case OpReplace:
+            applied = document->replaceText(range, text);
+            break;
+        }
+        
+        if (!applied) {
+            return static_cast<int>(i);
+        }
+        inverses.push_back({tracked ? tracked->toRange() : KTextEditor::Range(at, at), removed});
+    }
+    
+    return -1;
+}
+
+void EditBatch::Revert(KTextEditor::Document* document, const std::vector<Inverse>& inverses) {
+    // Later edits first, so each range is where its edit left it
+    for (auto it = inverses.rbegin(); it != inverses.rend(); ++it) {
+        document->replaceText(it->inserted, it->removed);
+    }
+}
+
+int64_t EditBatch::Revision(KTextEditor::Document* document) {
+    auto* moving = qobject_cast<KTextEditor::MovingInterface*>(document);
+    return moving ? moving->revision() : -1;
+}
+#else
+int EditBatch::Apply(PieceTable& text, const std::vector<PackedEdit>& edits) {
+    text.BeginStep();
+    
+    int failed = -1;
+    for (size_t i = 0; i < edits.size() && failed < 0; i++) {
+        const PackedEdit& edit = edits[i];
+        size_t length = static_cast<size_t>(edit.textLength);
+        
+        bool applied = false;
+        switch (edit.op) {
+        case OpInsert:
+            applied = text.Insert(edit.startLine, edit.startColumn, edit.text, length);
+            break;
+        case OpRemove:
+            applied = text.Remove(edit.startLine, edit.startColumn, edit.endLine, edit.endColumn);
+            break;
+        case OpReplace:
+            applied = text.Replace(edit.startLine, edit.startColumn, edit.endLine, edit.endColumn, edit.text, length);
+            break;
+        }
+        
+        if (!applied) {
+            failed = static_cast<int>(i);
+        }
+    }
+    
+    if (failed >= 0) {
+        text.AbortStep();
+    } else {
+        text.EndStep();
+    }
+    return failed;
+}
+#endif
+
+} // namespace KateNative
@@ -0,0 +1,108 @@
+#ifndef EDIT_BATCH_H
+#define EDIT_BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_KTEXTEDITOR
+#include <KTextEditor/Range>
+#include <QString>
+#endif
+
+namespace KTextEditor {
+    class Document;
+}
+
+namespace KateNative {
+
+class PieceTable;
+
+/**
+ * One record of a packed edit buffer
+ * `text` points into the buffer; it is only valid while the buffer is.
+ */
+struct PackedEdit {
+    uint32_t op;
+    int startLine;
+    int startColumn;
+    int endLine;
+    int endColumn;
+    const char16_t* text;
+    int textLength;
+};
+
+/**
+ * Packed Edit Batch
+ *
+ * Layout of the buffer, all values in native byte order:
+ *
+ *   uint32 count
+ *   count records of 7 uint32: op, startLine, startColumn, endLine,
+ *                              endColumn, textOffset, textLength
+ *   UTF-16 payload
+ *
+ * textOffset and textLength count UTF-16 code units from the start of the
+ * payload. Inserts ignore the end position; removes ignore the text. The
+ * edits are applied in order, each one against the document as the
+ * previous edits have left it.
+ */
+class EditBatch {
+public:
+    enum Op : uint32_t {
+        OpInsert = 0,
+        OpRemove = 1,
+        OpReplace = 2
+    };
+    
+    static constexpr size_t FieldsPerEdit = 7;
+    
+    /**
+     * Check the buffer and split it into edits without copying any text
+     * Returns false and sets `error` when the buffer is malformed.
+     */
+    static bool Parse(const uint8_t* data, size_t byteLength,
+                      std::vector<PackedEdit>& edits, std::string& error);
+    
+#ifdef HAVE_KTEXTEDITOR
+    /**
+     * Apply the edits inside one editing transaction; must run on the Qt thread
+     * Stops at the first edit the document rejects and returns its index,
+     * after reverting the edits before it within the same transaction, so
+     * the text is as it was. Returns -1 when all succeeded.
+     */
+    static int Apply(KTextEditor::Document* document, const std::vector<PackedEdit>& edits);
+    
+    // What one applied edit left behind: the range its text takes now and the text it replaced
+    struct Inverse {
+        KTextEditor::Range inserted;
+        QString removed;
+    };
+    
+    /**
+     * Apply() for a caller that reverts several batches as one: the inverse
+     * of each edit applied is appended to `inverses`, and nothing is reverted
+     * when an edit is rejected
+     */
+    static int Apply(KTextEditor::Document* document, const std::vector<PackedEdit>& edits,
+                     std::vector<Inverse>& inverses);
+    
+    // Undo edits by their inverses, later ones first, within the transaction that made them
+    static void Revert(KTextEditor::Document* document, const std::vector<Inverse>& inverses);
+    
+    // MovingInterface revision of the document, or -1 when unsupported
+    static int64_t Revision(KTextEditor::Document* document);
+#else
+    // The same, as one undo step of a fallback document's text; a failed batch leaves no step
+    static int Apply(PieceTable& text, const std::vector<PackedEdit>& edits);
+#endif
+
+private:
+    EditBatch() = delete;
+    ~EditBatch() = delete;
+};
+
+} // namespace KateNative
+
+#endif // EDIT_BATCH_H
@@ -0,0 +1,223 @@
+#include "edit_journal.h"
+#include "edit_batch.h"
+#include "line_metadata.h"
+#include <cstring>
+
+#ifdef HAVE_KTEXTEDITOR
+#include <KTextEditor/Document>
+#include <KTextEditor/Cursor>
+#include <KTextEditor/Range>
+#endif
+
+namespace KateNative {
+
+namespace {
+
+constexpr char MAGIC[8] = {'K', 'A', 'T', 'E', 'J', 'N', 'L', '1'};
+
+// type, byte length, checksum
+constexpr size_t RECORD_HEADER_BYTES = 16;
+
+// Payloads are whole UTF-16 units, or 32-bit values
+uint64_t PayloadChecksum(const void* data, size_t length) {
+    return LineMetadata::HashLine(static_cast<const char16_t*>(data), length / sizeof(char16_t));
+}
+
+} // namespace
+
+std::string EditJournal::Encode(uint32_t type, const void* data, size_t length) {
+    std::string record(RECORD_HEADER_BYTES + length, '\0');
+    uint32_t length32 = static_cast<uint32_t>(length);
+    uint64_t checksum = PayloadChecksum(data, length);
+    std::memcpy(&record[0], &type, sizeof(type));
+    std::memcpy(&record[4], &length32, sizeof(length32));
+    std::memcpy(&record[8], &checksum, sizeof(checksum));
+    if (length > 0) {
+        std::memcpy(&record[RECORD_HEADER_BYTES], data, length);
+    }
+    return record;
+}
+
+std::string EditJournal::Header(uint64_t baseChecksum) {
+    return std::string(MAGIC, sizeof(MAGIC)) + Encode(RecordBase, &baseChecksum, sizeof(baseChecksum));
+}
+
+uint64_t EditJournal::TextChecksum(const char16_t* text, size_t length) {
+    return LineMetadata::HashLine(text, length) | 1;
+}
+
+std::shared_ptr<EditJournal> EditJournal::Start(const std::string& path, std::u16string text, bool textIsOnDisk,
+                                                FileWriter::Done done) {
+    std::shared_ptr<EditJournal> journal(new EditJournal(path));
+    auto content = std::make_shared<std::u16string>(std::move(text));
+    FileWriter::Write(path,
+        [content, textIsOnDisk](FileWriter::Output& output, std::string&) {
+            if (textIsOnDisk) {
+                output.bytes = Header(TextChecksum(content->data(), content->size()));
+            } else {
+                output.bytes = Header(0) + Encode(RecordText, content->data(), content->size() * sizeof(char16_t));
+            }
+            return true;
+        },
+        std::move(done));
+    return journal;
+}
+
+void EditJournal::Append(uint32_t type, std::string payload, FileWriter::Done done) {
+    std::shared_ptr<EditJournal> self = shared_from_this();
+    auto content = std::make_shared<std::string>(std::move(payload));
+    FileWriter::Write(m_path,
+        [self, type, content](FileWriter::Output& output, std::string&) {
+            std::lock_guard<std::mutex> lock(self->m_mutex);
+            output.bytes = Encode(type, content->data(), content->size());
+            if (self->m_rebase) {
+                // The first record since the save starts the new journal
+                output.bytes = Header(self->m_rebaseChecksum) + output.bytes;
+                self->m_rebase = false;
+            } else {
+                output.append = true;
+            }
+            return true;
+        },
+        std::move(done));
+}
+
+void EditJournal::Rebase(uint64_t checksum) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_rebase = true;
+        m_rebaseChecksum = checksum;
+    }
+    
+    // Without edits after the save, the journal is just the new base
+    std::shared_ptr<EditJournal> self = shared_from_this();
+    FileWriter::Write(m_path,
+        [self](FileWriter::Output& output, std::string&) {
+            std::lock_guard<std::mutex> lock(self->m_mutex);
+            if (!self->m_rebase) {
+                output.skip = true;
+                return true;
+            }
+            output.bytes = Header(self->m_rebaseChecksum);
+            self->m_rebase = false;
+            return true;
+        },
+        nullptr);
+}
+
+bool EditJournal::Parse(const uint8_t* data, size_t length, std::vector<Record>& records, std::string& error) {
+    if (length < sizeof(MAGIC) || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0) {
+        error = "Not an edit journal";
+        return false;
+    }
+    
+    size_t offset = sizeof(MAGIC);
+    while (offset + RECORD_HEADER_BYTES <= length) {
+        uint32_t type = 0;
+        uint32_t recordLength = 0;
+        uint64_t checksum = 0;
+        std::memcpy(&type, data + offset, sizeof(type));
+        std::memcpy(&recordLength, data + offset + 4, sizeof(recordLength));
+        std::memcpy(&checksum, data + offset + 8, sizeof(checksum));
+        
+        const uint8_t* payload = data + offset + RECORD_HEADER_BYTES;
+        if (recordLength > length - offset - RECORD_HEADER_BYTES || recordLength % sizeof(char16_t) != 0
+            || PayloadChecksum(payload, recordLength) != checksum) {
+            break;
+        }
+        records.push_back(Record{type, payload, recordLength});
+        offset += RECORD_HEADER_BYTES + recordLength;
+    }
+    
+    if (records.empty() || records[0].type != RecordBase || records[0].length != sizeof(uint64_t)) {
+        error = "The edit journal has no base record";
+        return false;
+    }
+    return true;
+}
+
+#ifdef HAVE_KTEXTEDITOR
+JournalRecorder::JournalRecorder(KTextEditor::Document* document, std::shared_ptr<EditJournal> journal)
+    : QObject(document)
+    , m_document(document)
+    , m_journal(std::move(journal))
+{
+    connect(document, &KTextEditor::Document::textInserted, this,
+        [this](KTextEditor::Document*, const KTextEditor::Cursor& position, const QString& text) {
+            OnTextInserted(position, text);
+        });
+    connect(document, &KTextEditor::Document::textRemoved, this,
+        [this](KTextEditor::Document*, const KTextEditor::Range& range, const QString&) {
+            OnTextRemoved(range);
+        });
+        
+    // Loading a file replaces the content without textInserted/textRemoved
+    connect(document, &KTextEditor::Document::aboutToInvalidateMovingInterfaceContent, this,
+        [this](KTextEditor::Document*) {
+            m_reset = true;
+        });
+}
+
+void JournalRecorder::OnTextInserted(const KTextEditor::Cursor& position, const QString& text) {
+    if (m_reset || text.isEmpty()) {
+        return;
+    }
+    m_fields.insert(m_fields.end(), {
+        EditBatch::OpInsert,
+        static_cast<uint32_t>(position.line()), static_cast<uint32_t>(position.column()),
+        static_cast<uint32_t>(position.line()), static_cast<uint32_t>(position.column()),
+        static_cast<uint32_t>(m_text.length()), static_cast<uint32_t>(text.length())
+    });
+    m_text += text;
+}
+
+void JournalRecorder::OnTextRemoved(const KTextEditor::Range& range) {
+    if (m_reset || range.isEmpty()) {
+        return;
+    }
+    m_fields.insert(m_fields.end(), {
+        EditBatch::OpRemove,
+        static_cast<uint32_t>(range.start().line()), static_cast<uint32_t>(range.start().column()),
+        static_cast<uint32_t>(range.end().line()), static_cast<uint32_t>(range.end().column()),
+        static_cast<uint32_t>(m_text.length()), 0
+    });
+}
+
+void JournalRecorder::Flush(Flushed done) {
+    std::string payload;
+    uint32_t type = EditJournal::RecordEdits;
+    uint32_t count = static_cast<uint32_t>(m_fields.size() / EditBatch::FieldsPerEdit);
+    
+    if (m_reset) {
+        // A reloaded document is journaled as its whole new text
+        QString text = m_document->text();
+        payload.assign(reinterpret_cast<const char*>(text.utf16()), text.length() * sizeof(char16_t));
+        type = EditJournal::RecordText;
+        count = 1;
+    } else if (count > 0) {
+        payload.resize(sizeof(uint32_t) * (1 + m_fields.size()) + m_text.length() * sizeof(char16_t));
+        std::memcpy(&payload[0], &count, sizeof(count));
+        std::memcpy(&payload[sizeof(uint32_t)], m_fields.data(), m_fields.size() * sizeof(uint32_t));
+        std::memcpy(&payload[sizeof(uint32_t) * (1 + m_fields.size())], m_text.utf16(),
+                    m_text.length() * sizeof(char16_t));
+    }
+    
+    m_fields.clear();
+    m_text.clear();
+    m_reset = false;
+    
+    if (count == 0) {
+        if (done) {
+            done(0, true, std::string());
+        }
+        return;
+    }
+    m_journal->Append(type, std::move(payload), [done, count](bool success, const std::string& error) {
+        if (done) {
+            done(count, success, error);
+        }
+    });
+}
+#endif
+
+} // namespace KateNative
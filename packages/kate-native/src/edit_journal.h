@@ -0,0 +1,139 @@
+#ifndef EDIT_JOURNAL_H
+#define EDIT_JOURNAL_H
+
+#include "file_writer.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_KTEXTEDITOR
+#include <QObject>
+#include <QString>
+#endif
+
+namespace KTextEditor {
+    class Document;
+    class Cursor;
+    class Range;
+}
+
+namespace KateNative {
+
+/**
+ * Append-Only Edit Journal
+ *
+ * A file next to a document's file holding the edits made since it was
+ * last saved, so that autosaving is an append of the latest edits rather
+ * than a rewrite of the whole text, and a crash loses nothing that was
+ * flushed. Layout, all values in native byte order:
+ *
+ *   8 bytes "KATEJNL1"
+ *   records of uint32 type, uint32 byte length, uint64 checksum, payload
+ *
+ * The first record is the base: the checksum of the text the edits apply
+ * to, or 0 when the next record is the whole text. The other records are
+ * EditBatch buffers, or the whole text (UTF-16) after the document was
+ * reloaded. A record that was only partly written ends the journal.
+ *
+ * Writes go through the FileWriter. After a save of the document's file,
+ * Rebase() starts the journal over at the saved text, atomically, with
+ * whatever edits reach it from then on.
+ */
+class EditJournal : public std::enable_shared_from_this<EditJournal> {
+public:
+    enum RecordType : uint32_t {
+        RecordBase = 1,
+        RecordText = 2,
+        RecordEdits = 3
+    };
+    
+    struct Record {
+        uint32_t type;
+        const uint8_t* data;
+        size_t length;
+    };
+    
+    /**
+     * Replace `path` with a journal based on `text` (UTF-16), which is
+     * written out in full unless `textIsOnDisk`
+     */
+    static std::shared_ptr<EditJournal> Start(const std::string& path, std::u16string text, bool textIsOnDisk,
+                                              FileWriter::Done done);
+                                            
+    // Queue a record; `done` runs on the writer thread
+    void Append(uint32_t type, std::string payload, FileWriter::Done done);
+    
+    /**
+     * Start over at a text with this checksum once its file is on disk;
+     * writer thread, before anything queued after the save is written
+     */
+    void Rebase(uint64_t checksum);
+    
+    const std::string& Path() const { return m_path; }
+    
+    /**
+     * Split a journal into records, stopping at the first damaged one
+     * Returns false and sets `error` when it isn't a journal or has no base.
+     */
+    static bool Parse(const uint8_t* data, size_t length, std::vector<Record>& records, std::string& error);
+    
+    // Checksum of a text as the base record holds it; never 0
+    static uint64_t TextChecksum(const char16_t* text, size_t length);
+
+private:
+    explicit EditJournal(std::string path) : m_path(std::move(path)) {}
+    
+    static std::string Encode(uint32_t type, const void* data, size_t length);
+    static std::string Header(uint64_t baseChecksum);
+    
+    std::string m_path;
+    
+    // Writer thread and callers of Rebase()
+    std::mutex m_mutex;
+    bool m_rebase = false;
+    uint64_t m_rebaseChecksum = 0;
+};
+
+#ifdef HAVE_KTEXTEDITOR
+/**
+ * Collects a document's edits for its EditJournal, as EditBatch records
+ * A child of the document, on the Qt thread.
+ */
+class JournalRecorder : public QObject {
+public:
+    JournalRecorder(KTextEditor::Document* document, std::shared_ptr<EditJournal> journal);
+    
+    using Flushed = std::function<void(uint32_t edits, bool success, const std::string& error)>;
+    
+    const std::shared_ptr<EditJournal>& Journal() const { return m_journal; }
+    
+    /**
+     * Queue the edits recorded since the last flush; `done` gets their
+     * number once they are on disk, on the writer thread, or right away
+     * when there were none
+     */
+    void Flush(Flushed done);
+
+private:
+    void OnTextInserted(const KTextEditor::Cursor& position, const QString& text);
+    void OnTextRemoved(const KTextEditor::Range& range);
+    
+    KTextEditor::Document* m_document;
+    std::shared_ptr<EditJournal> m_journal;
+    
+    // EditBatch fields and text of the pending edits
+    std::vector<uint32_t> m_fields;
+    QString m_text;
+    
+    // Set when the content was replaced without edits (a file was loaded)
+    bool m_reset = false;
+};
+#endif
+
+} // namespace KateNative
+
+#endif // EDIT_JOURNAL_H
@@ -1,7 +1,10 @@
 #include "editor_wrapper.h"
-#include "qt_runner.h"
+#include "addon_data.h"
+#include "js_convert.h"
+#include "mode_catalog.h"
 
 #ifdef HAVE_KTEXTEDITOR
+#include "qt_runner.h"
 #include <KTextEditor/Editor>
 #include <QString>
 #endif
@@ -15,8 +18,7 @@ Napi::Object EditorWrapper::Init(Napi::Env env, Napi::Object exports) {
         InstanceMethod("availableModes", &EditorWrapper::GetAvailableModes),
     });
     
-    Napi::FunctionReference* constructor = new Napi::FunctionReference();
-    *constructor = Napi::Persistent(func);
+    AddonData::Get(env)->editorConstructor = Napi::Persistent(func);
     
     exports.Set("KateEditor", func);
     return exports;
@@ -24,9 +26,11 @@ Napi::Object EditorWrapper::Init(Napi::Env env, Napi::Object exports) {
 
 Napi::Object EditorWrapper::GetInstance(Napi::Env env) {
     Napi::EscapableHandleScope scope(env);
-    Napi::FunctionReference* constructor = env.GetInstanceData<Napi::FunctionReference>();
-    Napi::Object obj = constructor->New({});
-    return scope.Escape(napi_value(obj)).ToObject();
+    AddonData* data = AddonData::Get(env);
+    if (data->editor.IsEmpty()) {
+        data->editor = Napi::Persistent(data->editorConstructor.New({}));
+    }
+    return scope.Escape(napi_value(data->editor.Value())).ToObject();
 }
 
 EditorWrapper::EditorWrapper(const Napi::CallbackInfo& info) 
@@ -51,9 +55,14 @@ Napi::Value EditorWrapper::GetVersion(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     
 #ifdef HAVE_KTEXTEDITOR
-    KTextEditor::Editor* editor = KTextEditor::Editor::instance();
-    if (editor) {
-        QString version = editor->aboutData().version();
+    // The editor singleton belongs to the Qt thread, whichever environment asks
+    QString version;
+    QtRunner::RunSync([&version]() {
+        if (KTextEditor::Editor* editor = KTextEditor::Editor::instance()) {
+            version = editor->aboutData().version();
+        }
+    });
+    if (!version.isEmpty()) {
         return Napi::String::New(env, version.toStdString());
     }
 #endif
@@ -65,9 +74,13 @@ Napi::Value EditorWrapper::GetApplicationName(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     
 #ifdef HAVE_KTEXTEDITOR
-    KTextEditor::Editor* editor = KTextEditor::Editor::instance();
-    if (editor) {
-        QString name = editor->aboutData().displayName();
+    QString name;
+    QtRunner::RunSync([&name]() {
+        if (KTextEditor::Editor* editor = KTextEditor::Editor::instance()) {
+            name = editor->aboutData().displayName();
+        }
+    });
+    if (!name.isEmpty()) {
         return Napi::String::New(env, name.toStdString());
     }
 #endif
@@ -77,15 +90,12 @@ Napi::Value EditorWrapper::GetApplicationName(const Napi::CallbackInfo& info) {
 
 Napi::Value EditorWrapper::GetAvailableModes(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
-    Napi::Array modes = Napi::Array::New(env);
     
 #ifdef HAVE_KTEXTEDITOR
-    // Note: This is a simplified version. In a real implementation,
-    // we would query the syntax highlighting system for all available modes.
-    // For now, return an empty array as a placeholder.
+    return ModeNamesToJs(env, *ModeCatalog::Ensure());
+#else
+    return Napi::Array::New(env);
 #endif
-    
-    return modes;
 }
 
 } // namespace KateNative
@@ -13,6 +13,8 @@ namespace KateNative {
 class EditorWrapper : public Napi::ObjectWrap<EditorWrapper> {
 public:
     static Napi::Object Init(Napi::Env env, Napi::Object exports);
+    
+    // The environment's KateEditor, created on first use
     static Napi::Object GetInstance(Napi::Env env);
     
     EditorWrapper(const Napi::CallbackInfo& info);
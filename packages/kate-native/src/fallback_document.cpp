@@ -0,0 +1,387 @@
+#include "fallback_document.h"
+
+#ifndef HAVE_KTEXTEDITOR
+#include "line_diff.h"
+#include "line_metadata.h"
+#include "mapped_file.h"
+#include "mode_catalog.h"
+#include <algorithm>
+#include <filesystem>
+
+namespace KateNative {
+
+namespace {
+
+constexpr char16_t ReplacementCharacter = 0xFFFD;
+
+uint64_t HashUnits(const char16_t* text, size_t length, bool ignoreWhitespace, std::u16string& buffer) {
+    if (!ignoreWhitespace) {
+        return LineMetadata::HashLine(text, length);
+    }
+
+    buffer.clear();
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] != u' ' && text[i] != u'\t') {
+            buffer.push_back(text[i]);
+        }
+    }
+    return LineMetadata::HashLine(buffer.data(), buffer.size());
+}
+
+// Append a code unit, reading "\r\n" and "\r" as '\n' and noting the first break as the file's
+void AppendUnit(FallbackDocument::File& file, char16_t unit, bool& afterReturn, bool& sawBreak) {
+    if (unit == u'\n' && afterReturn) {
+        afterReturn = false;
+        if (file.lineEnding == "\r") {
+            file.lineEnding = "\r\n";
+        }
+        return;
+    }
+
+    afterReturn = unit == u'\r';
+    if (unit == u'\r' || unit == u'\n') {
+        if (!sawBreak) {
+            file.lineEnding = unit == u'\r' ? "\r" : "\n";
+            sawBreak = true;
+        }
+        unit = u'\n';
+    }
+    file.text.push_back(unit);
+}
+
+void DecodeUtf8(const uint8_t* data, size_t length, FallbackDocument::File& file) {
+    bool afterReturn = false;
+    bool sawBreak = false;
+    file.text.reserve(length);
+
+    for (size_t i = 0; i < length; ) {
+        uint8_t lead = data[i];
+        if (lead < 0x80) {
+            AppendUnit(file, lead, afterReturn, sawBreak);
+            i++;
+            continue;
+        }
+
+        // Sequence length and the smallest code point it may encode
+        size_t count = lead >= 0xF0 && lead < 0xF5 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC2 ? 2 : 0;
+        if (lead >= 0xF5) {
+            count = 0;
+        }
+        uint32_t codePoint = count == 4 ? lead & 0x07 : count == 3 ? lead & 0x0F : lead & 0x1F;
+        size_t read = 1;
+        while (read < count && i + read < length && (data[i + read] & 0xC0) == 0x80) {
+            codePoint = (codePoint << 6) | (data[i + read] & 0x3F);
+            read++;
+        }
+
+        uint32_t minimum = count == 4 ? 0x10000 : count == 3 ? 0x800 : 0x80;
+        bool valid = count > 0 && read == count && codePoint >= minimum && codePoint <= 0x10FFFF
+            && !(codePoint >= 0xD800 && codePoint < 0xE000);
+        if (!valid) {
+            AppendUnit(file, ReplacementCharacter, afterReturn, sawBreak);
+            i += std::max<size_t>(read, 1);
+            continue;
+        }
+
+        if (codePoint > 0xFFFF) {
+            codePoint -= 0x10000;
+            AppendUnit(file, static_cast<char16_t>(0xD800 + (codePoint >> 10)), afterReturn, sawBreak);
+            AppendUnit(file, static_cast<char16_t>(0xDC00 + (codePoint & 0x3FF)), afterReturn, sawBreak);
+        } else {
+            AppendUnit(file, static_cast<char16_t>(codePoint), afterReturn, sawBreak);
+        }
+        i += count;
+    }
+}
+
+void DecodeUtf16(const uint8_t* data, size_t length, bool bigEndian, FallbackDocument::File& file) {
+    bool afterReturn = false;
+    bool sawBreak = false;
+    file.text.reserve(length / 2);
+
+    for (size_t i = 0; i + 1 < length; i += 2) {
+        char16_t unit = bigEndian ? static_cast<char16_t>((data[i] << 8) | data[i + 1])
+                                  : static_cast<char16_t>(data[i] | (data[i + 1] << 8));
+        AppendUnit(file, unit, afterReturn, sawBreak);
+    }
+    if (length % 2 != 0) {
+        AppendUnit(file, ReplacementCharacter, afterReturn, sawBreak);
+    }
+}
+
+void AppendCodePoint(std::string& bytes, uint32_t codePoint, FallbackDocument::Encoding encoding) {
+    if (encoding == FallbackDocument::Encoding::Utf16LE || encoding == FallbackDocument::Encoding::Utf16BE) {
+        bool bigEndian = encoding == FallbackDocument::Encoding::Utf16BE;
+        auto appendUnit = [&bytes, bigEndian](uint32_t unit) {
+            bytes.push_back(static_cast<char>(bigEndian ? unit >> 8 : unit & 0xFF));
+            bytes.push_back(static_cast<char>(bigEndian ? unit & 0xFF : unit >> 8));
+        };
+        if (codePoint > 0xFFFF) {
+            codePoint -= 0x10000;
+            appendUnit(0xD800 + (codePoint >> 10));
+            appendUnit(0xDC00 + (codePoint & 0x3FF));
+        } else {
+            appendUnit(codePoint);
+        }
+        return;
+    }
+
+    if (codePoint < 0x80) {
+        bytes.push_back(static_cast<char>(codePoint));
+    } else if (codePoint < 0x800) {
+        bytes.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+        bytes.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    } else if (codePoint < 0x10000) {
+        bytes.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+        bytes.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        bytes.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    } else {
+        bytes.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+        bytes.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+        bytes.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        bytes.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+}
+
+} // namespace
+
+FallbackDocument::FallbackDocument()
+    : m_savedHashes(HashText(nullptr, 0, false))
+{
+    m_text.SetObserver([this](int64_t offset, int64_t removed, int64_t inserted) {
+        MoveAnchors(offset, removed, inserted);
+    });
+}
+
+bool FallbackDocument::Read(const std::string& path, File& file, std::string& error) {
+    std::shared_ptr<MappedFile> mapped = MappedFile::Open(path, error);
+    if (!mapped) {
+        return false;
+    }
+
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(mapped->Data());
+    size_t length = static_cast<size_t>(mapped->Size());
+    mapped->AdviseSequential(0, length);
+
+    file = File();
+    if (length >= 2 && data[0] == 0xFF && data[1] == 0xFE) {
+        file.encoding = Encoding::Utf16LE;
+        DecodeUtf16(data + 2, length - 2, false, file);
+    } else if (length >= 2 && data[0] == 0xFE && data[1] == 0xFF) {
+        file.encoding = Encoding::Utf16BE;
+        DecodeUtf16(data + 2, length - 2, true, file);
+    } else if (length >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF) {
+        file.encoding = Encoding::Utf8Bom;
+        DecodeUtf8(data + 3, length - 3, file);
+    } else {
+        DecodeUtf8(data, length, file);
+    }
+    return true;
+}
+
+void FallbackDocument::Load(const std::string& path, File file) {
+    std::error_code error;
+    std::filesystem::path absolute = std::filesystem::absolute(std::filesystem::u8path(path), error);
+    m_path = error ? path : absolute.lexically_normal().u8string();
+    m_encoding = file.encoding;
+    m_lineEnding = std::move(file.lineEnding);
+    m_text.Reset(std::move(file.text));
+    m_savedHashes = Hashes(false);
+    
+    // A KTextEditor document invalidates its moving ranges when it loads a file
+    for (auto& set : m_anchors) {
+        for (Anchor& anchor : set.second.anchors) {
+            anchor.valid = false;
+        }
+    }
+
+    // As KTextEditor does when it opens a file
+    int mode = ModeCatalog::Current()->ForFileName(m_path);
+    if (mode != ModeCatalog::None) {
+        SetMode(ModeCatalog::NameOf(mode));
+    }
+}
+
+void FallbackDocument::SetMode(std::string mode) {
+    if (mode == m_mode) {
+        return;
+    }
+    m_mode = std::move(mode);
+    if (m_modeObserver) {
+        m_modeObserver(m_mode);
+    }
+}
+
+std::u16string FallbackDocument::Decode(const char* data, size_t length) {
+    File file;
+    DecodeUtf8(reinterpret_cast<const uint8_t*>(data), length, file);
+    return std::move(file.text);
+}
+
+std::string FallbackDocument::Encode(const std::u16string& text, Encoding encoding, const std::string& lineEnding) {
+    std::string bytes;
+    bytes.reserve(text.size() + text.size() / 8);
+    if (encoding == Encoding::Utf8Bom) {
+        bytes.append("\xEF\xBB\xBF");
+    } else if (encoding == Encoding::Utf16LE) {
+        bytes.append("\xFF\xFE");
+    } else if (encoding == Encoding::Utf16BE) {
+        bytes.append("\xFE\xFF");
+    }
+
+    for (size_t i = 0; i < text.size(); i++) {
+        char16_t unit = text[i];
+        if (unit == u'\n') {
+            for (char character : lineEnding) {
+                AppendCodePoint(bytes, static_cast<uint8_t>(character), encoding);
+            }
+            continue;
+        }
+
+        uint32_t codePoint = unit;
+        if (unit >= 0xD800 && unit < 0xDC00 && i + 1 < text.size() && text[i + 1] >= 0xDC00 && text[i + 1] < 0xE000) {
+            codePoint = 0x10000 + ((unit - 0xD800) << 10) + (text[++i] - 0xDC00);
+        } else if (unit >= 0xD800 && unit < 0xE000) {
+            codePoint = ReplacementCharacter;
+        }
+        AppendCodePoint(bytes, codePoint, encoding);
+    }
+    return bytes;
+}
+
+void FallbackDocument::MarkSaved() {
+    m_text.MarkSaved();
+    m_savedHashes = Hashes(false);
+}
+
+std::vector<uint64_t> FallbackDocument::Hashes(bool ignoreWhitespace) const {
+    std::u16string text = m_text.Text();
+    return HashText(text.data(), text.size(), ignoreWhitespace);
+}
+
+std::vector<int32_t> FallbackDocument::DirtyHunks() const {
+    if (!m_text.IsModified()) {
+        return {};
+    }
+    return LineDiff::Compute(m_savedHashes, Hashes(false));
+}
+
+std::vector<uint64_t> FallbackDocument::HashText(const char16_t* text, size_t length, bool ignoreWhitespace) {
+    std::vector<uint64_t> hashes;
+    std::u16string buffer;
+    size_t lineStart = 0;
+    while (true) {
+        const char16_t* lineBreak = std::find(text + lineStart, text + length, u'\n');
+        size_t lineEnd = static_cast<size_t>(lineBreak - text);
+        size_t lineLength = lineEnd - lineStart;
+        if (lineLength > 0 && text[lineEnd - 1] == u'\r') {
+            lineLength--;
+        }
+        hashes.push_back(HashUnits(text + lineStart, lineLength, ignoreWhitespace, buffer));
+
+        if (lineEnd == length) {
+            break;
+        }
+        lineStart = lineEnd + 1;
+    }
+    return hashes;
+}
+
+uint32_t FallbackDocument::ConvertColumn(int& line, uint32_t column, ColumnEncoding from, ColumnEncoding to) {
+    line = std::clamp(line, 0, m_text.Lines() - 1);
+    if (line != m_columnLine || m_text.Revision() != m_columnRevision) {
+        m_columnText = m_text.Line(line);
+        m_columnAscii = !m_columnTable.Build(m_columnText.data(), m_columnText.size());
+        m_columnLine = line;
+        m_columnRevision = m_text.Revision();
+    }
+    
+    if (m_columnAscii) {
+        return std::min(column, static_cast<uint32_t>(m_columnText.size()));
+    }
+    uint32_t utf16 = m_columnTable.ToUtf16(m_columnText.data(), column, from);
+    return m_columnTable.FromUtf16(m_columnText.data(), utf16, to);
+}
+
+int FallbackDocument::CreateAnchors(const int32_t* fields, size_t count, bool expandLeft, bool expandRight,
+                                    bool invalidateIfEmpty) {
+    AnchorSet set{{}, expandLeft, expandRight, invalidateIfEmpty};
+    set.anchors.reserve(count / 4);
+    for (size_t i = 0; i + 4 <= count; i += 4) {
+        // OffsetAt() clamps to the text like DocumentAnchors does
+        int64_t start = m_text.OffsetAt(fields[i], fields[i + 1]);
+        int64_t end = m_text.OffsetAt(fields[i + 2], fields[i + 3]);
+        if (end < start) {
+            std::swap(start, end);
+        }
+        set.anchors.push_back({start, end, !(invalidateIfEmpty && start == end)});
+    }
+    
+    int handle = m_nextAnchors++;
+    m_anchors.emplace(handle, std::move(set));
+    return handle;
+}
+
+bool FallbackDocument::ReadAnchors(int handle, std::vector<int32_t>& fields) const {
+    auto it = m_anchors.find(handle);
+    if (it == m_anchors.end()) {
+        return false;
+    }
+    
+    fields.resize(it->second.anchors.size() * 4);
+    int32_t* out = fields.data();
+    for (const Anchor& anchor : it->second.anchors) {
+        int startLine = -1;
+        int startColumn = -1;
+        int endLine = -1;
+        int endColumn = -1;
+        if (anchor.valid) {
+            m_text.PositionAt(anchor.start, startLine, startColumn);
+            m_text.PositionAt(anchor.end, endLine, endColumn);
+        }
+        *out++ = startLine;
+        *out++ = startColumn;
+        *out++ = endLine;
+        *out++ = endColumn;
+    }
+    return true;
+}
+
+bool FallbackDocument::ReleaseAnchors(int handle) {
+    return m_anchors.erase(handle) > 0;
+}
+
+void FallbackDocument::MoveAnchors(int64_t offset, int64_t removed, int64_t inserted) {
+    for (auto& entry : m_anchors) {
+        AnchorSet& set = entry.second;
+        for (Anchor& anchor : set.anchors) {
+            if (!anchor.valid) {
+                continue;
+            }
+            
+            // Removed text takes whatever was in it to where it was
+            auto remove = [offset, removed](int64_t position) {
+                return position <= offset ? position : std::max(offset, position - removed);
+            };
+            anchor.start = remove(anchor.start);
+            anchor.end = remove(anchor.end);
+            
+            // Text inserted right at an end goes inside the range only if it expands that way
+            if (anchor.start > offset || (anchor.start == offset && !set.expandLeft && inserted > 0)) {
+                anchor.start += inserted;
+            }
+            if (anchor.end > offset || (anchor.end == offset && set.expandRight)) {
+                anchor.end += inserted;
+            }
+            anchor.end = std::max(anchor.end, anchor.start);
+            
+            if (set.invalidateIfEmpty && anchor.start == anchor.end) {
+                anchor.valid = false;
+            }
+        }
+    }
+}
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
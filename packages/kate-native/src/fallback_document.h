@@ -0,0 +1,147 @@
+#ifndef FALLBACK_DOCUMENT_H
+#define FALLBACK_DOCUMENT_H
+
+#ifndef HAVE_KTEXTEDITOR
+#include "column_table.h"
+#include "piece_table.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace KateNative {
+
+/**
+ * Fallback Document
+ *
+ * What a KateDocument keeps when the module is built without KTextEditor:
+ * its text in a PieceTable, and the mode, file, encoding and line break
+ * style a KTextEditor document would otherwise hold. Files are read as
+ * UTF-8, or as UTF-16 when they start with a byte order mark, and saved
+ * the way they were read. Every line break style reads as '\n'; the
+ * file's first one is what saving puts back. Malformed UTF-8 reads as
+ * U+FFFD.
+ *
+ * Settings a KTextEditor document takes from its configuration are
+ * Kate's defaults here: tab stops every 4 columns, indenting by 4 spaces.
+ *
+ * Anchors behave like KTextEditor's moving ranges, but are kept as
+ * offsets that every edit walks, and loading a file invalidates them.
+ *
+ * Lives on the JavaScript thread; only the static functions may be called
+ * from others.
+ */
+class FallbackDocument {
+public:
+    static constexpr int TabWidth = 4;
+    static constexpr int IndentWidth = 4;
+
+    enum class Encoding {
+        Utf8,
+        Utf8Bom,
+        Utf16LE,
+        Utf16BE
+    };
+
+    // Told of the new mode whenever it changes
+    using ModeObserver = std::function<void(const std::string& mode)>;
+
+    // A file's content as Read() decodes it
+    struct File {
+        std::u16string text;
+        Encoding encoding = Encoding::Utf8;
+        std::string lineEnding = "\n";
+    };
+
+    FallbackDocument();
+    FallbackDocument(const FallbackDocument&) = delete;
+    FallbackDocument& operator=(const FallbackDocument&) = delete;
+
+    PieceTable& Text() { return m_text; }
+    const PieceTable& Text() const { return m_text; }
+
+    const std::string& Mode() const { return m_mode; }
+    void SetMode(std::string mode);
+    void SetModeObserver(ModeObserver observer) { m_modeObserver = std::move(observer); }
+
+    // Absolute path of the open file; empty until one is opened
+    const std::string& Path() const { return m_path; }
+    Encoding FileEncoding() const { return m_encoding; }
+    const std::string& LineEnding() const { return m_lineEnding; }
+
+    /**
+     * Read and decode the file at `path` (UTF-8)
+     * Returns false and sets `error` when it can't be read.
+     */
+    static bool Read(const std::string& path, File& file, std::string& error);
+
+    // Take a file read from `path` as the saved text, in the mode the mode catalog has for it
+    void Load(const std::string& path, File file);
+
+    // The text as the bytes of a file, with `lineEnding` for every line break
+    static std::string Encode(const std::u16string& text, Encoding encoding, const std::string& lineEnding);
+
+    // UTF-8 text as Read() decodes it, e.g. one line of a mapped file
+    static std::u16string Decode(const char* data, size_t length);
+
+    // Take the current text as the one on disk
+    void MarkSaved();
+
+    std::vector<uint64_t> Hashes(bool ignoreWhitespace) const;
+
+    // Hunks from the saved lines to the current ones, in the LineDiff layout; empty while unmodified
+    std::vector<int32_t> DirtyHunks() const;
+
+    // Hashes of a text split at '\n', dropping a '\r' before the break, as LineHashes::HashText()
+    static std::vector<uint64_t> HashText(const char16_t* text, size_t length, bool ignoreWhitespace);
+    
+    // As ColumnMap::Convert(); keeps the table of the last line it converted in
+    uint32_t ConvertColumn(int& line, uint32_t column, ColumnEncoding from, ColumnEncoding to);
+    
+    // As DocumentAnchors::Create(), Read() and Release()
+    int CreateAnchors(const int32_t* fields, size_t count, bool expandLeft, bool expandRight, bool invalidateIfEmpty);
+    bool ReadAnchors(int handle, std::vector<int32_t>& fields) const;
+    bool ReleaseAnchors(int handle);
+    bool HasAnchors() const { return !m_anchors.empty(); }
+
+private:
+    struct Anchor {
+        int64_t start;
+        int64_t end;
+        bool valid;
+    };
+    
+    struct AnchorSet {
+        std::vector<Anchor> anchors;
+        bool expandLeft;
+        bool expandRight;
+        bool invalidateIfEmpty;
+    };
+    
+    void MoveAnchors(int64_t offset, int64_t removed, int64_t inserted);
+    
+    PieceTable m_text;
+    std::string m_mode = "Normal";
+    ModeObserver m_modeObserver;
+    std::string m_path;
+    Encoding m_encoding = Encoding::Utf8;
+    std::string m_lineEnding = "\n";
+    std::vector<uint64_t> m_savedHashes;
+    std::unordered_map<int, AnchorSet> m_anchors;
+    int m_nextAnchors = 1;
+    
+    // The line ConvertColumn() last measured, as of m_columnRevision
+    int m_columnLine = -1;
+    int64_t m_columnRevision = -1;
+    std::u16string m_columnText;
+    ColumnTable m_columnTable;
+    bool m_columnAscii = true;
+};
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
+
+#endif // FALLBACK_DOCUMENT_H
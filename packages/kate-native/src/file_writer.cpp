@@ -0,0 +1,333 @@
+#include "file_writer.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace KateNative {
+
+namespace {
+
+struct WriteJob {
+    std::string path;
+    FileWriter::Producer producer;
+    FileWriter::Done done;
+    bool endsBatch = false;
+};
+
+// One write of a batch, between its phases
+struct PendingWrite {
+    WriteJob job;
+    FileWriter::Output output;
+    std::string temporary;
+    bool success = true;
+    std::string error;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+};
+
+// Never destroyed, so the thread can't outlive it at exit
+struct WriterQueue {
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<WriteJob> jobs;
+    bool started = false;
+};
+
+WriterQueue& Queue() {
+    static WriterQueue* queue = new WriterQueue();
+    return *queue;
+}
+
+std::atomic<uint64_t> g_temporaryCounter{0};
+
+std::string DirectoryOf(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    if (slash == std::string::npos) {
+        return ".";
+    }
+    return slash == 0 ? path.substr(0, 1) : path.substr(0, slash);
+}
+
+// Hidden name next to the target, so the rename stays on one file system
+std::string TemporaryFor(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    std::string directory = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+#ifdef _WIN32
+    unsigned long pid = GetCurrentProcessId();
+#else
+    unsigned long pid = static_cast<unsigned long>(getpid());
+#endif
+    return directory + "." + name + ".kate-" + std::to_string(pid) + "-"
+        + std::to_string(g_temporaryCounter.fetch_add(1)) + ".tmp";
+}
+
+#ifdef _WIN32
+std::string LastErrorString() {
+    char buffer[256] = {};
+    FormatMessageA(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS, nullptr, GetLastError(),
+                   0, buffer, sizeof(buffer), nullptr);
+    return buffer;
+}
+
+std::wstring WidePath(const std::string& path) {
+    int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+    std::wstring widePath(length > 0 ? length - 1 : 0, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &widePath[0], length);
+    return widePath;
+}
+
+void Open(PendingWrite& pending) {
+    const FileWriter::Output& output = pending.output;
+    std::string target = output.append ? pending.job.path : TemporaryFor(pending.job.path);
+    pending.file = CreateFileW(WidePath(target).c_str(), output.append ? FILE_APPEND_DATA : GENERIC_WRITE, 0, nullptr,
+                             output.append ? OPEN_ALWAYS : CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (pending.file == INVALID_HANDLE_VALUE) {
+        pending.success = false;
+        pending.error = "Cannot write " + target + ": " + LastErrorString();
+        return;
+    }
+    if (!output.append) {
+        pending.temporary = target;
+    }
+    
+    size_t written = 0;
+    while (written < output.bytes.size()) {
+        DWORD chunk = 0;
+        DWORD wanted = static_cast<DWORD>(std::min<size_t>(output.bytes.size() - written, 1u << 30));
+        if (!WriteFile(pending.file, output.bytes.data() + written, wanted, &chunk, nullptr)) {
+            pending.success = false;
+            pending.error = "Cannot write " + target + ": " + LastErrorString();
+            return;
+        }
+        written += chunk;
+    }
+}
+
+void Sync(std::vector<PendingWrite>& writes) {
+    for (PendingWrite& pending : writes) {
+        if (pending.success && pending.file != INVALID_HANDLE_VALUE && !FlushFileBuffers(pending.file)) {
+            pending.success = false;
+            pending.error = "Cannot sync " + pending.job.path + ": " + LastErrorString();
+        }
+    }
+}
+
+void CloseFile(PendingWrite& pending) {
+    if (pending.file != INVALID_HANDLE_VALUE) {
+        CloseHandle(pending.file);
+        pending.file = INVALID_HANDLE_VALUE;
+    }
+}
+
+bool Rename(PendingWrite& pending) {
+    if (!MoveFileExW(WidePath(pending.temporary).c_str(), WidePath(pending.job.path).c_str(),
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        pending.error = "Cannot replace " + pending.job.path + ": " + LastErrorString();
+        return false;
+    }
+    return true;
+}
+
+void RemoveTemporary(const std::string& temporary) {
+    DeleteFileW(WidePath(temporary).c_str());
+}
+
+// MOVEFILE_WRITE_THROUGH already made the renames durable
+void SyncDirectories(const std::set<std::string>&) {
+}
+#else
+bool WriteAll(int fd, const std::string& bytes) {
+    size_t written = 0;
+    while (written < bytes.size()) {
+        ssize_t chunk = write(fd, bytes.data() + written, bytes.size() - written);
+        if (chunk < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += static_cast<size_t>(chunk);
+    }
+    return true;
+}
+
+void Open(PendingWrite& pending) {
+    const FileWriter::Output& output = pending.output;
+    if (output.append) {
+        pending.fd = open(pending.job.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    } else {
+        // 0666 goes through the umask like any new file; a replaced file keeps its mode
+        pending.temporary = TemporaryFor(pending.job.path);
+        pending.fd = open(pending.temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        struct stat status;
+        if (pending.fd >= 0 && stat(pending.job.path.c_str(), &status) == 0) {
+            fchmod(pending.fd, status.st_mode & 07777);
+        }
+    }
+    
+    if (pending.fd < 0) {
+        pending.success = false;
+        std::string target = output.append ? pending.job.path : pending.temporary;
+        pending.error = "Cannot write " + target + ": " + std::strerror(errno);
+        pending.temporary.clear();
+        return;
+    }
+    if (!WriteAll(pending.fd, output.bytes)) {
+        pending.success = false;
+        pending.error = "Cannot write " + pending.job.path + ": " + std::strerror(errno);
+    }
+}
+
+void Sync(std::vector<PendingWrite>& writes) {
+#ifdef __linux__
+    // Start writeback of every file first so their journal commits overlap
+    for (PendingWrite& pending : writes) {
+        if (pending.success && pending.fd >= 0) {
+            sync_file_range(pending.fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+        }
+    }
+#endif
+    for (PendingWrite& pending : writes) {
+        if (!pending.success || pending.fd < 0) {
+            continue;
+        }
+#ifdef __APPLE__
+        int result = fcntl(pending.fd, F_FULLFSYNC) == 0 ? 0 : fsync(pending.fd);
+#else
+        int result = fdatasync(pending.fd);
+#endif
+        if (result != 0) {
+            pending.success = false;
+            pending.error = "Cannot sync " + pending.job.path + ": " + std::strerror(errno);
+        }
+    }
+}
+
+void CloseFile(PendingWrite& pending) {
+    if (pending.fd >= 0) {
+        close(pending.fd);
+        pending.fd = -1;
+    }
+}
+
+bool Rename(PendingWrite& pending) {
+    if (rename(pending.temporary.c_str(), pending.job.path.c_str()) != 0) {
+        pending.error = "Cannot replace " + pending.job.path + ": " + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+void RemoveTemporary(const std::string& temporary) {
+    unlink(temporary.c_str());
+}
+
+void SyncDirectories(const std::set<std::string>& directories) {
+    for (const std::string& directory : directories) {
+        int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0) {
+            fsync(fd);
+            close(fd);
+        }
+    }
+}
+#endif
+
+void RunBatch(std::vector<WriteJob>& jobs) {
+    std::vector<PendingWrite> writes(jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++) {
+        PendingWrite& pending = writes[i];
+        pending.job = std::move(jobs[i]);
+        pending.success = pending.job.producer(pending.output, pending.error);
+        if (pending.success && !pending.output.skip) {
+            Open(pending);
+        }
+    }
+    
+    Sync(writes);
+    
+    // Renamed files are only durable once their directory is
+    std::set<std::string> directories;
+    for (PendingWrite& pending : writes) {
+        CloseFile(pending);
+        if (pending.temporary.empty()) {
+            continue;
+        }
+        if (pending.success && Rename(pending)) {
+            directories.insert(DirectoryOf(pending.job.path));
+        } else {
+            pending.success = false;
+            RemoveTemporary(pending.temporary);
+        }
+    }
+    SyncDirectories(directories);
+    
+    for (PendingWrite& pending : writes) {
+        if (pending.job.done) {
+            pending.job.done(pending.success, pending.error);
+        }
+    }
+}
+
+void WriterLoop() {
+    WriterQueue& queue = Queue();
+    std::vector<WriteJob> batch;
+    std::set<std::string> paths;
+    
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(queue.mutex);
+            queue.wake.wait(lock, [&queue]() { return !queue.jobs.empty(); });
+            
+            // Everything queued so far, up to the second write of a path
+            while (!queue.jobs.empty() && paths.insert(queue.jobs.front().path).second) {
+                bool endsBatch = queue.jobs.front().endsBatch;
+                batch.push_back(std::move(queue.jobs.front()));
+                queue.jobs.pop_front();
+                if (endsBatch) {
+                    break;
+                }
+            }
+        }
+        
+        RunBatch(batch);
+        batch.clear();
+        paths.clear();
+    }
+}
+
+} // namespace
+
+void FileWriter::Write(const std::string& path, Producer producer, Done done, bool endsBatch) {
+    WriterQueue& queue = Queue();
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(WriteJob{path, std::move(producer), std::move(done), endsBatch});
+        if (!queue.started) {
+            queue.started = true;
+            std::thread(WriterLoop).detach();
+        }
+    }
+    queue.wake.notify_one();
+}
+
+} // namespace KateNative
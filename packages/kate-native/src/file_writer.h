@@ -0,0 +1,54 @@
+#ifndef FILE_WRITER_H
+#define FILE_WRITER_H
+
+#include <functional>
+#include <string>
+
+namespace KateNative {
+
+/**
+ * Background File Writer
+ *
+ * One thread that writes files for every document, so neither the
+ * JavaScript nor the Qt thread waits on the disk. A file is either
+ * replaced, by writing a temporary file next to it and renaming it over
+ * the original, or appended to. Either way the data is on disk when the
+ * write is reported done.
+ *
+ * Writes queued while the thread is busy are done together and synced
+ * together: writeback of every file is started before the first one is
+ * waited for, and each directory is synced once for all the files renamed
+ * in it. A batch never touches a path twice, and writes are done and
+ * reported in the order they were queued.
+ */
+class FileWriter {
+public:
+    struct Output {
+        std::string bytes;
+        
+        // Append to the file instead of replacing it
+        bool append = false;
+        
+        // Nothing to write after all; reported as done
+        bool skip = false;
+    };
+    
+    // Produce the bytes on the writer thread (e.g. encode a text snapshot)
+    using Producer = std::function<bool(Output& output, std::string& error)>;
+    
+    using Done = std::function<void(bool success, const std::string& error)>;
+    
+    /**
+     * Queue a write of `path` (UTF-8); both callbacks run on the writer
+     * thread. With `endsBatch`, later writes wait until `done` has run.
+     */
+    static void Write(const std::string& path, Producer producer, Done done, bool endsBatch = false);
+
+private:
+    FileWriter() = delete;
+    ~FileWriter() = delete;
+};
+
+} // namespace KateNative
+
+#endif // FILE_WRITER_H
@@ -0,0 +1,146 @@
+#include "folding_index.h"
+
+#ifdef HAVE_KTEXTEDITOR
+#include <KTextEditor/Document>
+#include <KTextEditor/Attribute>
+#include <KTextEditor/Cursor>
+#include <KTextEditor/Range>
+
+namespace KateNative {
+
+FoldingIndex::FoldingIndex(KTextEditor::Document* document)
+    : QObject(document)
+    , m_document(document)
+{
+    connect(document, &KTextEditor::Document::textInserted, this,
+        [this](KTextEditor::Document*, const KTextEditor::Cursor& position, const QString& text) {
+            OnTextInserted(position, text);
+        });
+    connect(document, &KTextEditor::Document::textRemoved, this,
+        [this](KTextEditor::Document*, const KTextEditor::Range& range, const QString&) {
+            OnTextRemoved(range);
+        });
+    connect(document, &KTextEditor::Document::highlightingModeChanged, this,
+        [this](KTextEditor::Document*) { Reset(); });
+    connect(document, &KTextEditor::Document::reloaded, this,
+        [this](KTextEditor::Document*) { Reset(); });
+        
+    Reset();
+}
+
+QStringList FoldingIndex::Kinds() {
+    return QStringList{QStringLiteral("region"), QStringLiteral("comment")};
+}
+
+void FoldingIndex::Reset() {
+    m_entries.assign(qMax(m_document->lines(), 1), FoldEntry());
+}
+
+void FoldingIndex::InvalidateEnclosing(int line) {
+    for (int start = qMin(line, static_cast<int>(m_entries.size()) - 1); start >= 0; start--) {
+        FoldEntry& entry = m_entries[start];
+        if (entry.span >= 0 && start + entry.span >= line) {
+            entry.span = Unknown;
+        }
+    }
+}
+
+void FoldingIndex::OnTextInserted(const KTextEditor::Cursor& position, const QString& text) {
+    int line = position.line();
+    int added = text.count(QLatin1Char('\n'));
+    if (line < 0 || line >= static_cast<int>(m_entries.size())) {
+        Reset();
+        return;
+    }
+    
+    InvalidateEnclosing(line);
+    m_entries.insert(m_entries.begin() + line + 1, added, FoldEntry());
+    m_entries[line].span = Unknown;
+}
+
+void FoldingIndex::OnTextRemoved(const KTextEditor::Range& range) {
+    int line = range.start().line();
+    int removed = range.end().line() - line;
+    if (line < 0 || line + removed >= static_cast<int>(m_entries.size())) {
+        Reset();
+        return;
+    }
+    
+    InvalidateEnclosing(line);
+    m_entries.erase(m_entries.begin() + line + 1, m_entries.begin() + line + 1 + removed);
+    m_entries[line].span = Unknown;
+}
+
+void FoldingIndex::Scan(int line) {
+    FoldEntry& entry = m_entries[line];
+    entry.span = NoRegion;
+    entry.kind = KindRegion;
+    
+    // Get folding range starting at this line
+    auto foldingRange = m_document->foldingRegionAt(KTextEditor::Cursor(line, 0));
+    if (!foldingRange.isValid() || foldingRange.start().line() != line) {
+        return;
+    }
+    
+    entry.span = foldingRange.end().line() - line;
+    if (m_document->defaultStyleAt(foldingRange.start()) == KTextEditor::dsComment) {
+        entry.kind = KindComment;
+    }
+}
+
+bool FoldingIndex::Prepare(int& lineStart, int& lineEnd) {
+    // The signals should keep the entries in step with the document, but
+    // never report regions for lines that no longer exist
+    if (static_cast<int>(m_entries.size()) != qMax(m_document->lines(), 1)) {
+        Reset();
+    }
+    
+    lineStart = qMax(lineStart, 0);
+    lineEnd = qMin(lineEnd, static_cast<int>(m_entries.size()) - 1);
+    if (lineStart > lineEnd) {
+        return false;
+    }
+    
+    for (int line = lineStart; line <= lineEnd; line++) {
+        if (m_entries[line].span == Unknown) {
+            Scan(line);
+        }
+    }
+    return true;
+}
+
+std::vector<FoldingRegionData> FoldingIndex::Regions(int lineStart, int lineEnd) {
+    std::vector<FoldingRegionData> regions;
+    if (!Prepare(lineStart, lineEnd)) {
+        return regions;
+    }
+    
+    for (int line = lineStart; line <= lineEnd; line++) {
+        const FoldEntry& entry = m_entries[line];
+        if (entry.span >= 0) {
+            regions.push_back({line, line + entry.span, entry.kind});
+        }
+    }
+    return regions;
+}
+
+std::vector<uint32_t> FoldingIndex::RegionsPacked(int lineStart, int lineEnd) {
+    std::vector<uint32_t> data;
+    if (!Prepare(lineStart, lineEnd)) {
+        return data;
+    }
+    
+    for (int line = lineStart; line <= lineEnd; line++) {
+        const FoldEntry& entry = m_entries[line];
+        if (entry.span >= 0) {
+            data.push_back(static_cast<uint32_t>(line));
+            data.push_back(static_cast<uint32_t>(line + entry.span));
+            data.push_back(entry.kind);
+        }
+    }
+    return data;
+}
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
@@ -0,0 +1,94 @@
+#ifndef FOLDING_INDEX_H
+#define FOLDING_INDEX_H
+
+#ifdef HAVE_KTEXTEDITOR
+#include <QObject>
+#include <QStringList>
+#include <cstdint>
+#include <vector>
+
+namespace KTextEditor {
+    class Document;
+    class Cursor;
+    class Range;
+}
+
+namespace KateNative {
+
+/**
+ * A foldable region, identified by its first and last line
+ * `kind` indexes FoldingIndex::Kinds().
+ */
+struct FoldingRegionData {
+    int startLine;
+    int endLine;
+    uint32_t kind;
+};
+
+/**
+ * Folding Region Index
+ *
+ * Records, for every line of one document, the foldable region starting
+ * on it. The index is built by the first query and afterwards kept in
+ * step with the textInserted/textRemoved signals: entries move with the
+ * inserted or removed lines, and only the edited lines plus the regions
+ * enclosing the edit are asked for again. Regions are stored as spans
+ * relative to their start line, so regions after an edit need no update.
+ *
+ * The index is a child of its document and lives on the Qt thread.
+ */
+class FoldingIndex : public QObject {
+public:
+    static constexpr int FieldsPerRegion = 3;
+    
+    enum Kind : uint32_t {
+        KindRegion = 0,
+        KindComment = 1
+    };
+    
+    explicit FoldingIndex(KTextEditor::Document* document);
+    
+    /**
+     * Regions starting in the inclusive line range, ordered by start line
+     */
+    std::vector<FoldingRegionData> Regions(int lineStart, int lineEnd);
+    
+    /**
+     * Same as Regions(), packed as (start line, end line, kind) triples
+     */
+    std::vector<uint32_t> RegionsPacked(int lineStart, int lineEnd);
+    
+    /**
+     * Kind names by index
+     */
+    static QStringList Kinds();
+
+private:
+    static constexpr int32_t NoRegion = -1;
+    static constexpr int32_t Unknown = -2;
+    
+    struct FoldEntry {
+        int32_t span = Unknown;
+        uint32_t kind = KindRegion;
+    };
+    
+    void OnTextInserted(const KTextEditor::Cursor& position, const QString& text);
+    void OnTextRemoved(const KTextEditor::Range& range);
+    void Reset();
+    
+    // Mark regions that start before `line` and reach it for rescanning
+    void InvalidateEnclosing(int line);
+    
+    // Clamp the range and scan any line in it that is not known yet
+    bool Prepare(int& lineStart, int& lineEnd);
+    void Scan(int line);
+    
+    KTextEditor::Document* m_document;
+    std::vector<FoldEntry> m_entries;
+};
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
+
+#endif // FOLDING_INDEX_H
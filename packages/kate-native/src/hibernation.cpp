@@ -0,0 +1,174 @@
+#include "hibernation.h"
+
+#ifdef HAVE_KTEXTEDITOR
+#include <KTextEditor/Document>
+#include <QChar>
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include "addon_data.h"
+#include "document_wrapper.h"
+#include "qt_runner.h"
+
+namespace KateNative {
+
+namespace {
+
+// Rough costs of a live document beyond its text: line objects and
+// highlighting attributes per line, configuration and the attached
+// indexes per document
+const size_t LINE_BYTES = 96;
+const size_t DOCUMENT_BYTES = 128 * 1024;
+
+using Entry = HibernationState::Entry;
+
+HibernationState& State(Napi::Env env) {
+    return AddonData::Get(env)->hibernation;
+}
+
+int64_t NowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+size_t EstimatedBytes(KTextEditor::Document* document) {
+    return DOCUMENT_BYTES
+        + static_cast<size_t>(document->totalCharacters()) * sizeof(QChar)
+        + static_cast<size_t>(document->lines()) * LINE_BYTES;
+}
+
+} // namespace
+
+void Hibernation::Configure(Napi::Env env, size_t memoryBudget, int64_t idleMs) {
+    HibernationState& state = State(env);
+    state.memoryBudget = memoryBudget;
+    state.idleMs = std::max<int64_t>(idleMs, 0);
+    Enforce(state, nullptr);
+}
+
+void Hibernation::Register(DocumentWrapper* document) {
+    HibernationState& state = State(document->Env());
+    state.order.push_back(Entry{document, NowMs()});
+    state.entries[document] = std::prev(state.order.end());
+    Enforce(state, document);
+}
+
+void Hibernation::Unregister(DocumentWrapper* document) {
+    HibernationState& state = State(document->Env());
+    auto it = state.entries.find(document);
+    if (it != state.entries.end()) {
+        state.order.erase(it->second);
+        state.entries.erase(it);
+    }
+}
+
+void Hibernation::Touch(DocumentWrapper* document, bool woke) {
+    HibernationState& state = State(document->Env());
+    auto it = state.entries.find(document);
+    if (it == state.entries.end()) {
+        return;
+    }
+    
+    int64_t now = NowMs();
+    Entry& entry = *it->second;
+    entry.lastUse = now;
+    entry.measured = false;
+    state.order.splice(state.order.end(), state.order, it->second);
+    
+    if (woke) {
+        state.wakes++;
+    }
+    if (state.memoryBudget > 0 && now - state.lastCheck >= CheckIntervalMs) {
+        Enforce(state, document);
+    }
+}
+
+void Hibernation::Hibernated(DocumentWrapper* document) {
+    HibernationState& state = State(document->Env());
+    auto it = state.entries.find(document);
+    if (it != state.entries.end()) {
+        it->second->bytes = document->SnapshotBytes();
+        it->second->measured = true;
+    }
+    state.hibernations++;
+}
+
+void Hibernation::Measure(HibernationState& state) {
+    // Everything that changed in one trip to the Qt thread
+    std::vector<std::pair<Entry*, KTextEditor::Document*>> pending;
+    for (Entry& entry : state.order) {
+        if (!entry.measured && !entry.document->HasSnapshot()) {
+            pending.emplace_back(&entry, entry.document->m_document.get());
+        }
+    }
+    if (pending.empty() || !QtRunner::IsRunning()) {
+        return;
+    }
+    
+    QtRunner::RunSync([&pending]() {
+        for (auto& [entry, document] : pending) {
+            entry->bytes = EstimatedBytes(document);
+            entry->measured = true;
+        }
+    });
+}
+
+void Hibernation::Enforce(HibernationState& state, DocumentWrapper* keep) {
+    if (state.memoryBudget == 0 || state.order.empty()) {
+        return;
+    }
+    
+    int64_t now = NowMs();
+    state.lastCheck = now;
+    
+    Measure(state);
+    size_t liveBytes = 0;
+    for (const Entry& entry : state.order) {
+        if (!entry.document->HasSnapshot()) {
+            liveBytes += entry.bytes;
+        }
+    }
+    
+    // The order is by last use, so the first recent document ends the search
+    for (Entry& entry : state.order) {
+        if (liveBytes <= state.memoryBudget || now - entry.lastUse < state.idleMs) {
+            break;
+        }
+        if (entry.document == keep || entry.document->HasSnapshot()) {
+            continue;
+        }
+        
+        size_t bytes = entry.bytes;
+        if (entry.document->TryHibernate()) {
+            liveBytes -= bytes;
+            Hibernated(entry.document);
+        }
+    }
+}
+
+HibernationStatus Hibernation::Status(Napi::Env env) {
+    HibernationState& state = State(env);
+    Measure(state);
+    HibernationStatus status;
+    status.memoryBudget = state.memoryBudget;
+    status.idleMs = state.idleMs;
+    status.hibernations = state.hibernations;
+    status.wakes = state.wakes;
+    
+    for (const Entry& entry : state.order) {
+        if (entry.document->HasSnapshot()) {
+            status.hibernated++;
+            status.snapshotBytes += entry.bytes;
+        } else {
+            status.live++;
+            status.liveBytes += entry.bytes;
+        }
+    }
+    return status;
+}
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
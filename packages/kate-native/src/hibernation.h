@@ -0,0 +1,105 @@
+#ifndef HIBERNATION_H
+#define HIBERNATION_H
+
+#include <napi.h>
+#include <cstddef>
+#include <cstdint>
+
+#ifdef HAVE_KTEXTEDITOR
+#include <list>
+#include <unordered_map>
+#endif
+
+namespace KateNative {
+
+struct HibernationStatus {
+    size_t memoryBudget = 0;
+    int64_t idleMs = 0;
+    int live = 0;
+    int hibernated = 0;
+    size_t liveBytes = 0;
+    size_t snapshotBytes = 0;
+    uint64_t hibernations = 0;
+    uint64_t wakes = 0;
+};
+
+#ifdef HAVE_KTEXTEDITOR
+class DocumentWrapper;
+struct HibernationState;
+
+/**
+ * Idle Document Hibernation
+ *
+ * Keeps every KateDocument in least recently used order. While the
+ * estimated size of the live documents is over the memory budget, the
+ * least recently used ones idle for at least idleMs are hibernated: their
+ * content moves into a DocumentSnapshot and their KTextEditor::Document
+ * goes back to the DocumentPool. The next call on a hibernated document
+ * restores it first.
+ *
+ * Documents shared with other objects (search sessions, text indexes,
+ * pending async calls), with event listeners or with declared viewports
+ * are in use and stay live.
+ *
+ * Off with a budget of 0, the default. The budget is checked whenever a
+ * document is created, and at most once per CheckIntervalMs as documents
+ * are used; only documents used since the previous check are measured
+ * again. Each environment keeps its own documents, budget and counters;
+ * everything here runs on that environment's JavaScript thread.
+ */
+class Hibernation {
+public:
+    static constexpr int64_t DefaultIdleMs = 30000;
+    static constexpr int64_t CheckIntervalMs = 1000;
+    
+    static void Configure(Napi::Env env, size_t memoryBudget, int64_t idleMs);
+    
+    static void Register(DocumentWrapper* document);
+    static void Unregister(DocumentWrapper* document);
+    
+    // Mark a document as just used; `woke` when it was restored for it
+    static void Touch(DocumentWrapper* document, bool woke = false);
+    
+    // Count a hibernation made outside of the budget check, e.g. by hibernate()
+    static void Hibernated(DocumentWrapper* document);
+    
+    static HibernationStatus Status(Napi::Env env);
+
+private:
+    // Estimate the size of the live documents used since they were last measured
+    static void Measure(HibernationState& state);
+    
+    // Hibernate until the budget holds; never `keep`, which is being used
+    static void Enforce(HibernationState& state, DocumentWrapper* keep);
+    
+    Hibernation() = delete;
+    ~Hibernation() = delete;
+};
+
+// The documents of one environment; lives in its AddonData
+struct HibernationState {
+    struct Entry {
+        DocumentWrapper* document;
+        int64_t lastUse;
+        
+        // Estimated live size, or the snapshot size while hibernated
+        size_t bytes = 0;
+        bool measured = false;
+    };
+    
+    size_t memoryBudget = 0;
+    int64_t idleMs = Hibernation::DefaultIdleMs;
+    int64_t lastCheck = 0;
+    
+    // Least recently used first
+    std::list<Entry> order;
+    std::unordered_map<DocumentWrapper*, std::list<Entry>::iterator> entries;
+    
+    uint64_t hibernations = 0;
+    uint64_t wakes = 0;
+};
+#endif // HAVE_KTEXTEDITOR
+
+} // namespace KateNative
+
+#endif // HIBERNATION_H
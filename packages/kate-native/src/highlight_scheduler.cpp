@@ -0,0 +1,127 @@
+#include "highlight_scheduler.h"
+
+#ifdef HAVE_KTEXTEDITOR
+#include "document_events.h"
+#include "syntax_tokens.h"
+#include <KTextEditor/Document>
+#include <KTextEditor/Cursor>
+#include <KTextEditor/Range>
+
+namespace KateNative {
+
+HighlightScheduler::HighlightScheduler(KTextEditor::Document* document, SyntaxTokenCache* cache)
+    : QObject(document)
+    , m_document(document)
+    , m_cache(cache)
+    , m_timer(this)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setInterval(0);
+    connect(&m_timer, &QTimer::timeout, this, [this]() { RunSlice(); });
+    
+    connect(document, &KTextEditor::Document::textInserted, this,
+        [this](KTextEditor::Document*, const KTextEditor::Cursor& position, const QString&) {
+            OnEdit(position.line());
+        });
+    connect(document, &KTextEditor::Document::textRemoved, this,
+        [this](KTextEditor::Document*, const KTextEditor::Range& range, const QString&) {
+            OnEdit(range.start().line());
+        });
+    connect(document, &KTextEditor::Document::highlightingModeChanged, this,
+        [this](KTextEditor::Document*) { Reset(); });
+    connect(document, &KTextEditor::Document::reloaded, this,
+        [this](KTextEditor::Document*) { Reset(); });
+}
+
+void HighlightScheduler::SetViewport(const QString& client, int first, int last) {
+    m_viewports.insert(client, {qMin(first, last), qMax(first, last)});
+    Schedule();
+}
+
+void HighlightScheduler::ClearViewport(const QString& client) {
+    m_viewports.remove(client);
+}
+
+void HighlightScheduler::SetEvents(std::shared_ptr<DocumentEvents> events) {
+    m_events = std::move(events);
+    m_fillLine = 0;
+    Schedule();
+}
+
+void HighlightScheduler::Schedule() {
+    if (!m_timer.isActive()) {
+        m_timer.start();
+    }
+}
+
+void HighlightScheduler::OnEdit(int line) {
+    m_warmLine = qMin(m_warmLine, qMax(line, 0));
+    m_fillLine = qMin(m_fillLine, qMax(line, 0));
+    if (!m_viewports.isEmpty() || (m_events && m_events->RecordsTokens())) {
+        Schedule();
+    }
+}
+
+void HighlightScheduler::Reset() {
+    OnEdit(0);
+}
+
+bool HighlightScheduler::WarmTo(int line, const QElapsedTimer& clock) {
+    while (m_warmLine <= line) {
+        if (clock.nsecsElapsed() >= SliceNanoseconds) {
+            return false;
+        }
+        
+        // Asking for an attribute makes KatePart highlight every line up to it
+        int target = qMin(m_warmLine + WarmLines - 1, line);
+        m_document->attributeAt(KTextEditor::Cursor(target, 0));
+        m_warmLine = target + 1;
+    }
+    return true;
+}
+
+void HighlightScheduler::Tokenize(int first, int last, bool push) {
+    if (push) {
+        m_events->RecordTokens(SyntaxTokens::CollectUnreported(m_cache, first, last));
+    } else {
+        m_cache->Refresh(first, last);
+    }
+}
+
+void HighlightScheduler::RunSlice() {
+    QElapsedTimer clock;
+    clock.start();
+    
+    int lineCount = m_document->lines();
+    bool push = m_events && m_events->RecordsTokens();
+    bool pending = false;
+    
+    // Visible lines first; a viewport past the highlighted part waits for
+    // the following slices instead of stalling this one
+    for (auto it = m_viewports.constBegin(); it != m_viewports.constEnd(); ++it) {
+        int first = qBound(0, it.value().first, lineCount - 1);
+        int last = qBound(0, it.value().second, lineCount - 1);
+        if (WarmTo(last, clock)) {
+            Tokenize(first, last, push);
+        } else {
+            pending = true;
+        }
+    }
+    
+    WarmTo(lineCount - 1, clock);
+    
+    // Tokenizing only behind the highlighted part keeps each step small
+    while (push && m_fillLine < m_warmLine && clock.nsecsElapsed() < SliceNanoseconds) {
+        int last = qMin(m_fillLine + FillLines, m_warmLine) - 1;
+        Tokenize(m_fillLine, last, push);
+        m_fillLine = last + 1;
+    }
+    
+    if (pending || m_warmLine < lineCount || (push && m_fillLine < lineCount)) {
+        Schedule();
+    }
+}
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
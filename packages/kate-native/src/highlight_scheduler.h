@@ -0,0 +1,94 @@
+#ifndef HIGHLIGHT_SCHEDULER_H
+#define HIGHLIGHT_SCHEDULER_H
+
+#ifdef HAVE_KTEXTEDITOR
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <memory>
+#include <utility>
+
+namespace KTextEditor {
+    class Document;
+}
+
+namespace KateNative {
+
+class DocumentEvents;
+class SyntaxTokenCache;
+
+/**
+ * Viewport-first Background Highlighting
+ *
+ * KatePart highlights a document front to back, so the first request for
+ * a line far down a cold document has to highlight everything above it.
+ * The scheduler does that work ahead of time, on the Qt thread, in slices
+ * of at most SliceNanoseconds started from a zero-interval timer, so
+ * synchronous calls and edits get in between slices.
+ *
+ * Each slice first brings KatePart's highlighting up to every declared
+ * viewport and tokenizes the viewports into the SyntaxTokenCache, then
+ * keeps highlighting the rest of the document. While 'tokensChanged' has
+ * listeners it also tokenizes the rest of the document, and every line
+ * whose tokens weren't pushed yet goes out through DocumentEvents.
+ *
+ * Once the document has been highlighted through, a jump anywhere costs
+ * only the tokenizing of the visible lines. Edits move the highlighted
+ * and tokenized frontiers back to the edited line.
+ *
+ * The scheduler is a child of its document and lives on the Qt thread.
+ */
+class HighlightScheduler : public QObject {
+public:
+    // Budget of one slice, about a quarter of a 60 Hz frame
+    static constexpr qint64 SliceNanoseconds = 4000000;
+    
+    // Lines KatePart is asked to highlight, or the cache to tokenize, per step
+    static constexpr int WarmLines = 256;
+    static constexpr int FillLines = 64;
+    
+    HighlightScheduler(KTextEditor::Document* document, SyntaxTokenCache* cache);
+    
+    /**
+     * Inclusive range of lines `client` shows; replaces its previous one
+     */
+    void SetViewport(const QString& client, int first, int last);
+    void ClearViewport(const QString& client);
+    bool HasViewports() const { return !m_viewports.isEmpty(); }
+    
+    /**
+     * Where to push tokens; also rescans the document for tokens that
+     * weren't pushed yet, e.g. after a listener was added
+     */
+    void SetEvents(std::shared_ptr<DocumentEvents> events);
+
+private:
+    void Schedule();
+    void RunSlice();
+    void OnEdit(int line);
+    void Reset();
+    
+    // Highlight up to and including `line`; false when the slice ran out first
+    bool WarmTo(int line, const QElapsedTimer& clock);
+    
+    // Tokenize an inclusive range and push its unreported lines
+    void Tokenize(int first, int last, bool push);
+    
+    KTextEditor::Document* m_document;
+    SyntaxTokenCache* m_cache;
+    std::shared_ptr<DocumentEvents> m_events;
+    QTimer m_timer;
+    QHash<QString, std::pair<int, int>> m_viewports;
+    
+    // Lines before these are highlighted by KatePart and tokenized in the cache
+    int m_warmLine = 0;
+    int m_fillLine = 0;
+};
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
+
+#endif // HIGHLIGHT_SCHEDULER_H
@@ -0,0 +1,280 @@
+#include "js_convert.h"
+#include "mode_catalog.h"
+#include "stats.h"
+#include <climits>
+#include <cstring>
+
+namespace KateNative {
+
+Napi::Uint32Array Uint32ArrayToJs(Napi::Env env, const std::vector<uint32_t>& values) {
+    Napi::Uint32Array array = Napi::Uint32Array::New(env, values.size());
+    if (!values.empty()) {
+        std::memcpy(array.Data(), values.data(), values.size() * sizeof(uint32_t));
+    }
+    Stats::Add(Stats::TypedArraysCreated, 1);
+    Stats::Add(Stats::TypedArrayBytes, values.size() * sizeof(uint32_t));
+    return array;
+}
+
+Napi::Int32Array Int32ArrayToJs(Napi::Env env, const std::vector<int32_t>& values) {
+    Napi::Int32Array array = Napi::Int32Array::New(env, values.size());
+    if (!values.empty()) {
+        std::memcpy(array.Data(), values.data(), values.size() * sizeof(int32_t));
+    }
+    Stats::Add(Stats::TypedArraysCreated, 1);
+    Stats::Add(Stats::TypedArrayBytes, values.size() * sizeof(int32_t));
+    return array;
+}
+
+void ParseLineRange(const Napi::CallbackInfo& info, size_t index, int& lineStart, int& lineEnd) {
+    lineStart = 0;
+    lineEnd = INT_MAX;
+    if (info.Length() >= index + 2 && info[index].IsNumber() && info[index + 1].IsNumber()) {
+        lineStart = info[index].As<Napi::Number>().Int32Value();
+        lineEnd = info[index + 1].As<Napi::Number>().Int32Value();
+    }
+}
+
+bool Int32ElementsFromJs(Napi::Value value, const int32_t*& data, size_t& count) {
+    if (!value.IsTypedArray()) {
+        return false;
+    }
+    
+    Napi::TypedArray array = value.As<Napi::TypedArray>();
+    if (array.TypedArrayType() != napi_int32_array && array.TypedArrayType() != napi_uint32_array) {
+        return false;
+    }
+    
+    data = reinterpret_cast<const int32_t*>(
+        static_cast<const uint8_t*>(array.ArrayBuffer().Data()) + array.ByteOffset());
+    count = array.ElementLength();
+    return true;
+}
+
+bool IsText(Napi::Value value) {
+    if (value.IsString()) {
+        return true;
+    }
+    if (!value.IsTypedArray()) {
+        return false;
+    }
+    
+    Napi::TypedArray array = value.As<Napi::TypedArray>();
+    return array.TypedArrayType() == napi_uint16_array
+        || (array.TypedArrayType() == napi_uint8_array && array.ByteLength() % sizeof(char16_t) == 0);
+}
+
+namespace {
+
+Napi::Array StringsToJs(Napi::Env env, const std::vector<std::string>& strings) {
+    Napi::Array array = Napi::Array::New(env, strings.size());
+    for (size_t i = 0; i < strings.size(); i++) {
+        array[i] = Napi::String::New(env, strings[i]);
+    }
+    return array;
+}
+
+} // namespace
+
+Napi::Array ModeNamesToJs(Napi::Env env, const ModeCatalog& catalog) {
+    const std::vector<ModeInfo>& modes = catalog.Modes();
+    Napi::Array names = Napi::Array::New(env, modes.size());
+    for (size_t i = 0; i < modes.size(); i++) {
+        names[i] = Napi::String::New(env, modes[i].name);
+    }
+    return names;
+}
+
+Napi::Array ModeCatalogToJs(Napi::Env env, const ModeCatalog& catalog) {
+    const std::vector<ModeInfo>& modes = catalog.Modes();
+    Napi::Array entries = Napi::Array::New(env, modes.size());
+    Stats::Add(Stats::ObjectsCreated, modes.size() + 1);
+    for (size_t i = 0; i < modes.size(); i++) {
+        Napi::Object entry = Napi::Object::New(env);
+        entry.Set("id", Napi::Number::New(env, modes[i].id));
+        entry.Set("name", Napi::String::New(env, modes[i].name));
+        entry.Set("section", Napi::String::New(env, modes[i].section));
+        entry.Set("wildcards", StringsToJs(env, modes[i].wildcards));
+        entry.Set("mimeTypes", StringsToJs(env, modes[i].mimeTypes));
+        entry.Set("priority", Napi::Number::New(env, modes[i].priority));
+        entries[i] = entry;
+    }
+    return entries;
+}
+
+SearchOptions ParseSearchOptions(const Napi::CallbackInfo& info, size_t index) {
+    SearchOptions result;
+    
+    if (info.Length() > index && info[index].IsObject()) {
+        Napi::Object options = info[index].As<Napi::Object>();
+        
+        if (options.Has("caseSensitive") && options.Get("caseSensitive").IsBoolean()) {
+            result.caseSensitive = options.Get("caseSensitive").As<Napi::Boolean>().Value();
+        }
+        
+        if (options.Has("wholeWords") && options.Get("wholeWords").IsBoolean()) {
+            result.wholeWords = options.Get("wholeWords").As<Napi::Boolean>().Value();
+        }
+        
+        if (options.Has("regex") && options.Get("regex").IsBoolean()) {
+            result.regex = options.Get("regex").As<Napi::Boolean>().Value();
+        }
+    }
+    
+    return result;
+}
+
+Napi::String Utf16ToJs(Napi::Env env, const std::u16string& text) {
+    Stats::Add(Stats::TextBytesToJs, text.size() * sizeof(char16_t));
+    return Napi::String::New(env, text.data(), text.size());
+}
+
+Napi::Buffer<char16_t> Utf16ToBuffer(Napi::Env env, std::u16string text) {
+    // The buffer owns the moved string
+    auto* owner = new std::u16string(std::move(text));
+    Stats::Add(Stats::TextBytesToJs, owner->size() * sizeof(char16_t));
+    return Napi::Buffer<char16_t>::NewOrCopy(env, &(*owner)[0], owner->size(),
+        [](Napi::Env, char16_t*, std::u16string* owner) { delete owner; }, owner);
+}
+
+std::u16string Utf16FromJs(Napi::Value value) {
+    if (!IsText(value)) {
+        return std::u16string();
+    }
+    
+    if (value.IsString()) {
+        napi_env env = value.Env();
+        size_t length = 0;
+        if (napi_get_value_string_utf16(env, value, nullptr, 0, &length) != napi_ok) {
+            return std::u16string();
+        }
+        std::u16string text(length, u'\0');
+        napi_get_value_string_utf16(env, value, &text[0], length + 1, &length);
+        Stats::Add(Stats::TextBytesFromJs, length * sizeof(char16_t));
+        return text;
+    }
+    
+    // Copied byte-wise, since the view may start at an odd byte offset
+    Napi::TypedArray array = value.As<Napi::TypedArray>();
+    const uint8_t* bytes = static_cast<const uint8_t*>(array.ArrayBuffer().Data()) + array.ByteOffset();
+    size_t length = array.ByteLength() / sizeof(char16_t);
+    Stats::Add(Stats::TextBytesFromJs, length * sizeof(char16_t));
+    std::u16string text(length, u'\0');
+    if (length > 0) {
+        std::memcpy(&text[0], bytes, length * sizeof(char16_t));
+    }
+    return text;
+}
+
+Napi::Value TextMatchesToJs(Napi::Env env, const std::vector<TextMatch>& matches) {
+    Napi::Array results = Napi::Array::New(env, matches.size());
+    Stats::Add(Stats::ObjectsCreated, matches.size() + 1);
+    
+    for (size_t i = 0; i < matches.size(); ++i) {
+        Napi::Object result = Napi::Object::New(env);
+        result.Set("line", Napi::Number::New(env, matches[i].line));
+        result.Set("column", Napi::Number::New(env, matches[i].column));
+        result.Set("length", Napi::Number::New(env, matches[i].length));
+        result.Set("text", Utf16ToJs(env, matches[i].text));
+        results[i] = result;
+    }
+    
+    return results;
+}
+
+#ifdef HAVE_KTEXTEDITOR
+Napi::String QStringToJs(Napi::Env env, const QString& text) {
+    Stats::Add(Stats::TextBytesToJs, text.length() * sizeof(char16_t));
+    return Napi::String::New(env, reinterpret_cast<const char16_t*>(text.utf16()), text.length());
+}
+
+Napi::Buffer<char16_t> QStringToBuffer(Napi::Env env, const QString& text) {
+    // The buffer keeps its own reference; data() detaches, so it can't write into the document's copy
+    auto* owner = new QString(text);
+    Stats::Add(Stats::TextBytesToJs, text.length() * sizeof(char16_t));
+    char16_t* data = reinterpret_cast<char16_t*>(owner->data());
+    
+    // Copies (and releases the string) where the runtime forbids external buffers
+    return Napi::Buffer<char16_t>::NewOrCopy(env, data, owner->length(),
+        [](Napi::Env, char16_t*, QString* owner) { delete owner; }, owner);
+}
+
+QString TextFromJs(Napi::Value value) {
+    if (!IsText(value)) {
+        return QString();
+    }
+    
+    if (value.IsString()) {
+        // Read the UTF-16 straight into the QString's own storage
+        napi_env env = value.Env();
+        size_t length = 0;
+        if (napi_get_value_string_utf16(env, value, nullptr, 0, &length) != napi_ok) {
+            return QString();
+        }
+        QString text(static_cast<int>(length), Qt::Uninitialized);
+        napi_get_value_string_utf16(env, value, reinterpret_cast<char16_t*>(text.data()), length + 1, &length);
+        Stats::Add(Stats::TextBytesFromJs, length * sizeof(char16_t));
+        return text;
+    }
+    
+    Napi::TypedArray array = value.As<Napi::TypedArray>();
+    const uint8_t* bytes = static_cast<const uint8_t*>(array.ArrayBuffer().Data()) + array.ByteOffset();
+    int length = static_cast<int>(array.ByteLength() / sizeof(char16_t));
+    Stats::Add(Stats::TextBytesFromJs, length * sizeof(char16_t));
+    if (reinterpret_cast<uintptr_t>(bytes) % alignof(QChar) == 0) {
+        return QString(reinterpret_cast<const QChar*>(bytes), length);
+    }
+    
+    // Odd byte offset into the underlying ArrayBuffer
+    QString text(length, Qt::Uninitialized);
+    std::memcpy(text.data(), bytes, length * sizeof(char16_t));
+    return text;
+}
+
+Napi::Array StringListToJs(Napi::Env env, const QStringList& list) {
+    Napi::Array array = Napi::Array::New(env, list.size());
+    Stats::Add(Stats::ObjectsCreated, 1);
+    for (int i = 0; i < list.size(); ++i) {
+        array[i] = QStringToJs(env, list[i]);
+    }
+    return array;
+}
+
+Napi::Value SearchMatchesToJs(Napi::Env env, const std::vector<SearchMatch>& matches) {
+    Napi::Array results = Napi::Array::New(env, matches.size());
+    Stats::Add(Stats::ObjectsCreated, matches.size() + 1);
+    
+    for (size_t i = 0; i < matches.size(); ++i) {
+        Napi::Object result = Napi::Object::New(env);
+        result.Set("line", Napi::Number::New(env, matches[i].line));
+        result.Set("column", Napi::Number::New(env, matches[i].column));
+        result.Set("length", Napi::Number::New(env, matches[i].length));
+        result.Set("text", QStringToJs(env, matches[i].text));
+        results[i] = result;
+    }
+    
+    return results;
+}
+
+Napi::Value SyntaxTokenDeltaToJs(Napi::Env env, const SyntaxTokenDelta& delta) {
+    Napi::Object result = Napi::Object::New(env);
+    
+    result.Set("revision", Napi::Number::New(env, static_cast<double>(delta.revision)));
+    result.Set("lineCount", Napi::Number::New(env, delta.lineCount));
+    result.Set("reset", Napi::Boolean::New(env, delta.reset));
+    result.Set("shifts", Int32ArrayToJs(env, delta.shifts));
+    result.Set("lines", Uint32ArrayToJs(env, delta.lines));
+    result.Set("offsets", Uint32ArrayToJs(env, delta.offsets));
+    result.Set("data", Uint32ArrayToJs(env, delta.data));
+    result.Set("mode", Napi::String::New(env, delta.mode.toStdString()));
+    result.Set("legendVersion", Napi::Number::New(env, delta.legendVersion));
+    
+    if (delta.hasLegend) {
+        result.Set("legend", StringListToJs(env, delta.legend));
+    }
+    
+    return result;
+}
+#endif
+
+} // namespace KateNative
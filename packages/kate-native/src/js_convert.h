@@ -0,0 +1,77 @@
+#ifndef JS_CONVERT_H
+#define JS_CONVERT_H
+
+#include <napi.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "search_pattern.h"
+#include "text_pattern.h"
+
+#ifdef HAVE_KTEXTEDITOR
+#include <QString>
+#include <QStringList>
+#include "syntax_tokens.h"
+#endif
+
+namespace KateNative {
+
+class ModeCatalog;
+
+/**
+ * Conversions between JavaScript values and plain C++/Qt data
+ * Shared by the wrapper classes; must run on the JavaScript thread.
+ */
+
+Napi::Uint32Array Uint32ArrayToJs(Napi::Env env, const std::vector<uint32_t>& values);
+Napi::Int32Array Int32ArrayToJs(Napi::Env env, const std::vector<int32_t>& values);
+
+// Optional inclusive line range at info[index], info[index + 1]; defaults to every line
+void ParseLineRange(const Napi::CallbackInfo& info, size_t index, int& lineStart, int& lineEnd);
+
+// Points `data` at the elements of an Int32Array or Uint32Array; false for anything else
+bool Int32ElementsFromJs(Napi::Value value, const int32_t*& data, size_t& count);
+
+// True for strings, Uint16Arrays of code units and Buffers of UTF-16LE
+bool IsText(Napi::Value value);
+
+Napi::Array ModeNamesToJs(Napi::Env env, const ModeCatalog& catalog);
+
+// Optional { caseSensitive, wholeWords, regex } object at info[index]
+SearchOptions ParseSearchOptions(const Napi::CallbackInfo& info, size_t index);
+
+// The std::u16string counterparts of the QString conversions below, for the fallback document
+Napi::String Utf16ToJs(Napi::Env env, const std::u16string& text);
+Napi::Buffer<char16_t> Utf16ToBuffer(Napi::Env env, std::u16string text);
+std::u16string Utf16FromJs(Napi::Value value);
+
+Napi::Value TextMatchesToJs(Napi::Env env, const std::vector<TextMatch>& matches);
+
+// [{ id, name, section, wildcards, mimeTypes, priority }]
+Napi::Array ModeCatalogToJs(Napi::Env env, const ModeCatalog& catalog);
+
+#ifdef HAVE_KTEXTEDITOR
+/**
+ * Text crosses the boundary as UTF-16 in both directions, which is what
+ * both QString and V8 use, so nothing is transcoded and the characters
+ * are copied once.
+ */
+Napi::String QStringToJs(Napi::Env env, const QString& text);
+
+// A Buffer of UTF-16LE that shares the string's storage instead of copying it
+Napi::Buffer<char16_t> QStringToBuffer(Napi::Env env, const QString& text);
+
+// Accepts anything IsText() does; returns a null QString otherwise
+QString TextFromJs(Napi::Value value);
+
+Napi::Array StringListToJs(Napi::Env env, const QStringList& list);
+
+Napi::Value SearchMatchesToJs(Napi::Env env, const std::vector<SearchMatch>& matches);
+
+// { revision, lineCount, reset, shifts, lines, offsets, data, mode, legendVersion, legend? }
+Napi::Value SyntaxTokenDeltaToJs(Napi::Env env, const SyntaxTokenDelta& delta);
+#endif
+
+} // namespace KateNative
+
+#endif // JS_CONVERT_H
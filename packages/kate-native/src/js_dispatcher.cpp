@@ -0,0 +1,144 @@
+#include "js_dispatcher.h"
+#include <unordered_map>
+#include <stdexcept>
+
+namespace KateNative {
+
+// One dispatcher per environment
+static std::mutex g_registryMutex;
+static std::unordered_map<napi_env, std::shared_ptr<JsDispatcher>> g_dispatchers;
+
+std::shared_ptr<JsDispatcher> JsDispatcher::ForEnv(Napi::Env env) {
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+    
+    auto it = g_dispatchers.find(env);
+    if (it != g_dispatchers.end()) {
+        return it->second;
+    }
+    
+    uv_loop_t* loop = nullptr;
+    if (napi_get_uv_event_loop(env, &loop) != napi_ok || !loop) {
+        throw std::runtime_error("Unable to access the Node.js event loop");
+    }
+    
+    auto dispatcher = std::make_shared<JsDispatcher>(env, loop);
+    g_dispatchers.emplace(env, dispatcher);
+    napi_add_env_cleanup_hook(env, &JsDispatcher::OnEnvCleanup, static_cast<void*>(static_cast<napi_env>(env)));
+    return dispatcher;
+}
+
+JsDispatcher::JsDispatcher(Napi::Env env, uv_loop_t* loop)
+    : m_env(env), m_context(std::make_unique<Napi::AsyncContext>(env, "KateNativeDispatcher")) {
+    uv_async_init(loop, &m_async, &JsDispatcher::OnAsync);
+    m_async.data = this;
+    
+    // Idle until something is pending
+    uv_unref(reinterpret_cast<uv_handle_t*>(&m_async));
+}
+
+JsDispatcher::~JsDispatcher() {
+}
+
+void JsDispatcher::Post(Task task) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    
+    if (m_closed) {
+        return;
+    }
+    
+    m_tasks.push_back(std::move(task));
+    
+    // Coalesces with any send that hasn't been handled yet
+    uv_async_send(&m_async);
+}
+
+void JsDispatcher::Ref() {
+    if (m_closed) {
+        return;
+    }
+    if (m_pending++ == 0) {
+        uv_ref(reinterpret_cast<uv_handle_t*>(&m_async));
+    }
+}
+
+void JsDispatcher::Unref() {
+    if (m_closed) {
+        return;
+    }
+    if (m_pending > 0 && --m_pending == 0) {
+        uv_unref(reinterpret_cast<uv_handle_t*>(&m_async));
+    }
+}
+
+void JsDispatcher::OnAsync(uv_async_t* handle) {
+    static_cast<JsDispatcher*>(handle->data)->Drain();
+}
+
+void JsDispatcher::Drain() {
+    std::deque<Task> tasks;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        tasks.swap(m_tasks);
+    }
+    
+    if (tasks.empty() || !m_context) {
+        return;
+    }
+    
+    // The callback scope runs microtasks on exit, so promise reactions
+    // fire as part of this wakeup rather than on some later tick
+    Napi::HandleScope handleScope(m_env);
+    Napi::CallbackScope callbackScope(m_env, *m_context);
+    
+    for (Task& task : tasks) {
+        Napi::HandleScope taskScope(m_env);
+        try {
+            task(m_env);
+        } catch (const Napi::Error& e) {
+            napi_fatal_exception(m_env, e.Value());
+        } catch (const std::exception& e) {
+            napi_fatal_exception(m_env, Napi::Error::New(m_env, e.what()).Value());
+        }
+    }
+}
+
+void JsDispatcher::OnEnvCleanup(void* arg) {
+    napi_env env = static_cast<napi_env>(arg);
+    std::shared_ptr<JsDispatcher> dispatcher;
+    {
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        auto it = g_dispatchers.find(env);
+        if (it == g_dispatchers.end()) {
+            return;
+        }
+        dispatcher = std::move(it->second);
+        g_dispatchers.erase(it);
+    }
+    
+    Close(std::move(dispatcher));
+}
+
+void JsDispatcher::Close(std::shared_ptr<JsDispatcher> dispatcher) {
+    std::deque<Task> dropped;
+    {
+        std::lock_guard<std::mutex> lock(dispatcher->m_mutex);
+        dispatcher->m_closed = true;
+        dropped.swap(dispatcher->m_tasks);
+    }
+    // Outside the lock, in case destroying a task posts another
+    dropped.clear();
+    
+    // While the environment is still there to destroy it in
+    dispatcher->m_context.reset();
+    
+    // Keep the dispatcher alive until libuv is done with the handle
+    uv_handle_t* handle = reinterpret_cast<uv_handle_t*>(&dispatcher->m_async);
+    handle->data = new std::shared_ptr<JsDispatcher>(dispatcher);
+    uv_close(handle, &JsDispatcher::OnClosed);
+}
+
+void JsDispatcher::OnClosed(uv_handle_t* handle) {
+    delete static_cast<std::shared_ptr<JsDispatcher>*>(handle->data);
+}
+
+} // namespace KateNative
@@ -0,0 +1,81 @@
+#ifndef JS_DISPATCHER_H
+#define JS_DISPATCHER_H
+
+#include <napi.h>
+#include <uv.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace KateNative {
+
+/**
+ * Node.js Event Loop Dispatcher
+ *
+ * Delivers work from the Qt thread (or any other thread) back onto the
+ * JavaScript thread through a single uv_async_t per environment. Posting
+ * wakes the Node.js event loop immediately, and any number of posts made
+ * before the loop gets to run are drained in one callback.
+ *
+ * The handle is unreferenced while nothing is pending, so an idle
+ * dispatcher neither keeps the process alive nor causes wakeups.
+ *
+ * When the environment is torn down the dispatcher closes: pending and
+ * later tasks are dropped without running.
+ */
+class JsDispatcher {
+public:
+    using Task = std::function<void(Napi::Env)>;
+    
+    /**
+     * Get the dispatcher for an environment, creating it on first use
+     * Must be called on the JavaScript thread
+     */
+    static std::shared_ptr<JsDispatcher> ForEnv(Napi::Env env);
+    
+    /**
+     * Queue a task for the JavaScript thread
+     * Safe to call from any thread. Tasks posted after the environment
+     * has been torn down are dropped.
+     */
+    void Post(Task task);
+    
+    /**
+     * Mark an operation as pending, keeping the event loop alive until
+     * the matching Unref(). Must be called on the JavaScript thread.
+     */
+    void Ref();
+    
+    /**
+     * Mark a pending operation as finished
+     * Must be called on the JavaScript thread
+     */
+    void Unref();
+    
+    JsDispatcher(Napi::Env env, uv_loop_t* loop);
+    ~JsDispatcher();
+
+private:
+    static void OnAsync(uv_async_t* handle);
+    static void OnClosed(uv_handle_t* handle);
+    static void OnEnvCleanup(void* arg);
+    static void Close(std::shared_ptr<JsDispatcher> dispatcher);
+    
+    void Drain();
+    
+    Napi::Env m_env;
+    
+    // Released by the environment's cleanup hook: the dispatcher itself can
+    // outlive the environment, and its last owner may be on another thread
+    std::unique_ptr<Napi::AsyncContext> m_context;
+    uv_async_t m_async;
+    std::mutex m_mutex;
+    std::deque<Task> m_tasks;
+    size_t m_pending = 0;
+    bool m_closed = false;
+};
+
+} // namespace KateNative
+
+#endif // JS_DISPATCHER_H
@@ -0,0 +1,423 @@
+#include "large_document_wrapper.h"
+#include "js_convert.h"
+#include "js_dispatcher.h"
+#include "line_index_builder.h"
+#include "line_offsets.h"
+#include "mapped_file.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <functional>
+#include <vector>
+
+#ifdef HAVE_KTEXTEDITOR
+#include <QString>
+#include "search_pattern.h"
+#else
+#include "fallback_document.h"
+#include "text_pattern.h"
+#endif
+
+namespace KateNative {
+
+/**
+ * The mapping and its index, shared with the workers
+ * `offsets` is written by the indexing worker only, before `indexed` is set.
+ */
+struct LargeDocumentData {
+    std::shared_ptr<MappedFile> file;
+    LineOffsets offsets;
+    std::atomic<bool> indexed{false};
+    
+    // JavaScript thread only
+    std::string error;
+    std::vector<Napi::Promise::Deferred> waiting;
+};
+
+namespace {
+
+// Line text without the line break, and without the '\r' of a CRLF
+void LineBytes(const LargeDocumentData& data, int64_t line, const char*& text, size_t& length) {
+    uint64_t start = data.offsets.LineStart(line);
+    uint64_t end = data.offsets.LineEnd(line);
+    if (end > start && data.file->Data()[end - 1] == '\r') {
+        end--;
+    }
+    text = data.file->Data() + start;
+    length = static_cast<size_t>(end - start);
+}
+
+Napi::String LineToJs(Napi::Env env, const LargeDocumentData& data, int64_t line) {
+    const char* text = nullptr;
+    size_t length = 0;
+    LineBytes(data, line, text, length);
+    return Napi::String::New(env, length > 0 ? text : "", length);
+}
+
+void FinishIndexing(Napi::Env env, const std::shared_ptr<LargeDocumentData>& data) {
+    // Search results and line numbers are passed as int32
+    if (data->offsets.LineCount() > INT_MAX) {
+        data->error = "Files with more than 2^31 lines are not supported";
+    } else {
+        data->indexed = true;
+    }
+    
+    for (Napi::Promise::Deferred& deferred : data->waiting) {
+        if (data->error.empty()) {
+            deferred.Resolve(env.Undefined());
+        } else {
+            deferred.Reject(Napi::Error::New(env, data->error).Value());
+        }
+    }
+    data->waiting.clear();
+}
+
+const int FIELDS_PER_MATCH = 3;
+const int64_t CHUNK_LINES = LineOffsets::BlockLines * 256;
+
+#ifdef HAVE_KTEXTEDITOR
+using LinePattern = SearchPattern;
+using LineText = QString;
+#else
+using LinePattern = TextPattern;
+using LineText = std::u16string;
+#endif
+
+/**
+ * One search over a mapped file
+ */
+struct LargeSearch {
+    LargeSearch(std::shared_ptr<LargeDocumentData> data, LineText query, const SearchOptions& options)
+        : data(std::move(data)), pattern(std::move(query), options) {}
+        
+    std::shared_ptr<LargeDocumentData> data;
+    const LinePattern pattern;
+    
+    // Plain case sensitive queries look for the UTF-8 bytes of the query
+    // first and only decode the lines they occur in
+    std::string needle;
+    
+    int limit = 0;
+    int chunkCount = 0;
+    std::atomic<int> nextChunk{0};
+    std::atomic<int> pendingChunks{0};
+    std::vector<std::vector<int32_t>> results;
+};
+
+// Appends the matches in `line`; false once the chunk's limit is reached
+bool SearchLine(const LargeSearch& search, int64_t line, std::vector<int32_t>& matches) {
+    const char* text = nullptr;
+    size_t length = 0;
+    LineBytes(*search.data, line, text, length);
+#ifdef HAVE_KTEXTEDITOR
+    QString lineText = QString::fromUtf8(text, static_cast<int>(std::min<size_t>(length, INT_MAX)));
+#else
+    std::u16string lineText = FallbackDocument::Decode(text, length);
+#endif
+    
+    bool full = false;
+    search.pattern.ForEachMatch(lineText, [&](int column, int matchLength) {
+        matches.insert(matches.end(), {static_cast<int32_t>(line), column, matchLength});
+        full = search.limit > 0 && matches.size() >= static_cast<size_t>(search.limit) * FIELDS_PER_MATCH;
+        return !full;
+    });
+    return !full;
+}
+
+// Runs on a worker thread
+void SearchChunk(const LargeSearch& search, int chunk, std::vector<int32_t>& matches) {
+    const LineOffsets& offsets = search.data->offsets;
+    int64_t lineStart = chunk * CHUNK_LINES;
+    int64_t lineEnd = std::min(lineStart + CHUNK_LINES, offsets.LineCount());
+    
+    if (search.needle.empty()) {
+        for (int64_t line = lineStart; line < lineEnd; line++) {
+            if (!SearchLine(search, line, matches)) {
+                return;
+            }
+        }
+        return;
+    }
+    
+    const char* data = search.data->file->Data();
+    const char* end = data + offsets.LineEnd(lineEnd - 1);
+    std::boyer_moore_horspool_searcher<const char*> searcher(search.needle.data(),
+                                                             search.needle.data() + search.needle.size());
+    for (const char* p = data + offsets.LineStart(lineStart); p < end; ) {
+        const char* found = std::search(p, end, searcher);
+        if (found == end) {
+            return;
+        }
+        int64_t line = offsets.LineAt(static_cast<uint64_t>(found - data));
+        if (!SearchLine(search, line, matches)) {
+            return;
+        }
+        p = data + offsets.LineEnd(line) + 1;
+    }
+}
+
+void FinishSearch(Napi::Env env, LargeSearch& search, Napi::Promise::Deferred deferred) {
+    // Chunks are in line order; each is capped at the limit already
+    std::vector<int32_t> matches;
+    size_t cap = search.limit > 0 ? static_cast<size_t>(search.limit) * FIELDS_PER_MATCH : SIZE_MAX;
+    for (const std::vector<int32_t>& chunk : search.results) {
+        if (matches.size() >= cap) {
+            break;
+        }
+        matches.insert(matches.end(), chunk.begin(), chunk.begin() + std::min(chunk.size(), cap - matches.size()));
+    }
+    deferred.Resolve(Int32ArrayToJs(env, matches));
+}
+
+} // namespace
+
+Napi::Object LargeDocumentWrapper::Init(Napi::Env env, Napi::Object exports) {
+    Napi::Function func = DefineClass(env, "KateLargeDocument", {
+        InstanceMethod("ready", &LargeDocumentWrapper::Ready),
+        InstanceMethod("isReady", &LargeDocumentWrapper::IsReady),
+        InstanceMethod("path", &LargeDocumentWrapper::GetPath),
+        InstanceMethod("byteLength", &LargeDocumentWrapper::GetByteLength),
+        InstanceMethod("indexBytes", &LargeDocumentWrapper::GetIndexBytes),
+        InstanceMethod("close", &LargeDocumentWrapper::Close),
+        InstanceMethod("lineCount", &LargeDocumentWrapper::GetLineCount),
+        InstanceMethod("line", &LargeDocumentWrapper::GetLine),
+        InstanceMethod("lines", &LargeDocumentWrapper::GetLines),
+        InstanceMethod("byteOffset", &LargeDocumentWrapper::GetByteOffset),
+        InstanceMethod("search", &LargeDocumentWrapper::Search),
+    });
+    
+    exports.Set("KateLargeDocument", func);
+    return exports;
+}
+
+LargeDocumentWrapper::LargeDocumentWrapper(const Napi::CallbackInfo& info)
+    : Napi::ObjectWrap<LargeDocumentWrapper>(info) {
+    Napi::Env env = info.Env();
+    
+    // Parameters: path, optional { onProgress(scanned, total) }
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "Expected a file path").ThrowAsJavaScriptException();
+        return;
+    }
+    
+    m_path = info[0].As<Napi::String>().Utf8Value();
+    std::string error;
+    std::shared_ptr<MappedFile> file = MappedFile::Open(m_path, error);
+    if (!file) {
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return;
+    }
+    
+    m_data = std::make_shared<LargeDocumentData>();
+    m_data->file = file;
+    
+    // Released on the JavaScript thread once indexing is done
+    Napi::FunctionReference* onProgress = nullptr;
+    if (info.Length() > 1 && info[1].IsObject() && info[1].As<Napi::Object>().Get("onProgress").IsFunction()) {
+        onProgress = new Napi::FunctionReference(
+            Napi::Persistent(info[1].As<Napi::Object>().Get("onProgress").As<Napi::Function>()));
+    }
+    
+    std::shared_ptr<LargeDocumentData> data = m_data;
+    std::shared_ptr<JsDispatcher> dispatcher = JsDispatcher::ForEnv(env);
+    dispatcher->Ref();
+    LineScanner::Progress progress = LineIndexBuilder::ProgressTo(dispatcher, onProgress, file->Size());
+    WorkerPool::Post([data, dispatcher, onProgress, progress]() {
+        data->file->AdviseSequential(0, data->file->Size());
+        data->offsets.Build(data->file->Data(), data->file->Size(), progress);
+        
+        dispatcher->Post([data, dispatcher, onProgress](Napi::Env env) {
+            delete onProgress;
+            FinishIndexing(env, data);
+            dispatcher->Unref();
+        });
+    });
+}
+
+LargeDocumentWrapper::~LargeDocumentWrapper() = default;
+
+bool LargeDocumentWrapper::CheckIndexed(Napi::Env env) const {
+    if (!m_data) {
+        Napi::Error::New(env, "Document is closed").ThrowAsJavaScriptException();
+        return false;
+    }
+    if (!m_data->error.empty()) {
+        Napi::Error::New(env, m_data->error).ThrowAsJavaScriptException();
+        return false;
+    }
+    if (!m_data->indexed.load()) {
+        Napi::Error::New(env, "The line index is still being built; wait for ready()").ThrowAsJavaScriptException();
+        return false;
+    }
+    return true;
+}
+
+Napi::Value LargeDocumentWrapper::Ready(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+    
+    if (!m_data) {
+        deferred.Reject(Napi::Error::New(env, "Document is closed").Value());
+    } else if (!m_data->error.empty()) {
+        deferred.Reject(Napi::Error::New(env, m_data->error).Value());
+    } else if (m_data->indexed.load()) {
+        deferred.Resolve(env.Undefined());
+    } else {
+        m_data->waiting.push_back(deferred);
+    }
+    return deferred.Promise();
+}
+
+Napi::Value LargeDocumentWrapper::IsReady(const Napi::CallbackInfo& info) {
+    return Napi::Boolean::New(info.Env(), m_data && m_data->indexed.load());
+}
+
+Napi::Value LargeDocumentWrapper::GetPath(const Napi::CallbackInfo& info) {
+    return Napi::String::New(info.Env(), m_path);
+}
+
+Napi::Value LargeDocumentWrapper::GetByteLength(const Napi::CallbackInfo& info) {
+    uint64_t size = m_data ? m_data->file->Size() : 0;
+    return Napi::Number::New(info.Env(), static_cast<double>(size));
+}
+
+Napi::Value LargeDocumentWrapper::GetIndexBytes(const Napi::CallbackInfo& info) {
+    size_t bytes = m_data && m_data->indexed.load() ? m_data->offsets.MemoryBytes() : 0;
+    return Napi::Number::New(info.Env(), static_cast<double>(bytes));
+}
+
+void LargeDocumentWrapper::Close(const Napi::CallbackInfo&) {
+    // Running searches keep their own reference; the file is unmapped
+    // once the last of them is done
+    m_data.reset();
+}
+
+Napi::Value LargeDocumentWrapper::GetLineCount(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (!CheckIndexed(env)) {
+        return env.Null();
+    }
+    return Napi::Number::New(env, static_cast<double>(m_data->offsets.LineCount()));
+}
+
+Napi::Value LargeDocumentWrapper::GetLine(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (!CheckIndexed(env)) {
+        return env.Null();
+    }
+    
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Expected a line number").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    int64_t line = info[0].As<Napi::Number>().Int64Value();
+    if (line < 0 || line >= m_data->offsets.LineCount()) {
+        return Napi::String::New(env, "");
+    }
+    return LineToJs(env, *m_data, line);
+}
+
+Napi::Value LargeDocumentWrapper::GetLines(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (!CheckIndexed(env)) {
+        return env.Null();
+    }
+    
+    // Parameters: lineStart, lineEnd (inclusive)
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Expected lineStart and lineEnd as numbers").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    int64_t lineStart = std::max<int64_t>(info[0].As<Napi::Number>().Int64Value(), 0);
+    int64_t lineEnd = std::min(info[1].As<Napi::Number>().Int64Value(), m_data->offsets.LineCount() - 1);
+    
+    Napi::Array lines = Napi::Array::New(env, lineEnd >= lineStart ? lineEnd - lineStart + 1 : 0);
+    for (int64_t line = lineStart; line <= lineEnd; line++) {
+        lines.Set(static_cast<uint32_t>(line - lineStart), LineToJs(env, *m_data, line));
+    }
+    return lines;
+}
+
+Napi::Value LargeDocumentWrapper::GetByteOffset(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (!CheckIndexed(env)) {
+        return env.Null();
+    }
+    
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Expected a line number").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    // Past the last line is the end of the file
+    int64_t line = info[0].As<Napi::Number>().Int64Value();
+    uint64_t offset = line >= m_data->offsets.LineCount()
+        ? m_data->file->Size() : m_data->offsets.LineStart(std::max<int64_t>(line, 0));
+    return Napi::Number::New(env, static_cast<double>(offset));
+}
+
+Napi::Value LargeDocumentWrapper::Search(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+    
+    if (!CheckIndexed(env)) {
+        return env.Null();
+    }
+    
+    // Parameters: query, optional { caseSensitive, wholeWords, regex, limit }
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "First argument must be a search string").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    std::string query = info[0].As<Napi::String>().Utf8Value();
+    SearchOptions options = ParseSearchOptions(info, 1);
+#ifdef HAVE_KTEXTEDITOR
+    auto search = std::make_shared<LargeSearch>(m_data, QString::fromStdString(query), options);
+    std::string error = search->pattern.ErrorString().toStdString();
+#else
+    auto search = std::make_shared<LargeSearch>(m_data, Utf16FromJs(info[0]), options);
+    std::string error = search->pattern.ErrorString();
+#endif
+    
+    if (!search->pattern.IsValid()) {
+        deferred.Reject(Napi::Error::New(env, "Invalid search pattern: " + error).Value());
+        return deferred.Promise();
+    }
+    
+    search->limit = DefaultSearchLimit;
+    if (info.Length() > 1 && info[1].IsObject() && info[1].As<Napi::Object>().Get("limit").IsNumber()) {
+        search->limit = std::max(info[1].As<Napi::Object>().Get("limit").As<Napi::Number>().Int32Value(), 0);
+    }
+    if (!options.regex && options.caseSensitive && !query.empty()) {
+        search->needle = query;
+    }
+    
+    search->chunkCount = static_cast<int>((m_data->offsets.LineCount() + CHUNK_LINES - 1) / CHUNK_LINES);
+    search->pendingChunks = search->chunkCount;
+    search->results.resize(search->chunkCount);
+    
+    std::shared_ptr<JsDispatcher> dispatcher = JsDispatcher::ForEnv(env);
+    dispatcher->Ref();
+    int workers = std::min(WorkerPool::ThreadCount(), search->chunkCount);
+    for (int i = 0; i < workers; i++) {
+        WorkerPool::Post([search, dispatcher, deferred]() {
+            for (int chunk = search->nextChunk++; chunk < search->chunkCount; chunk = search->nextChunk++) {
+                SearchChunk(*search, chunk, search->results[chunk]);
+                
+                if (--search->pendingChunks == 0) {
+                    dispatcher->Post([search, dispatcher, deferred](Napi::Env env) {
+                        FinishSearch(env, *search, deferred);
+                        dispatcher->Unref();
+                    });
+                }
+            }
+        });
+    }
+    return deferred.Promise();
+}
+
+} // namespace KateNative
@@ -0,0 +1,58 @@
+#ifndef LARGE_DOCUMENT_WRAPPER_H
+#define LARGE_DOCUMENT_WRAPPER_H
+
+#include <napi.h>
+#include <memory>
+#include <string>
+
+namespace KateNative {
+
+struct LargeDocumentData;
+
+/**
+ * JavaScript wrapper for a read-only, memory-mapped file
+ *
+ * For files too large for a KTextEditor::Document, which holds the whole
+ * text in memory as UTF-16. The file is mapped instead of read, and a
+ * compact line offset index (see LineOffsets) is built on a worker
+ * thread; ready() resolves once it is done. Lines are decoded from UTF-8
+ * only when they are asked for, so memory use stays at the size of the
+ * index plus the pages the kernel keeps cached.
+ *
+ * Searching runs on the worker pool straight over the mapping and never
+ * touches the Qt thread; without KTextEditor, lines are matched with a
+ * TextPattern instead of a SearchPattern.
+ */
+class LargeDocumentWrapper : public Napi::ObjectWrap<LargeDocumentWrapper> {
+public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports);
+    
+    LargeDocumentWrapper(const Napi::CallbackInfo& info);
+    ~LargeDocumentWrapper();
+    
+    Napi::Value Ready(const Napi::CallbackInfo& info);
+    Napi::Value IsReady(const Napi::CallbackInfo& info);
+    Napi::Value GetPath(const Napi::CallbackInfo& info);
+    Napi::Value GetByteLength(const Napi::CallbackInfo& info);
+    Napi::Value GetIndexBytes(const Napi::CallbackInfo& info);
+    void Close(const Napi::CallbackInfo& info);
+    
+    Napi::Value GetLineCount(const Napi::CallbackInfo& info);
+    Napi::Value GetLine(const Napi::CallbackInfo& info);
+    Napi::Value GetLines(const Napi::CallbackInfo& info);
+    Napi::Value GetByteOffset(const Napi::CallbackInfo& info);
+    Napi::Value Search(const Napi::CallbackInfo& info);
+
+private:
+    static constexpr int DefaultSearchLimit = 10000;
+    
+    // Throws and returns false unless the index is built
+    bool CheckIndexed(Napi::Env env) const;
+    
+    std::string m_path;
+    std::shared_ptr<LargeDocumentData> m_data;
+};
+
+} // namespace KateNative
+
+#endif // LARGE_DOCUMENT_WRAPPER_H
@@ -0,0 +1,203 @@
+#include "line_diff.h"
+#include <algorithm>
+
+namespace KateNative {
+
+namespace {
+
+// Half-open line ranges of both sides still to be compared
+struct Subproblem {
+    int64_t baseStart;
+    int64_t baseEnd;
+    int64_t start;
+    int64_t end;
+};
+
+class Differ {
+public:
+    Differ(const std::vector<uint64_t>& base, const std::vector<uint64_t>& lines)
+        : m_base(base)
+        , m_lines(lines)
+        , m_removed(base.size(), false)
+        , m_added(lines.size(), false)
+    {
+    }
+    
+    void Run() {
+        // An explicit stack, as a long run of alternating edits splits deeply
+        std::vector<Subproblem> pending = {{0, static_cast<int64_t>(m_base.size()), 0, static_cast<int64_t>(m_lines.size())}};
+        while (!pending.empty()) {
+            Subproblem problem = pending.back();
+            pending.pop_back();
+            
+            while (problem.baseStart < problem.baseEnd && problem.start < problem.end
+                   && m_base[problem.baseStart] == m_lines[problem.start]) {
+                problem.baseStart++;
+                problem.start++;
+            }
+            while (problem.baseStart < problem.baseEnd && problem.start < problem.end
+                   && m_base[problem.baseEnd - 1] == m_lines[problem.end - 1]) {
+                problem.baseEnd--;
+                problem.end--;
+            }
+            
+            if (problem.baseStart == problem.baseEnd || problem.start == problem.end) {
+                MarkChanged(problem);
+                continue;
+            }
+            
+            // A split at a corner would not make progress
+            int64_t baseSplit, split;
+            if (!Bisect(problem, baseSplit, split)
+                || (baseSplit == problem.baseStart && split == problem.start)
+                || (baseSplit == problem.baseEnd && split == problem.end)) {
+                MarkChanged(problem);
+                continue;
+            }
+            pending.push_back({baseSplit, problem.baseEnd, split, problem.end});
+            pending.push_back({problem.baseStart, baseSplit, problem.start, split});
+        }
+    }
+    
+    std::vector<int32_t> Hunks() const {
+        std::vector<int32_t> hunks;
+        size_t baseLine = 0;
+        size_t line = 0;
+        while (baseLine < m_base.size() || line < m_lines.size()) {
+            bool removed = baseLine < m_base.size() && m_removed[baseLine];
+            bool added = line < m_lines.size() && m_added[line];
+            if (!removed && !added) {
+                baseLine++;
+                line++;
+                continue;
+            }
+            
+            size_t baseStart = baseLine;
+            size_t start = line;
+            while (baseLine < m_base.size() && m_removed[baseLine]) {
+                baseLine++;
+            }
+            while (line < m_lines.size() && m_added[line]) {
+                line++;
+            }
+            hunks.push_back(static_cast<int32_t>(baseStart));
+            hunks.push_back(static_cast<int32_t>(baseLine - baseStart));
+            hunks.push_back(static_cast<int32_t>(start));
+            hunks.push_back(static_cast<int32_t>(line - start));
+        }
+        return hunks;
+    }
+
+private:
+    void MarkChanged(const Subproblem& problem) {
+        std::fill(m_removed.begin() + problem.baseStart, m_removed.begin() + problem.baseEnd, true);
+        std::fill(m_added.begin() + problem.start, m_added.begin() + problem.end, true);
+    }
+    
+    /**
+     * Point where the forward and reverse searches for the shortest edit
+     * script meet, which lies on an optimal path and splits the problem
+     * Both sides must be non-empty. False when the edit distance exceeds
+     * MaxCost.
+     */
+    bool Bisect(const Subproblem& problem, int64_t& baseSplit, int64_t& split) {
+        const uint64_t* a = m_base.data() + problem.baseStart;
+        const uint64_t* b = m_lines.data() + problem.start;
+        int64_t n = problem.baseEnd - problem.baseStart;
+        int64_t m = problem.end - problem.start;
+        
+        int64_t maxD = std::min((n + m + 1) / 2, LineDiff::MaxCost);
+        int64_t offset = maxD + 1;
+        m_forward.assign(2 * offset + 1, -1);
+        m_reverse.assign(2 * offset + 1, -1);
+        m_forward[offset + 1] = 0;
+        m_reverse[offset + 1] = 0;
+        
+        // Odd deltas meet during a forward step, even ones during a reverse step
+        int64_t delta = n - m;
+        bool front = (delta & 1) != 0;
+        
+        // Diagonals that ran off the grid are not extended again
+        int64_t forwardStart = 0, forwardEnd = 0, reverseStart = 0, reverseEnd = 0;
+        
+        for (int64_t d = 0; d < maxD; d++) {
+            for (int64_t k = -d + forwardStart; k <= d - forwardEnd; k += 2) {
+                int64_t index = offset + k;
+                int64_t x = (k == -d || (k != d && m_forward[index - 1] < m_forward[index + 1]))
+                    ? m_forward[index + 1]
+                    : m_forward[index - 1] + 1;
+                int64_t y = x - k;
+                while (x < n && y < m && a[x] == b[y]) {
+                    x++;
+                    y++;
+                }
+                m_forward[index] = x;
+                
+                if (x > n) {
+                    forwardEnd += 2;
+                } else if (y > m) {
+                    forwardStart += 2;
+                } else if (front) {
+                    int64_t reverseIndex = offset + delta - k;
+                    if (reverseIndex >= 0 && reverseIndex < static_cast<int64_t>(m_reverse.size())
+                        && m_reverse[reverseIndex] != -1 && x >= n - m_reverse[reverseIndex]) {
+                        baseSplit = problem.baseStart + x;
+                        split = problem.start + y;
+                        return true;
+                    }
+                }
+            }
+            
+            for (int64_t k = -d + reverseStart; k <= d - reverseEnd; k += 2) {
+                int64_t index = offset + k;
+                int64_t x = (k == -d || (k != d && m_reverse[index - 1] < m_reverse[index + 1]))
+                    ? m_reverse[index + 1]
+                    : m_reverse[index - 1] + 1;
+                int64_t y = x - k;
+                while (x < n && y < m && a[n - x - 1] == b[m - y - 1]) {
+                    x++;
+                    y++;
+                }
+                m_reverse[index] = x;
+                
+                if (x > n) {
+                    reverseEnd += 2;
+                } else if (y > m) {
+                    reverseStart += 2;
+                } else if (!front) {
+                    int64_t forwardIndex = offset + delta - k;
+                    if (forwardIndex >= 0 && forwardIndex < static_cast<int64_t>(m_forward.size())
+                        && m_forward[forwardIndex] != -1) {
+                        int64_t forwardX = m_forward[forwardIndex];
+                        int64_t forwardY = forwardX - (forwardIndex - offset);
+                        if (forwardX >= n - x) {
+                            baseSplit = problem.baseStart + forwardX;
+                            split = problem.start + forwardY;
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+        return false;
+    }
+    
+    const std::vector<uint64_t>& m_base;
+    const std::vector<uint64_t>& m_lines;
+    std::vector<bool> m_removed;
+    std::vector<bool> m_added;
+    
+    // Furthest x reached on each diagonal, reused across bisections
+    std::vector<int64_t> m_forward;
+    std::vector<int64_t> m_reverse;
+};
+
+} // namespace
+
+std::vector<int32_t> LineDiff::Compute(const std::vector<uint64_t>& base, const std::vector<uint64_t>& lines) {
+    Differ differ(base, lines);
+    differ.Run();
+    return differ.Hunks();
+}
+
+} // namespace KateNative
@@ -0,0 +1,44 @@
+#ifndef LINE_DIFF_H
+#define LINE_DIFF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace KateNative {
+
+/**
+ * Line Diff
+ *
+ * Myers' O(ND) difference algorithm over line hashes (see
+ * LineMetadata::HashLine), in its linear space form: the middle snake
+ * splits each subproblem in two, so memory stays proportional to the
+ * number of lines and no edit script is kept. Lines count as equal when
+ * their 64-bit hashes are. Common leading and trailing lines are peeled
+ * off every subproblem first, which makes the usual case of a few edits
+ * in a large file close to a linear scan.
+ *
+ * A subproblem whose edit distance exceeds MaxCost is reported as one
+ * replacement instead of searched further, bounding the time spent on
+ * unrelated texts; the result is then a valid but not minimal diff.
+ */
+class LineDiff {
+public:
+    static constexpr int64_t MaxCost = 4096;
+    
+    /**
+     * Hunks turning `base` into `lines`, in order
+     * Four values per hunk: base start line, base line count, start line
+     * and line count. A count of 0 is a pure insertion or removal; its
+     * start is the line before which the other side's lines go.
+     */
+    static std::vector<int32_t> Compute(const std::vector<uint64_t>& base, const std::vector<uint64_t>& lines);
+
+private:
+    LineDiff() = delete;
+    ~LineDiff() = delete;
+};
+
+} // namespace KateNative
+
+#endif // LINE_DIFF_H
@@ -0,0 +1,221 @@
+#include "line_hashes.h"
+
+#ifdef HAVE_KTEXTEDITOR
+#include "line_diff.h"
+#include "line_metadata.h"
+#include <KTextEditor/Document>
+#include <KTextEditor/Cursor>
+#include <KTextEditor/Range>
+#include <algorithm>
+#include <string>
+#include <utility>
+
+namespace KateNative {
+
+namespace {
+
+uint64_t HashUnits(const char16_t* text, size_t length, bool ignoreWhitespace, std::u16string& buffer) {
+    if (!ignoreWhitespace) {
+        return LineMetadata::HashLine(text, length);
+    }
+    
+    buffer.clear();
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] != u' ' && text[i] != u'\t') {
+            buffer.push_back(text[i]);
+        }
+    }
+    return LineMetadata::HashLine(buffer.data(), buffer.size());
+}
+
+uint64_t HashLineText(const QString& text) {
+    return LineMetadata::HashLine(reinterpret_cast<const char16_t*>(text.utf16()), text.length());
+}
+
+} // namespace
+
+LineHashes::LineHashes(KTextEditor::Document* document)
+    : QObject(document)
+    , m_document(document)
+{
+    connect(document, &KTextEditor::Document::textInserted, this,
+        [this](KTextEditor::Document*, const KTextEditor::Cursor& position, const QString& text) {
+            OnTextInserted(position, text);
+        });
+    connect(document, &KTextEditor::Document::textRemoved, this,
+        [this](KTextEditor::Document*, const KTextEditor::Range& range, const QString&) {
+            OnTextRemoved(range);
+        });
+        
+    // Loading a file replaces the content without textInserted/textRemoved
+    connect(document, &KTextEditor::Document::aboutToInvalidateMovingInterfaceContent, this,
+        [this](KTextEditor::Document*) {
+            m_reset = true;
+            m_dirtyHunksValid = false;
+        });
+    connect(document, &KTextEditor::Document::reloaded, this,
+        [this](KTextEditor::Document*) {
+            m_reset = true;
+            MarkSaved();
+        });
+    connect(document, &KTextEditor::Document::modifiedChanged, this,
+        [this](KTextEditor::Document*) {
+            if (!m_document->isModified()) {
+                MarkSaved();
+            }
+        });
+        
+    MarkSaved();
+}
+
+const std::vector<uint64_t>& LineHashes::Hashes() {
+    // Never answer from an index that has a different number of lines
+    size_t lineCount = static_cast<size_t>(qMax(m_document->lines(), 1));
+    if (m_reset || m_hashes.size() != lineCount) {
+        m_hashes.resize(lineCount);
+        for (size_t line = 0; line < lineCount; line++) {
+            m_hashes[line] = HashLineText(m_document->line(static_cast<int>(line)));
+        }
+        m_stale.assign(lineCount, false);
+        m_reset = false;
+    } else {
+        for (int line = m_staleFirst; line < m_staleEnd; line++) {
+            if (m_stale[line]) {
+                m_hashes[line] = HashLineText(m_document->line(line));
+                m_stale[line] = false;
+            }
+        }
+    }
+    
+    m_staleFirst = 0;
+    m_staleEnd = 0;
+    return m_hashes;
+}
+
+std::vector<uint64_t> LineHashes::HashesIgnoringWhitespace() const {
+    int lineCount = qMax(m_document->lines(), 1);
+    std::vector<uint64_t> hashes(lineCount);
+    std::u16string buffer;
+    for (int line = 0; line < lineCount; line++) {
+        QString text = m_document->line(line);
+        hashes[line] = HashUnits(reinterpret_cast<const char16_t*>(text.utf16()), text.length(), true, buffer);
+    }
+    return hashes;
+}
+
+void LineHashes::MarkSaved() {
+    m_saved = Hashes();
+    m_dirtyHunks.clear();
+    m_dirtyHunksValid = true;
+}
+
+void LineHashes::SetSavedHashes(std::vector<uint64_t> hashes) {
+    m_saved = std::move(hashes);
+    m_dirtyHunksValid = false;
+}
+
+const std::vector<int32_t>& LineHashes::DirtyHunks() {
+    if (!m_dirtyHunksValid) {
+        m_dirtyHunks = LineDiff::Compute(m_saved, Hashes());
+        m_dirtyHunksValid = true;
+    }
+    return m_dirtyHunks;
+}
+
+std::vector<uint64_t> LineHashes::HashText(const QString& text, bool ignoreWhitespace) {
+    const char16_t* data = reinterpret_cast<const char16_t*>(text.utf16());
+    size_t length = static_cast<size_t>(text.length());
+    
+    std::vector<uint64_t> hashes;
+    std::u16string buffer;
+    size_t lineStart = 0;
+    while (true) {
+        const char16_t* lineBreak = std::find(data + lineStart, data + length, u'\n');
+        size_t lineEnd = static_cast<size_t>(lineBreak - data);
+        size_t lineLength = lineEnd - lineStart;
+        if (lineLength > 0 && data[lineEnd - 1] == u'\r') {
+            lineLength--;
+        }
+        hashes.push_back(HashUnits(data + lineStart, lineLength, ignoreWhitespace, buffer));
+        
+        if (lineEnd == length) {
+            break;
+        }
+        lineStart = lineEnd + 1;
+    }
+    return hashes;
+}
+
+void LineHashes::Touch(int line, int count) {
+    for (int i = line; i < line + count; i++) {
+        m_stale[i] = true;
+    }
+    
+    if (m_staleFirst == m_staleEnd) {
+        m_staleFirst = line;
+        m_staleEnd = line + count;
+    } else {
+        m_staleFirst = std::min(m_staleFirst, line);
+        m_staleEnd = std::max(m_staleEnd, line + count);
+    }
+    m_dirtyHunksValid = false;
+}
+
+void LineHashes::OnTextInserted(const KTextEditor::Cursor& position, const QString& text) {
+    m_dirtyHunksValid = false;
+    if (m_reset) {
+        return;
+    }
+    
+    int line = position.line();
+    int added = text.count(QLatin1Char('\n'));
+    if (line < 0 || line >= static_cast<int>(m_hashes.size())) {
+        m_reset = true;
+        return;
+    }
+    
+    m_hashes.insert(m_hashes.begin() + line + 1, added, 0);
+    m_stale.insert(m_stale.begin() + line + 1, added, false);
+    
+    // Stale lines after the edit moved down
+    if (m_staleFirst > line) {
+        m_staleFirst += added;
+    }
+    if (m_staleEnd > line) {
+        m_staleEnd += added;
+    }
+    Touch(line, added + 1);
+}
+
+void LineHashes::OnTextRemoved(const KTextEditor::Range& range) {
+    m_dirtyHunksValid = false;
+    if (m_reset) {
+        return;
+    }
+    
+    int line = range.start().line();
+    int removed = range.end().line() - line;
+    if (line < 0 || line + removed >= static_cast<int>(m_hashes.size())) {
+        m_reset = true;
+        return;
+    }
+    
+    m_hashes.erase(m_hashes.begin() + line + 1, m_hashes.begin() + line + 1 + removed);
+    m_stale.erase(m_stale.begin() + line + 1, m_stale.begin() + line + 1 + removed);
+    
+    // Stale lines after the edit moved up; those inside it are gone
+    auto shift = [line, removed](int& bound) {
+        if (bound > line + removed) {
+            bound -= removed;
+        } else if (bound > line + 1) {
+            bound = line + 1;
+        }
+    };
+    shift(m_staleFirst);
+    shift(m_staleEnd);
+    Touch(line, 1);
+}
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
@@ -0,0 +1,84 @@
+#ifndef LINE_HASHES_H
+#define LINE_HASHES_H
+
+#ifdef HAVE_KTEXTEDITOR
+#include <QObject>
+#include <QString>
+#include <cstdint>
+#include <vector>
+
+namespace KTextEditor {
+    class Document;
+    class Cursor;
+    class Range;
+}
+
+namespace KateNative {
+
+/**
+ * Line Hash Index
+ *
+ * Keeps the LineMetadata::HashLine() hash of every line of one document,
+ * for diffing with LineDiff. Edits only mark the lines they touched; those
+ * are rehashed by the next query. A copy of the hashes is taken whenever
+ * the document becomes unmodified (created, loaded, saved or reloaded),
+ * so the lines changed since then are one diff of two hash arrays away.
+ *
+ * The index is a child of its document and lives on the Qt thread.
+ */
+class LineHashes : public QObject {
+public:
+    explicit LineHashes(KTextEditor::Document* document);
+    
+    // Current hash of every line
+    const std::vector<uint64_t>& Hashes();
+    
+    // Recomputed from the text, ignoring spaces and tabs
+    std::vector<uint64_t> HashesIgnoringWhitespace() const;
+    
+    // Take the current lines as the saved ones
+    void MarkSaved();
+    
+    // The saved lines, e.g. to carry them over to another document
+    const std::vector<uint64_t>& SavedHashes() const { return m_saved; }
+    void SetSavedHashes(std::vector<uint64_t> hashes);
+    
+    /**
+     * Hunks from the saved lines to the current ones, in the LineDiff
+     * layout; cached until the next edit, and empty while unmodified
+     */
+    const std::vector<int32_t>& DirtyHunks();
+    
+    /**
+     * Hashes of a text split at '\n'; a '\r' before the break is dropped
+     * as KatePart does when it loads the text
+     */
+    static std::vector<uint64_t> HashText(const QString& text, bool ignoreWhitespace);
+
+private:
+    void OnTextInserted(const KTextEditor::Cursor& position, const QString& text);
+    void OnTextRemoved(const KTextEditor::Range& range);
+    
+    // Mark `count` lines from `line` for rehashing
+    void Touch(int line, int count);
+    
+    KTextEditor::Document* m_document;
+    std::vector<uint64_t> m_hashes;
+    std::vector<uint64_t> m_saved;
+    std::vector<int32_t> m_dirtyHunks;
+    
+    // Lines whose hash is out of date, all within [m_staleFirst, m_staleEnd)
+    std::vector<bool> m_stale;
+    int m_staleFirst = 0;
+    int m_staleEnd = 0;
+    
+    // Set when the whole content must be rehashed
+    bool m_reset = true;
+    bool m_dirtyHunksValid = false;
+};
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
+
+#endif // LINE_HASHES_H
@@ -0,0 +1,125 @@
+#include "line_index.h"
+
+#ifdef HAVE_KTEXTEDITOR
+#include <KTextEditor/Document>
+#include <KTextEditor/Cursor>
+#include <KTextEditor/Range>
+#include <algorithm>
+
+namespace KateNative {
+
+LineIndex::LineIndex(KTextEditor::Document* document)
+    : QObject(document)
+    , m_document(document)
+{
+    connect(document, &KTextEditor::Document::textInserted, this,
+        [this](KTextEditor::Document*, const KTextEditor::Cursor& position, const QString& text) {
+            OnTextInserted(position, text);
+        });
+    connect(document, &KTextEditor::Document::textRemoved, this,
+        [this](KTextEditor::Document*, const KTextEditor::Range& range, const QString&) {
+            OnTextRemoved(range);
+        });
+        
+    // Loading a file replaces the content without textInserted/textRemoved
+    connect(document, &KTextEditor::Document::aboutToInvalidateMovingInterfaceContent, this,
+        [this](KTextEditor::Document*) { m_stale = true; });
+    connect(document, &KTextEditor::Document::reloaded, this,
+        [this](KTextEditor::Document*) { m_stale = true; });
+}
+
+void LineIndex::Reset() {
+    int lineCount = qMax(m_document->lines(), 1);
+    m_lengths.resize(lineCount);
+    m_starts.resize(lineCount);
+    for (int line = 0; line < lineCount; line++) {
+        m_lengths[line] = m_document->lineLength(line);
+    }
+    m_validStarts = 0;
+    m_stale = false;
+}
+
+void LineIndex::RefreshLines(int line, int count) {
+    for (int i = line; i < line + count; i++) {
+        m_lengths[i] = m_document->lineLength(i);
+    }
+    m_validStarts = std::min(m_validStarts, static_cast<size_t>(line) + 1);
+}
+
+void LineIndex::OnTextInserted(const KTextEditor::Cursor& position, const QString& text) {
+    if (m_stale) {
+        return;
+    }
+    
+    int line = position.line();
+    int added = text.count(QLatin1Char('\n'));
+    if (line < 0 || line >= static_cast<int>(m_lengths.size())) {
+        m_stale = true;
+        return;
+    }
+    
+    m_lengths.insert(m_lengths.begin() + line + 1, added, 0);
+    m_starts.insert(m_starts.begin() + line + 1, added, 0);
+    RefreshLines(line, added + 1);
+}
+
+void LineIndex::OnTextRemoved(const KTextEditor::Range& range) {
+    if (m_stale) {
+        return;
+    }
+    
+    int line = range.start().line();
+    int removed = range.end().line() - line;
+    if (line < 0 || line + removed >= static_cast<int>(m_lengths.size())) {
+        m_stale = true;
+        return;
+    }
+    
+    m_lengths.erase(m_lengths.begin() + line + 1, m_lengths.begin() + line + 1 + removed);
+    m_starts.erase(m_starts.begin() + line + 1, m_starts.begin() + line + 1 + removed);
+    RefreshLines(line, 1);
+}
+
+void LineIndex::Prepare() {
+    // The signals should keep the lengths in step with the document, but
+    // never answer from an index that has a different number of lines
+    if (m_stale || static_cast<int>(m_lengths.size()) != qMax(m_document->lines(), 1)) {
+        Reset();
+    }
+    
+    if (m_validStarts == 0) {
+        m_starts[0] = 0;
+        m_validStarts = 1;
+    }
+    for (size_t line = m_validStarts; line < m_starts.size(); line++) {
+        m_starts[line] = m_starts[line - 1] + m_lengths[line - 1] + 1;
+    }
+    m_validStarts = m_starts.size();
+}
+
+int64_t LineIndex::Length() {
+    Prepare();
+    return m_starts.back() + m_lengths.back();
+}
+
+int64_t LineIndex::OffsetAt(int line, int column) {
+    Prepare();
+    line = std::clamp(line, 0, static_cast<int>(m_starts.size()) - 1);
+    column = std::clamp(column, 0, static_cast<int>(m_lengths[line]));
+    return m_starts[line] + column;
+}
+
+void LineIndex::PositionAt(int64_t offset, int& line, int& column) {
+    Prepare();
+    offset = std::clamp<int64_t>(offset, 0, m_starts.back() + m_lengths.back());
+    
+    // Last line starting at or before offset; an offset on a line break
+    // is the end of its line
+    auto it = std::upper_bound(m_starts.begin(), m_starts.end(), offset);
+    line = static_cast<int>(it - m_starts.begin()) - 1;
+    column = static_cast<int>(std::min<int64_t>(offset - m_starts[line], m_lengths[line]));
+}
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
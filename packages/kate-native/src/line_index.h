@@ -0,0 +1,68 @@
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+#ifdef HAVE_KTEXTEDITOR
+#include <QObject>
+#include <QString>
+#include <cstdint>
+#include <vector>
+
+namespace KTextEditor {
+    class Document;
+    class Cursor;
+    class Range;
+}
+
+namespace KateNative {
+
+/**
+ * Line Start Index
+ *
+ * Keeps the length of every line of one document and the offset at which
+ * each line starts, counted in UTF-16 code units with one unit for every
+ * line break, i.e. positions in the string getText() returns. Edits only
+ * re-read the lengths of the lines they touched; line starts after an
+ * edit are recomputed by the next query that needs them.
+ *
+ * Positions outside the document are clamped to it, matching how LSP
+ * clients treat out of range positions.
+ *
+ * The index is a child of its document and lives on the Qt thread.
+ */
+class LineIndex : public QObject {
+public:
+    explicit LineIndex(KTextEditor::Document* document);
+    
+    // Length of the whole text, line breaks included
+    int64_t Length();
+    
+    int64_t OffsetAt(int line, int column);
+    void PositionAt(int64_t offset, int& line, int& column);
+
+private:
+    void OnTextInserted(const KTextEditor::Cursor& position, const QString& text);
+    void OnTextRemoved(const KTextEditor::Range& range);
+    void Reset();
+    
+    // Re-read the lengths of `count` lines from `line` and drop the starts after it
+    void RefreshLines(int line, int count);
+    
+    // Bring the line starts up to date
+    void Prepare();
+    
+    KTextEditor::Document* m_document;
+    std::vector<int32_t> m_lengths;
+    std::vector<int64_t> m_starts;
+    
+    // m_starts is valid below this line
+    size_t m_validStarts = 0;
+    
+    // Set when the whole content is about to be replaced
+    bool m_stale = true;
+};
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
+
+#endif // LINE_INDEX_H
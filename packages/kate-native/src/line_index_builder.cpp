@@ -0,0 +1,196 @@
+#include "line_index_builder.h"
+#include "js_dispatcher.h"
+#include "mapped_file.h"
+#include "worker_pool.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace KateNative {
+
+namespace {
+
+const uint64_t WIDE_OFFSETS_FROM = uint64_t(1) << 32;
+
+/**
+ * JavaScript side of a build; deleted by the task that settles it
+ */
+struct BuildCallbacks {
+    explicit BuildCallbacks(Napi::Env env)
+        : deferred(Napi::Promise::Deferred::New(env)) {}
+        
+    Napi::Promise::Deferred deferred;
+    Napi::FunctionReference onProgress;
+    
+    // Keeps a buffer source alive while it is scanned
+    Napi::ObjectReference source;
+};
+
+/**
+ * Worker side of a build
+ */
+struct BuildJob {
+    std::shared_ptr<MappedFile> file;
+    const char* data = nullptr;
+    uint64_t size = 0;
+    bool wide = false;
+    
+    // Filled by the worker; only one of them is used
+    std::vector<uint32_t>* narrowOffsets = nullptr;
+    std::vector<uint64_t>* wideOffsets = nullptr;
+};
+
+// Line starts of every chunk, flattened into `offsets`
+template <typename Offset>
+std::vector<Offset>* Flatten(std::vector<LineBreakChunk>& chunks) {
+    size_t count = 1;
+    for (const LineBreakChunk& chunk : chunks) {
+        count += chunk.starts.size();
+    }
+    
+    auto* offsets = new std::vector<Offset>();
+    offsets->reserve(count);
+    offsets->push_back(0);
+    for (LineBreakChunk& chunk : chunks) {
+        for (uint32_t start : chunk.starts) {
+            offsets->push_back(static_cast<Offset>(chunk.base + start));
+        }
+        std::vector<uint32_t>().swap(chunk.starts);
+    }
+    return offsets;
+}
+
+// Hands the offsets to JavaScript without copying them where the runtime allows
+template <typename Offset>
+Napi::TypedArray OffsetsToJs(Napi::Env env, std::vector<Offset>* offsets, napi_typedarray_type type) {
+    size_t count = offsets->size();
+    Napi::Buffer<uint8_t> bytes = Napi::Buffer<uint8_t>::NewOrCopy(env,
+        reinterpret_cast<uint8_t*>(offsets->data()), count * sizeof(Offset),
+        [](Napi::Env, uint8_t*, std::vector<Offset>* offsets) { delete offsets; }, offsets);
+    return Napi::TypedArrayOf<Offset>::New(env, count, bytes.ArrayBuffer(), bytes.ByteOffset(), type);
+}
+
+void Finish(Napi::Env env, BuildCallbacks* callbacks, const std::shared_ptr<BuildJob>& job) {
+    Napi::Object result = Napi::Object::New(env);
+    size_t lineCount = 0;
+    if (job->wide) {
+        lineCount = job->wideOffsets->size();
+        result.Set("offsets", OffsetsToJs(env, job->wideOffsets, napi_biguint64_array));
+    } else {
+        lineCount = job->narrowOffsets->size();
+        result.Set("offsets", OffsetsToJs(env, job->narrowOffsets, napi_uint32_array));
+    }
+    result.Set("lineCount", Napi::Number::New(env, static_cast<double>(lineCount)));
+    result.Set("byteLength", Napi::Number::New(env, static_cast<double>(job->size)));
+    result.Set("kernel", Napi::String::New(env, LineScanner::Kernel()));
+    
+    callbacks->deferred.Resolve(result);
+    delete callbacks;
+}
+
+void Reject(BuildCallbacks* callbacks, Napi::Error error) {
+    callbacks->deferred.Reject(error.Value());
+    delete callbacks;
+}
+
+} // namespace
+
+LineScanner::Progress LineIndexBuilder::ProgressTo(std::shared_ptr<JsDispatcher> dispatcher,
+                                                   Napi::FunctionReference* callback, uint64_t total) {
+    if (!callback || callback->IsEmpty() || total == 0) {
+        return nullptr;
+    }
+    
+    auto lastPercent = std::make_shared<std::atomic<int>>(-1);
+    return [dispatcher, callback, total, lastPercent](uint64_t scanned) {
+        int percent = static_cast<int>(scanned * 100 / total);
+        int last = lastPercent->load();
+        while (percent > last) {
+            if (lastPercent->compare_exchange_weak(last, percent)) {
+                dispatcher->Post([callback, scanned, total](Napi::Env env) {
+                    callback->Call({Napi::Number::New(env, static_cast<double>(scanned)),
+                                    Napi::Number::New(env, static_cast<double>(total))});
+                });
+                return;
+            }
+        }
+    };
+}
+
+Napi::Promise LineIndexBuilder::Start(Napi::Env env, Napi::Value source, Napi::Value options) {
+    auto* callbacks = new BuildCallbacks(env);
+    Napi::Promise promise = callbacks->deferred.Promise();
+    auto job = std::make_shared<BuildJob>();
+    
+    if (source.IsString()) {
+        std::string error;
+        job->file = MappedFile::Open(source.As<Napi::String>().Utf8Value(), error);
+        if (!job->file) {
+            Reject(callbacks, Napi::Error::New(env, error));
+            return promise;
+        }
+        job->data = job->file->Data();
+        job->size = job->file->Size();
+    } else if (source.IsArrayBuffer()) {
+        Napi::ArrayBuffer buffer = source.As<Napi::ArrayBuffer>();
+        job->data = static_cast<const char*>(buffer.Data());
+        job->size = buffer.ByteLength();
+        callbacks->source = Napi::Persistent(source.As<Napi::Object>());
+    } else if (source.IsTypedArray()) {
+        Napi::TypedArray array = source.As<Napi::TypedArray>();
+        job->data = static_cast<const char*>(array.ArrayBuffer().Data()) + array.ByteOffset();
+        job->size = array.ByteLength();
+        callbacks->source = Napi::Persistent(source.As<Napi::Object>());
+    } else {
+        Reject(callbacks, Napi::TypeError::New(env, "Expected a file path, an ArrayBuffer or a typed array"));
+        return promise;
+    }
+    
+    job->wide = job->size >= WIDE_OFFSETS_FROM;
+    if (options.IsObject()) {
+        Napi::Object optionsObject = options.As<Napi::Object>();
+        Napi::Value format = optionsObject.Get("format");
+        if (format.IsString()) {
+            std::string name = format.As<Napi::String>().Utf8Value();
+            if (name == "uint64") {
+                job->wide = true;
+            } else if (name == "uint32" && job->wide) {
+                Reject(callbacks, Napi::RangeError::New(env, "Offsets past 4 GiB don't fit the uint32 format"));
+                return promise;
+            } else if (name != "uint32") {
+                Reject(callbacks, Napi::TypeError::New(env, "format must be 'uint32' or 'uint64'"));
+                return promise;
+            }
+        }
+        
+        Napi::Value onProgress = optionsObject.Get("onProgress");
+        if (onProgress.IsFunction()) {
+            callbacks->onProgress = Napi::Persistent(onProgress.As<Napi::Function>());
+        }
+    }
+    
+    std::shared_ptr<JsDispatcher> dispatcher = JsDispatcher::ForEnv(env);
+    dispatcher->Ref();
+    LineScanner::Progress progress = ProgressTo(dispatcher, &callbacks->onProgress, job->size);
+    WorkerPool::Post([job, dispatcher, callbacks, progress]() {
+        if (job->file) {
+            job->file->AdviseSequential(0, job->size);
+        }
+        std::vector<LineBreakChunk> chunks = LineScanner::Scan(job->data, job->size, progress);
+        if (job->wide) {
+            job->wideOffsets = Flatten<uint64_t>(chunks);
+        } else {
+            job->narrowOffsets = Flatten<uint32_t>(chunks);
+        }
+        
+        // Every progress task is queued ahead of this one
+        dispatcher->Post([job, dispatcher, callbacks](Napi::Env env) {
+            Finish(env, callbacks, job);
+            dispatcher->Unref();
+        });
+    });
+    
+    return promise;
+}
+
+} // namespace KateNative
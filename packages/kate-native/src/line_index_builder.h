@@ -0,0 +1,49 @@
+#ifndef LINE_INDEX_BUILDER_H
+#define LINE_INDEX_BUILDER_H
+
+#include <napi.h>
+#include <memory>
+#include "line_scanner.h"
+
+namespace KateNative {
+
+class JsDispatcher;
+
+/**
+ * Standalone Line Index Builder
+ *
+ * Backs buildLineIndex(): scans a file (mapped, not read) or a buffer
+ * with LineScanner on the worker pool and resolves with the byte offset
+ * of every line start as one typed array, for callers that keep their
+ * own index instead of opening a KateLargeDocument.
+ */
+class LineIndexBuilder {
+public:
+    /**
+     * Start indexing `source`, a path or an ArrayBuffer/ArrayBufferView
+     *
+     * Options: { format?: 'uint32' | 'uint64', onProgress?(scanned, total) }.
+     * The promise resolves with { offsets, lineCount, byteLength, kernel };
+     * offsets is a Uint32Array when the text is under 4 GiB and a
+     * BigUint64Array otherwise, unless the format says which.
+     */
+    static Napi::Promise Start(Napi::Env env, Napi::Value source, Napi::Value options);
+    
+    /**
+     * A LineScanner progress callback that calls `callback` on the
+     * JavaScript thread, at most once per percent
+     *
+     * `callback` is only used by tasks posted while the scan runs, so it
+     * must outlive tasks posted to `dispatcher` before Scan() returns.
+     */
+    static LineScanner::Progress ProgressTo(std::shared_ptr<JsDispatcher> dispatcher,
+                                            Napi::FunctionReference* callback, uint64_t total);
+
+private:
+    LineIndexBuilder() = delete;
+    ~LineIndexBuilder() = delete;
+};
+
+} // namespace KateNative
+
+#endif // LINE_INDEX_BUILDER_H
@@ -0,0 +1,144 @@
+#include "line_metadata.h"
+#include <algorithm>
+#include <cstring>
+
+namespace KateNative {
+
+namespace {
+
+constexpr uint64_t HASH_MULTIPLIER = 0x9E3779B97F4A7C15ULL;
+
+// Final mix of MurmurHash3, so every input bit affects every output bit
+uint64_t Mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDULL;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+uint64_t RotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+} // namespace
+
+LineMetadata::LineMetadata(int fields, int tabWidth)
+    : m_fields(fields & AllFields)
+    , m_tabWidth(std::max(tabWidth, 1))
+{
+}
+
+void LineMetadata::Reserve(size_t lines) {
+    if (m_fields & Indent) {
+        m_indent.reserve(lines);
+    }
+    if (m_fields & Length) {
+        m_length.reserve(lines);
+    }
+    if (m_fields & FirstNonWhitespace) {
+        m_firstNonWhitespace.reserve(lines);
+    }
+    if (m_fields & Hash) {
+        m_hash.reserve(lines * 2);
+    }
+}
+
+void LineMetadata::Append(const char16_t* text, size_t length) {
+    if (m_fields & (Indent | FirstNonWhitespace)) {
+        int32_t indent = 0;
+        size_t column = 0;
+        for (; column < length; column++) {
+            if (text[column] == u' ') {
+                indent++;
+            } else if (text[column] == u'\t') {
+                indent += m_tabWidth - indent % m_tabWidth;
+            } else {
+                break;
+            }
+        }
+        
+        if (m_fields & Indent) {
+            m_indent.push_back(indent);
+        }
+        if (m_fields & FirstNonWhitespace) {
+            m_firstNonWhitespace.push_back(column < length ? static_cast<int32_t>(column) : -1);
+        }
+    }
+    
+    if (m_fields & Length) {
+        m_length.push_back(static_cast<int32_t>(length));
+    }
+    
+    if (m_fields & Hash) {
+        uint64_t hash = HashLine(text, length);
+        m_hash.push_back(static_cast<int32_t>(static_cast<uint32_t>(hash)));
+        m_hash.push_back(static_cast<int32_t>(static_cast<uint32_t>(hash >> 32)));
+    }
+}
+
+uint64_t LineMetadata::HashLine(const char16_t* text, size_t length) {
+    uint64_t hash = HASH_MULTIPLIER ^ (length * 0xC2B2AE3D27D4EB4FULL);
+    
+    // Four code units per step; the tail is zero padded
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        uint64_t word;
+        std::memcpy(&word, text + i, sizeof(word));
+        hash = RotateLeft(hash ^ Mix(word), 27) * HASH_MULTIPLIER;
+    }
+    if (i < length) {
+        uint64_t word = 0;
+        std::memcpy(&word, text + i, (length - i) * sizeof(char16_t));
+        hash = RotateLeft(hash ^ Mix(word), 27) * HASH_MULTIPLIER;
+    }
+    
+    return Mix(hash);
+}
+
+void IndentDetector::Add(const char16_t* text, size_t length) {
+    m_sampledLines++;
+    
+    size_t column = 0;
+    while (column < length && (text[column] == u' ' || text[column] == u'\t')) {
+        column++;
+    }
+    
+    // Blank lines neither vote nor break the step across them
+    if (column == length) {
+        return;
+    }
+    
+    if (column > 0 && text[0] == u'\t') {
+        m_tabLines++;
+        m_previousIndent = -1;
+        return;
+    }
+    
+    int indent = static_cast<int>(column);
+    if (indent > 0) {
+        m_spaceLines++;
+    }
+    
+    if (m_previousIndent >= 0) {
+        int step = indent - m_previousIndent;
+        if (step > 0 && step <= MaxIndentWidth) {
+            m_steps[step]++;
+        }
+    }
+    m_previousIndent = indent;
+}
+
+int IndentDetector::IndentWidth() const {
+    // Ties go to the wider step
+    int width = 0;
+    for (int step = 1; step <= MaxIndentWidth; step++) {
+        if (m_steps[step] > 0 && m_steps[step] >= m_steps[width]) {
+            width = step;
+        }
+    }
+    return width;
+}
+
+} // namespace KateNative
@@ -0,0 +1,105 @@
+#ifndef LINE_METADATA_H
+#define LINE_METADATA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace KateNative {
+
+/**
+ * Bulk Line Metadata
+ *
+ * Struct-of-arrays layout facts for a run of lines, as needed by indent
+ * guides, minimaps and sticky scroll: the indent width in columns, the
+ * length and the first non-whitespace column in UTF-16 code units, and a
+ * 64-bit content hash. Only the requested fields are filled in.
+ *
+ * Only spaces and tabs count as indentation; a tab advances to the next
+ * multiple of the tab width. Blank lines have a first non-whitespace
+ * column of -1 and the width of their whitespace as indent.
+ */
+class LineMetadata {
+public:
+    enum Field {
+        Indent = 1 << 0,
+        Length = 1 << 1,
+        FirstNonWhitespace = 1 << 2,
+        Hash = 1 << 3,
+        AllFields = Indent | Length | FirstNonWhitespace | Hash
+    };
+    
+    LineMetadata(int fields, int tabWidth);
+    
+    void Reserve(size_t lines);
+    void Append(const char16_t* text, size_t length);
+    
+    int Fields() const { return m_fields; }
+    int TabWidth() const { return m_tabWidth; }
+    
+    const std::vector<int32_t>& Indents() const { return m_indent; }
+    const std::vector<int32_t>& Lengths() const { return m_length; }
+    const std::vector<int32_t>& FirstNonWhitespaces() const { return m_firstNonWhitespace; }
+    
+    // Two values per line, the low then the high 32 bits of the hash
+    const std::vector<int32_t>& Hashes() const { return m_hash; }
+    
+    /**
+     * Hash of a line's code units
+     * Equal lines hash equal within and across documents for the life of
+     * the process; the value isn't meant to be persisted.
+     */
+    static uint64_t HashLine(const char16_t* text, size_t length);
+
+private:
+    int m_fields;
+    int m_tabWidth;
+    std::vector<int32_t> m_indent;
+    std::vector<int32_t> m_length;
+    std::vector<int32_t> m_firstNonWhitespace;
+    std::vector<int32_t> m_hash;
+};
+
+/**
+ * Indent Style Detection
+ *
+ * Guesses whether a text indents with tabs or spaces, and by how many
+ * columns, from the lines fed to it. Each indented line votes for tabs
+ * or spaces by its leading character; for space indentation, the step
+ * from the previous non-blank line's indent votes for the width.
+ * Lines must be added in document order for the steps to mean anything.
+ */
+class IndentDetector {
+public:
+    // Lines sampled per document, taken in runs of SampleRunLines consecutive lines
+    static constexpr int SampleLines = 4096;
+    static constexpr int SampleRunLines = 128;
+    
+    void Add(const char16_t* text, size_t length);
+    
+    // Breaks the step between the previous line and the next one, e.g. between sample runs
+    void Skip() { m_previousIndent = -1; }
+    
+    int SampledLines() const { return m_sampledLines; }
+    
+    // False when no line was indented; the results are then meaningless
+    bool HasEvidence() const { return m_tabLines + m_spaceLines > 0; }
+    
+    bool UsesTabs() const { return m_tabLines > m_spaceLines; }
+    
+    // Most common indent step of space-indented lines, 0 without any
+    int IndentWidth() const;
+
+private:
+    static constexpr int MaxIndentWidth = 8;
+    
+    int m_sampledLines = 0;
+    int m_tabLines = 0;
+    int m_spaceLines = 0;
+    int m_previousIndent = -1;
+    int m_steps[MaxIndentWidth + 1] = {};
+};
+
+} // namespace KateNative
+
+#endif // LINE_METADATA_H
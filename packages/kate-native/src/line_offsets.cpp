@@ -0,0 +1,82 @@
+#include "line_offsets.h"
+#include <algorithm>
+
+namespace KateNative {
+
+void LineOffsets::Append(uint64_t lineStart) {
+    int64_t line = LineCount();
+    if (line % BlockLines == 0) {
+        m_blockStarts.push_back(lineStart);
+        m_deltas.push_back(0);
+        return;
+    }
+    
+    uint64_t delta = lineStart - m_blockStarts.back();
+    if (delta >= FarDelta) {
+        m_farStarts[line] = lineStart;
+        m_deltas.push_back(FarDelta);
+    } else {
+        m_deltas.push_back(static_cast<uint32_t>(delta));
+    }
+}
+
+void LineOffsets::Build(const char* data, uint64_t size, const LineScanner::Progress& progress) {
+    m_blockStarts.clear();
+    m_deltas.clear();
+    m_farStarts.clear();
+    m_size = size;
+    
+    std::vector<LineBreakChunk> chunks = LineScanner::Scan(data, size, progress);
+    size_t lineCount = 1;
+    for (const LineBreakChunk& chunk : chunks) {
+        lineCount += chunk.starts.size();
+    }
+    m_deltas.reserve(lineCount);
+    m_blockStarts.reserve((lineCount + BlockLines - 1) / BlockLines);
+    
+    // Chunks are dropped as they are merged, to keep the peak down
+    Append(0);
+    for (LineBreakChunk& chunk : chunks) {
+        for (uint32_t start : chunk.starts) {
+            Append(chunk.base + start);
+        }
+        std::vector<uint32_t>().swap(chunk.starts);
+    }
+}
+
+uint64_t LineOffsets::LineStart(int64_t line) const {
+    uint32_t delta = m_deltas[line];
+    if (delta == FarDelta) {
+        return m_farStarts.at(line);
+    }
+    return m_blockStarts[line / BlockLines] + delta;
+}
+
+uint64_t LineOffsets::LineEnd(int64_t line) const {
+    return line + 1 < LineCount() ? LineStart(line + 1) - 1 : m_size;
+}
+
+int64_t LineOffsets::LineAt(uint64_t offset) const {
+    // The last block starting at or before the offset, then the last line in it
+    auto block = std::upper_bound(m_blockStarts.begin(), m_blockStarts.end(), offset);
+    int64_t first = (block - m_blockStarts.begin() - 1) * BlockLines;
+    int64_t last = std::min(first + BlockLines, LineCount()) - 1;
+    
+    while (first < last) {
+        int64_t middle = first + (last - first + 1) / 2;
+        if (LineStart(middle) <= offset) {
+            first = middle;
+        } else {
+            last = middle - 1;
+        }
+    }
+    return first;
+}
+
+size_t LineOffsets::MemoryBytes() const {
+    return m_blockStarts.capacity() * sizeof(uint64_t)
+        + m_deltas.capacity() * sizeof(uint32_t)
+        + m_farStarts.size() * (sizeof(int64_t) + sizeof(uint64_t));
+}
+
+} // namespace KateNative
@@ -0,0 +1,62 @@
+#ifndef LINE_OFFSETS_H
+#define LINE_OFFSETS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "line_scanner.h"
+
+namespace KateNative {
+
+/**
+ * Compact Line Offset Index
+ *
+ * Byte offsets of the line starts of a read-only text, for files too
+ * large to keep one 64-bit offset (or a JavaScript object) per line.
+ * Every BlockLines-th line start is stored as a uint64 and the others
+ * as uint32 deltas from the start of their block, so the index costs a
+ * little over four bytes per line. The rare delta that doesn't fit,
+ * after gigabytes of text in one block, is kept in a side table.
+ *
+ * Lines end at '\n'; a text ending with a line break has one more,
+ * empty, line, as in the editor. Immutable once built.
+ */
+class LineOffsets {
+public:
+    static constexpr int64_t BlockLines = 64;
+    
+    /**
+     * Index `size` bytes at `data` (may be null when size is 0)
+     * The text is scanned in parallel; see LineScanner.
+     */
+    void Build(const char* data, uint64_t size, const LineScanner::Progress& progress = nullptr);
+    
+    int64_t LineCount() const { return static_cast<int64_t>(m_deltas.size()); }
+    
+    // Offset of the first byte of `line`
+    uint64_t LineStart(int64_t line) const;
+    
+    // Offset of the line break ending `line`, or the text size for the last line
+    uint64_t LineEnd(int64_t line) const;
+    
+    // Line containing `offset`
+    int64_t LineAt(uint64_t offset) const;
+    
+    // Bytes used by the index
+    size_t MemoryBytes() const;
+
+private:
+    static constexpr uint32_t FarDelta = UINT32_MAX;
+    
+    void Append(uint64_t lineStart);
+    
+    std::vector<uint64_t> m_blockStarts;
+    std::vector<uint32_t> m_deltas;
+    std::unordered_map<int64_t, uint64_t> m_farStarts;
+    uint64_t m_size = 0;
+};
+
+} // namespace KateNative
+
+#endif // LINE_OFFSETS_H
@@ -0,0 +1,205 @@
+#include "line_scanner.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define KATE_SCAN_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define KATE_SCAN_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace KateNative {
+
+namespace {
+
+using ScanKernel = void (*)(const char* begin, const char* end, const char* base, std::vector<uint32_t>& starts);
+
+inline int TrailingZeros(uint64_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+// Appends the line start after each bit set in `mask`, for bytes at `block`
+inline void AppendMask(uint64_t mask, const char* block, const char* base, std::vector<uint32_t>& starts) {
+    uint32_t offset = static_cast<uint32_t>(block - base) + 1;
+    while (mask) {
+        starts.push_back(offset + TrailingZeros(mask));
+        mask &= mask - 1;
+    }
+}
+
+void ScanScalar(const char* begin, const char* end, const char* base, std::vector<uint32_t>& starts) {
+    for (const char* p = begin; p < end; ) {
+        const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!newline) {
+            return;
+        }
+        p = newline + 1;
+        starts.push_back(static_cast<uint32_t>(p - base));
+    }
+}
+
+#if KATE_SCAN_X86
+void ScanSse2(const char* begin, const char* end, const char* base, std::vector<uint32_t>& starts) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    const char* p = begin;
+    for (; p + 16 <= end; p += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)));
+        AppendMask(mask, p, base, starts);
+    }
+    ScanScalar(p, end, base, starts);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx2")))
+void ScanAvx2(const char* begin, const char* end, const char* base, std::vector<uint32_t>& starts) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const char* p = begin;
+    for (; p + 64 <= end; p += 64) {
+        __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+        uint64_t lowMask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, newline)));
+        uint64_t highMask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, newline)));
+        AppendMask(lowMask | (highMask << 32), p, base, starts);
+    }
+    ScanSse2(p, end, base, starts);
+}
+#endif
+#endif
+
+#if KATE_SCAN_NEON
+void ScanNeon(const char* begin, const char* end, const char* base, std::vector<uint32_t>& starts) {
+    const uint8x16_t newline = vdupq_n_u8('\n');
+    const char* p = begin;
+    for (; p + 16 <= end; p += 16) {
+        uint8x16_t matches = vceqq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(p)), newline);
+        // Four bits per byte, as NEON has no movemask
+        uint64_t nibbles = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+        while (nibbles) {
+            int index = TrailingZeros(nibbles) / 4;
+            starts.push_back(static_cast<uint32_t>(p - base) + index + 1);
+            nibbles &= ~(uint64_t(0xF) << (index * 4));
+        }
+    }
+    ScanScalar(p, end, base, starts);
+}
+#endif
+
+struct SelectedKernel {
+    ScanKernel scan;
+    const char* name;
+};
+
+SelectedKernel SelectKernel() {
+#if KATE_SCAN_X86
+#if defined(__GNUC__) || defined(__clang__)
+    if (__builtin_cpu_supports("avx2")) {
+        return {ScanAvx2, "avx2"};
+    }
+#endif
+    return {ScanSse2, "sse2"};
+#elif KATE_SCAN_NEON
+    return {ScanNeon, "neon"};
+#else
+    return {ScanScalar, "scalar"};
+#endif
+}
+
+const SelectedKernel& CurrentKernel() {
+    static const SelectedKernel kernel = SelectKernel();
+    return kernel;
+}
+
+/**
+ * Scan state shared by the caller and the helpers it posts
+ * Helpers that start after every chunk is taken leave right away.
+ */
+struct ScanState {
+    const char* data = nullptr;
+    uint64_t size = 0;
+    LineScanner::Progress progress;
+    std::vector<LineBreakChunk> chunks;
+    size_t chunkCount = 0;
+    std::atomic<size_t> nextChunk{0};
+    std::atomic<uint64_t> scanned{0};
+    
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t remaining = 0;
+};
+
+void RunChunks(ScanState& state) {
+    const ScanKernel scan = CurrentKernel().scan;
+    for (size_t chunk = state.nextChunk++; chunk < state.chunkCount; chunk = state.nextChunk++) {
+        LineBreakChunk& result = state.chunks[chunk];
+        const char* begin = state.data + result.base;
+        const char* end = state.data + std::min(result.base + LineScanner::ChunkBytes, state.size);
+        
+        // About one line per 64 bytes is typical for source and logs
+        result.starts.reserve(static_cast<size_t>(end - begin) / 64);
+        scan(begin, end, begin, result.starts);
+        result.starts.shrink_to_fit();
+        
+        uint64_t scanned = state.scanned += static_cast<uint64_t>(end - begin);
+        if (state.progress) {
+            state.progress(scanned);
+        }
+        
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (--state.remaining == 0) {
+            state.done.notify_all();
+        }
+    }
+}
+
+} // namespace
+
+std::vector<LineBreakChunk> LineScanner::Scan(const char* data, uint64_t size, const Progress& progress) {
+    auto state = std::make_shared<ScanState>();
+    state->data = data;
+    state->size = size;
+    state->progress = progress;
+    
+    size_t chunkCount = static_cast<size_t>((size + ChunkBytes - 1) / ChunkBytes);
+    state->chunkCount = chunkCount;
+    state->chunks.resize(chunkCount);
+    for (size_t i = 0; i < chunkCount; i++) {
+        state->chunks[i].base = i * ChunkBytes;
+    }
+    state->remaining = chunkCount;
+    
+    int helpers = std::min(WorkerPool::ThreadCount(), static_cast<int>(chunkCount)) - 1;
+    for (int i = 0; i < helpers; i++) {
+        WorkerPool::Post([state]() { RunChunks(*state); });
+    }
+    RunChunks(*state);
+    
+    // Chunks still running on helpers have been taken already, so this
+    // never waits on work that hasn't started
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&state]() { return state->remaining == 0; });
+    return std::move(state->chunks);
+}
+
+const char* LineScanner::Kernel() {
+    return CurrentKernel().name;
+}
+
+} // namespace KateNative
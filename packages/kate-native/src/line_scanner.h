@@ -0,0 +1,53 @@
+#ifndef LINE_SCANNER_H
+#define LINE_SCANNER_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace KateNative {
+
+/**
+ * Line starts found in one chunk of a text, relative to the chunk's base
+ */
+struct LineBreakChunk {
+    uint64_t base = 0;
+    std::vector<uint32_t> starts;
+};
+
+/**
+ * Parallel Newline Scanner
+ *
+ * Finds every '\n' in a block of memory at close to memory bandwidth.
+ * The text is cut into ChunkBytes pieces that the calling thread and the
+ * worker pool take in turn; each piece is scanned 16, 32 or 64 bytes at
+ * a time with SSE2, AVX2 (picked at runtime) or NEON comparisons, and a
+ * plain loop elsewhere.
+ *
+ * The caller takes part in the scan, so Scan() may be called from a
+ * worker thread without waiting on queued work.
+ */
+class LineScanner {
+public:
+    static constexpr uint64_t ChunkBytes = 16 << 20;
+    
+    // Called from any thread with the number of bytes scanned so far
+    using Progress = std::function<void(uint64_t scanned)>;
+    
+    /**
+     * Offsets just after every '\n' in `size` bytes at `data`, in order,
+     * as one entry per chunk
+     */
+    static std::vector<LineBreakChunk> Scan(const char* data, uint64_t size, const Progress& progress = nullptr);
+    
+    // Name of the kernel in use: "avx2", "sse2", "neon" or "scalar"
+    static const char* Kernel();
+
+private:
+    LineScanner() = delete;
+    ~LineScanner() = delete;
+};
+
+} // namespace KateNative
+
+#endif // LINE_SCANNER_H
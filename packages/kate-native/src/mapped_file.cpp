@@ -0,0 +1,137 @@
+#include "mapped_file.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace KateNative {
+
+#ifdef _WIN32
+namespace {
+
+std::string LastErrorString() {
+    char buffer[256] = {};
+    FormatMessageA(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS, nullptr, GetLastError(),
+                   0, buffer, sizeof(buffer), nullptr);
+    return buffer;
+}
+
+} // namespace
+
+std::shared_ptr<MappedFile> MappedFile::Open(const std::string& path, std::string& error) {
+    int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+    std::wstring widePath(length > 0 ? length - 1 : 0, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &widePath[0], length);
+    
+    HANDLE file = CreateFileW(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        error = "Cannot open " + path + ": " + LastErrorString();
+        return nullptr;
+    }
+    
+    std::shared_ptr<MappedFile> mapped(new MappedFile());
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        error = "Cannot read the size of " + path + ": " + LastErrorString();
+        CloseHandle(file);
+        return nullptr;
+    }
+    mapped->m_size = static_cast<uint64_t>(size.QuadPart);
+    
+    // Empty files can't be mapped
+    if (mapped->m_size > 0) {
+        mapped->m_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapped->m_mapping) {
+            mapped->m_data = static_cast<const char*>(MapViewOfFile(mapped->m_mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+        if (!mapped->m_data) {
+            error = "Cannot map " + path + ": " + LastErrorString();
+            CloseHandle(file);
+            return nullptr;
+        }
+    }
+    
+    // The mapping keeps the file open
+    CloseHandle(file);
+    return mapped;
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+    }
+}
+
+void MappedFile::AdviseSequential(uint64_t, uint64_t) const {
+}
+#else
+std::shared_ptr<MappedFile> MappedFile::Open(const std::string& path, std::string& error) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = "Cannot open " + path + ": " + std::strerror(errno);
+        return nullptr;
+    }
+    
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        error = "Cannot read the size of " + path + ": " + std::strerror(errno);
+        close(fd);
+        return nullptr;
+    }
+    if (!S_ISREG(status.st_mode)) {
+        error = path + " is not a regular file";
+        close(fd);
+        return nullptr;
+    }
+    
+    std::shared_ptr<MappedFile> mapped(new MappedFile());
+    mapped->m_size = static_cast<uint64_t>(status.st_size);
+    
+    // Empty files can't be mapped
+    if (mapped->m_size > 0) {
+        void* data = mmap(nullptr, mapped->m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            error = "Cannot map " + path + ": " + std::strerror(errno);
+            close(fd);
+            return nullptr;
+        }
+        mapped->m_data = static_cast<const char*>(data);
+    }
+    
+    // The mapping keeps the file open
+    close(fd);
+    return mapped;
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+}
+
+void MappedFile::AdviseSequential(uint64_t offset, uint64_t length) const {
+    if (!m_data || offset >= m_size) {
+        return;
+    }
+    
+    // madvise wants a page aligned start
+    uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t start = offset - offset % pageSize;
+    uint64_t end = std::min(offset + length, m_size);
+    madvise(const_cast<char*>(m_data + start), end - start, MADV_SEQUENTIAL);
+}
+#endif
+
+} // namespace KateNative
@@ -0,0 +1,52 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace KateNative {
+
+/**
+ * Read-Only File Mapping
+ *
+ * Maps a whole file into memory without reading it. Pages are loaded by
+ * the kernel as they are touched and can be dropped again under memory
+ * pressure, so a mapping of a file larger than the available memory is
+ * fine as long as only part of it is in use at a time.
+ *
+ * The mapping is immutable and may be read from any thread.
+ */
+class MappedFile {
+public:
+    /**
+     * Map the file at `path` (UTF-8)
+     * Returns null and sets `error` when the file can't be opened or mapped.
+     */
+    static std::shared_ptr<MappedFile> Open(const std::string& path, std::string& error);
+    
+    ~MappedFile();
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    // Null for an empty file
+    const char* Data() const { return m_data; }
+    uint64_t Size() const { return m_size; }
+    
+    // Hint that the range is about to be read front to back
+    void AdviseSequential(uint64_t offset, uint64_t length) const;
+
+private:
+    MappedFile() = default;
+    
+    const char* m_data = nullptr;
+    uint64_t m_size = 0;
+#ifdef _WIN32
+    void* m_mapping = nullptr;
+#endif
+};
+
+} // namespace KateNative
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,455 @@
+#include "mode_catalog.h"
+#include "file_writer.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+#ifdef HAVE_KTEXTEDITOR
+#include <KTextEditor/Editor>
+#include <KSyntaxHighlighting/Definition>
+#include <KSyntaxHighlighting/Repository>
+#include <QString>
+#include <QStringList>
+#include <atomic>
+#include "qt_runner.h"
+#endif
+
+namespace KateNative {
+
+namespace {
+
+constexpr char MAGIC[8] = {'K', 'A', 'T', 'E', 'M', 'O', 'D', '1'};
+
+// Interpreters named on "#!" lines, by the Kate mode of their scripts; modes the catalog lacks are left out
+const std::pair<const char*, const char*> INTERPRETERS[] = {
+    {"sh", "Bash"}, {"bash", "Bash"}, {"dash", "Bash"}, {"ksh", "Bash"}, {"zsh", "Zsh"}, {"fish", "Fish"},
+    {"python", "Python"}, {"pypy", "Python"}, {"perl", "Perl"}, {"ruby", "Ruby"}, {"php", "PHP/PHP"},
+    {"node", "JavaScript"}, {"nodejs", "JavaScript"}, {"bun", "JavaScript"}, {"deno", "TypeScript"},
+    {"lua", "Lua"}, {"tclsh", "Tcl/Tk"}, {"wish", "Tcl/Tk"}, {"awk", "AWK"}, {"gawk", "AWK"},
+    {"Rscript", "R Script"}, {"julia", "Julia"}, {"pwsh", "PowerShell"}, {"make", "Makefile"},
+};
+
+// Process-wide, never destroyed, so ids outlive every catalog and environment
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::string> names;
+    std::unordered_map<std::string, int> ids;
+    std::shared_ptr<const ModeCatalog> current;
+    std::string cachePath;
+};
+
+Registry& TheRegistry() {
+    static Registry* registry = new Registry();
+    return *registry;
+}
+
+bool HasWildcard(const std::string& pattern) {
+    return pattern.find_first_of("*?[") != std::string::npos;
+}
+
+// '*', '?' and "[...]" sets (with ranges and '!' or '^' for negation), as syntax definitions use them
+bool GlobMatch(const char* pattern, const char* text) {
+    const char* starPattern = nullptr;
+    const char* starText = nullptr;
+    while (*text) {
+        bool matched = false;
+        const char* next = pattern + 1;
+        if (*pattern == '*') {
+            starPattern = pattern++;
+            starText = text;
+            continue;
+        }
+        if (*pattern == '?') {
+            matched = true;
+        } else if (*pattern == '[') {
+            const char* p = pattern + 1;
+            bool negate = *p == '!' || *p == '^';
+            p += negate;
+            bool inSet = false;
+            for (bool first = true; *p && (first || *p != ']'); first = false, p++) {
+                if (p[1] == '-' && p[2] && p[2] != ']') {
+                    inSet |= *text >= p[0] && *text <= p[2];
+                    p += 2;
+                } else {
+                    inSet |= *text == *p;
+                }
+            }
+            if (*p == ']') {
+                matched = inSet != negate;
+                next = p + 1;
+            } else {
+                matched = *text == '[';
+            }
+        } else {
+            matched = *pattern != '\0' && *pattern == *text;
+        }
+        
+        if (matched) {
+            pattern = next;
+            text++;
+        } else if (starPattern) {
+            pattern = starPattern + 1;
+            text = ++starText;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
+
+void AppendString(std::string& out, const std::string& value) {
+    uint32_t length = static_cast<uint32_t>(value.size());
+    out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    out.append(value);
+}
+
+void AppendStrings(std::string& out, const std::vector<std::string>& values) {
+    uint32_t count = static_cast<uint32_t>(values.size());
+    out.append(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const std::string& value : values) {
+        AppendString(out, value);
+    }
+}
+
+// Bounds-checked reads over a serialized catalog
+struct Reader {
+    const uint8_t* data;
+    size_t length;
+    size_t offset = 0;
+    
+    bool Read(void* value, size_t size) {
+        if (size > length - offset) {
+            return false;
+        }
+        std::memcpy(value, data + offset, size);
+        offset += size;
+        return true;
+    }
+    
+    bool ReadString(std::string& value) {
+        uint32_t size = 0;
+        if (!Read(&size, sizeof(size)) || size > length - offset) {
+            return false;
+        }
+        value.assign(reinterpret_cast<const char*>(data + offset), size);
+        offset += size;
+        return true;
+    }
+    
+    bool ReadStrings(std::vector<std::string>& values) {
+        uint32_t count = 0;
+        if (!Read(&count, sizeof(count)) || count > length - offset) {
+            return false;
+        }
+        values.resize(count);
+        for (std::string& value : values) {
+            if (!ReadString(value)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace
+
+ModeCatalog::ModeCatalog(std::vector<ModeInfo> modes)
+    : m_modes(std::move(modes))
+{
+    for (int index = 0; index < static_cast<int>(m_modes.size()); index++) {
+        ModeInfo& mode = m_modes[index];
+        mode.id = Intern(mode.name);
+        m_byName.emplace(mode.name, index);
+        for (const std::string& mimeType : mode.mimeTypes) {
+            Index(m_byMimeType, mimeType, index);
+        }
+        for (const std::string& wildcard : mode.wildcards) {
+            if (!HasWildcard(wildcard)) {
+                Index(m_byFileName, wildcard, index);
+            } else if (wildcard.compare(0, 2, "*.") == 0 && !HasWildcard(wildcard.substr(2))) {
+                Index(m_byExtension, wildcard.substr(2), index);
+            } else {
+                m_globs.emplace_back(wildcard, index);
+                m_globPriority = std::max(m_globPriority, mode.priority);
+            }
+        }
+    }
+    
+    for (const auto& interpreter : INTERPRETERS) {
+        auto it = m_byName.find(interpreter.second);
+        if (it != m_byName.end()) {
+            m_byInterpreter.emplace(interpreter.first, it->second);
+        }
+    }
+}
+
+void ModeCatalog::Index(std::unordered_map<std::string, int>& map, const std::string& key, int index) {
+    auto inserted = map.emplace(key, index);
+    if (!inserted.second && m_modes[index].priority > m_modes[inserted.first->second].priority) {
+        inserted.first->second = index;
+    }
+}
+
+ModeCatalog::Candidate ModeCatalog::Lookup(const std::unordered_map<std::string, int>& map,
+                                           const std::string& key) const {
+    auto it = map.find(key);
+    if (it == map.end()) {
+        return Candidate();
+    }
+    return Candidate{it->second, m_modes[it->second].priority};
+}
+
+int ModeCatalog::ForName(const std::string& name) const {
+    Candidate found = Lookup(m_byName, name);
+    return found.index < 0 ? None : m_modes[found.index].id;
+}
+
+int ModeCatalog::ForFileName(const std::string& path) const {
+    size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    if (name.empty()) {
+        return None;
+    }
+    
+    // A plain name, then the longest extension ("tar.gz" before "gz"); the
+    // higher priority wins, and the earlier of these on a tie
+    Candidate best = Lookup(m_byFileName, name);
+    for (size_t dot = name.find('.'); dot != std::string::npos; dot = name.find('.', dot + 1)) {
+        Candidate found = Lookup(m_byExtension, name.substr(dot + 1));
+        if (found.index >= 0 && (best.index < 0 || found.priority > best.priority)) {
+            best = found;
+        }
+    }
+    
+    // Other wildcards only matter when one of them could beat what was found
+    if (best.index < 0 || m_globPriority > best.priority) {
+        for (const auto& glob : m_globs) {
+            int priority = m_modes[glob.second].priority;
+            if ((best.index < 0 || priority > best.priority) && GlobMatch(glob.first.c_str(), name.c_str())) {
+                best = Candidate{glob.second, priority};
+            }
+        }
+    }
+    return best.index < 0 ? None : m_modes[best.index].id;
+}
+
+int ModeCatalog::ForMimeType(const std::string& mimeType) const {
+    Candidate found = Lookup(m_byMimeType, mimeType);
+    return found.index < 0 ? None : m_modes[found.index].id;
+}
+
+int ModeCatalog::ForFirstLine(const std::string& line) const {
+    if (line.compare(0, 2, "#!") != 0) {
+        return None;
+    }
+    
+    // Words of the line after "#!"; "env" runs the first word that isn't an option or assignment
+    size_t end = line.find_first_of("\r\n");
+    std::string command = line.substr(2, end == std::string::npos ? std::string::npos : end - 2);
+    std::string interpreter;
+    bool viaEnv = false;
+    for (size_t start = command.find_first_not_of(" \t"); start != std::string::npos;
+         start = command.find_first_not_of(" \t", start)) {
+        size_t stop = command.find_first_of(" \t", start);
+        std::string word = command.substr(start, stop == std::string::npos ? std::string::npos : stop - start);
+        start = stop;
+        
+        size_t slash = word.find_last_of('/');
+        std::string base = slash == std::string::npos ? word : word.substr(slash + 1);
+        if (!viaEnv && interpreter.empty() && base == "env") {
+            viaEnv = true;
+            continue;
+        }
+        if (viaEnv && (word[0] == '-' || word.find('=') != std::string::npos)) {
+            continue;
+        }
+        interpreter = base;
+        break;
+    }
+    
+    // python3.11 is python
+    size_t versioned = interpreter.find_last_not_of("0123456789.");
+    if (versioned != std::string::npos) {
+        interpreter.erase(versioned + 1);
+    }
+    Candidate found = Lookup(m_byInterpreter, interpreter);
+    return found.index < 0 ? None : m_modes[found.index].id;
+}
+
+std::string ModeCatalog::Serialize() const {
+    std::string out(MAGIC, sizeof(MAGIC));
+    uint32_t count = static_cast<uint32_t>(m_modes.size());
+    out.append(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const ModeInfo& mode : m_modes) {
+        AppendString(out, mode.name);
+        AppendString(out, mode.section);
+        int32_t priority = mode.priority;
+        out.append(reinterpret_cast<const char*>(&priority), sizeof(priority));
+        AppendStrings(out, mode.wildcards);
+        AppendStrings(out, mode.mimeTypes);
+    }
+    return out;
+}
+
+std::shared_ptr<const ModeCatalog> ModeCatalog::Deserialize(const uint8_t* data, size_t length) {
+    if (length < sizeof(MAGIC) || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0) {
+        return nullptr;
+    }
+    
+    Reader reader{data, length, sizeof(MAGIC)};
+    uint32_t count = 0;
+    if (!reader.Read(&count, sizeof(count)) || count > length) {
+        return nullptr;
+    }
+    std::vector<ModeInfo> modes(count);
+    for (ModeInfo& mode : modes) {
+        int32_t priority = 0;
+        if (!reader.ReadString(mode.name) || !reader.ReadString(mode.section) || !reader.Read(&priority, sizeof(priority))
+            || !reader.ReadStrings(mode.wildcards) || !reader.ReadStrings(mode.mimeTypes)) {
+            return nullptr;
+        }
+        mode.priority = priority;
+    }
+    if (reader.offset != length) {
+        return nullptr;
+    }
+    return std::make_shared<const ModeCatalog>(std::move(modes));
+}
+
+std::shared_ptr<const ModeCatalog> ModeCatalog::Current() {
+    static const std::shared_ptr<const ModeCatalog> empty = std::make_shared<const ModeCatalog>(std::vector<ModeInfo>());
+    Registry& registry = TheRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    return registry.current ? registry.current : empty;
+}
+
+void ModeCatalog::SetCurrent(std::shared_ptr<const ModeCatalog> catalog) {
+    Registry& registry = TheRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.current = std::move(catalog);
+}
+
+bool ModeCatalog::ConfigureCache(const std::string& path) {
+    Registry& registry = TheRegistry();
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.cachePath = path;
+        if (registry.current) {
+            return false;
+        }
+    }
+    
+    std::string error;
+    std::shared_ptr<MappedFile> file = MappedFile::Open(path, error);
+    std::shared_ptr<const ModeCatalog> catalog = file
+        ? Deserialize(reinterpret_cast<const uint8_t*>(file->Data()), static_cast<size_t>(file->Size())) : nullptr;
+    if (!catalog) {
+        return false;
+    }
+    
+    // A catalog built meanwhile is newer than the file
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    if (registry.current) {
+        return false;
+    }
+    registry.current = std::move(catalog);
+    return true;
+}
+
+int ModeCatalog::Intern(const std::string& name) {
+    Registry& registry = TheRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto inserted = registry.ids.emplace(name, static_cast<int>(registry.names.size()));
+    if (inserted.second) {
+        registry.names.push_back(name);
+    }
+    return inserted.first->second;
+}
+
+std::string ModeCatalog::NameOf(int id) {
+    Registry& registry = TheRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    return id >= 0 && id < static_cast<int>(registry.names.size()) ? registry.names[id] : std::string();
+}
+
+#ifdef HAVE_KTEXTEDITOR
+namespace {
+
+// Set by the first Build(), so the background refresh doesn't repeat it
+std::atomic<bool> g_built{false};
+
+std::vector<std::string> ToStrings(const QStringList& list) {
+    std::vector<std::string> strings;
+    strings.reserve(list.size());
+    for (const QString& value : list) {
+        strings.push_back(value.toStdString());
+    }
+    return strings;
+}
+
+} // namespace
+
+std::shared_ptr<const ModeCatalog> ModeCatalog::Build() {
+    g_built = true;
+    
+    // "Normal" is Kate's mode without highlighting; every other mode is a visible syntax definition
+    std::vector<ModeInfo> modes(1);
+    modes[0].name = "Normal";
+    for (const KSyntaxHighlighting::Definition& definition : KTextEditor::Editor::instance()->repository().definitions()) {
+        if (!definition.isValid() || definition.isHidden()) {
+            continue;
+        }
+        ModeInfo mode;
+        mode.name = definition.name().toStdString();
+        mode.section = definition.section().toStdString();
+        mode.wildcards = ToStrings(definition.extensions());
+        mode.mimeTypes = ToStrings(definition.mimeTypes());
+        mode.priority = definition.priority();
+        modes.push_back(std::move(mode));
+    }
+    
+    auto catalog = std::make_shared<const ModeCatalog>(std::move(modes));
+    std::string bytes = catalog->Serialize();
+    bool changed = bytes != Current()->Serialize();
+    SetCurrent(catalog);
+    
+    std::string path;
+    {
+        Registry& registry = TheRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        path = registry.cachePath;
+    }
+    if (changed && !path.empty()) {
+        auto content = std::make_shared<std::string>(std::move(bytes));
+        FileWriter::Write(path,
+            [content](FileWriter::Output& output, std::string&) {
+                output.bytes = std::move(*content);
+                return true;
+            },
+            nullptr);
+    }
+    return catalog;
+}
+
+std::shared_ptr<const ModeCatalog> ModeCatalog::Ensure() {
+    std::shared_ptr<const ModeCatalog> catalog = Current();
+    if (!catalog->IsEmpty()) {
+        return catalog;
+    }
+    QtRunner::Initialize();
+    QtRunner::RunSync([&catalog]() { catalog = Build(); });
+    return catalog;
+}
+
+void ModeCatalog::RefreshInBackground() {
+    if (!g_built.exchange(true)) {
+        QtRunner::Post([]() { Build(); });
+    }
+}
+#endif
+
+} // namespace KateNative
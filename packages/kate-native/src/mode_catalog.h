@@ -0,0 +1,116 @@
+#ifndef MODE_CATALOG_H
+#define MODE_CATALOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace KateNative {
+
+struct ModeInfo {
+    int id = -1;
+    std::string name;
+    std::string section;
+    
+    // File name wildcards, as the syntax definition gives them (e.g. "*.cpp", "Makefile")
+    std::vector<std::string> wildcards;
+    std::vector<std::string> mimeTypes;
+    int priority = 0;
+};
+
+/**
+ * Mode Catalog
+ *
+ * Every Kate mode with the file names, mimetypes and interpreters that
+ * select it, indexed so that resolving a file's mode is a few hash
+ * lookups instead of a pass over every syntax definition. A mode is
+ * known by an interned id, the same for its name for the whole process
+ * and every catalog, so ids handed to JavaScript stay valid when the
+ * catalog is rebuilt.
+ *
+ * The current catalog is built once on the Qt thread from the syntax
+ * highlighting repository. configureModeCatalog() names a cache file
+ * that holds it between runs: a warm start answers from the file without
+ * starting Qt, and the first document to open rebuilds the catalog in
+ * the background, rewriting the file when something changed.
+ *
+ * Catalogs are immutable; Current() may be called from any thread.
+ */
+class ModeCatalog {
+public:
+    static constexpr int None = -1;
+    
+    explicit ModeCatalog(std::vector<ModeInfo> modes);
+    
+    const std::vector<ModeInfo>& Modes() const { return m_modes; }
+    bool IsEmpty() const { return m_modes.empty(); }
+    
+    // Each returns a mode id, or None
+    int ForName(const std::string& name) const;
+    int ForFileName(const std::string& path) const;
+    int ForMimeType(const std::string& mimeType) const;
+    
+    // From a "#!" line, by its interpreter (e.g. "#!/usr/bin/env python3")
+    int ForFirstLine(const std::string& line) const;
+    
+    std::string Serialize() const;
+    
+    // Null when `data` is not a catalog this version wrote
+    static std::shared_ptr<const ModeCatalog> Deserialize(const uint8_t* data, size_t length);
+    
+    // The catalog lookups answer from; empty until one is loaded or built
+    static std::shared_ptr<const ModeCatalog> Current();
+    static void SetCurrent(std::shared_ptr<const ModeCatalog> catalog);
+    
+    /**
+     * Use `path` as the cache file, and load the catalog from it when
+     * there is none yet; returns whether it was loaded
+     */
+    static bool ConfigureCache(const std::string& path);
+    
+    // Interned ids; NameOf() is empty for an id that was never handed out
+    static int Intern(const std::string& name);
+    static std::string NameOf(int id);
+    
+#ifdef HAVE_KTEXTEDITOR
+    /**
+     * Build the catalog from the syntax highlighting repository and make it
+     * current, then rewrite the cache file if it changed; Qt thread only
+     */
+    static std::shared_ptr<const ModeCatalog> Build();
+    
+    // The current catalog, built on the Qt thread first if there is none; JavaScript thread
+    static std::shared_ptr<const ModeCatalog> Ensure();
+    
+    // Build() on the Qt thread once per process, without waiting for it
+    static void RefreshInBackground();
+#endif
+
+private:
+    struct Candidate {
+        int index = -1;
+        int priority = 0;
+    };
+    
+    // Keep the higher priority mode for a key; the first one on a tie
+    void Index(std::unordered_map<std::string, int>& map, const std::string& key, int index);
+    Candidate Lookup(const std::unordered_map<std::string, int>& map, const std::string& key) const;
+    
+    std::vector<ModeInfo> m_modes;
+    std::unordered_map<std::string, int> m_byName;
+    std::unordered_map<std::string, int> m_byFileName;
+    std::unordered_map<std::string, int> m_byExtension;
+    std::unordered_map<std::string, int> m_byMimeType;
+    std::unordered_map<std::string, int> m_byInterpreter;
+    
+    // Wildcards that are neither a plain name nor "*." and a suffix
+    std::vector<std::pair<std::string, int>> m_globs;
+    int m_globPriority = INT32_MIN;
+};
+
+} // namespace KateNative
+
+#endif // MODE_CATALOG_H
@@ -0,0 +1,442 @@
+#include "piece_table.h"
+
+namespace KateNative {
+
+size_t PieceTable::CountBreaks(Source source, size_t start, size_t length) const {
+    const std::vector<size_t>& breaks = m_breaks[source];
+    auto first = std::lower_bound(breaks.begin(), breaks.end(), start);
+    auto last = std::lower_bound(first, breaks.end(), start + length);
+    return static_cast<size_t>(last - first);
+}
+
+PieceTable::Piece PieceTable::MakePiece(Source source, size_t start, size_t length) const {
+    return {source, start, length, CountBreaks(source, start, length)};
+}
+
+void PieceTable::Load(std::u16string text) {
+    m_buffers[Original] = std::move(text);
+    m_buffers[Added].clear();
+    m_breaks[Original].clear();
+    m_breaks[Added].clear();
+
+    const std::u16string& original = m_buffers[Original];
+    for (size_t i = 0; i < original.size(); i++) {
+        if (original[i] == u'\n') {
+            m_breaks[Original].push_back(i);
+        }
+    }
+
+    m_pieces.clear();
+    if (!original.empty()) {
+        m_pieces.push_back({Original, 0, original.size(), m_breaks[Original].size()});
+    }
+    m_length = static_cast<int64_t>(original.size());
+    m_lineBreaks = m_breaks[Original].size();
+    m_validPrefix = 0;
+}
+
+void PieceTable::Reset(std::u16string text) {
+    Load(std::move(text));
+    m_undo.clear();
+    m_redo.clear();
+    m_stepOpen = false;
+    m_savedStep = 0;
+    m_revision++;
+}
+
+void PieceTable::SetText(const char16_t* text, size_t length) {
+    if (m_editListener) {
+        m_editListener(0, m_length, text, length);
+    }
+
+    std::u16string removed = Text();
+    int64_t removedLength = m_length;
+    Record(0, std::move(removed), text, length);
+
+    // The old buffers only hold text no piece refers to any more
+    Load(std::u16string(text, length));
+    m_revision++;
+    if (m_observer) {
+        m_observer(0, removedLength, m_length);
+    }
+}
+
+std::u16string PieceTable::Text() const {
+    std::u16string text;
+    text.reserve(static_cast<size_t>(m_length));
+    Read(0, m_length, text);
+    return text;
+}
+
+void PieceTable::Prepare() const {
+    size_t count = m_pieces.size();
+    m_pieceOffsets.resize(count);
+    m_pieceLines.resize(count);
+    if (count == 0) {
+        m_validPrefix = 0;
+        return;
+    }
+
+    if (m_validPrefix == 0) {
+        m_pieceOffsets[0] = 0;
+        m_pieceLines[0] = 0;
+        m_validPrefix = 1;
+    }
+    for (size_t i = m_validPrefix; i < count; i++) {
+        m_pieceOffsets[i] = m_pieceOffsets[i - 1] + static_cast<int64_t>(m_pieces[i - 1].length);
+        m_pieceLines[i] = m_pieceLines[i - 1] + m_pieces[i - 1].lineBreaks;
+    }
+    m_validPrefix = count;
+}
+
+void PieceTable::Locate(int64_t offset, size_t& piece, size_t& within) const {
+    Prepare();
+    if (offset >= m_length) {
+        piece = m_pieces.size();
+        within = 0;
+        return;
+    }
+
+    auto it = std::upper_bound(m_pieceOffsets.begin(), m_pieceOffsets.end(), offset);
+    piece = static_cast<size_t>(it - m_pieceOffsets.begin()) - 1;
+    within = static_cast<size_t>(offset - m_pieceOffsets[piece]);
+}
+
+int64_t PieceTable::LineStart(int line) const {
+    if (line <= 0) {
+        return 0;
+    }
+
+    // The piece holding the line's break: the last one with fewer breaks before it
+    Prepare();
+    size_t breakNumber = static_cast<size_t>(line);
+    auto it = std::lower_bound(m_pieceLines.begin(), m_pieceLines.end(), breakNumber);
+    size_t index = static_cast<size_t>(it - m_pieceLines.begin()) - 1;
+    const Piece& piece = m_pieces[index];
+
+    const std::vector<size_t>& breaks = m_breaks[piece.source];
+    size_t first = static_cast<size_t>(std::lower_bound(breaks.begin(), breaks.end(), piece.start) - breaks.begin());
+    size_t position = breaks[first + (breakNumber - m_pieceLines[index]) - 1];
+    return m_pieceOffsets[index] + static_cast<int64_t>(position - piece.start) + 1;
+}
+
+int PieceTable::LineLength(int line) const {
+    if (line < 0 || line >= Lines()) {
+        return 0;
+    }
+
+    int64_t start = LineStart(line);
+    int64_t end = line == Lines() - 1 ? m_length : LineStart(line + 1) - 1;
+    return static_cast<int>(end - start);
+}
+
+std::u16string PieceTable::Line(int line) const {
+    std::u16string text;
+    if (line < 0 || line >= Lines()) {
+        return text;
+    }
+
+    Read(LineStart(line), LineLength(line), text);
+    return text;
+}
+
+int64_t PieceTable::OffsetAt(int line, int column) const {
+    line = std::clamp(line, 0, Lines() - 1);
+    column = std::clamp(column, 0, LineLength(line));
+    return LineStart(line) + column;
+}
+
+void PieceTable::PositionAt(int64_t offset, int& line, int& column) const {
+    offset = std::clamp<int64_t>(offset, 0, m_length);
+
+    // An offset on a line break is the end of its line
+    size_t index = 0;
+    size_t within = 0;
+    Locate(offset, index, within);
+    if (index == m_pieces.size()) {
+        line = static_cast<int>(m_lineBreaks);
+    } else {
+        const Piece& piece = m_pieces[index];
+        line = static_cast<int>(m_pieceLines[index] + CountBreaks(piece.source, piece.start, within));
+    }
+    column = static_cast<int>(offset - LineStart(line));
+}
+
+void PieceTable::Read(int64_t offset, int64_t length, std::u16string& out) const {
+    size_t index = 0;
+    size_t within = 0;
+    Locate(offset, index, within);
+
+    for (; length > 0 && index < m_pieces.size(); index++) {
+        const Piece& piece = m_pieces[index];
+        size_t take = std::min(piece.length - within, static_cast<size_t>(length));
+        out.append(m_buffers[piece.source], piece.start + within, take);
+        length -= static_cast<int64_t>(take);
+        within = 0;
+    }
+}
+
+bool PieceTable::ToRange(int startLine, int startColumn, int endLine, int endColumn,
+                         int64_t& start, int64_t& end) const {
+    if (endLine < startLine || (endLine == startLine && endColumn < startColumn)) {
+        std::swap(startLine, endLine);
+        std::swap(startColumn, endColumn);
+    }
+    if (startLine < 0 || startColumn < 0 || startLine >= Lines()) {
+        return false;
+    }
+
+    // Like KTextEditor, the end may be past the end of its line or of the text
+    start = OffsetAt(startLine, startColumn);
+    end = endLine >= Lines() ? m_length : OffsetAt(endLine, endColumn);
+    return true;
+}
+
+bool PieceTable::Insert(int line, int column, const char16_t* text, size_t length) {
+    if (line < 0 || column < 0 || line > Lines()) {
+        return false;
+    }
+
+    // As in KTextEditor, the line after the last one and columns past the
+    // end of a line are filled in with a line break and spaces
+    std::u16string fill;
+    int64_t offset = m_length;
+    if (line == Lines()) {
+        fill.push_back(u'\n');
+        fill.append(static_cast<size_t>(column), u' ');
+    } else {
+        int lineLength = LineLength(line);
+        offset = LineStart(line) + std::min(column, lineLength);
+        if (column > lineLength) {
+            fill.append(static_cast<size_t>(column - lineLength), u' ');
+        }
+    }
+
+    if (!fill.empty()) {
+        fill.append(text, length);
+        text = fill.data();
+        length = fill.size();
+    }
+    if (length == 0) {
+        return true;
+    }
+
+    Record(offset, std::u16string(), text, length);
+    InsertAt(offset, text, length);
+    return true;
+}
+
+bool PieceTable::Remove(int startLine, int startColumn, int endLine, int endColumn) {
+    int64_t start = 0;
+    int64_t end = 0;
+    if (!ToRange(startLine, startColumn, endLine, endColumn, start, end)) {
+        return false;
+    }
+    if (end == start) {
+        return true;
+    }
+
+    std::u16string removed;
+    Read(start, end - start, removed);
+    Record(start, std::move(removed), nullptr, 0);
+    RemoveAt(start, end - start);
+    return true;
+}
+
+bool PieceTable::Replace(int startLine, int startColumn, int endLine, int endColumn,
+                         const char16_t* text, size_t length) {
+    int64_t start = 0;
+    int64_t end = 0;
+    if (!ToRange(startLine, startColumn, endLine, endColumn, start, end)) {
+        return false;
+    }
+    if (end == start && length == 0) {
+        return true;
+    }
+
+    std::u16string removed;
+    Read(start, end - start, removed);
+    Record(start, std::move(removed), text, length);
+    RemoveAt(start, end - start);
+    InsertAt(start, text, length);
+    return true;
+}
+
+void PieceTable::InsertAt(int64_t offset, const char16_t* text, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    if (m_editListener) {
+        m_editListener(offset, 0, text, length);
+    }
+
+    std::u16string& added = m_buffers[Added];
+    size_t start = added.size();
+    added.append(text, length);
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] == u'\n') {
+            m_breaks[Added].push_back(start + i);
+        }
+    }
+    Piece inserted = MakePiece(Added, start, length);
+
+    size_t index = 0;
+    size_t within = 0;
+    Locate(offset, index, within);
+
+    if (within == 0 && index > 0 && m_pieces[index - 1].source == Added
+        && m_pieces[index - 1].start + m_pieces[index - 1].length == start) {
+        // Typing on from the previous insert
+        m_pieces[index - 1].length += length;
+        m_pieces[index - 1].lineBreaks += inserted.lineBreaks;
+        Invalidate(index);
+    } else if (within == 0) {
+        m_pieces.insert(m_pieces.begin() + static_cast<ptrdiff_t>(index), inserted);
+        Invalidate(index);
+    } else {
+        Piece target = m_pieces[index];
+        Piece right = MakePiece(target.source, target.start + within, target.length - within);
+        m_pieces[index] = MakePiece(target.source, target.start, within);
+        m_pieces.insert(m_pieces.begin() + static_cast<ptrdiff_t>(index) + 1, {inserted, right});
+        Invalidate(index + 1);
+    }
+
+    m_length += static_cast<int64_t>(length);
+    m_lineBreaks += inserted.lineBreaks;
+    m_revision++;
+
+    if (m_pieces.size() > MaxPieces) {
+        Compact();
+    }
+    if (m_observer) {
+        m_observer(offset, 0, static_cast<int64_t>(length));
+    }
+}
+
+void PieceTable::RemoveAt(int64_t offset, int64_t length) {
+    if (length <= 0) {
+        return;
+    }
+    if (m_editListener) {
+        m_editListener(offset, length, nullptr, 0);
+    }
+
+    size_t first = 0;
+    size_t firstWithin = 0;
+    size_t last = 0;
+    size_t lastWithin = 0;
+    Locate(offset, first, firstWithin);
+    Locate(offset + length - 1, last, lastWithin);
+
+    // What is left of the first and last pieces replaces all of them
+    std::vector<Piece> kept;
+    if (firstWithin > 0) {
+        kept.push_back(MakePiece(m_pieces[first].source, m_pieces[first].start, firstWithin));
+    }
+    size_t tail = lastWithin + 1;
+    if (tail < m_pieces[last].length) {
+        kept.push_back(MakePiece(m_pieces[last].source, m_pieces[last].start + tail, m_pieces[last].length - tail));
+    }
+
+    size_t removedBreaks = 0;
+    for (size_t i = first; i <= last; i++) {
+        removedBreaks += m_pieces[i].lineBreaks;
+    }
+    for (const Piece& piece : kept) {
+        removedBreaks -= piece.lineBreaks;
+    }
+
+    auto begin = m_pieces.begin() + static_cast<ptrdiff_t>(first);
+    m_pieces.insert(m_pieces.erase(begin, begin + static_cast<ptrdiff_t>(last - first + 1)), kept.begin(), kept.end());
+    Invalidate(first);
+
+    m_length -= length;
+    m_lineBreaks -= removedBreaks;
+    m_revision++;
+    if (m_observer) {
+        m_observer(offset, length, 0);
+    }
+}
+
+void PieceTable::Compact() {
+    Load(Text());
+}
+
+void PieceTable::Record(int64_t offset, std::u16string removed, const char16_t* text, size_t length) {
+    if (m_stepDepth == 0 || !m_stepOpen) {
+        if (m_stepDepth > 0) {
+            m_stepRedo = std::move(m_redo);
+        }
+        m_redo.clear();
+        m_undo.push_back({m_nextStep++, {}});
+        m_stepOpen = m_stepDepth > 0;
+    }
+    m_undo.back().changes.push_back({offset, std::move(removed), std::u16string(text, length)});
+}
+
+void PieceTable::BeginStep() {
+    if (m_stepDepth++ == 0) {
+        m_stepOpen = false;
+    }
+}
+
+void PieceTable::EndStep() {
+    if (m_stepDepth > 0 && --m_stepDepth == 0) {
+        m_stepOpen = false;
+        m_stepRedo.clear();
+    }
+}
+
+void PieceTable::AbortStep() {
+    if (m_stepDepth == 0) {
+        return;
+    }
+    m_stepDepth = 0;
+
+    // Nothing was recorded unless the step was opened
+    if (m_stepOpen) {
+        Step step = std::move(m_undo.back());
+        m_undo.pop_back();
+        for (auto it = step.changes.rbegin(); it != step.changes.rend(); ++it) {
+            RemoveAt(it->offset, static_cast<int64_t>(it->inserted.size()));
+            InsertAt(it->offset, it->removed.data(), it->removed.size());
+        }
+        m_redo = std::move(m_stepRedo);
+    }
+    m_stepRedo.clear();
+    m_stepOpen = false;
+}
+
+bool PieceTable::Undo() {
+    if (m_undo.empty()) {
+        return false;
+    }
+
+    Step step = std::move(m_undo.back());
+    m_undo.pop_back();
+    for (auto it = step.changes.rbegin(); it != step.changes.rend(); ++it) {
+        RemoveAt(it->offset, static_cast<int64_t>(it->inserted.size()));
+        InsertAt(it->offset, it->removed.data(), it->removed.size());
+    }
+    m_redo.push_back(std::move(step));
+    m_stepOpen = false;
+    return true;
+}
+
+bool PieceTable::Redo() {
+    if (m_redo.empty()) {
+        return false;
+    }
+
+    Step step = std::move(m_redo.back());
+    m_redo.pop_back();
+    for (const Change& change : step.changes) {
+        RemoveAt(change.offset, static_cast<int64_t>(change.removed.size()));
+        InsertAt(change.offset, change.inserted.data(), change.inserted.size());
+    }
+    m_undo.push_back(std::move(step));
+    m_stepOpen = false;
+    return true;
+}
+
+} // namespace KateNative
@@ -0,0 +1,179 @@
+#ifndef PIECE_TABLE_H
+#define PIECE_TABLE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace KateNative {
+
+/**
+ * Piece Table
+ *
+ * UTF-16 text kept as a sequence of pieces, each a run of either the
+ * original text or an append-only buffer of everything inserted since.
+ * An edit splits at most one piece and never moves any text, and typing
+ * at the end of the previous insert only grows that piece. Both buffers
+ * keep the position of every line break in them, so finding a line or a
+ * position is two binary searches: over the pieces' running offsets and
+ * line counts, then over the breaks inside one piece. The running counts
+ * are only brought up to date past an edit when a lookup needs them.
+ *
+ * Lines break at '\n' only and positions are (line, column) in UTF-16
+ * code units, as in a KTextEditor document; positions outside the text
+ * are clamped by the lookups and rejected by the edits.
+ *
+ * Every edit is recorded for undo. Edits made between BeginStep() and
+ * EndStep() are undone as one step, like the edits of one editing
+ * transaction in KTextEditor.
+ *
+ * Not thread safe; const lookups update the running counts.
+ */
+class PieceTable {
+public:
+    // `removed` units at `offset` were replaced by `inserted` new ones
+    using Observer = std::function<void(int64_t offset, int64_t removed, int64_t inserted)>;
+    
+    // `removed` units at `offset` are about to be replaced by `text`
+    using EditListener = std::function<void(int64_t offset, int64_t removed, const char16_t* text, size_t length)>;
+    
+    // Past this many pieces the text is copied back into a single one
+    static constexpr size_t MaxPieces = 16384;
+
+    // Replace the whole text as one undoable edit
+    void SetText(const char16_t* text, size_t length);
+
+    // Start over from `text` without undo history, unmodified
+    void Reset(std::u16string text);
+
+    std::u16string Text() const;
+    int64_t Length() const { return m_length; }
+    int Lines() const { return static_cast<int>(m_lineBreaks) + 1; }
+
+    // Empty / 0 for a line outside the text
+    std::u16string Line(int line) const;
+    int LineLength(int line) const;
+
+    int64_t OffsetAt(int line, int column) const;
+    void PositionAt(int64_t offset, int& line, int& column) const;
+
+    // Each returns false, changing nothing, when a position is outside the text
+    bool Insert(int line, int column, const char16_t* text, size_t length);
+    bool Remove(int startLine, int startColumn, int endLine, int endColumn);
+    bool Replace(int startLine, int startColumn, int endLine, int endColumn, const char16_t* text, size_t length);
+
+    // Nest; the outermost pair makes one undo step
+    void BeginStep();
+    void EndStep();
+
+    /**
+     * End the outermost step in place of EndStep() by reverting its edits
+     * and dropping it, so the text, undo and redo history and modified
+     * state are as they were at BeginStep()
+     */
+    void AbortStep();
+
+    bool CanUndo() const { return !m_undo.empty(); }
+    bool CanRedo() const { return !m_redo.empty(); }
+    bool Undo();
+    bool Redo();
+
+    // Counts every edit, including those made by undo and redo
+    int64_t Revision() const { return m_revision; }
+
+    // Whether the text differs from the last MarkSaved() or Reset() by the undo history
+    bool IsModified() const { return CurrentStep() != m_savedStep; }
+    void MarkSaved() { m_savedStep = CurrentStep(); }
+
+    size_t PieceCount() const { return m_pieces.size(); }
+    
+    // Told of every edit after it is made, including those of undo and redo, but not of Reset()
+    void SetObserver(Observer observer) { m_observer = std::move(observer); }
+    
+    // Told of the same edits as the observer, but before each is made, while the text is still as it was
+    void SetEditListener(EditListener listener) { m_editListener = std::move(listener); }
+
+private:
+    enum Source : uint8_t {
+        Original = 0,
+        Added = 1
+    };
+
+    struct Piece {
+        Source source;
+        size_t start;
+        size_t length;
+        size_t lineBreaks;
+    };
+
+    // One edit, enough to apply it in either direction
+    struct Change {
+        int64_t offset;
+        std::u16string removed;
+        std::u16string inserted;
+    };
+
+    struct Step {
+        uint64_t id;
+        std::vector<Change> changes;
+    };
+
+    uint64_t CurrentStep() const { return m_undo.empty() ? 0 : m_undo.back().id; }
+
+    // Valid positions only; the raw edits under Insert(), Remove() and undo
+    void InsertAt(int64_t offset, const char16_t* text, size_t length);
+    void RemoveAt(int64_t offset, int64_t length);
+    void Record(int64_t offset, std::u16string removed, const char16_t* text, size_t length);
+
+    // Copy `length` units from `offset` onto `out`
+    void Read(int64_t offset, int64_t length, std::u16string& out) const;
+
+    // The piece holding `offset` and the position in it; m_pieces.size() at the end of the text
+    void Locate(int64_t offset, size_t& piece, size_t& within) const;
+
+    int64_t LineStart(int line) const;
+    // Both ends of a range as offsets, ordered; false when the start is outside the text
+    bool ToRange(int startLine, int startColumn, int endLine, int endColumn, int64_t& start, int64_t& end) const;
+
+    size_t CountBreaks(Source source, size_t start, size_t length) const;
+    Piece MakePiece(Source source, size_t start, size_t length) const;
+
+    // Make `text` the original buffer and the only piece, keeping the undo history
+    void Load(std::u16string text);
+
+    // Bring the running offsets and line counts up to date
+    void Prepare() const;
+    void Invalidate(size_t piece) { m_validPrefix = std::min(m_validPrefix, piece); }
+    void Compact();
+
+    std::u16string m_buffers[2];
+    std::vector<size_t> m_breaks[2];
+    std::vector<Piece> m_pieces;
+    int64_t m_length = 0;
+    size_t m_lineBreaks = 0;
+
+    // Offset and line breaks before each piece, valid below m_validPrefix
+    mutable std::vector<int64_t> m_pieceOffsets;
+    mutable std::vector<size_t> m_pieceLines;
+    mutable size_t m_validPrefix = 0;
+
+    std::vector<Step> m_undo;
+    std::vector<Step> m_redo;
+    // What the open step cleared from m_redo, for AbortStep()
+    std::vector<Step> m_stepRedo;
+    int m_stepDepth = 0;
+    bool m_stepOpen = false;
+    uint64_t m_nextStep = 1;
+    uint64_t m_savedStep = 0;
+    int64_t m_revision = 0;
+    
+    Observer m_observer;
+    EditListener m_editListener;
+};
+
+} // namespace KateNative
+
+#endif // PIECE_TABLE_H
@@ -1,20 +1,28 @@
 #include "qt_runner.h"
+
+#ifdef HAVE_KTEXTEDITOR
+#include "stats.h"
 #include <QCoreApplication>
-#include <QTimer>
+#include <QMetaObject>
 #include <thread>
 #include <mutex>
-#include <chrono>
+#include <condition_variable>
+#include <atomic>
+#include <future>
+#include <stdexcept>
 
 namespace KateNative {
 
 // Global state
-static QCoreApplication* g_app = nullptr;
+static std::atomic<QCoreApplication*> g_app{nullptr};
 static std::thread g_qtThread;
+static std::thread::id g_qtThreadId;
 static std::mutex g_qtMutex;
-static bool g_qtRunning = false;
+static std::condition_variable g_qtStarted;
+static std::atomic<bool> g_qtRunning{false};
 
 void QtRunner::Initialize() {
-    std::lock_guard<std::mutex> lock(g_qtMutex);
+    std::unique_lock<std::mutex> lock(g_qtMutex);
     
     if (g_qtRunning) {
         return;  // Already initialized
@@ -28,30 +36,27 @@ void QtRunner::Initialize() {
         int argc = 1;
         char* argv[] = {(char*)"kate-native"};
         
+        g_qtThreadId = std::this_thread::get_id();
         g_app = new QCoreApplication(argc, argv);
         
-        // Process events periodically
-        QTimer* timer = new QTimer();
-        QObject::connect(timer, &QTimer::timeout, []() {
-            QCoreApplication::processEvents();
-        });
-        timer->start(10);  // Process every 10ms
+        // Anything posted from here on is queued on this thread and picked
+        // up as soon as exec() starts
+        {
+            std::lock_guard<std::mutex> startLock(g_qtMutex);
+            g_qtRunning = true;
+        }
+        g_qtStarted.notify_all();
         
-        g_qtRunning = true;
+        // Run event loop; it sleeps in the event dispatcher until a queued
+        // invocation, timer or socket wakes it up
+        QCoreApplication::exec();
         
-        // Run event loop
-        g_app->exec();
-        
-        delete timer;
-        delete g_app;
-        g_app = nullptr;
         g_qtRunning = false;
+        delete g_app.exchange(nullptr);
     });
     
     // Wait for Qt to start
-    while (!g_qtRunning) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    }
+    g_qtStarted.wait(lock, []() { return g_qtRunning.load(); });
 }
 
 void QtRunner::Shutdown() {
@@ -61,8 +66,10 @@ void QtRunner::Shutdown() {
         return;
     }
     
-    if (g_app) {
-        g_app->quit();
+    if (QCoreApplication* app = g_app.load()) {
+        QMetaObject::invokeMethod(app, []() {
+            QCoreApplication::quit();
+        }, Qt::QueuedConnection);
     }
     
     if (g_qtThread.joinable()) {
@@ -71,14 +78,82 @@ void QtRunner::Shutdown() {
 }
 
 bool QtRunner::IsRunning() {
-    std::lock_guard<std::mutex> lock(g_qtMutex);
     return g_qtRunning;
 }
 
 void QtRunner::ProcessEvents() {
-    if (g_app && g_qtRunning) {
+    if (g_app && g_qtRunning && IsQtThread()) {
         QCoreApplication::processEvents();
     }
 }
 
+bool QtRunner::Post(std::function<void()> task) {
+    QCoreApplication* app = g_app.load();
+    if (!app || !g_qtRunning) {
+        return false;
+    }
+    
+    if (Stats::Enabled()) {
+        task = [task = std::move(task), queuedAt = Stats::QtTaskQueued()]() {
+            Stats::QtTaskStarted(queuedAt);
+            task();
+        };
+    }
+    
+    // Queued invocation on the application object runs the task from
+    // the Qt thread's event loop
+    QMetaObject::invokeMethod(app, std::move(task), Qt::QueuedConnection);
+    return true;
+}
+
+void QtRunner::RunSync(const std::function<void()>& task) {
+    if (IsQtThread()) {
+        task();
+        return;
+    }
+    
+    std::promise<void> done;
+    std::future<void> result = done.get_future();
+    
+    // Blocked and running time are charged to the method being timed, if any
+    bool timed = Stats::Enabled();
+    uint64_t blockedSince = timed ? Stats::Now() : 0;
+    uint64_t work = 0;
+    
+    bool posted = Post([&task, &done, &work, timed]() {
+        uint64_t started = timed ? Stats::Now() : 0;
+        std::exception_ptr failure;
+        try {
+            task();
+        } catch (...) {
+            failure = std::current_exception();
+        }
+        
+        if (timed) {
+            work = Stats::Now() - started;
+        }
+        if (failure) {
+            done.set_exception(failure);
+        } else {
+            done.set_value();
+        }
+    });
+    
+    if (!posted) {
+        throw std::runtime_error("Qt event loop is not running");
+    }
+    
+    result.wait();
+    if (timed) {
+        StatsScope::AddBlocked(Stats::Now() - blockedSince, work);
+    }
+    result.get();
+}
+
+bool QtRunner::IsQtThread() {
+    return g_qtRunning && std::this_thread::get_id() == g_qtThreadId;
+}
+
 } // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
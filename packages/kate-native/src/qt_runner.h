@@ -1,12 +1,17 @@
 #ifndef QT_RUNNER_H
 #define QT_RUNNER_H
 
+#include <functional>
+
 /**
  * Qt Event Loop Manager
  * 
  * Manages the Qt event loop in a separate thread to avoid blocking
  * the Node.js event loop. This allows Qt to run headless without
  * requiring a display server.
+ *
+ * Only built with KTextEditor; everything else runs on the JavaScript
+ * thread or the worker pool.
  */
 namespace KateNative {
 
@@ -14,7 +19,9 @@ class QtRunner {
 public:
     /**
      * Initialize Qt application and start event loop
-     * Must be called before any Qt/KDE operations
+     * Must be called before any Qt/KDE operations. Safe to call from the
+     * JavaScript thread of any environment; only the first call starts
+     * the thread, which then serves every environment.
      */
     static void Initialize();
     
@@ -34,6 +41,28 @@ public:
      * Normally called automatically by the event loop
      */
     static void ProcessEvents();
+    
+    /**
+     * Queue a task for execution on the Qt thread
+     * Returns immediately; the task runs from the Qt event loop.
+     * Returns false if Qt is not running and the task was dropped.
+     */
+    static bool Post(std::function<void()> task);
+    
+    /**
+     * Run a task on the Qt thread and block until it has finished
+     * Runs inline when called from the Qt thread itself. Exceptions
+     * thrown by the task, and std::runtime_error when Qt isn't running,
+     * are thrown on the calling thread; the module is built with
+     * NODE_ADDON_API_CPP_EXCEPTIONS_ALL, so a binding that lets one
+     * through throws a JavaScript Error with its message.
+     */
+    static void RunSync(const std::function<void()>& task);
+    
+    /**
+     * Check if the calling thread is the Qt thread
+     */
+    static bool IsQtThread();
 
 private:
     QtRunner() = delete;
@@ -0,0 +1,121 @@
+#ifndef QT_TASK_H
+#define QT_TASK_H
+
+#include <napi.h>
+#include <exception>
+#include <functional>
+#include <string>
+#include <memory>
+#include <utility>
+#include "js_dispatcher.h"
+#include "qt_runner.h"
+#include "stats.h"
+
+namespace KateNative {
+
+/**
+ * Promise-returning Qt thread dispatch
+ *
+ * Runs a unit of work on the Qt thread and settles a JavaScript promise
+ * with its result on the Node.js thread via the environment's
+ * JsDispatcher. The work function must only
+ * produce plain C++/Qt data; conversion to JavaScript values happens in
+ * the toJs function, which always runs on the JavaScript thread.
+ */
+class QtTask {
+public:
+    template <typename Result>
+    using Work = std::function<Result()>;
+    
+    template <typename Result>
+    using Converter = std::function<Napi::Value(Napi::Env, Result&)>;
+    
+    template <typename Result>
+    static Napi::Promise Run(Napi::Env env, Work<Result> work, Converter<Result> toJs) {
+        Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+        Napi::Promise promise = deferred.Promise();
+        
+        if (!QtRunner::IsRunning()) {
+            deferred.Reject(Napi::Error::New(env, "Qt event loop is not running").Value());
+            return promise;
+        }
+        
+        std::shared_ptr<JsDispatcher> dispatcher = JsDispatcher::ForEnv(env);
+        auto job = std::make_shared<Job<Result>>(deferred, std::move(work), std::move(toJs));
+        job->stats = StatsScope::Current();
+        
+        // Keep the event loop alive until the promise settles
+        dispatcher->Ref();
+        
+        // Only the posted tasks own the job, so a task the dispatcher drops
+        // at teardown frees it along with its deferred and captures
+        bool posted = QtRunner::Post([job, dispatcher]() {
+            uint64_t started = job->stats ? Stats::Now() : 0;
+            try {
+                job->result = job->work();
+            } catch (const std::exception& e) {
+                job->failed = true;
+                job->error = e.what();
+            } catch (...) {
+                job->failed = true;
+                job->error = "Unknown error on Qt thread";
+            }
+            if (job->stats) {
+                job->stats->work.Record(Stats::Now() - started);
+            }
+            
+            dispatcher->Post([job, dispatcher](Napi::Env env) {
+                Settle(env, *job);
+                dispatcher->Unref();
+            });
+        });
+        
+        if (!posted) {
+            dispatcher->Unref();
+            deferred.Reject(Napi::Error::New(env, "Qt event loop is not running").Value());
+        }
+        
+        return promise;
+    }
+
+private:
+    template <typename Result>
+    struct Job {
+        Job(Napi::Promise::Deferred deferred, Work<Result> work, Converter<Result> toJs)
+            : deferred(deferred), work(std::move(work)), toJs(std::move(toJs)) {}
+        
+        Napi::Promise::Deferred deferred;
+        Work<Result> work;
+        Converter<Result> toJs;
+        Result result{};
+        std::string error;
+        bool failed = false;
+        
+        // Timings of the method that started the job, when stats are on
+        MethodStats* stats = nullptr;
+    };
+    
+    template <typename Result>
+    static void Settle(Napi::Env env, Job<Result>& job) {
+        uint64_t started = job.stats ? Stats::Now() : 0;
+        if (job.failed) {
+            job.deferred.Reject(Napi::Error::New(env, job.error).Value());
+        } else {
+            try {
+                job.deferred.Resolve(job.toJs(env, job.result));
+            } catch (const Napi::Error& e) {
+                job.deferred.Reject(e.Value());
+            }
+        }
+        if (job.stats) {
+            job.stats->settle.Record(Stats::Now() - started);
+        }
+    }
+    
+    QtTask() = delete;
+    ~QtTask() = delete;
+};
+
+} // namespace KateNative
+
+#endif // QT_TASK_H
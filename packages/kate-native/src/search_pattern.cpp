@@ -0,0 +1,113 @@
+#include "search_pattern.h"
+
+#ifdef HAVE_KTEXTEDITOR
+
+namespace KateNative {
+
+SearchPattern::SearchPattern(const QString& pattern, const SearchOptions& options)
+    : m_pattern(pattern)
+    , m_options(options)
+{
+    if (m_options.regex) {
+        QString source = m_options.wholeWords
+            ? QStringLiteral("\\b(?:%1)\\b").arg(pattern)
+            : pattern;
+        m_regex = QRegularExpression(source, m_options.caseSensitive
+            ? QRegularExpression::NoPatternOption
+            : QRegularExpression::CaseInsensitiveOption);
+            
+        // JIT compile now rather than on first use
+        m_regex.optimize();
+    } else {
+        m_matcher = QStringMatcher(pattern, m_options.caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive);
+    }
+}
+
+bool SearchPattern::IsValid() const {
+    return !m_options.regex || m_regex.isValid();
+}
+
+QString SearchPattern::ErrorString() const {
+    return IsValid() ? QString() : m_regex.errorString();
+}
+
+bool SearchPattern::IsWholeWord(const QString& text, int column, int length) const {
+    bool isWordStart = (column == 0 || !text[column - 1].isLetterOrNumber());
+    bool isWordEnd = (column + length >= text.length() ||
+                     !text[column + length].isLetterOrNumber());
+    return isWordStart && isWordEnd;
+}
+
+bool SearchPattern::Find(const QString& text, int from, int& column, int& length) const {
+    if (m_pattern.isEmpty() || !IsValid()) {
+        return false;
+    }
+    
+    if (m_options.regex) {
+        QRegularExpressionMatch match = m_regex.match(text, from);
+        if (!match.hasMatch()) {
+            return false;
+        }
+        column = match.capturedStart();
+        length = match.capturedLength();
+        return true;
+    }
+    
+    for (int pos = m_matcher.indexIn(text, from); pos >= 0; pos = m_matcher.indexIn(text, pos + 1)) {
+        // Check whole word match if requested
+        if (!m_options.wholeWords || IsWholeWord(text, pos, m_pattern.length())) {
+            column = pos;
+            length = m_pattern.length();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SearchPattern::Narrows(const SearchPattern& previous) const {
+    // Word boundaries and regular expressions don't nest like substrings do
+    if (m_options.regex || m_options.wholeWords || previous.IsEmpty() || !(m_options == previous.m_options)) {
+        return false;
+    }
+    
+    return m_pattern.contains(previous.m_pattern,
+        m_options.caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive);
+}
+
+QString SearchPattern::Substitute(const QString& text, int column, const QString& replacement) const {
+    if (!m_options.regex || !replacement.contains(QLatin1Char('\\'))) {
+        return replacement;
+    }
+    
+    // Nothing matched earlier than column, so this finds the same match again
+    QRegularExpressionMatch match = m_regex.match(text, column);
+    if (!match.hasMatch()) {
+        return replacement;
+    }
+    
+    QString result;
+    result.reserve(replacement.length());
+    for (int i = 0; i < replacement.length(); i++) {
+        QChar c = replacement[i];
+        if (c != QLatin1Char('\\') || i + 1 == replacement.length()) {
+            result += c;
+            continue;
+        }
+        
+        QChar escaped = replacement[++i];
+        if (escaped.isDigit()) {
+            result += match.captured(escaped.digitValue());
+        } else if (escaped == QLatin1Char('n')) {
+            result += QLatin1Char('\n');
+        } else if (escaped == QLatin1Char('t')) {
+            result += QLatin1Char('\t');
+        } else {
+            result += escaped;
+        }
+    }
+    return result;
+}
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
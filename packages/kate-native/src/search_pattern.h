@@ -0,0 +1,100 @@
+#ifndef SEARCH_PATTERN_H
+#define SEARCH_PATTERN_H
+
+#ifdef HAVE_KTEXTEDITOR
+#include <QRegularExpression>
+#include <QString>
+#include <QStringMatcher>
+#endif
+
+namespace KateNative {
+
+struct SearchOptions {
+    bool caseSensitive = false;
+    bool wholeWords = false;
+    bool regex = false;
+    
+    bool operator==(const SearchOptions& other) const {
+        return caseSensitive == other.caseSensitive
+            && wholeWords == other.wholeWords
+            && regex == other.regex;
+    }
+};
+
+#ifdef HAVE_KTEXTEDITOR
+struct SearchMatch {
+    int line;
+    int column;
+    int length;
+    QString text;
+};
+
+/**
+ * Compiled Search Pattern
+ *
+ * Compiles a search query once: regular expressions are JIT-optimized up
+ * front and plain text uses a precomputed QStringMatcher. Matching is
+ * const and only reads its input, so one pattern can be shared by
+ * several threads.
+ */
+class SearchPattern {
+public:
+    SearchPattern(const QString& pattern, const SearchOptions& options);
+    
+    const QString& Pattern() const { return m_pattern; }
+    const SearchOptions& Options() const { return m_options; }
+    bool IsEmpty() const { return m_pattern.isEmpty(); }
+    bool IsValid() const;
+    QString ErrorString() const;
+    
+    /**
+     * Find the first match in `text` starting at or after `from`
+     * Returns false when there is none.
+     */
+    bool Find(const QString& text, int from, int& column, int& length) const;
+    
+    /**
+     * Call visit(column, length) for every non-overlapping match in `text`
+     * Stops early when visit returns false.
+     */
+    template <typename Visitor>
+    void ForEachMatch(const QString& text, Visitor visit) const {
+        int column = 0;
+        int length = 0;
+        
+        for (int from = 0; from <= text.length() && Find(text, from, column, length); ) {
+            if (!visit(column, length)) {
+                return;
+            }
+            // Step over empty matches so they are not found again
+            from = column + qMax(length, 1);
+        }
+    }
+    
+    /**
+     * True when every line matching this pattern must also match `previous`,
+     * i.e. this is a plain query that extends the previous one
+     */
+    bool Narrows(const SearchPattern& previous) const;
+    
+    /**
+     * Expand `replacement` for the match found at `column` in `text`
+     * For regular expressions, \0 to \9 insert capture groups and \n, \t
+     * and \\ insert a newline, a tab and a backslash. Plain patterns
+     * return the replacement unchanged.
+     */
+    QString Substitute(const QString& text, int column, const QString& replacement) const;
+
+private:
+    bool IsWholeWord(const QString& text, int column, int length) const;
+    
+    QString m_pattern;
+    SearchOptions m_options;
+    QRegularExpression m_regex;
+    QStringMatcher m_matcher;
+};
+#endif // HAVE_KTEXTEDITOR
+
+} // namespace KateNative
+
+#endif // SEARCH_PATTERN_H
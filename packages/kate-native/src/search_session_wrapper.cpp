@@ -0,0 +1,438 @@
+#include "search_session_wrapper.h"
+#include "document_wrapper.h"
+#include "js_convert.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#ifdef HAVE_KTEXTEDITOR
+#include "qt_runner.h"
+#include <KTextEditor/Document>
+#include <KTextEditor/MovingInterface>
+#include <QString>
+#include "search_pattern.h"
+#else
+#include "fallback_document.h"
+#include "text_pattern.h"
+#endif
+
+namespace KateNative {
+
+namespace {
+
+#ifdef HAVE_KTEXTEDITOR
+using SessionDocument = KTextEditor::Document;
+using SessionPattern = SearchPattern;
+using SessionText = QString;
+
+int64_t DocumentRevision(KTextEditor::Document* document) {
+    auto* moving = qobject_cast<KTextEditor::MovingInterface*>(document);
+    return moving ? moving->revision() : -1;
+}
+
+int LineCount(KTextEditor::Document* document) {
+    return document->lines();
+}
+
+QString LineText(KTextEditor::Document* document, int line) {
+    return document->line(line);
+}
+#else
+using SessionDocument = FallbackDocument;
+using SessionPattern = TextPattern;
+using SessionText = std::u16string;
+
+int64_t DocumentRevision(FallbackDocument* document) {
+    return document->Text().Revision();
+}
+
+int LineCount(FallbackDocument* document) {
+    return document->Text().Lines();
+}
+
+std::u16string LineText(FallbackDocument* document, int line) {
+    return document->Text().Line(line);
+}
+#endif
+
+} // namespace
+
+/**
+ * Document-side state of a search session: on the Qt thread, or with the
+ * fallback document on the JavaScript thread
+ */
+struct SearchSessionState {
+    std::unique_ptr<SessionPattern> pattern;
+    
+    // Lines that matched in the last complete scan, valid while the
+    // document is still at candidateRevision
+    std::vector<int> candidateLines;
+    int64_t candidateRevision = -1;
+    int totalCount = -1;
+    
+    // Where the next findNext() starts
+    int cursorLine = 0;
+    int cursorColumn = 0;
+};
+
+namespace {
+
+const int FIELDS_PER_MATCH = 3;
+
+bool HasCandidates(const SearchSessionState& state, SessionDocument* document) {
+    return state.candidateRevision >= 0 && state.candidateRevision == DocumentRevision(document);
+}
+
+void ForgetCandidates(SearchSessionState& state) {
+    state.candidateLines.clear();
+    state.candidateRevision = -1;
+    state.totalCount = -1;
+}
+
+// Record the outcome of a complete scan of the whole document
+void RememberScan(SearchSessionState& state, SessionDocument* document,
+                  std::vector<int> matchedLines, int count) {
+    state.candidateRevision = DocumentRevision(document);
+    state.candidateLines = std::move(matchedLines);
+    state.totalCount = count;
+}
+
+/**
+ * Visit the lines of the inclusive range that can contain matches
+ * Calls visit(line) in order until it returns false.
+ */
+template <typename Visitor>
+void ForEachCandidateLine(const SearchSessionState& state, SessionDocument* document,
+                          int lineStart, int lineEnd, Visitor visit) {
+    lineStart = std::max(lineStart, 0);
+    lineEnd = std::min(lineEnd, LineCount(document) - 1);
+    
+    if (HasCandidates(state, document)) {
+        auto it = std::lower_bound(state.candidateLines.begin(), state.candidateLines.end(), lineStart);
+        for (; it != state.candidateLines.end() && *it <= lineEnd; ++it) {
+            if (!visit(*it)) return;
+        }
+        return;
+    }
+    
+    for (int line = lineStart; line <= lineEnd; line++) {
+        if (!visit(line)) return;
+    }
+}
+
+/**
+ * Append (line, column, length) triples for the inclusive range
+ * Stops after `limit` matches unless limit is 0.
+ */
+void CollectMatches(SearchSessionState& state, SessionDocument* document,
+                    int lineStart, int lineEnd, int limit, std::vector<int32_t>& out) {
+    const SessionPattern& pattern = *state.pattern;
+    if (pattern.IsEmpty() || !pattern.IsValid()) {
+        return;
+    }
+    
+    size_t maxValues = limit > 0 ? static_cast<size_t>(limit) * FIELDS_PER_MATCH : SIZE_MAX;
+    bool wholeDocument = lineStart <= 0 && lineEnd >= LineCount(document) - 1;
+    bool complete = true;
+    std::vector<int> matchedLines;
+    
+    ForEachCandidateLine(state, document, lineStart, lineEnd, [&](int line) {
+        SessionText lineText = LineText(document, line);
+        bool matched = false;
+        
+        pattern.ForEachMatch(lineText, [&](int column, int length) {
+            if (out.size() >= maxValues) {
+                complete = false;
+                return false;
+            }
+            out.push_back(line);
+            out.push_back(column);
+            out.push_back(length);
+            matched = true;
+            return true;
+        });
+        
+        if (matched && wholeDocument) {
+            matchedLines.push_back(line);
+        }
+        return complete;
+    });
+    
+    if (complete && wholeDocument) {
+        RememberScan(state, document, std::move(matchedLines), static_cast<int>(out.size() / FIELDS_PER_MATCH));
+    }
+}
+
+int CountMatches(SearchSessionState& state, SessionDocument* document) {
+    if (state.totalCount >= 0 && HasCandidates(state, document)) {
+        return state.totalCount;
+    }
+    
+    const SessionPattern& pattern = *state.pattern;
+    if (pattern.IsEmpty() || !pattern.IsValid()) {
+        return 0;
+    }
+    
+    int count = 0;
+    std::vector<int> matchedLines;
+    
+    ForEachCandidateLine(state, document, 0, INT_MAX, [&](int line) {
+        int before = count;
+        pattern.ForEachMatch(LineText(document, line), [&count](int, int) {
+            count++;
+            return true;
+        });
+        if (count > before) {
+            matchedLines.push_back(line);
+        }
+        return true;
+    });
+    
+    RememberScan(state, document, std::move(matchedLines), count);
+    return count;
+}
+
+// Find the first match at or after the session cursor, wrapping around once
+bool FindNextMatch(SearchSessionState& state, SessionDocument* document, std::vector<int32_t>& out) {
+    const SessionPattern& pattern = *state.pattern;
+    if (pattern.IsEmpty() || !pattern.IsValid() || LineCount(document) == 0) {
+        return false;
+    }
+    
+    int startLine = std::clamp(state.cursorLine, 0, LineCount(document) - 1);
+    int startColumn = state.cursorColumn;
+    bool wrapped = false;
+    bool found = false;
+    
+    auto tryLine = [&](int line) {
+        int from = (line == startLine && !wrapped) ? startColumn : 0;
+        int column = 0;
+        int length = 0;
+        
+        if (pattern.Find(LineText(document, line), from, column, length)) {
+            out = {line, column, length};
+            state.cursorLine = line;
+            state.cursorColumn = column + std::max(length, 1);
+            found = true;
+            return false;
+        }
+        return true;
+    };
+    
+    ForEachCandidateLine(state, document, startLine, INT_MAX, tryLine);
+    if (!found) {
+        wrapped = true;
+        ForEachCandidateLine(state, document, 0, startLine, tryLine);
+    }
+    
+    return found;
+}
+
+// Run on the thread that owns the document
+void RunOnDocument(const std::function<void()>& task) {
+#ifdef HAVE_KTEXTEDITOR
+    QtRunner::RunSync(task);
+#else
+    task();
+#endif
+}
+
+} // namespace
+
+Napi::Object SearchSessionWrapper::Init(Napi::Env env, Napi::Object exports) {
+    Napi::Function func = DefineClass(env, "KateSearchSession", {
+        InstanceMethod("setPattern", &SearchSessionWrapper::SetPattern),
+        InstanceMethod("isValid", &SearchSessionWrapper::IsValid),
+        InstanceMethod("errorString", &SearchSessionWrapper::GetErrorString),
+        InstanceMethod("limit", &SearchSessionWrapper::GetLimit),
+        InstanceMethod("setLimit", &SearchSessionWrapper::SetLimit),
+        InstanceMethod("findNext", &SearchSessionWrapper::FindNext),
+        InstanceMethod("findInRange", &SearchSessionWrapper::FindInRange),
+        InstanceMethod("findAll", &SearchSessionWrapper::FindAll),
+        InstanceMethod("count", &SearchSessionWrapper::Count),
+    });
+    
+    exports.Set("KateSearchSession", func);
+    return exports;
+}
+
+SearchSessionWrapper::SearchSessionWrapper(const Napi::CallbackInfo& info)
+    : Napi::ObjectWrap<SearchSessionWrapper>(info) {
+    Napi::Env env = info.Env();
+    
+    // Parameters: document, pattern, optional options
+    if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsString()) {
+        Napi::TypeError::New(env, "Expected document and pattern").ThrowAsJavaScriptException();
+        return;
+    }
+    
+    DocumentWrapper* document = Napi::ObjectWrap<DocumentWrapper>::Unwrap(info[0].As<Napi::Object>());
+#ifdef HAVE_KTEXTEDITOR
+    m_document = document ? document->Document() : nullptr;
+#else
+    m_document = document ? document->Fallback() : nullptr;
+#endif
+    if (!m_document) {
+        Napi::Error::New(env, "Document not initialized").ThrowAsJavaScriptException();
+        return;
+    }
+    
+    m_state = std::make_shared<SearchSessionState>();
+    
+#ifdef HAVE_KTEXTEDITOR
+    QString pattern = QString::fromStdString(info[1].As<Napi::String>().Utf8Value());
+#else
+    std::u16string pattern = Utf16FromJs(info[1]);
+#endif
+    SearchOptions options = ParseSearchOptions(info, 2);
+    RunOnDocument([&]() { m_state->pattern.reset(new SessionPattern(pattern, options)); });
+}
+
+SearchSessionWrapper::~SearchSessionWrapper() = default;
+
+Napi::Value SearchSessionWrapper::SetPattern(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "Expected pattern as string").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+#ifdef HAVE_KTEXTEDITOR
+    QString pattern = QString::fromStdString(info[0].As<Napi::String>().Utf8Value());
+#else
+    std::u16string pattern = Utf16FromJs(info[0]);
+#endif
+    SearchOptions options = ParseSearchOptions(info, 1);
+    bool valid = false;
+    
+    RunOnDocument([&]() {
+        SearchSessionState& state = *m_state;
+        
+        // Typing the same query again keeps everything
+        if (state.pattern->Pattern() == pattern && state.pattern->Options() == options) {
+            valid = state.pattern->IsValid();
+            return;
+        }
+        
+        std::unique_ptr<SessionPattern> next(new SessionPattern(pattern, options));
+        if (next->Narrows(*state.pattern)) {
+            // The old matching lines still bound the new matches
+            state.totalCount = -1;
+        } else {
+            ForgetCandidates(state);
+        }
+        
+        state.pattern = std::move(next);
+        state.cursorLine = 0;
+        state.cursorColumn = 0;
+        valid = state.pattern->IsValid();
+    });
+    
+    return Napi::Boolean::New(env, valid);
+}
+
+Napi::Value SearchSessionWrapper::IsValid(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    bool valid = false;
+    RunOnDocument([&]() { valid = m_state->pattern->IsValid(); });
+    return Napi::Boolean::New(env, valid);
+}
+
+Napi::Value SearchSessionWrapper::GetErrorString(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+#ifdef HAVE_KTEXTEDITOR
+    QString error;
+    QtRunner::RunSync([&]() { error = m_state->pattern->ErrorString(); });
+    return Napi::String::New(env, error.toStdString());
+#else
+    return Napi::String::New(env, m_state->pattern->ErrorString());
+#endif
+}
+
+Napi::Value SearchSessionWrapper::GetLimit(const Napi::CallbackInfo& info) {
+    return Napi::Number::New(info.Env(), m_limit);
+}
+
+void SearchSessionWrapper::SetLimit(const Napi::CallbackInfo& info) {
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(info.Env(), "Expected limit as number").ThrowAsJavaScriptException();
+        return;
+    }
+    
+    // 0 means no limit
+    m_limit = std::max(info[0].As<Napi::Number>().Int32Value(), 0);
+}
+
+Napi::Value SearchSessionWrapper::FindNext(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    // Parameters: optional line, column to start from instead of the last match
+    bool hasPosition = info.Length() >= 2 && info[0].IsNumber() && info[1].IsNumber();
+    int line = hasPosition ? info[0].As<Napi::Number>().Int32Value() : 0;
+    int column = hasPosition ? info[1].As<Napi::Number>().Int32Value() : 0;
+    
+    std::vector<int32_t> match;
+    bool found = false;
+    RunOnDocument([&]() {
+        if (hasPosition) {
+            m_state->cursorLine = line;
+            m_state->cursorColumn = std::max(column, 0);
+        }
+        found = FindNextMatch(*m_state, m_document.get(), match);
+    });
+    
+    if (!found) {
+        return env.Null();
+    }
+    return Int32ArrayToJs(env, match);
+}
+
+Napi::Value SearchSessionWrapper::FindInRange(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    // Parameters: lineStart, lineEnd, optional limit
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Expected lineStart and lineEnd as numbers").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    int lineStart = info[0].As<Napi::Number>().Int32Value();
+    int lineEnd = info[1].As<Napi::Number>().Int32Value();
+    int limit = (info.Length() > 2 && info[2].IsNumber()) ? std::max(info[2].As<Napi::Number>().Int32Value(), 0) : m_limit;
+    
+    std::vector<int32_t> matches;
+    RunOnDocument([&]() {
+        CollectMatches(*m_state, m_document.get(), lineStart, lineEnd, limit, matches);
+    });
+    
+    return Int32ArrayToJs(env, matches);
+}
+
+Napi::Value SearchSessionWrapper::FindAll(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    // Parameters: optional limit
+    int limit = (info.Length() > 0 && info[0].IsNumber()) ? std::max(info[0].As<Napi::Number>().Int32Value(), 0) : m_limit;
+    
+    std::vector<int32_t> matches;
+    RunOnDocument([&]() {
+        CollectMatches(*m_state, m_document.get(), 0, INT_MAX, limit, matches);
+    });
+    
+    return Int32ArrayToJs(env, matches);
+}
+
+Napi::Value SearchSessionWrapper::Count(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    int count = 0;
+    RunOnDocument([&]() { count = CountMatches(*m_state, m_document.get()); });
+    return Napi::Number::New(env, count);
+}
+
+} // namespace KateNative
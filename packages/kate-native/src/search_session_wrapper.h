@@ -0,0 +1,65 @@
+#ifndef SEARCH_SESSION_WRAPPER_H
+#define SEARCH_SESSION_WRAPPER_H
+
+#include <napi.h>
+#include <memory>
+
+// Forward declarations
+namespace KTextEditor {
+    class Document;
+}
+
+namespace KateNative {
+
+class FallbackDocument;
+struct SearchSessionState;
+
+/**
+ * JavaScript wrapper for a reusable search over one document
+ *
+ * The pattern is compiled once and kept across calls. Results come back
+ * as Int32Array triples (line, column, length) and every query is capped
+ * by the session limit, so find-as-you-type stays cheap.
+ *
+ * When a complete scan has run, the session remembers which lines
+ * matched. While the document is unchanged, a new plain pattern that
+ * extends the previous one only rescans those lines.
+ *
+ * Built without KTextEditor, the session searches a fallback document
+ * with a TextPattern, on the JavaScript thread.
+ */
+class SearchSessionWrapper : public Napi::ObjectWrap<SearchSessionWrapper> {
+public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports);
+    
+    SearchSessionWrapper(const Napi::CallbackInfo& info);
+    ~SearchSessionWrapper();
+    
+    Napi::Value SetPattern(const Napi::CallbackInfo& info);
+    Napi::Value IsValid(const Napi::CallbackInfo& info);
+    Napi::Value GetErrorString(const Napi::CallbackInfo& info);
+    Napi::Value GetLimit(const Napi::CallbackInfo& info);
+    void SetLimit(const Napi::CallbackInfo& info);
+    
+    Napi::Value FindNext(const Napi::CallbackInfo& info);
+    Napi::Value FindInRange(const Napi::CallbackInfo& info);
+    Napi::Value FindAll(const Napi::CallbackInfo& info);
+    Napi::Value Count(const Napi::CallbackInfo& info);
+
+private:
+    static constexpr int DefaultLimit = 10000;
+    
+#ifdef HAVE_KTEXTEDITOR
+    std::shared_ptr<KTextEditor::Document> m_document;
+#else
+    std::shared_ptr<FallbackDocument> m_document;
+#endif
+    
+    // Only touched on the thread that owns the document
+    std::shared_ptr<SearchSessionState> m_state;
+    int m_limit = DefaultLimit;
+};
+
+} // namespace KateNative
+
+#endif // SEARCH_SESSION_WRAPPER_H
@@ -0,0 +1,493 @@
+#include "shared_channel.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <new>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <fstream>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+namespace KateNative {
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "Shared memory rings need address-free atomics");
+
+// One direction; positions count bytes since the segment was created
+struct SharedRing {
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    
+    // Futex words, bumped after every write and every read
+    alignas(64) std::atomic<uint32_t> written{0};
+    std::atomic<uint32_t> readerWaiting{0};
+    alignas(64) std::atomic<uint32_t> read{0};
+    std::atomic<uint32_t> writerWaiting{0};
+};
+
+struct SharedSegment {
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint64_t ringBytes = 0;
+    std::atomic<int32_t> creatorPid{0};
+    std::atomic<int32_t> openerPid{0};
+    std::atomic<uint32_t> closed{0};
+    
+    // [0] carries messages from the creator, [1] to it
+    SharedRing rings[2];
+};
+
+namespace {
+
+const uint32_t SEGMENT_MAGIC = 0x4b415445;
+const uint32_t SEGMENT_VERSION = 1;
+
+// A frame is a uint32 length, with this bit set when more frames of the
+// same message follow, a uint32 tag and the bytes
+const uint32_t MORE_FRAMES = 0x80000000u;
+const size_t FRAME_HEADER = 2 * sizeof(uint32_t);
+
+const size_t MIN_RING_BYTES = 4096;
+
+// Waits wake up this often to notice a peer that exited
+const int WAIT_SLICE_MS = 100;
+
+size_t DataOffset() {
+    return (sizeof(SharedSegment) + 63) & ~size_t(63);
+}
+
+void CopyIn(uint8_t* ring, size_t capacity, uint64_t position, const void* source, size_t length) {
+    size_t offset = static_cast<size_t>(position % capacity);
+    size_t first = std::min(length, capacity - offset);
+    std::memcpy(ring + offset, source, first);
+    std::memcpy(ring, static_cast<const uint8_t*>(source) + first, length - first);
+}
+
+void CopyOut(const uint8_t* ring, size_t capacity, uint64_t position, void* target, size_t length) {
+    size_t offset = static_cast<size_t>(position % capacity);
+    size_t first = std::min(length, capacity - offset);
+    std::memcpy(target, ring + offset, first);
+    std::memcpy(static_cast<uint8_t*>(target) + first, ring, length - first);
+}
+
+// Sleep while `word` still holds `seen`, for at most WAIT_SLICE_MS
+void WaitOn(std::atomic<uint32_t>& word, uint32_t seen) {
+#ifdef __linux__
+    // Not FUTEX_PRIVATE: the word is shared with another process
+    struct timespec timeout = {0, WAIT_SLICE_MS * 1000000L};
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, seen, &timeout, nullptr, 0);
+#else
+    if (word.load() == seen) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+#endif
+}
+
+void WakeAll(std::atomic<uint32_t>& word) {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#else
+    (void)word;
+#endif
+}
+
+#ifndef _WIN32
+bool ProcessAlive(int32_t pid) {
+    // Not opened yet
+    if (pid <= 0) {
+        return true;
+    }
+    if (kill(pid, 0) != 0 && errno != EPERM) {
+        return false;
+    }
+    
+#ifdef __linux__
+    // An exited child stays a zombie until its parent's event loop reaps it,
+    // which can't happen while that loop is blocked on this channel
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    if (std::getline(stat, line)) {
+        size_t end = line.rfind(')');
+        if (end != std::string::npos && end + 2 < line.size() && (line[end + 2] == 'Z' || line[end + 2] == 'X')) {
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+#endif
+
+} // namespace
+
+#ifdef _WIN32
+std::shared_ptr<SharedChannel> SharedChannel::Create(const std::string&, size_t, std::string& error) {
+    error = "Shared memory channels are not supported on Windows";
+    return nullptr;
+}
+
+std::shared_ptr<SharedChannel> SharedChannel::Open(const std::string&, std::string& error) {
+    error = "Shared memory channels are not supported on Windows";
+    return nullptr;
+}
+
+bool SharedChannel::Map(int, size_t, std::string&) {
+    return false;
+}
+
+SharedChannel::~SharedChannel() {
+}
+
+void SharedChannel::ExpectPeer(int32_t) {
+}
+
+void SharedChannel::Unlink() {
+}
+
+bool SharedChannel::PeerAlive() const {
+    return false;
+}
+#else
+std::shared_ptr<SharedChannel> SharedChannel::Create(const std::string& name, size_t ringBytes, std::string& error) {
+    ringBytes = std::max(ringBytes, MIN_RING_BYTES);
+    size_t bytes = DataOffset() + 2 * ringBytes;
+    
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        error = "Cannot create shared memory " + name + ": " + std::strerror(errno);
+        return nullptr;
+    }
+    if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+        error = "Cannot size shared memory " + name + ": " + std::strerror(errno);
+        close(fd);
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+    
+    std::shared_ptr<SharedChannel> channel(new SharedChannel());
+    channel->m_name = name;
+    channel->m_creator = true;
+    if (!channel->Map(fd, bytes, error)) {
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+    
+    SharedSegment* segment = new (channel->m_mapping) SharedSegment();
+    segment->ringBytes = ringBytes;
+    segment->creatorPid = static_cast<int32_t>(getpid());
+    segment->version = SEGMENT_VERSION;
+    
+    // Last, so an opener never sees a half-initialized segment as valid
+    std::atomic_thread_fence(std::memory_order_release);
+    segment->magic = SEGMENT_MAGIC;
+    
+    channel->Start();
+    return channel;
+}
+
+std::shared_ptr<SharedChannel> SharedChannel::Open(const std::string& name, std::string& error) {
+    int fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0) {
+        error = "Cannot open shared memory " + name + ": " + std::strerror(errno);
+        return nullptr;
+    }
+    
+    struct stat status;
+    if (fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) < DataOffset()) {
+        error = "Shared memory " + name + " is not a channel";
+        close(fd);
+        return nullptr;
+    }
+    
+    std::shared_ptr<SharedChannel> channel(new SharedChannel());
+    channel->m_name = name;
+    if (!channel->Map(fd, static_cast<size_t>(status.st_size), error)) {
+        return nullptr;
+    }
+    
+    SharedSegment* segment = static_cast<SharedSegment*>(channel->m_mapping);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (segment->magic != SEGMENT_MAGIC || segment->version != SEGMENT_VERSION
+        || DataOffset() + 2 * segment->ringBytes != channel->m_mappingBytes) {
+        error = "Shared memory " + name + " is not a channel of this version";
+        return nullptr;
+    }
+    // The creator may already have named this process with ExpectPeer()
+    int32_t expected = 0;
+    int32_t self = static_cast<int32_t>(getpid());
+    if (!segment->openerPid.compare_exchange_strong(expected, self) && expected != self) {
+        error = "Shared memory " + name + " is already open in another process";
+        return nullptr;
+    }
+    
+    channel->Start();
+    return channel;
+}
+
+bool SharedChannel::Map(int fd, size_t bytes, std::string& error) {
+    void* mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    
+    // The mapping keeps the segment
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        error = "Cannot map shared memory " + m_name + ": " + std::strerror(errno);
+        return false;
+    }
+    
+    m_mapping = mapping;
+    m_mappingBytes = bytes;
+    return true;
+}
+
+SharedChannel::~SharedChannel() {
+    if (m_segment) {
+        Close();
+    }
+    if (m_creator) {
+        Unlink();
+    }
+    if (m_mapping) {
+        munmap(m_mapping, m_mappingBytes);
+    }
+}
+
+void SharedChannel::ExpectPeer(int32_t pid) {
+    int32_t expected = 0;
+    m_segment->openerPid.compare_exchange_strong(expected, pid);
+}
+
+void SharedChannel::Unlink() {
+    if (!m_unlinked) {
+        shm_unlink(m_name.c_str());
+        m_unlinked = true;
+    }
+}
+
+bool SharedChannel::PeerAlive() const {
+    if (m_segment->closed.load()) {
+        return false;
+    }
+    return ProcessAlive(m_creator ? m_segment->openerPid.load() : m_segment->creatorPid.load());
+}
+#endif
+
+void SharedChannel::Start() {
+    m_segment = static_cast<SharedSegment*>(m_mapping);
+    uint8_t* data = static_cast<uint8_t*>(m_mapping) + DataOffset();
+    int out = m_creator ? 0 : 1;
+    m_out = &m_segment->rings[out];
+    m_in = &m_segment->rings[1 - out];
+    m_outData = data + out * m_segment->ringBytes;
+    m_inData = data + (1 - out) * m_segment->ringBytes;
+    
+    m_reader = std::thread([this]() { ReadLoop(); });
+}
+
+bool SharedChannel::Send(uint32_t tag, const uint8_t* data, size_t length, std::string& error) {
+    if (!m_segment || m_stopping) {
+        error = "The channel is closed";
+        return false;
+    }
+    
+    size_t capacity = static_cast<size_t>(m_segment->ringBytes);
+    size_t maxChunk = capacity / 4 - FRAME_HEADER;
+    size_t offset = 0;
+    do {
+        size_t chunk = std::min(length - offset, maxChunk);
+        size_t frame = FRAME_HEADER + chunk;
+        
+        uint64_t head = m_out->head.load(std::memory_order_relaxed);
+        while (capacity - (head - m_out->tail.load(std::memory_order_acquire)) < frame) {
+            if (!PeerAlive()) {
+                error = m_segment->closed.load() ? "The channel is closed" : "The other end of the channel exited";
+                return false;
+            }
+            
+            // Announce the wait, then look again, so a read in between isn't missed
+            uint32_t seen = m_out->read.load();
+            m_out->writerWaiting.fetch_add(1);
+            if (capacity - (head - m_out->tail.load()) < frame) {
+                WaitOn(m_out->read, seen);
+            }
+            m_out->writerWaiting.fetch_sub(1);
+        }
+        
+        uint32_t header[2] = {static_cast<uint32_t>(chunk) | (offset + chunk < length ? MORE_FRAMES : 0), tag};
+        CopyIn(m_outData, capacity, head, header, FRAME_HEADER);
+        if (chunk > 0) {
+            CopyIn(m_outData, capacity, head + FRAME_HEADER, data + offset, chunk);
+        }
+        m_out->head.store(head + frame, std::memory_order_release);
+        m_out->written.fetch_add(1);
+        if (m_out->readerWaiting.load() > 0) {
+            WakeAll(m_out->written);
+        }
+        
+        offset += chunk;
+    } while (offset < length);
+    return true;
+}
+
+bool SharedChannel::Call(uint32_t tag, const uint8_t* data, size_t length, int64_t timeoutMs,
+                         std::vector<uint8_t>& reply, std::string& error) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_awaited = tag;
+        m_hasReply = false;
+    }
+    
+    bool sent = Send(tag, data, length, error);
+    
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (sent && !m_hasReply) {
+        // The reader drains what the peer wrote before it exited first
+        if (m_stopping || m_readerDone) {
+            error = m_segment->closed.load() ? "The channel is closed" : "The other end of the channel exited";
+            sent = false;
+        } else if (timeoutMs > 0 && std::chrono::steady_clock::now() >= deadline) {
+            error = "No reply within " + std::to_string(timeoutMs) + " ms";
+            sent = false;
+        } else {
+            m_replied.wait_for(lock, std::chrono::milliseconds(WAIT_SLICE_MS));
+        }
+    }
+    
+    // A late reply goes to the receiver like any other message
+    m_awaited = 0;
+    if (!sent) {
+        return false;
+    }
+    reply = std::move(m_reply);
+    m_reply.clear();
+    m_hasReply = false;
+    return true;
+}
+
+void SharedChannel::Listen(Receiver receiver, std::function<void()> onClosed) {
+    std::deque<std::pair<uint32_t, std::vector<uint8_t>>> early;
+    bool done;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_receiver = receiver;
+        m_onClosed = onClosed;
+        early.swap(m_early);
+        done = m_readerDone;
+    }
+    
+    for (auto& [tag, payload] : early) {
+        receiver(tag, std::move(payload));
+    }
+    if (done && onClosed) {
+        onClosed();
+    }
+}
+
+void SharedChannel::Close() {
+    if (!m_segment) {
+        return;
+    }
+    
+    m_segment->closed.store(1);
+    m_stopping = true;
+    for (SharedRing& ring : m_segment->rings) {
+        ring.written.fetch_add(1);
+        WakeAll(ring.written);
+        ring.read.fetch_add(1);
+        WakeAll(ring.read);
+    }
+    
+    if (m_reader.joinable() && m_reader.get_id() != std::this_thread::get_id()) {
+        m_reader.join();
+    }
+    m_replied.notify_all();
+}
+
+bool SharedChannel::IsClosed() const {
+    return !m_segment || m_stopping || m_segment->closed.load();
+}
+
+void SharedChannel::ReadLoop() {
+    size_t capacity = static_cast<size_t>(m_segment->ringBytes);
+    std::vector<uint8_t> message;
+    
+    while (!m_stopping) {
+        uint64_t tail = m_in->tail.load(std::memory_order_relaxed);
+        if (m_in->head.load(std::memory_order_acquire) == tail) {
+            if (!PeerAlive()) {
+                break;
+            }
+            
+            uint32_t seen = m_in->written.load();
+            m_in->readerWaiting.fetch_add(1);
+            if (m_in->head.load() == tail) {
+                WaitOn(m_in->written, seen);
+            }
+            m_in->readerWaiting.fetch_sub(1);
+            continue;
+        }
+        
+        uint32_t header[2];
+        CopyOut(m_inData, capacity, tail, header, FRAME_HEADER);
+        size_t chunk = header[0] & ~MORE_FRAMES;
+        size_t offset = message.size();
+        message.resize(offset + chunk);
+        if (chunk > 0) {
+            CopyOut(m_inData, capacity, tail + FRAME_HEADER, message.data() + offset, chunk);
+        }
+        
+        m_in->tail.store(tail + FRAME_HEADER + chunk, std::memory_order_release);
+        m_in->read.fetch_add(1);
+        if (m_in->writerWaiting.load() > 0) {
+            WakeAll(m_in->read);
+        }
+        
+        if (!(header[0] & MORE_FRAMES)) {
+            Deliver(header[1], std::move(message));
+            message = std::vector<uint8_t>();
+        }
+    }
+    
+    std::function<void()> onClosed;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_readerDone = true;
+        onClosed = m_onClosed;
+    }
+    m_replied.notify_all();
+    if (onClosed) {
+        onClosed();
+    }
+}
+
+void SharedChannel::Deliver(uint32_t tag, std::vector<uint8_t> payload) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_awaited != 0 && tag == m_awaited && !m_hasReply) {
+        m_reply = std::move(payload);
+        m_hasReply = true;
+        lock.unlock();
+        m_replied.notify_all();
+        return;
+    }
+    
+    if (!m_receiver) {
+        m_early.emplace_back(tag, std::move(payload));
+        return;
+    }
+    Receiver receiver = m_receiver;
+    lock.unlock();
+    receiver(tag, std::move(payload));
+}
+
+} // namespace KateNative
@@ -0,0 +1,142 @@
+#ifndef SHARED_CHANNEL_H
+#define SHARED_CHANNEL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace KateNative {
+
+struct SharedSegment;
+struct SharedRing;
+
+/**
+ * Shared Memory Message Channel
+ *
+ * Two single-producer, single-consumer byte rings in one POSIX shared
+ * memory segment, one per direction, between the process that created the
+ * segment and the one that opened it. Messages are an application tag
+ * (e.g. a call id) and a byte payload; payloads of any size are split into
+ * frames of at most a quarter of the ring and joined again on the way out.
+ *
+ * A reader thread drains the incoming ring as soon as anything arrives,
+ * so a writer is only ever held up by a slow peer, never by its own side,
+ * and both ends always make progress. Messages go to the receiver given
+ * to Listen(), except for the reply Call() is waiting for. Waiting, on
+ * either ring, sleeps on a futex in the segment on Linux and polls
+ * elsewhere; a peer that exits ends every wait with an error.
+ *
+ * Send() and Call() must come from one thread at a time, which the
+ * JavaScript wrapper guarantees.
+ */
+class SharedChannel {
+public:
+    using Receiver = std::function<void(uint32_t tag, std::vector<uint8_t> payload)>;
+    
+    static constexpr size_t DefaultRingBytes = 4 * 1024 * 1024;
+    
+    /**
+     * Create a segment named `name` (a POSIX shared memory name such as
+     * "/kate-123-0") with rings of `ringBytes` each
+     * Returns null and sets `error` on failure, including when it exists.
+     */
+    static std::shared_ptr<SharedChannel> Create(const std::string& name, size_t ringBytes, std::string& error);
+    
+    // Open a segment made by Create() in another process
+    static std::shared_ptr<SharedChannel> Open(const std::string& name, std::string& error);
+    
+    ~SharedChannel();
+    
+    SharedChannel(const SharedChannel&) = delete;
+    SharedChannel& operator=(const SharedChannel&) = delete;
+    
+    /**
+     * Queue a message for the peer, waiting while its ring is full
+     * Returns false and sets `error` once the channel is closed or the
+     * peer has exited.
+     */
+    bool Send(uint32_t tag, const uint8_t* data, size_t length, std::string& error);
+    
+    /**
+     * Send a message and wait for the peer's message with the same tag,
+     * which must not be 0
+     * Gives up after `timeoutMs` unless 0.
+     */
+    bool Call(uint32_t tag, const uint8_t* data, size_t length, int64_t timeoutMs,
+              std::vector<uint8_t>& reply, std::string& error);
+    
+    /**
+     * Deliver incoming messages from now on, those that came earlier first
+     * Both callbacks run on the reader thread; `onClosed` once the channel
+     * is closed from either end or the peer has exited.
+     */
+    void Listen(Receiver receiver, std::function<void()> onClosed);
+    
+    /**
+     * Name the process that is going to open the segment, so that it
+     * counts as exited should it die before it gets there
+     */
+    void ExpectPeer(int32_t pid);
+    
+    // Remove the name, from either end; both keep their mapping
+    void Unlink();
+    
+    // Stop both directions; waits in the peer end with an error
+    void Close();
+    
+    bool IsClosed() const;
+    const std::string& Name() const { return m_name; }
+
+private:
+    SharedChannel() = default;
+    
+    bool Map(int fd, size_t bytes, std::string& error);
+    void Start();
+    
+    // Reader thread; one whole message per loop
+    void ReadLoop();
+    
+    // False once the channel is closed or the peer is gone
+    bool PeerAlive() const;
+    
+    void Deliver(uint32_t tag, std::vector<uint8_t> payload);
+    
+    std::string m_name;
+    bool m_creator = false;
+    bool m_unlinked = false;
+    
+    void* m_mapping = nullptr;
+    size_t m_mappingBytes = 0;
+    SharedSegment* m_segment = nullptr;
+    SharedRing* m_out = nullptr;
+    SharedRing* m_in = nullptr;
+    uint8_t* m_outData = nullptr;
+    uint8_t* m_inData = nullptr;
+    
+    std::thread m_reader;
+    std::atomic<bool> m_stopping{false};
+    
+    std::mutex m_mutex;
+    std::condition_variable m_replied;
+    Receiver m_receiver;
+    std::function<void()> m_onClosed;
+    bool m_readerDone = false;
+    std::deque<std::pair<uint32_t, std::vector<uint8_t>>> m_early;
+    
+    // The tag Call() is waiting for, 0 for none
+    uint32_t m_awaited = 0;
+    bool m_hasReply = false;
+    std::vector<uint8_t> m_reply;
+};
+
+} // namespace KateNative
+
+#endif // SHARED_CHANNEL_H
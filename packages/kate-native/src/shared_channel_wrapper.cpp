@@ -0,0 +1,279 @@
+#include "shared_channel_wrapper.h"
+#include "js_dispatcher.h"
+#include "shared_channel.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace KateNative {
+
+// Shared with the channel's reader thread, which only posts to the dispatcher
+struct ChannelListener {
+    explicit ChannelListener(std::shared_ptr<JsDispatcher> dispatcher) : dispatcher(std::move(dispatcher)) {}
+    
+    std::shared_ptr<JsDispatcher> dispatcher;
+    
+    // JavaScript thread only
+    Napi::FunctionReference onMessage;
+    Napi::FunctionReference onClose;
+    bool wantsRef = true;
+    bool referenced = false;
+    bool closed = false;
+    
+    void UpdateRef() {
+        bool want = wantsRef && !closed;
+        if (want != referenced) {
+            referenced = want;
+            want ? dispatcher->Ref() : dispatcher->Unref();
+        }
+    }
+    
+    void Finish() {
+        closed = true;
+        UpdateRef();
+        onMessage.Reset();
+        onClose.Reset();
+    }
+};
+
+namespace {
+
+// ArrayBuffer or typed array view (including Buffer); false for anything else
+bool BytesFromJs(Napi::Value value, const uint8_t*& data, size_t& length) {
+    if (value.IsArrayBuffer()) {
+        Napi::ArrayBuffer buffer = value.As<Napi::ArrayBuffer>();
+        data = static_cast<const uint8_t*>(buffer.Data());
+        length = buffer.ByteLength();
+        return true;
+    }
+    if (value.IsTypedArray()) {
+        Napi::TypedArray view = value.As<Napi::TypedArray>();
+        data = static_cast<const uint8_t*>(view.ArrayBuffer().Data()) + view.ByteOffset();
+        length = view.ByteLength();
+        return true;
+    }
+    return false;
+}
+
+Napi::Buffer<uint8_t> PayloadToJs(Napi::Env env, std::vector<uint8_t>&& payload) {
+    auto* owner = new std::vector<uint8_t>(std::move(payload));
+    return Napi::Buffer<uint8_t>::NewOrCopy(env, owner->data(), owner->size(),
+        [](Napi::Env, uint8_t*, std::vector<uint8_t>* owner) { delete owner; }, owner);
+}
+
+} // namespace
+
+Napi::Object SharedChannelWrapper::Init(Napi::Env env, Napi::Object exports) {
+    Napi::Function func = DefineClass(env, "KateSharedChannel", {
+        InstanceMethod("send", &SharedChannelWrapper::Send),
+        InstanceMethod("call", &SharedChannelWrapper::Call),
+        InstanceMethod("listen", &SharedChannelWrapper::Listen),
+        InstanceMethod("ref", &SharedChannelWrapper::Ref),
+        InstanceMethod("unref", &SharedChannelWrapper::Unref),
+        InstanceMethod("expectPeer", &SharedChannelWrapper::ExpectPeer),
+        InstanceMethod("unlink", &SharedChannelWrapper::Unlink),
+        InstanceMethod("close", &SharedChannelWrapper::Close),
+        InstanceMethod("isClosed", &SharedChannelWrapper::IsClosed),
+        InstanceMethod("name", &SharedChannelWrapper::GetName),
+    });
+    
+    exports.Set("KateSharedChannel", func);
+    return exports;
+}
+
+SharedChannelWrapper::SharedChannelWrapper(const Napi::CallbackInfo& info)
+    : Napi::ObjectWrap<SharedChannelWrapper>(info) {
+    Napi::Env env = info.Env();
+    
+    // Parameters: name, optional { create, ringBytes }
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "Expected a shared memory name").ThrowAsJavaScriptException();
+        return;
+    }
+    
+    std::string name = info[0].As<Napi::String>().Utf8Value();
+    bool create = false;
+    size_t ringBytes = SharedChannel::DefaultRingBytes;
+    if (info.Length() > 1 && info[1].IsObject()) {
+        Napi::Object options = info[1].As<Napi::Object>();
+        create = options.Get("create").ToBoolean().Value();
+        if (options.Get("ringBytes").IsNumber()) {
+            ringBytes = static_cast<size_t>(std::max(options.Get("ringBytes").As<Napi::Number>().DoubleValue(), 0.0));
+        }
+    }
+    
+    std::string error;
+    m_channel = create ? SharedChannel::Create(name, ringBytes, error) : SharedChannel::Open(name, error);
+    if (!m_channel) {
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+    }
+}
+
+SharedChannelWrapper::~SharedChannelWrapper() {
+    if (m_listener) {
+        m_listener->Finish();
+    }
+    
+    // Joins the reader thread, whose callbacks only post
+    m_channel.reset();
+}
+
+bool SharedChannelWrapper::CheckOpen(Napi::Env env) const {
+    if (!m_channel || m_channel->IsClosed()) {
+        Napi::Error::New(env, "The channel is closed").ThrowAsJavaScriptException();
+        return false;
+    }
+    return true;
+}
+
+Napi::Value SharedChannelWrapper::Send(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    // Parameters: tag, bytes
+    const uint8_t* data = nullptr;
+    size_t length = 0;
+    if (info.Length() < 2 || !info[0].IsNumber() || !BytesFromJs(info[1], data, length)) {
+        Napi::TypeError::New(env, "Expected a tag and an ArrayBuffer or view").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!CheckOpen(env)) {
+        return env.Null();
+    }
+    
+    std::string error;
+    if (!m_channel->Send(info[0].As<Napi::Number>().Uint32Value(), data, length, error)) {
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    return env.Undefined();
+}
+
+Napi::Value SharedChannelWrapper::Call(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    // Parameters: tag (not 0), bytes, optional timeout in ms
+    const uint8_t* data = nullptr;
+    size_t length = 0;
+    if (info.Length() < 2 || !info[0].IsNumber() || info[0].As<Napi::Number>().Uint32Value() == 0
+        || !BytesFromJs(info[1], data, length)) {
+        Napi::TypeError::New(env, "Expected a non-zero tag and an ArrayBuffer or view").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!CheckOpen(env)) {
+        return env.Null();
+    }
+    
+    int64_t timeoutMs = info.Length() > 2 && info[2].IsNumber() ? info[2].As<Napi::Number>().Int64Value() : 0;
+    std::vector<uint8_t> reply;
+    std::string error;
+    if (!m_channel->Call(info[0].As<Napi::Number>().Uint32Value(), data, length, std::max<int64_t>(timeoutMs, 0),
+                         reply, error)) {
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    return PayloadToJs(env, std::move(reply));
+}
+
+Napi::Value SharedChannelWrapper::Listen(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    // Parameters: onMessage(tag, buffer), optional onClose()
+    if (info.Length() < 1 || !info[0].IsFunction()) {
+        Napi::TypeError::New(env, "Expected a message callback").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (m_listener) {
+        Napi::Error::New(env, "The channel already has a listener").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!m_channel) {
+        Napi::Error::New(env, "The channel is closed").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    auto listener = std::make_shared<ChannelListener>(JsDispatcher::ForEnv(env));
+    listener->onMessage = Napi::Persistent(info[0].As<Napi::Function>());
+    if (info.Length() > 1 && info[1].IsFunction()) {
+        listener->onClose = Napi::Persistent(info[1].As<Napi::Function>());
+    }
+    listener->UpdateRef();
+    m_listener = listener;
+    
+    SharedChannel::Receiver receiver = [listener](uint32_t tag, std::vector<uint8_t> payload) {
+        auto message = std::make_shared<std::vector<uint8_t>>(std::move(payload));
+        listener->dispatcher->Post([listener, tag, message](Napi::Env env) {
+            if (!listener->onMessage.IsEmpty()) {
+                listener->onMessage.Call({Napi::Number::New(env, tag), PayloadToJs(env, std::move(*message))});
+            }
+        });
+    };
+    
+    m_channel->Listen(receiver, [listener]() {
+        listener->dispatcher->Post([listener](Napi::Env) {
+            if (listener->closed) {
+                return;
+            }
+            Napi::FunctionReference onClose = std::move(listener->onClose);
+            listener->Finish();
+            if (!onClose.IsEmpty()) {
+                onClose.Call({});
+            }
+        });
+    });
+    return env.Undefined();
+}
+
+Napi::Value SharedChannelWrapper::Ref(const Napi::CallbackInfo& info) {
+    if (m_listener) {
+        m_listener->wantsRef = true;
+        m_listener->UpdateRef();
+    }
+    return info.This();
+}
+
+Napi::Value SharedChannelWrapper::Unref(const Napi::CallbackInfo& info) {
+    if (m_listener) {
+        m_listener->wantsRef = false;
+        m_listener->UpdateRef();
+    }
+    return info.This();
+}
+
+Napi::Value SharedChannelWrapper::ExpectPeer(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    // Parameters: pid of the process about to open the channel
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Expected a process id").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (m_channel) {
+        m_channel->ExpectPeer(info[0].As<Napi::Number>().Int32Value());
+    }
+    return env.Undefined();
+}
+
+Napi::Value SharedChannelWrapper::Unlink(const Napi::CallbackInfo& info) {
+    if (m_channel) {
+        m_channel->Unlink();
+    }
+    return info.Env().Undefined();
+}
+
+Napi::Value SharedChannelWrapper::Close(const Napi::CallbackInfo& info) {
+    // The close callback still runs, from the reader thread's last post
+    if (m_channel) {
+        m_channel->Close();
+    }
+    return info.Env().Undefined();
+}
+
+Napi::Value SharedChannelWrapper::IsClosed(const Napi::CallbackInfo& info) {
+    return Napi::Boolean::New(info.Env(), !m_channel || m_channel->IsClosed());
+}
+
+Napi::Value SharedChannelWrapper::GetName(const Napi::CallbackInfo& info) {
+    return Napi::String::New(info.Env(), m_channel ? m_channel->Name() : std::string());
+}
+
+} // namespace KateNative
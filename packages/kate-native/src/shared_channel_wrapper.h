@@ -0,0 +1,52 @@
+#ifndef SHARED_CHANNEL_WRAPPER_H
+#define SHARED_CHANNEL_WRAPPER_H
+
+#include <napi.h>
+#include <memory>
+
+namespace KateNative {
+
+class SharedChannel;
+struct ChannelListener;
+
+/**
+ * JavaScript wrapper for a SharedChannel
+ *
+ * `new KateSharedChannel(name, { create, ringBytes })` creates the named
+ * segment, or opens one another process created. Messages are a uint32
+ * tag and bytes; they are handed to the listen() callback as Buffers on
+ * the JavaScript thread. call() blocks until the peer answers with the
+ * same tag, which is how the host pool keeps KateDocument synchronous.
+ *
+ * A listening channel keeps the event loop alive until it is closed or
+ * unref()'d, like a socket.
+ */
+class SharedChannelWrapper : public Napi::ObjectWrap<SharedChannelWrapper> {
+public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports);
+    
+    SharedChannelWrapper(const Napi::CallbackInfo& info);
+    ~SharedChannelWrapper();
+    
+    Napi::Value Send(const Napi::CallbackInfo& info);
+    Napi::Value Call(const Napi::CallbackInfo& info);
+    Napi::Value Listen(const Napi::CallbackInfo& info);
+    Napi::Value Ref(const Napi::CallbackInfo& info);
+    Napi::Value Unref(const Napi::CallbackInfo& info);
+    Napi::Value ExpectPeer(const Napi::CallbackInfo& info);
+    Napi::Value Unlink(const Napi::CallbackInfo& info);
+    Napi::Value Close(const Napi::CallbackInfo& info);
+    Napi::Value IsClosed(const Napi::CallbackInfo& info);
+    Napi::Value GetName(const Napi::CallbackInfo& info);
+
+private:
+    // Throws and returns false once closed
+    bool CheckOpen(Napi::Env env) const;
+    
+    std::shared_ptr<SharedChannel> m_channel;
+    std::shared_ptr<ChannelListener> m_listener;
+};
+
+} // namespace KateNative
+
+#endif // SHARED_CHANNEL_WRAPPER_H
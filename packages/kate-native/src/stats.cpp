@@ -0,0 +1,220 @@
+#include "stats.h"
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+
+namespace KateNative {
+
+namespace {
+
+bool EnabledFromEnvironment() {
+    const char* value = std::getenv("KATE_NATIVE_STATS");
+    return value && value[0] != '\0' && value[0] != '0';
+}
+
+// Registered methods; a deque so references survive later registrations
+std::mutex g_methodsMutex;
+std::deque<MethodStats>& Methods() {
+    static std::deque<MethodStats> methods;
+    return methods;
+}
+
+std::atomic<int64_t> g_qtQueueDepth{0};
+std::atomic<int64_t> g_qtMaxQueueDepth{0};
+std::atomic<uint64_t> g_qtTasks{0};
+Histogram g_qtWait;
+std::atomic<uint64_t> g_resetAt{Stats::Now()};
+
+thread_local StatsScope* t_currentScope = nullptr;
+
+const char* const COUNTER_NAMES[Stats::CounterCount] = {
+    "textBytesToJs",
+    "textBytesFromJs",
+    "objectsCreated",
+    "typedArraysCreated",
+    "typedArrayBytes",
+};
+
+double ToMilliseconds(uint64_t nanoseconds) {
+    return static_cast<double>(nanoseconds) / 1e6;
+}
+
+} // namespace
+
+std::atomic<bool> Stats::s_enabled{EnabledFromEnvironment()};
+std::atomic<uint64_t> Stats::s_counters[Stats::CounterCount] = {};
+
+void Histogram::Record(uint64_t nanoseconds) {
+    uint64_t microseconds = nanoseconds / 1000;
+    int bucket = 0;
+    while (bucket < BucketCount - 1 && microseconds > (uint64_t(1) << bucket)) {
+        bucket++;
+    }
+    
+    m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sumNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+void Histogram::Reset() {
+    for (std::atomic<uint64_t>& bucket : m_buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sumNanoseconds.store(0, std::memory_order_relaxed);
+}
+
+Napi::Object Histogram::ToJs(Napi::Env env) const {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("count", Napi::Number::New(env, static_cast<double>(Count())));
+    result.Set("sumMs", Napi::Number::New(env, ToMilliseconds(m_sumNanoseconds.load(std::memory_order_relaxed))));
+    
+    Napi::Array buckets = Napi::Array::New(env, BucketCount);
+    for (int i = 0; i < BucketCount; i++) {
+        buckets[i] = Napi::Number::New(env, static_cast<double>(m_buckets[i].load(std::memory_order_relaxed)));
+    }
+    result.Set("buckets", buckets);
+    return result;
+}
+
+void Stats::SetEnabled(bool enabled) {
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+uint64_t Stats::Now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+MethodStats& Stats::ForMethod(const char* name) {
+    std::lock_guard<std::mutex> lock(g_methodsMutex);
+    for (MethodStats& method : Methods()) {
+        if (method.name == name) {
+            return method;
+        }
+    }
+    return Methods().emplace_back(name);
+}
+
+uint64_t Stats::QtTaskQueued() {
+    int64_t depth = ++g_qtQueueDepth;
+    int64_t max = g_qtMaxQueueDepth.load(std::memory_order_relaxed);
+    while (depth > max && !g_qtMaxQueueDepth.compare_exchange_weak(max, depth, std::memory_order_relaxed)) {
+    }
+    return Now();
+}
+
+void Stats::QtTaskStarted(uint64_t queuedAt) {
+    --g_qtQueueDepth;
+    g_qtTasks.fetch_add(1, std::memory_order_relaxed);
+    g_qtWait.Record(Now() - queuedAt);
+}
+
+Napi::Object Stats::ToJs(Napi::Env env) {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("enabled", Napi::Boolean::New(env, Enabled()));
+    
+    uint64_t resetAt = g_resetAt.load(std::memory_order_relaxed);
+    result.Set("sinceResetMs", Napi::Number::New(env, ToMilliseconds(Now() - resetAt)));
+    
+    Napi::Array bounds = Napi::Array::New(env, Histogram::BucketCount - 1);
+    for (int i = 0; i < Histogram::BucketCount - 1; i++) {
+        bounds[i] = Napi::Number::New(env, static_cast<double>(uint64_t(1) << i) / 1000);
+    }
+    result.Set("bucketBoundsMs", bounds);
+    
+    // Methods that were never called are left out
+    Napi::Object methods = Napi::Object::New(env);
+    {
+        std::lock_guard<std::mutex> lock(g_methodsMutex);
+        for (const MethodStats& method : Methods()) {
+            uint64_t calls = method.calls.load(std::memory_order_relaxed);
+            if (calls == 0) {
+                continue;
+            }
+            Napi::Object entry = Napi::Object::New(env);
+            entry.Set("calls", Napi::Number::New(env, static_cast<double>(calls)));
+            entry.Set("marshal", method.marshal.ToJs(env));
+            entry.Set("work", method.work.ToJs(env));
+            entry.Set("settle", method.settle.ToJs(env));
+            methods.Set(method.name, entry);
+        }
+    }
+    result.Set("methods", methods);
+    
+    Napi::Object conversions = Napi::Object::New(env);
+    for (int i = 0; i < CounterCount; i++) {
+        conversions.Set(COUNTER_NAMES[i],
+                        Napi::Number::New(env, static_cast<double>(s_counters[i].load(std::memory_order_relaxed))));
+    }
+    result.Set("conversions", conversions);
+    
+    Napi::Object qt = Napi::Object::New(env);
+    qt.Set("queueDepth", Napi::Number::New(env, static_cast<double>(g_qtQueueDepth.load())));
+    qt.Set("maxQueueDepth", Napi::Number::New(env, static_cast<double>(g_qtMaxQueueDepth.load())));
+    qt.Set("tasks", Napi::Number::New(env, static_cast<double>(g_qtTasks.load(std::memory_order_relaxed))));
+    qt.Set("wait", g_qtWait.ToJs(env));
+    result.Set("qt", qt);
+    
+    return result;
+}
+
+void Stats::Reset() {
+    {
+        std::lock_guard<std::mutex> lock(g_methodsMutex);
+        for (MethodStats& method : Methods()) {
+            method.calls.store(0, std::memory_order_relaxed);
+            method.marshal.Reset();
+            method.work.Reset();
+            method.settle.Reset();
+        }
+    }
+    
+    for (std::atomic<uint64_t>& counter : s_counters) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    
+    g_qtTasks.store(0, std::memory_order_relaxed);
+    g_qtWait.Reset();
+    g_qtMaxQueueDepth.store(g_qtQueueDepth.load());
+    g_resetAt.store(Now(), std::memory_order_relaxed);
+}
+
+StatsScope::StatsScope(MethodStats& method) {
+    if (!Stats::Enabled()) {
+        return;
+    }
+    
+    m_method = &method;
+    m_previous = t_currentScope;
+    m_start = Stats::Now();
+    t_currentScope = this;
+}
+
+StatsScope::~StatsScope() {
+    if (!m_method) {
+        return;
+    }
+    
+    uint64_t elapsed = Stats::Now() - m_start;
+    m_method->calls.fetch_add(1, std::memory_order_relaxed);
+    m_method->marshal.Record(elapsed > m_blocked ? elapsed - m_blocked : 0);
+    if (m_blocked > 0) {
+        m_method->work.Record(m_work);
+    }
+    t_currentScope = m_previous;
+}
+
+MethodStats* StatsScope::Current() {
+    return t_currentScope ? t_currentScope->m_method : nullptr;
+}
+
+void StatsScope::AddBlocked(uint64_t blocked, uint64_t work) {
+    if (t_currentScope) {
+        t_currentScope->m_blocked += blocked;
+        t_currentScope->m_work += work;
+    }
+}
+
+} // namespace KateNative
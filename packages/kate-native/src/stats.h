@@ -0,0 +1,143 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <napi.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace KateNative {
+
+/**
+ * Latency histogram with power-of-two buckets
+ *
+ * Bucket i counts samples up to 2^i microseconds; the last one counts
+ * everything slower. Safe to record into from any thread.
+ */
+class Histogram {
+public:
+    static constexpr int BucketCount = 24;
+    
+    void Record(uint64_t nanoseconds);
+    void Reset();
+    uint64_t Count() const { return m_count.load(std::memory_order_relaxed); }
+    
+    // { count, sumMs, buckets }; the bounds are shared, see Stats::ToJs()
+    Napi::Object ToJs(Napi::Env env) const;
+
+private:
+    std::atomic<uint64_t> m_buckets[BucketCount] = {};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_sumNanoseconds{0};
+};
+
+/**
+ * Timings of one JavaScript method
+ *
+ * marshal is the time spent on the JavaScript thread outside of Qt
+ * (argument parsing, conversions, N-API calls), work the time spent
+ * running on the Qt thread, and settle the time spent turning the result
+ * of a promise-returning call into JavaScript values.
+ */
+struct MethodStats {
+    explicit MethodStats(std::string methodName) : name(std::move(methodName)) {}
+    
+    const std::string name;
+    std::atomic<uint64_t> calls{0};
+    Histogram marshal;
+    Histogram work;
+    Histogram settle;
+};
+
+/**
+ * Addon Instrumentation
+ *
+ * Opt-in counters behind getStats()/resetStats(): per-method call counts
+ * and latencies, conversion volume and the Qt thread's queue. Off unless
+ * enabled at runtime or with KATE_NATIVE_STATS=1 in the environment;
+ * while off, every hook is a single relaxed load.
+ */
+class Stats {
+public:
+    enum Counter {
+        TextBytesToJs,
+        TextBytesFromJs,
+        ObjectsCreated,
+        TypedArraysCreated,
+        TypedArrayBytes,
+        CounterCount
+    };
+    
+    static bool Enabled() { return s_enabled.load(std::memory_order_relaxed); }
+    static void SetEnabled(bool enabled);
+    
+    // Monotonic clock in nanoseconds
+    static uint64_t Now();
+    
+    /**
+     * Timings for a method, created on first use
+     * The reference stays valid for the life of the process, so callers
+     * keep it in a function-local static.
+     */
+    static MethodStats& ForMethod(const char* name);
+    
+    static void Add(Counter counter, uint64_t amount) {
+        if (Enabled()) {
+            s_counters[counter].fetch_add(amount, std::memory_order_relaxed);
+        }
+    }
+    
+    // A task was queued for the Qt thread; returns the time to pass to QtTaskStarted()
+    static uint64_t QtTaskQueued();
+    static void QtTaskStarted(uint64_t queuedAt);
+    
+    /**
+     * Everything recorded since the last reset
+     */
+    static Napi::Object ToJs(Napi::Env env);
+    
+    /**
+     * Zero every counter and histogram; the queue depth is left alone
+     */
+    static void Reset();
+
+private:
+    static std::atomic<bool> s_enabled;
+    static std::atomic<uint64_t> s_counters[CounterCount];
+    
+    Stats() = delete;
+    ~Stats() = delete;
+};
+
+/**
+ * Times one method call on the JavaScript thread
+ *
+ * Time the calling thread spends blocked in QtRunner::RunSync() is
+ * reported through AddBlocked() and counted as work instead of marshal.
+ * Does nothing when stats are disabled at construction.
+ */
+class StatsScope {
+public:
+    explicit StatsScope(MethodStats& method);
+    ~StatsScope();
+    
+    StatsScope(const StatsScope&) = delete;
+    StatsScope& operator=(const StatsScope&) = delete;
+    
+    // The method being timed on this thread, or nullptr
+    static MethodStats* Current();
+    
+    // `blocked` nanoseconds waiting on the Qt thread, `work` of them running the task
+    static void AddBlocked(uint64_t blocked, uint64_t work);
+
+private:
+    MethodStats* m_method = nullptr;
+    StatsScope* m_previous = nullptr;
+    uint64_t m_start = 0;
+    uint64_t m_blocked = 0;
+    uint64_t m_work = 0;
+};
+
+} // namespace KateNative
+
+#endif // STATS_H
@@ -0,0 +1,397 @@
+#include "syntax_tokens.h"
+
+#ifdef HAVE_KTEXTEDITOR
+#include <KTextEditor/Document>
+#include <KTextEditor/Attribute>
+#include <KTextEditor/Cursor>
+#include <KTextEditor/Range>
+
+namespace KateNative {
+
+namespace {
+
+const int MAX_SCAN_LENGTH = 10000; // Prevent excessive scanning
+const int MAX_TOKEN_LENGTH = 1000;
+
+/**
+ * Interned attribute names for one highlighting mode
+ */
+struct SyntaxLegend {
+    QStringList names;
+    QHash<QString, uint32_t> index;
+    uint32_t version = 0;
+    
+    uint32_t Intern(const QString& name) {
+        auto it = index.find(name);
+        if (it != index.end()) {
+            return it.value();
+        }
+        
+        uint32_t id = static_cast<uint32_t>(names.size());
+        names.append(name);
+        index.insert(name, id);
+        version = NextVersion();
+        return id;
+    }
+    
+    // Shared by every mode, so a version also tells the legends apart
+    static uint32_t NextVersion() {
+        static uint32_t counter = 0;
+        return ++counter;
+    }
+};
+
+// Only touched from the Qt thread
+QHash<QString, SyntaxLegend>& Legends() {
+    static QHash<QString, SyntaxLegend> legends;
+    return legends;
+}
+
+/**
+ * Walk the attribute runs of one line
+ * Calls visit(startColumn, endColumn, attribute) for every run.
+ */
+template <typename Visitor>
+void ForEachAttributeRun(KTextEditor::Document* document, int line, Visitor visit) {
+    int lineLength = qMin(document->lineLength(line), MAX_SCAN_LENGTH);
+    
+    // Iterate through each character to get highlighting
+    for (int col = 0; col < lineLength; ) {
+        auto attr = document->attributeAt(KTextEditor::Cursor(line, col));
+        
+        // Find the extent of this attribute
+        int startCol = col;
+        int endCol = col + 1;
+        
+        // Extend while attribute is the same (with limit)
+        while (endCol < lineLength && (endCol - startCol) < MAX_TOKEN_LENGTH) {
+            auto nextAttr = document->attributeAt(KTextEditor::Cursor(line, endCol));
+            if (nextAttr != attr) break;
+            endCol++;
+        }
+        
+        visit(startCol, endCol, attr);
+        col = endCol;
+    }
+}
+
+QString AttributeName(const KTextEditor::Attribute::Ptr& attr) {
+    return attr ? attr->name() : QStringLiteral("text");
+}
+
+/**
+ * Clamp an inclusive line range to the cache and refresh it
+ * Returns false when the range is empty.
+ */
+bool PrepareRange(SyntaxTokenCache* cache, int& lineStart, int& lineEnd) {
+    lineStart = qMax(lineStart, 0);
+    lineEnd = qMin(lineEnd, cache->LineCount() - 1);
+    if (lineStart > lineEnd) {
+        return false;
+    }
+    
+    cache->Refresh(lineStart, lineEnd);
+    return true;
+}
+
+/**
+ * Stamp the current legend's version and attach the legend when the
+ * caller holds another one
+ */
+void AttachLegend(SyntaxTokenCache* cache, uint32_t knownLegend, QStringList& legend, bool& hasLegend,
+                  uint32_t& legendVersion) {
+    const SyntaxLegend& current = Legends()[cache->Mode()];
+    
+    legendVersion = current.version;
+    if (knownLegend != current.version) {
+        legend = current.names;
+        hasLegend = true;
+    }
+}
+
+/**
+ * Delta of the lines in an inclusive range that `include` picks, with
+ * the shifts made after revision `since`
+ */
+template <typename Filter>
+SyntaxTokenDelta CollectLines(SyntaxTokenCache* cache, quint64 since, uint32_t knownLegend,
+                              int lineStart, int lineEnd, Filter include) {
+    SyntaxTokenDelta result;
+    
+    if (PrepareRange(cache, lineStart, lineEnd)) {
+        for (int line = lineStart; line <= lineEnd; line++) {
+            if (!include(line)) {
+                continue;
+            }
+            
+            const std::vector<uint32_t>& runs = cache->Runs(line);
+            result.lines.push_back(static_cast<uint32_t>(line));
+            result.offsets.push_back(static_cast<uint32_t>(result.data.size()));
+            result.data.insert(result.data.end(), runs.begin(), runs.end());
+        }
+    }
+    result.offsets.push_back(static_cast<uint32_t>(result.data.size()));
+    
+    // After the refresh, which may have rebuilt the cache
+    result.reset = !cache->ShiftsSince(since, result.shifts);
+    result.revision = cache->Revision();
+    result.lineCount = cache->LineCount();
+    result.mode = cache->Mode();
+    AttachLegend(cache, knownLegend, result.legend, result.hasLegend, result.legendVersion);
+    return result;
+}
+
+} // namespace
+
+SyntaxTokenCache::SyntaxTokenCache(KTextEditor::Document* document)
+    : QObject(document)
+    , m_document(document)
+{
+    connect(document, &KTextEditor::Document::textInserted, this,
+        [this](KTextEditor::Document*, const KTextEditor::Cursor& position, const QString& text) {
+            OnTextInserted(position, text);
+        });
+    connect(document, &KTextEditor::Document::textRemoved, this,
+        [this](KTextEditor::Document*, const KTextEditor::Range& range, const QString&) {
+            OnTextRemoved(range);
+        });
+    connect(document, &KTextEditor::Document::highlightingModeChanged, this,
+        [this](KTextEditor::Document*) { Reset(); });
+    connect(document, &KTextEditor::Document::reloaded, this,
+        [this](KTextEditor::Document*) { Reset(); });
+        
+    Reset();
+}
+
+void SyntaxTokenCache::Reset() {
+    m_revision++;
+    m_mode = m_document->mode();
+    m_lines.assign(qMax(m_document->lines(), 1), LineEntry());
+    m_shifts.clear();
+    m_shiftsFrom = m_revision;
+}
+
+void SyntaxTokenCache::ContinueFrom(quint64 revision) {
+    // The other cache's shifts are gone, so its revisions can't be followed
+    m_revision = qMax(m_revision, revision + 1);
+    m_shifts.clear();
+    m_shiftsFrom = m_revision;
+}
+
+void SyntaxTokenCache::RecordShift(int line, int delta) {
+    if (m_shifts.size() >= MaxShifts) {
+        size_t dropped = m_shifts.size() / 2;
+        m_shiftsFrom = m_shifts[dropped - 1].revision;
+        m_shifts.erase(m_shifts.begin(), m_shifts.begin() + dropped);
+    }
+    m_shifts.push_back({m_revision, line, delta});
+}
+
+bool SyntaxTokenCache::ShiftsSince(quint64 revision, std::vector<int32_t>& shifts) const {
+    if (revision < m_shiftsFrom) {
+        return false;
+    }
+    
+    for (const LineShift& shift : m_shifts) {
+        if (shift.revision > revision) {
+            shifts.push_back(shift.line);
+            shifts.push_back(shift.delta);
+        }
+    }
+    return true;
+}
+
+void SyntaxTokenCache::OnTextInserted(const KTextEditor::Cursor& position, const QString& text) {
+    m_revision++;
+    
+    int line = position.line();
+    int added = text.count(QLatin1Char('\n'));
+    if (line < 0 || line >= LineCount()) {
+        Reset();
+        return;
+    }
+    
+    if (added > 0) {
+        m_lines.insert(m_lines.begin() + line + 1, added, LineEntry());
+        RecordShift(line + 1, added);
+    }
+    for (int i = line; i <= line + added; i++) {
+        m_lines[i].valid = false;
+        m_lines[i].edited = true;
+    }
+}
+
+void SyntaxTokenCache::OnTextRemoved(const KTextEditor::Range& range) {
+    m_revision++;
+    
+    int line = range.start().line();
+    int removed = range.end().line() - line;
+    if (line < 0 || line + removed >= LineCount()) {
+        Reset();
+        return;
+    }
+    
+    if (removed > 0) {
+        m_lines.erase(m_lines.begin() + line + 1, m_lines.begin() + line + 1 + removed);
+        RecordShift(line + 1, -removed);
+    }
+    m_lines[line].valid = false;
+    m_lines[line].edited = true;
+}
+
+bool SyntaxTokenCache::Retokenize(int line) {
+    LineEntry& entry = m_lines[line];
+    std::vector<uint32_t> runs = SyntaxTokens::TokenizeLine(m_document, m_mode, line);
+    
+    // A line tokenized for the first time counts as changed
+    bool changed = entry.changedAt == 0 || runs != entry.runs;
+    if (changed) {
+        entry.runs = std::move(runs);
+        entry.changedAt = m_revision;
+        entry.reported = false;
+    }
+    
+    entry.valid = true;
+    entry.edited = false;
+    return changed;
+}
+
+void SyntaxTokenCache::Refresh(int lineStart, int lineEnd) {
+    // The signals should keep the entries in step with the document, but
+    // never hand out tokens for lines that no longer exist
+    if (LineCount() != qMax(m_document->lines(), 1)) {
+        Reset();
+    }
+    
+    bool cascade = false;
+    
+    for (int line = qMax(lineStart, 0); line < LineCount(); line++) {
+        LineEntry& entry = m_lines[line];
+        
+        // Past the range only follow a cascade, and only through lines
+        // that were tokenized before
+        if (line > lineEnd && (!cascade || entry.changedAt == 0)) {
+            break;
+        }
+        
+        if (!entry.valid) {
+            bool follow = entry.edited || cascade;
+            cascade = Retokenize(line) && follow;
+        } else if (cascade) {
+            cascade = Retokenize(line);
+        }
+    }
+}
+
+std::vector<uint32_t> SyntaxTokens::TokenizeLine(KTextEditor::Document* document,
+                                                 const QString& mode, int line) {
+    std::vector<uint32_t> runs;
+    SyntaxLegend& legend = Legends()[mode];
+    
+    ForEachAttributeRun(document, line,
+        [&](int startCol, int endCol, const KTextEditor::Attribute::Ptr& attr) {
+            runs.push_back(static_cast<uint32_t>(startCol));
+            runs.push_back(static_cast<uint32_t>(endCol - startCol));
+            runs.push_back(legend.Intern(AttributeName(attr)));
+        });
+        
+    return runs;
+}
+
+std::vector<SyntaxTokenData> SyntaxTokens::Collect(SyntaxTokenCache* cache,
+                                                   int lineStart, int lineEnd) {
+    std::vector<SyntaxTokenData> tokens;
+    if (!PrepareRange(cache, lineStart, lineEnd)) {
+        return tokens;
+    }
+    
+    const QStringList& names = Legends()[cache->Mode()].names;
+    
+    for (int line = lineStart; line <= lineEnd; line++) {
+        const std::vector<uint32_t>& runs = cache->Runs(line);
+        for (size_t i = 0; i < runs.size(); i += FieldsPerRun) {
+            int startCol = static_cast<int>(runs[i]);
+            int endCol = startCol + static_cast<int>(runs[i + 1]);
+            tokens.push_back({line, startCol, endCol, names.value(static_cast<int>(runs[i + 2]))});
+        }
+    }
+    
+    return tokens;
+}
+
+PackedSyntaxTokens SyntaxTokens::CollectPacked(SyntaxTokenCache* cache,
+                                               int lineStart, int lineEnd, uint32_t knownLegend) {
+    PackedSyntaxTokens result;
+    result.mode = cache->Mode();
+    
+    if (PrepareRange(cache, lineStart, lineEnd)) {
+        int prevLine = 0;
+        int prevStart = 0;
+        
+        for (int line = lineStart; line <= lineEnd; line++) {
+            const std::vector<uint32_t>& runs = cache->Runs(line);
+            for (size_t i = 0; i < runs.size(); i += FieldsPerRun) {
+                int startCol = static_cast<int>(runs[i]);
+                result.data.push_back(static_cast<uint32_t>(line - prevLine));
+                result.data.push_back(static_cast<uint32_t>(line == prevLine ? startCol - prevStart : startCol));
+                result.data.push_back(runs[i + 1]);
+                result.data.push_back(runs[i + 2]);
+                prevLine = line;
+                prevStart = startCol;
+            }
+        }
+    }
+    
+    AttachLegend(cache, knownLegend, result.legend, result.hasLegend, result.legendVersion);
+    return result;
+}
+
+SyntaxTokenDelta SyntaxTokens::CollectSince(SyntaxTokenCache* cache, quint64 revision,
+                                            int lineStart, int lineEnd, uint32_t knownLegend) {
+    return CollectLines(cache, revision, knownLegend, lineStart, lineEnd,
+                        [cache, revision](int line) { return cache->ChangedAt(line) > revision; });
+}
+
+SyntaxTokenDelta SyntaxTokens::CollectUnreported(SyntaxTokenCache* cache, int lineStart, int lineEnd) {
+    auto unreported = [cache](int line) {
+        if (cache->Reported(line)) {
+            return false;
+        }
+        cache->SetReported(line);
+        return true;
+    };
+    
+    SyntaxTokenDelta result = CollectLines(cache, cache->ReportedRevision(), cache->ReportedLegend(),
+                                           lineStart, lineEnd, unreported);
+    cache->SetReportedRevision(result.revision);
+    cache->SetReportedLegend(result.legendVersion);
+    return result;
+}
+
+bool SyntaxTokens::FollowShifts(const std::vector<int32_t>& shifts, uint32_t& line) {
+    int64_t current = line;
+    
+    for (size_t i = 0; i + 1 < shifts.size(); i += 2) {
+        int64_t start = shifts[i];
+        int64_t delta = shifts[i + 1];
+        
+        if (delta < 0 && current >= start && current < start - delta) {
+            return false;
+        }
+        if (current >= start) {
+            current += delta;
+        }
+    }
+    
+    line = static_cast<uint32_t>(current);
+    return true;
+}
+
+QStringList SyntaxTokens::Legend(const QString& mode) {
+    auto it = Legends().constFind(mode);
+    return it != Legends().constEnd() ? it.value().names : QStringList();
+}
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
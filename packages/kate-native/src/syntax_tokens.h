@@ -0,0 +1,248 @@
+#ifndef SYNTAX_TOKENS_H
+#define SYNTAX_TOKENS_H
+
+#ifdef HAVE_KTEXTEDITOR
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <cstdint>
+#include <vector>
+
+namespace KTextEditor {
+    class Document;
+    class Cursor;
+    class Range;
+}
+
+namespace KateNative {
+
+/**
+ * A run of characters sharing one highlighting attribute
+ */
+struct SyntaxTokenData {
+    int line;
+    int startColumn;
+    int endColumn;
+    QString tokenType;
+};
+
+/**
+ * Semantic-token style packed output
+ *
+ * `data` holds FieldsPerToken values per token: line delta, start delta
+ * (relative to the previous token on the same line, absolute otherwise),
+ * length and legend index. The first token's line delta is relative to
+ * line 0, matching the LSP semanticTokens encoding.
+ *
+ * `legendVersion` names the legend the indexes refer to; `legend` is only
+ * filled in when the caller said it holds another one.
+ */
+struct PackedSyntaxTokens {
+    std::vector<uint32_t> data;
+    QString mode;
+    QStringList legend;
+    bool hasLegend = false;
+    uint32_t legendVersion = 0;
+};
+
+/**
+ * Lines whose tokens changed since a given revision
+ *
+ * `shifts` holds a (line, delta) pair for every edit since that revision
+ * that added or removed lines, oldest first: a positive delta inserts that
+ * many lines before `line`, a negative one removes -delta lines starting
+ * at `line`. Applied in order to the caller's copy they bring its line
+ * numbers up to date. `reset` means the shifts are not known, because the
+ * cache was rebuilt or the revision is too old; the caller must then drop
+ * the lines it has outside the result.
+ *
+ * `lines` lists the changed line numbers, after the shifts. The tokens of
+ * lines[i] are the (start column, length, legend index) triples stored in
+ * data[offsets[i] .. offsets[i + 1]).
+ */
+struct SyntaxTokenDelta {
+    quint64 revision = 0;
+    int lineCount = 0;
+    QString mode;
+    QStringList legend;
+    bool hasLegend = false;
+    uint32_t legendVersion = 0;
+    bool reset = false;
+    std::vector<int32_t> shifts;
+    std::vector<uint32_t> lines;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> data;
+};
+
+/**
+ * Per-line Syntax Token Cache
+ *
+ * Keeps the tokenized form of every line of one document so repeated
+ * requests only re-tokenize lines that were edited. Entries are shifted
+ * and invalidated from the document's textInserted/textRemoved signals
+ * and dropped wholesale when the highlighting mode changes or the file
+ * is reloaded.
+ *
+ * Every edit bumps the revision, and an edit that adds or removes lines
+ * is logged as a line shift so a caller holding tokens of an older
+ * revision can renumber them. A re-tokenized line whose tokens came
+ * out different records the current revision, and the cached lines after
+ * it are re-checked until one is unchanged, since an edit can change the
+ * highlighting context of the following lines (e.g. opening a comment).
+ *
+ * The cache is a child of its document and lives on the Qt thread.
+ */
+class SyntaxTokenCache : public QObject {
+public:
+    explicit SyntaxTokenCache(KTextEditor::Document* document);
+    
+    quint64 Revision() const { return m_revision; }
+    
+    // Count on from another cache's revision, e.g. one of a hibernated document
+    void ContinueFrom(quint64 revision);
+    const QString& Mode() const { return m_mode; }
+    int LineCount() const { return static_cast<int>(m_lines.size()); }
+    
+    /**
+     * Make sure every line in the inclusive range is tokenized
+     */
+    void Refresh(int lineStart, int lineEnd);
+    
+    /**
+     * Cached (start column, length, legend index) triples of a line
+     * Only meaningful for lines covered by a preceding Refresh().
+     */
+    const std::vector<uint32_t>& Runs(int line) const { return m_lines[line].runs; }
+    
+    /**
+     * Revision at which the tokens of a line last changed
+     */
+    quint64 ChangedAt(int line) const { return m_lines[line].changedAt; }
+    
+    /**
+     * Whether the current tokens of a line were pushed to listeners
+     * Cleared whenever the line's tokens change.
+     */
+    bool Reported(int line) const { return m_lines[line].reported; }
+    void SetReported(int line) { m_lines[line].reported = true; }
+    
+    /**
+     * Append the (line, delta) shifts made after `revision`
+     * Returns false when they are no longer known.
+     */
+    bool ShiftsSince(quint64 revision, std::vector<int32_t>& shifts) const;
+    
+    // Revision and legend version of the last CollectUnreported() result
+    quint64 ReportedRevision() const { return m_reportedRevision; }
+    void SetReportedRevision(quint64 revision) { m_reportedRevision = revision; }
+    uint32_t ReportedLegend() const { return m_reportedLegend; }
+    void SetReportedLegend(uint32_t version) { m_reportedLegend = version; }
+
+private:
+    struct LineEntry {
+        std::vector<uint32_t> runs;
+        quint64 changedAt = 0;
+        bool valid = false;
+        bool edited = false;
+        bool reported = false;
+    };
+    
+    struct LineShift {
+        quint64 revision;
+        int line;
+        int delta;
+    };
+    
+    // Older shifts are dropped past this many
+    static constexpr size_t MaxShifts = 4096;
+    
+    void OnTextInserted(const KTextEditor::Cursor& position, const QString& text);
+    void OnTextRemoved(const KTextEditor::Range& range);
+    void Reset();
+    void RecordShift(int line, int delta);
+    
+    // Returns true when the line's tokens differ from the cached ones
+    bool Retokenize(int line);
+    
+    KTextEditor::Document* m_document;
+    std::vector<LineEntry> m_lines;
+    quint64 m_revision = 1;
+    std::vector<LineShift> m_shifts;
+    quint64 m_shiftsFrom = 0;       // Shifts after this revision are all in m_shifts
+    quint64 m_reportedRevision = 0;
+    uint32_t m_reportedLegend = 0;
+    QString m_mode;
+};
+
+/**
+ * Syntax Token Extraction
+ *
+ * Turns KTextEditor highlighting attributes into plain token data.
+ * All functions must run on the Qt thread.
+ *
+ * Every legend carries a version, unique across modes and bumped whenever
+ * a name is added. Callers pass back the version they hold and the legend
+ * is attached whenever it differs, so each consumer gets it whether or not
+ * another consumer of the same document already did.
+ */
+class SyntaxTokens {
+public:
+    static constexpr int FieldsPerToken = 4;
+    static constexpr int FieldsPerRun = 3;
+    
+    /**
+     * Collect tokens for the inclusive line range as individual records
+     */
+    static std::vector<SyntaxTokenData> Collect(SyntaxTokenCache* cache,
+                                                int lineStart, int lineEnd);
+                                                
+    /**
+     * Collect tokens for the inclusive line range in packed form
+     * The legend is attached unless `knownLegend` is its version.
+     */
+    static PackedSyntaxTokens CollectPacked(SyntaxTokenCache* cache,
+                                            int lineStart, int lineEnd, uint32_t knownLegend);
+                                            
+    /**
+     * Collect the lines in the inclusive range whose tokens changed after
+     * `revision`. Revision 0 returns every line in the range. The legend
+     * is attached unless `knownLegend` is its version.
+     */
+    static SyntaxTokenDelta CollectSince(SyntaxTokenCache* cache, quint64 revision,
+                                         int lineStart, int lineEnd, uint32_t knownLegend);
+                                         
+    /**
+     * Like CollectSince(), for the lines in the range whose tokens were
+     * not reported yet, with the shifts since the previous call; marks
+     * them reported. The legend is attached when it changed since then.
+     */
+    static SyntaxTokenDelta CollectUnreported(SyntaxTokenCache* cache, int lineStart, int lineEnd);
+                                        
+    /**
+     * Renumber a line by the shifts of a SyntaxTokenDelta
+     * Returns false when they removed it.
+     */
+    static bool FollowShifts(const std::vector<int32_t>& shifts, uint32_t& line);
+    
+    /**
+     * Tokenize one line into (start column, length, legend index) triples
+     */
+    static std::vector<uint32_t> TokenizeLine(KTextEditor::Document* document,
+                                              const QString& mode, int line);
+                                            
+    /**
+     * Current legend (attribute names by index) for a highlighting mode
+     */
+    static QStringList Legend(const QString& mode);
+
+private:
+    SyntaxTokens() = delete;
+    ~SyntaxTokens() = delete;
+};
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
+
+#endif // SYNTAX_TOKENS_H
@@ -0,0 +1,694 @@
+#include "text_index.h"
+
+#ifdef HAVE_KTEXTEDITOR
+#include <KTextEditor/Document>
+#include <KTextEditor/Cursor>
+#include <KTextEditor/Range>
+#include <QChar>
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <iterator>
+#include <set>
+
+namespace KateNative {
+
+namespace {
+
+const int FIELDS_PER_MATCH = 4;
+
+// Rough cost of a posting list's hash map node and vector header
+const size_t POSTING_NODE_BYTES = 64;
+
+// Simple case folding, the same for indexed text and queries
+char16_t Fold(char16_t unit) {
+    if (unit < 0x80) {
+        return (unit >= u'A' && unit <= u'Z') ? static_cast<char16_t>(unit + 32) : unit;
+    }
+    return QChar(unit).toCaseFolded().unicode();
+}
+
+uint32_t TrigramCode(char16_t a, char16_t b, char16_t c) {
+    uint64_t key = (uint64_t(a) << 32) | (uint64_t(b) << 16) | uint64_t(c);
+    return static_cast<uint32_t>((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+void AppendTrigrams(const QString& text, std::vector<uint32_t>& out) {
+    const QChar* data = text.constData();
+    int length = text.length();
+    if (length < 3) {
+        return;
+    }
+    
+    char16_t a = Fold(data[0].unicode());
+    char16_t b = Fold(data[1].unicode());
+    for (int i = 2; i < length; i++) {
+        char16_t c = Fold(data[i].unicode());
+        out.push_back(TrigramCode(a, b, c));
+        a = b;
+        b = c;
+    }
+}
+
+void SortUnique(std::vector<uint32_t>& values) {
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+}
+
+// Sorted values as varint deltas
+std::vector<uint8_t> Encode(const std::vector<uint32_t>& sorted) {
+    std::vector<uint8_t> bytes;
+    bytes.reserve(sorted.size() * 2);
+    uint32_t previous = 0;
+    for (uint32_t value : sorted) {
+        uint32_t delta = value - previous;
+        previous = value;
+        while (delta >= 0x80) {
+            bytes.push_back(static_cast<uint8_t>(delta | 0x80));
+            delta >>= 7;
+        }
+        bytes.push_back(static_cast<uint8_t>(delta));
+    }
+    bytes.shrink_to_fit();
+    return bytes;
+}
+
+std::vector<uint32_t> Decode(const std::vector<uint8_t>& bytes) {
+    std::vector<uint32_t> values;
+    uint32_t value = 0;
+    uint32_t delta = 0;
+    int shift = 0;
+    for (uint8_t byte : bytes) {
+        delta |= uint32_t(byte & 0x7F) << shift;
+        if (byte & 0x80) {
+            shift += 7;
+            continue;
+        }
+        value += delta;
+        values.push_back(value);
+        delta = 0;
+        shift = 0;
+    }
+    return values;
+}
+
+bool IsQuantifier(QChar c) {
+    return c == QLatin1Char('*') || c == QLatin1Char('+') || c == QLatin1Char('?') || c == QLatin1Char('{');
+}
+
+// Index just past the group or class starting at `i`
+int SkipBracketed(const QString& pattern, int i) {
+    if (pattern[i] == QLatin1Char('[')) {
+        // A ']' right after '[' or '[^' is a literal
+        i++;
+        if (i < pattern.length() && pattern[i] == QLatin1Char('^')) {
+            i++;
+        }
+        if (i < pattern.length() && pattern[i] == QLatin1Char(']')) {
+            i++;
+        }
+        for (; i < pattern.length() && pattern[i] != QLatin1Char(']'); i++) {
+            if (pattern[i] == QLatin1Char('\\')) {
+                i++;
+            }
+        }
+        return i + 1;
+    }
+    
+    int depth = 0;
+    for (; i < pattern.length(); i++) {
+        QChar c = pattern[i];
+        if (c == QLatin1Char('\\')) {
+            i++;
+        } else if (c == QLatin1Char('[')) {
+            i = SkipBracketed(pattern, i) - 1;
+        } else if (c == QLatin1Char('(')) {
+            depth++;
+        } else if (c == QLatin1Char(')') && --depth == 0) {
+            return i + 1;
+        }
+    }
+    return i;
+}
+
+// Index just past the quantifier at `i`, including a lazy or possessive suffix
+int SkipQuantifier(const QString& pattern, int i) {
+    if (pattern[i] == QLatin1Char('{')) {
+        int close = pattern.indexOf(QLatin1Char('}'), i);
+        i = close < 0 ? pattern.length() : close + 1;
+    } else {
+        i++;
+    }
+    if (i < pattern.length() && (pattern[i] == QLatin1Char('?') || pattern[i] == QLatin1Char('+'))) {
+        i++;
+    }
+    return i;
+}
+
+// Index just past the letter or digit escape whose letter is at `i`, with its argument
+int SkipEscape(const QString& pattern, int i) {
+    QChar letter = pattern[i++];
+    if (i >= pattern.length()) {
+        return i;
+    }
+    
+    // \x{...}, \p{...}, \k<name>, \g'name' and the like
+    QChar open = pattern[i];
+    if (QStringLiteral("xopPNkgu").contains(letter)
+        && (open == QLatin1Char('{') || open == QLatin1Char('<') || open == QLatin1Char('\''))) {
+        QChar close = open;
+        if (open == QLatin1Char('{')) {
+            close = QLatin1Char('}');
+        } else if (open == QLatin1Char('<')) {
+            close = QLatin1Char('>');
+        }
+        int end = pattern.indexOf(close, i + 1);
+        return end < 0 ? pattern.length() : end + 1;
+    }
+    
+    if (letter == QLatin1Char('x')) {
+        for (int n = 0; n < 2 && i < pattern.length() && isxdigit(pattern[i].toLatin1()); n++) {
+            i++;
+        }
+    } else if (letter.isDigit() || letter == QLatin1Char('g')) {
+        while (i < pattern.length() && pattern[i].isDigit()) {
+            i++;
+        }
+    } else if (letter == QLatin1Char('c') || letter == QLatin1Char('p') || letter == QLatin1Char('P')) {
+        i++;
+    }
+    return i;
+}
+
+// True when the quantifier at `i` allows zero repetitions
+bool AllowsZero(const QString& pattern, int i) {
+    QChar c = pattern[i];
+    if (c == QLatin1Char('*') || c == QLatin1Char('?')) {
+        return true;
+    }
+    if (c == QLatin1Char('{')) {
+        int close = pattern.indexOf(QLatin1Char('}'), i);
+        bool ok = false;
+        int minimum = pattern.mid(i + 1, close - i - 1).section(QLatin1Char(','), 0, 0).toInt(&ok);
+        return !ok || minimum == 0;
+    }
+    return false;
+}
+
+} // namespace
+
+TextIndex::TextIndex(size_t memoryLimit)
+    : m_memoryLimit(memoryLimit)
+{
+}
+
+TextIndex::~TextIndex() = default;
+
+int TextIndex::Add(std::shared_ptr<KTextEditor::Document> document) {
+    KTextEditor::Document* key = document.get();
+    if (m_ids.contains(key)) {
+        return m_ids.value(key);
+    }
+    
+    int id = m_nextId++;
+    m_ids.insert(key, id);
+    m_documents[id].document = std::move(document);
+    
+    connect(key, &KTextEditor::Document::textInserted, this,
+        [this, id](KTextEditor::Document*, const KTextEditor::Cursor& position, const QString& text) {
+            OnTextInserted(id, position.line(), text.count(QLatin1Char('\n')));
+        });
+    connect(key, &KTextEditor::Document::textRemoved, this,
+        [this, id](KTextEditor::Document*, const KTextEditor::Range& range, const QString&) {
+            OnTextRemoved(id, range.start().line(), range.end().line() - range.start().line());
+        });
+        
+    // Loading a file replaces the content without textInserted/textRemoved
+    auto invalidate = [this, id](KTextEditor::Document*) {
+        auto it = m_documents.find(id);
+        if (it != m_documents.end()) {
+            it->second.stale = true;
+        }
+    };
+    connect(key, &KTextEditor::Document::aboutToInvalidateMovingInterfaceContent, this, invalidate);
+    connect(key, &KTextEditor::Document::reloaded, this, invalidate);
+    
+    Refresh(m_documents[id]);
+    EnforceLimit();
+    return id;
+}
+
+bool TextIndex::Remove(int id) {
+    auto it = m_documents.find(id);
+    if (it == m_documents.end()) {
+        return false;
+    }
+    
+    KTextEditor::Document* document = it->second.document.get();
+    disconnect(document, nullptr, this, nullptr);
+    DropBlocks(it->second);
+    m_ids.remove(document);
+    m_documents.erase(it);
+    
+    IndexWaiting();
+    return true;
+}
+
+int TextIndex::IdOf(KTextEditor::Document* document) const {
+    return m_ids.value(document, 0);
+}
+
+void TextIndex::OnTextInserted(int id, int line, int added) {
+    auto it = m_documents.find(id);
+    if (it == m_documents.end() || !it->second.indexed || it->second.stale) {
+        return;
+    }
+    
+    // The lines go into the block holding the edited line
+    Entry& entry = it->second;
+    int start = 0;
+    for (uint32_t block : entry.blocks) {
+        if (line < start + m_blocks[block].lines) {
+            m_blocks[block].lines += added;
+            m_blocks[block].dirty = true;
+            entry.dirty = true;
+            return;
+        }
+        start += m_blocks[block].lines;
+    }
+    entry.stale = true;
+}
+
+void TextIndex::OnTextRemoved(int id, int line, int removed) {
+    auto it = m_documents.find(id);
+    if (it == m_documents.end() || !it->second.indexed || it->second.stale) {
+        return;
+    }
+    
+    // The edited line stays; the `removed` lines after it leave their blocks
+    Entry& entry = it->second;
+    int start = 0;
+    size_t i = 0;
+    for (; i < entry.blocks.size() && line >= start + m_blocks[entry.blocks[i]].lines; i++) {
+        start += m_blocks[entry.blocks[i]].lines;
+    }
+    if (i == entry.blocks.size()) {
+        entry.stale = true;
+        return;
+    }
+    
+    Block& first = m_blocks[entry.blocks[i]];
+    int taken = std::min(removed, first.lines - (line - start) - 1);
+    first.lines -= taken;
+    first.dirty = true;
+    entry.dirty = true;
+    removed -= taken;
+    
+    for (i++; removed > 0 && i < entry.blocks.size(); ) {
+        Block& block = m_blocks[entry.blocks[i]];
+        taken = std::min(removed, block.lines);
+        block.lines -= taken;
+        block.dirty = true;
+        removed -= taken;
+        
+        if (block.lines == 0) {
+            uint32_t empty = entry.blocks[i];
+            Reindex(empty, 0);
+            m_blocks[empty].document = 0;
+            m_freeBlocks.push_back(empty);
+            entry.blocks.erase(entry.blocks.begin() + i);
+        } else {
+            i++;
+        }
+    }
+    if (removed > 0) {
+        entry.stale = true;
+    }
+}
+
+void TextIndex::Refresh(Entry& entry) {
+    if (!entry.indexed) {
+        return;
+    }
+    
+    // Never trust blocks that disagree with the document about its size
+    if (!entry.stale) {
+        int lines = 0;
+        for (uint32_t block : entry.blocks) {
+            lines += m_blocks[block].lines;
+        }
+        entry.stale = lines != entry.document->lines();
+    }
+    if (entry.stale) {
+        Rebuild(entry);
+    }
+    if (!entry.dirty) {
+        return;
+    }
+    
+    int start = 0;
+    for (size_t i = 0; i < entry.blocks.size(); i++) {
+        uint32_t block = entry.blocks[i];
+        if (!m_blocks[block].dirty) {
+            start += m_blocks[block].lines;
+            continue;
+        }
+        
+        // Split blocks that grew too large; the first part keeps its postings
+        if (m_blocks[block].lines > 2 * BlockLines) {
+            int rest = m_blocks[block].lines - BlockLines;
+            m_blocks[block].lines = BlockLines;
+            std::vector<uint32_t> parts;
+            for (; rest > 0; rest -= BlockLines) {
+                parts.push_back(NewBlock(m_blocks[block].document, std::min(rest, BlockLines)));
+            }
+            entry.blocks.insert(entry.blocks.begin() + i + 1, parts.begin(), parts.end());
+        }
+        
+        Reindex(block, start);
+        start += m_blocks[block].lines;
+    }
+    entry.dirty = false;
+}
+
+void TextIndex::Rebuild(Entry& entry) {
+    DropBlocks(entry);
+    
+    int id = m_ids.value(entry.document.get());
+    int lineCount = entry.document->lines();
+    for (int start = 0; start < lineCount; start += BlockLines) {
+        entry.blocks.push_back(NewBlock(id, std::min(BlockLines, lineCount - start)));
+    }
+    entry.stale = false;
+    entry.dirty = !entry.blocks.empty();
+}
+
+void TextIndex::Reindex(uint32_t block, int startLine) {
+    Block& data = m_blocks[block];
+    KTextEditor::Document* document = data.lines > 0 ? m_documents[data.document].document.get() : nullptr;
+    
+    std::vector<uint32_t> trigrams;
+    for (int line = startLine; line < startLine + data.lines; line++) {
+        AppendTrigrams(document->line(line), trigrams);
+    }
+    SortUnique(trigrams);
+    
+    std::vector<uint32_t> previous = Decode(data.trigrams);
+    std::vector<uint32_t> changed;
+    std::set_difference(previous.begin(), previous.end(), trigrams.begin(), trigrams.end(),
+                        std::back_inserter(changed));
+    for (uint32_t trigram : changed) {
+        RemovePosting(trigram, block);
+    }
+    
+    changed.clear();
+    std::set_difference(trigrams.begin(), trigrams.end(), previous.begin(), previous.end(),
+                        std::back_inserter(changed));
+    for (uint32_t trigram : changed) {
+        AddPosting(trigram, block);
+    }
+    
+    m_trigramBytes -= data.trigrams.size();
+    data.trigrams = Encode(trigrams);
+    m_trigramBytes += data.trigrams.size();
+    data.dirty = false;
+}
+
+void TextIndex::DropBlocks(Entry& entry) {
+    for (uint32_t block : entry.blocks) {
+        for (uint32_t trigram : Decode(m_blocks[block].trigrams)) {
+            RemovePosting(trigram, block);
+        }
+        m_trigramBytes -= m_blocks[block].trigrams.size();
+        m_blocks[block] = Block();
+        m_freeBlocks.push_back(block);
+    }
+    entry.blocks.clear();
+    entry.dirty = false;
+}
+
+uint32_t TextIndex::NewBlock(int document, int lines) {
+    uint32_t block;
+    if (!m_freeBlocks.empty()) {
+        block = m_freeBlocks.back();
+        m_freeBlocks.pop_back();
+    } else {
+        block = static_cast<uint32_t>(m_blocks.size());
+        m_blocks.emplace_back();
+    }
+    
+    m_blocks[block] = Block();
+    m_blocks[block].document = document;
+    m_blocks[block].lines = lines;
+    return block;
+}
+
+void TextIndex::AddPosting(uint32_t trigram, uint32_t block) {
+    std::vector<uint32_t>& list = m_postings[trigram];
+    list.insert(std::lower_bound(list.begin(), list.end(), block), block);
+    m_postingCount++;
+}
+
+void TextIndex::RemovePosting(uint32_t trigram, uint32_t block) {
+    auto it = m_postings.find(trigram);
+    if (it == m_postings.end()) {
+        return;
+    }
+    
+    std::vector<uint32_t>& list = it->second;
+    auto position = std::lower_bound(list.begin(), list.end(), block);
+    if (position != list.end() && *position == block) {
+        list.erase(position);
+        m_postingCount--;
+    }
+    if (list.empty()) {
+        m_postings.erase(it);
+    }
+}
+
+size_t TextIndex::MemoryBytes() const {
+    return m_postingCount * sizeof(uint32_t)
+        + m_postings.size() * POSTING_NODE_BYTES
+        + m_trigramBytes
+        + m_blocks.size() * sizeof(Block);
+}
+
+void TextIndex::EnforceLimit() {
+    if (m_memoryLimit == 0) {
+        return;
+    }
+    
+    for (auto it = m_documents.rbegin(); it != m_documents.rend() && MemoryBytes() > m_memoryLimit; ++it) {
+        if (it->second.indexed) {
+            DropBlocks(it->second);
+            it->second.indexed = false;
+        }
+    }
+}
+
+void TextIndex::IndexWaiting() {
+    for (auto& [id, entry] : m_documents) {
+        if (entry.indexed) {
+            continue;
+        }
+        
+        entry.indexed = true;
+        entry.stale = true;
+        Refresh(entry);
+        if (m_memoryLimit > 0 && MemoryBytes() > m_memoryLimit) {
+            DropBlocks(entry);
+            entry.indexed = false;
+            return;
+        }
+    }
+}
+
+bool TextIndex::Verify(int id, const Entry& entry, const SearchPattern& pattern, int startLine, int lineCount,
+                       size_t maxValues, std::vector<int32_t>& out) const {
+    bool open = true;
+    for (int line = startLine; line < startLine + lineCount && open; line++) {
+        pattern.ForEachMatch(entry.document->line(line), [&](int column, int length) {
+            if (out.size() >= maxValues) {
+                open = false;
+                return false;
+            }
+            out.push_back(id);
+            out.push_back(line);
+            out.push_back(column);
+            out.push_back(length);
+            return true;
+        });
+    }
+    return open;
+}
+
+void TextIndex::Search(const SearchPattern& pattern, int limit, std::vector<int32_t>& out) {
+    if (pattern.IsEmpty() || !pattern.IsValid()) {
+        return;
+    }
+    
+    for (auto& [id, entry] : m_documents) {
+        Refresh(entry);
+    }
+    EnforceLimit();
+    
+    std::vector<uint32_t> trigrams;
+    for (const QString& literal : RequiredLiterals(pattern.Pattern(), pattern.Options())) {
+        AppendTrigrams(literal, trigrams);
+    }
+    SortUnique(trigrams);
+    
+    // Shortest posting lists first, so the candidates shrink fastest
+    std::vector<const std::vector<uint32_t>*> lists;
+    bool none = false;
+    for (uint32_t trigram : trigrams) {
+        auto it = m_postings.find(trigram);
+        if (it == m_postings.end()) {
+            none = true;
+            break;
+        }
+        lists.push_back(&it->second);
+    }
+    std::sort(lists.begin(), lists.end(),
+              [](const std::vector<uint32_t>* a, const std::vector<uint32_t>* b) { return a->size() < b->size(); });
+            
+    std::vector<uint32_t> candidates;
+    if (!none && !lists.empty()) {
+        candidates = *lists.front();
+        std::vector<uint32_t> next;
+        for (size_t i = 1; i < lists.size() && !candidates.empty(); i++) {
+            next.clear();
+            std::set_intersection(candidates.begin(), candidates.end(), lists[i]->begin(), lists[i]->end(),
+                                  std::back_inserter(next));
+            candidates.swap(next);
+        }
+    }
+    bool scanAll = trigrams.empty();
+    
+    std::set<int> candidateDocuments;
+    std::vector<bool> isCandidate(scanAll ? 0 : m_blocks.size(), false);
+    for (uint32_t block : candidates) {
+        isCandidate[block] = true;
+        candidateDocuments.insert(m_blocks[block].document);
+    }
+    
+    size_t maxValues = limit > 0 ? static_cast<size_t>(limit) * FIELDS_PER_MATCH : SIZE_MAX;
+    for (const auto& [id, entry] : m_documents) {
+        if (!entry.indexed || scanAll) {
+            if (!Verify(id, entry, pattern, 0, entry.document->lines(), maxValues, out)) {
+                return;
+            }
+            continue;
+        }
+        if (!candidateDocuments.count(id)) {
+            continue;
+        }
+        
+        int start = 0;
+        for (uint32_t block : entry.blocks) {
+            if (isCandidate[block] && !Verify(id, entry, pattern, start, m_blocks[block].lines, maxValues, out)) {
+                return;
+            }
+            start += m_blocks[block].lines;
+        }
+    }
+}
+
+TextIndexStats TextIndex::Stats() const {
+    TextIndexStats stats;
+    stats.documents = static_cast<int>(m_documents.size());
+    for (const auto& [id, entry] : m_documents) {
+        if (entry.indexed) {
+            stats.indexedDocuments++;
+        }
+        stats.blocks += entry.blocks.size();
+    }
+    stats.trigrams = m_postings.size();
+    stats.postings = m_postingCount;
+    stats.memoryBytes = MemoryBytes();
+    stats.memoryLimit = m_memoryLimit;
+    return stats;
+}
+
+QStringList TextIndex::RequiredLiterals(const QString& pattern, const SearchOptions& options) {
+    if (!options.regex) {
+        return pattern.length() >= 3 ? QStringList{pattern} : QStringList();
+    }
+    
+    // Alternatives, quoted sequences and extended syntax, where whitespace isn't literal, are not analyzed
+    if (pattern.contains(QLatin1Char('|')) || pattern.contains(QLatin1String("\\Q"))
+        || pattern.contains(QRegularExpression(QStringLiteral("\\(\\?[a-zA-Z^-]*x")))) {
+        return QStringList();
+    }
+    
+    QStringList literals;
+    QString run;
+    auto flush = [&]() {
+        if (run.length() >= 3) {
+            literals.append(run);
+        }
+        run.clear();
+    };
+    
+    for (int i = 0; i < pattern.length(); ) {
+        QChar c = pattern[i];
+        
+        // Groups and classes end the run; their contents are not analyzed
+        if (c == QLatin1Char('(') || c == QLatin1Char('[')) {
+            flush();
+            i = SkipBracketed(pattern, i);
+            if (i < pattern.length() && IsQuantifier(pattern[i])) {
+                i = SkipQuantifier(pattern, i);
+            }
+            continue;
+        }
+        
+        QChar literal;
+        int next = i + 1;
+        if (c == QLatin1Char('\\')) {
+            if (next >= pattern.length()) {
+                break;
+            }
+            
+            // Letter and digit escapes are classes, anchors or code points: not a known character
+            QChar escaped = pattern[next];
+            if (escaped.isLetterOrNumber()) {
+                flush();
+                i = SkipEscape(pattern, next);
+                continue;
+            }
+            literal = escaped;
+            next++;
+        } else if (IsQuantifier(c)) {
+            flush();
+            i = SkipQuantifier(pattern, i);
+            continue;
+        } else if (c == QLatin1Char('.') || c == QLatin1Char('^') || c == QLatin1Char('$') || c == QLatin1Char(')')) {
+            flush();
+            i = next;
+            continue;
+        } else {
+            literal = c;
+        }
+        
+        // A quantified character may be missing or repeated, so it ends the run
+        if (next < pattern.length() && IsQuantifier(pattern[next])) {
+            if (!AllowsZero(pattern, next)) {
+                run.append(literal);
+            }
+            flush();
+            i = SkipQuantifier(pattern, next);
+            continue;
+        }
+        
+        run.append(literal);
+        i = next;
+    }
+    flush();
+    
+    return literals;
+}
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
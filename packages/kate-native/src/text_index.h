@@ -0,0 +1,148 @@
+#ifndef TEXT_INDEX_H
+#define TEXT_INDEX_H
+
+#ifdef HAVE_KTEXTEDITOR
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "search_pattern.h"
+
+namespace KTextEditor {
+    class Document;
+}
+
+namespace KateNative {
+
+struct TextIndexStats {
+    int documents = 0;
+    int indexedDocuments = 0;
+    size_t blocks = 0;
+    size_t trigrams = 0;
+    size_t postings = 0;
+    size_t memoryBytes = 0;
+    size_t memoryLimit = 0;
+};
+
+/**
+ * Trigram Index over Documents
+ *
+ * Splits every registered document into blocks of about BlockLines lines
+ * and keeps, for each trigram of case-folded UTF-16 code units, the sorted
+ * list of blocks containing it. Each block also keeps its own trigram set,
+ * delta and varint encoded, so an edit only moves the postings of the
+ * trigrams it actually added or removed.
+ *
+ * The index follows its documents' textInserted/textRemoved signals: an
+ * edit only adjusts the line counts of the blocks it touched and marks
+ * them dirty, and dirty blocks are reindexed by the next query. Blocks
+ * grown past twice the target size are split then.
+ *
+ * A query intersects the posting lists of the trigrams every match must
+ * contain (the query itself, or the literal runs a regular expression
+ * requires) and runs the SearchPattern only on the lines of the blocks
+ * left. Queries without such trigrams scan every line.
+ *
+ * Memory is estimated as the index changes. Documents that would take it
+ * past the limit stay registered but unindexed, and are scanned line by
+ * line, until removing others makes room.
+ *
+ * The index lives on the Qt thread and keeps its documents alive.
+ */
+class TextIndex : public QObject {
+public:
+    static constexpr int BlockLines = 64;
+    
+    // 0 means no limit
+    explicit TextIndex(size_t memoryLimit);
+    ~TextIndex();
+    
+    // Register a document; returns its id, the existing one when already registered
+    int Add(std::shared_ptr<KTextEditor::Document> document);
+    bool Remove(int id);
+    
+    // Id of a registered document, or 0
+    int IdOf(KTextEditor::Document* document) const;
+    
+    /**
+     * Append (document id, line, column, length) quadruples, ordered by
+     * document id and position; stops after `limit` matches unless 0
+     */
+    void Search(const SearchPattern& pattern, int limit, std::vector<int32_t>& out);
+    
+    TextIndexStats Stats() const;
+    
+    /**
+     * Literal runs of at least three code units that every match of the
+     * pattern contains; empty when none can be determined
+     */
+    static QStringList RequiredLiterals(const QString& pattern, const SearchOptions& options);
+
+private:
+    struct Block {
+        int document = 0;
+        int lines = 0;
+        bool dirty = true;
+        std::vector<uint8_t> trigrams;
+    };
+    
+    struct Entry {
+        std::shared_ptr<KTextEditor::Document> document;
+        std::vector<uint32_t> blocks;
+        bool indexed = true;
+        
+        // The blocks no longer describe the document and must be rebuilt
+        bool stale = true;
+        
+        // Some block is dirty
+        bool dirty = false;
+    };
+    
+    void OnTextInserted(int id, int line, int added);
+    void OnTextRemoved(int id, int line, int removed);
+    
+    // Bring an indexed document's blocks and postings up to date
+    void Refresh(Entry& entry);
+    void Rebuild(Entry& entry);
+    void Reindex(uint32_t block, int startLine);
+    void DropBlocks(Entry& entry);
+    
+    uint32_t NewBlock(int document, int lines);
+    void AddPosting(uint32_t trigram, uint32_t block);
+    void RemovePosting(uint32_t trigram, uint32_t block);
+    
+    size_t MemoryBytes() const;
+    
+    // Unindex the newest documents while over the limit; index waiting ones that fit
+    void EnforceLimit();
+    void IndexWaiting();
+    
+    // Append the matches in `lineCount` lines from `startLine`; false once the limit is reached
+    bool Verify(int id, const Entry& entry, const SearchPattern& pattern, int startLine, int lineCount,
+                size_t maxValues, std::vector<int32_t>& out) const;
+                
+    size_t m_memoryLimit;
+    int m_nextId = 1;
+    
+    // Registered documents in the order they were added
+    std::map<int, Entry> m_documents;
+    QHash<KTextEditor::Document*, int> m_ids;
+    
+    std::vector<Block> m_blocks;
+    std::vector<uint32_t> m_freeBlocks;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> m_postings;
+    size_t m_postingCount = 0;
+    size_t m_trigramBytes = 0;
+};
+
+} // namespace KateNative
+
+#endif // HAVE_KTEXTEDITOR
+
+#endif // TEXT_INDEX_H
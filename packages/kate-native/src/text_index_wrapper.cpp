@@ -0,0 +1,161 @@
+#include "text_index_wrapper.h"
+#include "document_wrapper.h"
+#include "js_convert.h"
+
+#ifdef HAVE_KTEXTEDITOR
+#include "qt_runner.h"
+#include <QString>
+#include <algorithm>
+#include <vector>
+#include "search_pattern.h"
+#include "text_index.h"
+#endif
+
+namespace KateNative {
+
+Napi::Object TextIndexWrapper::Init(Napi::Env env, Napi::Object exports) {
+    Napi::Function func = DefineClass(env, "KateTextIndex", {
+        InstanceMethod("add", &TextIndexWrapper::Add),
+        InstanceMethod("remove", &TextIndexWrapper::Remove),
+        InstanceMethod("search", &TextIndexWrapper::Search),
+        InstanceMethod("stats", &TextIndexWrapper::GetStats),
+    });
+    
+    exports.Set("KateTextIndex", func);
+    return exports;
+}
+
+TextIndexWrapper::TextIndexWrapper(const Napi::CallbackInfo& info)
+    : Napi::ObjectWrap<TextIndexWrapper>(info) {
+    Napi::Env env = info.Env();
+    
+#ifdef HAVE_KTEXTEDITOR
+    // Parameters: optional options { memoryLimit } in bytes, 0 for no limit
+    size_t memoryLimit = DefaultMemoryLimit;
+    if (info.Length() > 0 && info[0].IsObject()) {
+        Napi::Value limit = info[0].As<Napi::Object>().Get("memoryLimit");
+        if (limit.IsNumber()) {
+            memoryLimit = static_cast<size_t>(std::max(limit.As<Napi::Number>().DoubleValue(), 0.0));
+        }
+    }
+    
+    if (!QtRunner::IsRunning()) {
+        QtRunner::Initialize();
+    }
+    QtRunner::RunSync([&]() { m_index = new TextIndex(memoryLimit); });
+#else
+    Napi::TypeError::New(env,
+        "KTextEditor library not available. Native bindings require Qt5/KF5.")
+        .ThrowAsJavaScriptException();
+#endif
+}
+
+TextIndexWrapper::~TextIndexWrapper() {
+#ifdef HAVE_KTEXTEDITOR
+    // The index holds its documents, which are released on the Qt thread
+    if (m_index) {
+        TextIndex* index = m_index;
+        QtRunner::Post([index]() { delete index; });
+    }
+#endif
+}
+
+Napi::Value TextIndexWrapper::Add(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+#ifdef HAVE_KTEXTEDITOR
+    DocumentWrapper* document = info.Length() > 0 && info[0].IsObject()
+        ? Napi::ObjectWrap<DocumentWrapper>::Unwrap(info[0].As<Napi::Object>()) : nullptr;
+    if (!document || !document->Document()) {
+        Napi::TypeError::New(env, "Expected an initialized document").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    std::shared_ptr<KTextEditor::Document> target = document->Document();
+    int id = 0;
+    QtRunner::RunSync([&]() { id = m_index->Add(target); });
+    return Napi::Number::New(env, id);
+#else
+    return env.Null();
+#endif
+}
+
+Napi::Value TextIndexWrapper::Remove(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+#ifdef HAVE_KTEXTEDITOR
+    // Parameters: document or the id add() returned
+    int id = 0;
+    KTextEditor::Document* target = nullptr;
+    if (info.Length() > 0 && info[0].IsNumber()) {
+        id = info[0].As<Napi::Number>().Int32Value();
+    } else if (info.Length() > 0 && info[0].IsObject()) {
+        DocumentWrapper* document = Napi::ObjectWrap<DocumentWrapper>::Unwrap(info[0].As<Napi::Object>());
+        target = document ? document->Document().get() : nullptr;
+    } else {
+        Napi::TypeError::New(env, "Expected a document or a document id").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    bool removed = false;
+    QtRunner::RunSync([&]() { removed = m_index->Remove(target ? m_index->IdOf(target) : id); });
+    return Napi::Boolean::New(env, removed);
+#else
+    return Napi::Boolean::New(env, false);
+#endif
+}
+
+Napi::Value TextIndexWrapper::Search(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+#ifdef HAVE_KTEXTEDITOR
+    // Parameters: query, optional options (search options plus limit)
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "Expected query as string").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    QString query = QString::fromStdString(info[0].As<Napi::String>().Utf8Value());
+    SearchOptions options = ParseSearchOptions(info, 1);
+    int limit = DefaultLimit;
+    if (info.Length() > 1 && info[1].IsObject()) {
+        Napi::Value value = info[1].As<Napi::Object>().Get("limit");
+        if (value.IsNumber()) {
+            limit = std::max(value.As<Napi::Number>().Int32Value(), 0);
+        }
+    }
+    
+    // An invalid pattern matches nothing, as in KateDocument.search()
+    std::vector<int32_t> matches;
+    QtRunner::RunSync([&]() {
+        SearchPattern pattern(query, options);
+        m_index->Search(pattern, limit, matches);
+    });
+    
+    return Int32ArrayToJs(env, matches);
+#else
+    return Napi::Int32Array::New(env, 0);
+#endif
+}
+
+Napi::Value TextIndexWrapper::GetStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Object result = Napi::Object::New(env);
+    
+#ifdef HAVE_KTEXTEDITOR
+    TextIndexStats stats;
+    QtRunner::RunSync([&]() { stats = m_index->Stats(); });
+    
+    result.Set("documents", Napi::Number::New(env, stats.documents));
+    result.Set("indexedDocuments", Napi::Number::New(env, stats.indexedDocuments));
+    result.Set("blocks", Napi::Number::New(env, static_cast<double>(stats.blocks)));
+    result.Set("trigrams", Napi::Number::New(env, static_cast<double>(stats.trigrams)));
+    result.Set("postings", Napi::Number::New(env, static_cast<double>(stats.postings)));
+    result.Set("memoryBytes", Napi::Number::New(env, static_cast<double>(stats.memoryBytes)));
+    result.Set("memoryLimit", Napi::Number::New(env, static_cast<double>(stats.memoryLimit)));
+#endif
+    
+    return result;
+}
+
+} // namespace KateNative
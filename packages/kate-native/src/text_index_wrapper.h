@@ -0,0 +1,40 @@
+#ifndef TEXT_INDEX_WRAPPER_H
+#define TEXT_INDEX_WRAPPER_H
+
+#include <napi.h>
+#include <cstddef>
+
+namespace KateNative {
+
+class TextIndex;
+
+/**
+ * JavaScript wrapper for a trigram index over several documents
+ *
+ * Documents are added once and the index follows their edits. search()
+ * returns Int32Array quadruples (document id, line, column, length),
+ * where the id is the one add() returned.
+ */
+class TextIndexWrapper : public Napi::ObjectWrap<TextIndexWrapper> {
+public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports);
+    
+    TextIndexWrapper(const Napi::CallbackInfo& info);
+    ~TextIndexWrapper();
+    
+    Napi::Value Add(const Napi::CallbackInfo& info);
+    Napi::Value Remove(const Napi::CallbackInfo& info);
+    Napi::Value Search(const Napi::CallbackInfo& info);
+    Napi::Value GetStats(const Napi::CallbackInfo& info);
+
+private:
+    static constexpr int DefaultLimit = 10000;
+    static constexpr size_t DefaultMemoryLimit = 256 * 1024 * 1024;
+    
+    // Owned, only touched on the Qt thread
+    TextIndex* m_index = nullptr;
+};
+
+} // namespace KateNative
+
+#endif // TEXT_INDEX_WRAPPER_H
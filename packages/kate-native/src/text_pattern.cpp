@@ -0,0 +1,170 @@
+#include "text_pattern.h"
+#include <algorithm>
+#include <cwctype>
+#include <vector>
+
+namespace KateNative {
+
+namespace {
+
+bool IsHighSurrogate(char16_t unit) {
+    return unit >= 0xD800 && unit < 0xDC00;
+}
+
+bool IsLowSurrogate(char16_t unit) {
+    return unit >= 0xDC00 && unit < 0xE000;
+}
+
+char16_t FoldCase(char16_t unit) {
+    if (unit < 0x80) {
+        return unit >= u'A' && unit <= u'Z' ? static_cast<char16_t>(unit + (u'a' - u'A')) : unit;
+    }
+    if (IsHighSurrogate(unit) || IsLowSurrogate(unit)) {
+        return unit;
+    }
+    wint_t folded = std::towlower(static_cast<wint_t>(unit));
+    return folded <= 0xFFFF ? static_cast<char16_t>(folded) : unit;
+}
+
+std::u16string FoldCase(const std::u16string& text) {
+    std::u16string folded(text);
+    for (char16_t& unit : folded) {
+        unit = FoldCase(unit);
+    }
+    return folded;
+}
+
+bool IsWordCharacter(char16_t unit) {
+    if (unit < 0x80) {
+        return (unit >= u'a' && unit <= u'z') || (unit >= u'A' && unit <= u'Z') || (unit >= u'0' && unit <= u'9');
+    }
+    return !std::iswspace(static_cast<wint_t>(unit)) && !std::iswpunct(static_cast<wint_t>(unit));
+}
+
+} // namespace
+
+TextPattern::TextPattern(std::u16string pattern, const SearchOptions& options)
+    : m_pattern(std::move(pattern))
+    , m_options(options)
+{
+    if (!m_options.regex) {
+        m_needle = m_options.caseSensitive ? m_pattern : FoldCase(m_pattern);
+        return;
+    }
+
+    std::u16string source = m_options.wholeWords ? u"\\b(?:" + m_pattern + u")\\b" : m_pattern;
+    m_regex.Compile(source, m_options.caseSensitive, m_error);
+}
+
+bool TextPattern::IsWholeWord(const std::u16string& line, size_t column, size_t length) const {
+    bool isWordStart = column == 0 || !IsWordCharacter(line[column - 1]);
+    bool isWordEnd = column + length >= line.size() || !IsWordCharacter(line[column + length]);
+    return isWordStart && isWordEnd;
+}
+
+bool TextPattern::Narrows(const TextPattern& previous) const {
+    // Word boundaries and regular expressions don't nest like substrings do
+    if (m_options.regex || m_options.wholeWords || previous.IsEmpty() || !(m_options == previous.m_options)) {
+        return false;
+    }
+    
+    // Both needles are folded the same way
+    return m_needle.find(previous.m_needle) != std::u16string::npos;
+}
+
+bool TextPattern::Find(const std::u16string& line, int from, int& column, int& length) const {
+    bool found = false;
+    if (from < 0 || static_cast<size_t>(from) > line.size()) {
+        return false;
+    }
+    
+    Scan(line, static_cast<size_t>(from), nullptr, [&](int matchColumn, int matchLength, std::u16string) {
+        column = matchColumn;
+        length = matchLength;
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+void TextPattern::ForEachMatch(const std::u16string& line, const Visitor& visit) const {
+    Scan(line, 0, nullptr, [&visit](int column, int length, std::u16string) { return visit(column, length); });
+}
+
+void TextPattern::ForEachReplacement(const std::u16string& line, const std::u16string& replacement,
+                                     const ReplacementVisitor& visit) const {
+    Scan(line, 0, &replacement, visit);
+}
+
+void TextPattern::Scan(const std::u16string& line, size_t from, const std::u16string* replacement,
+                       const ReplacementVisitor& visit) const {
+    if (IsEmpty() || !IsValid()) {
+        return;
+    }
+    if (m_options.regex) {
+        ScanRegex(line, from, replacement, visit);
+        return;
+    }
+
+    std::u16string folded;
+    const std::u16string& haystack = m_options.caseSensitive ? line : (folded = FoldCase(line));
+    size_t length = m_needle.size();
+    for (size_t column = haystack.find(m_needle, from); column != std::u16string::npos; ) {
+        if (m_options.wholeWords && !IsWholeWord(line, column, length)) {
+            column = haystack.find(m_needle, column + 1);
+            continue;
+        }
+        if (!visit(static_cast<int>(column), static_cast<int>(length), replacement ? *replacement : std::u16string())) {
+            return;
+        }
+        column = haystack.find(m_needle, column + length);
+    }
+}
+
+void TextPattern::ScanRegex(const std::u16string& line, size_t from, const std::u16string* replacement,
+                            const ReplacementVisitor& visit) const {
+    std::vector<int> captures;
+    for (size_t position = from; position <= line.size() && m_regex.Search(line, position, captures); ) {
+        int column = captures[0];
+        int length = captures[1] - captures[0];
+
+        std::u16string expanded;
+        if (replacement) {
+            for (size_t i = 0; i < replacement->size(); i++) {
+                char16_t unit = (*replacement)[i];
+                if (unit != u'\\' || i + 1 == replacement->size()) {
+                    expanded.push_back(unit);
+                    continue;
+                }
+
+                char16_t escaped = (*replacement)[++i];
+                if (escaped >= u'0' && escaped <= u'9') {
+                    size_t group = static_cast<size_t>(escaped - u'0');
+                    if (group * 2 + 1 < captures.size() && captures[group * 2] >= 0) {
+                        expanded.append(line, static_cast<size_t>(captures[group * 2]),
+                                        static_cast<size_t>(captures[group * 2 + 1] - captures[group * 2]));
+                    }
+                } else if (escaped == u'n') {
+                    expanded.push_back(u'\n');
+                } else if (escaped == u't') {
+                    expanded.push_back(u'\t');
+                } else {
+                    expanded.push_back(escaped);
+                }
+            }
+        }
+
+        if (!visit(column, length, std::move(expanded))) {
+            return;
+        }
+        
+        // After an empty match the next one starts a character later, as in JavaScript
+        position = static_cast<size_t>(captures[1]);
+        if (length == 0) {
+            bool isPair = position + 1 < line.size() && IsHighSurrogate(line[position]) && IsLowSurrogate(line[position + 1]);
+            position += isPair ? 2 : 1;
+        }
+    }
+}
+
+} // namespace KateNative
@@ -0,0 +1,82 @@
+#ifndef TEXT_PATTERN_H
+#define TEXT_PATTERN_H
+
+#include "search_pattern.h"
+#include "text_regex.h"
+#include <functional>
+#include <string>
+
+namespace KateNative {
+
+struct TextMatch {
+    int line;
+    int column;
+    int length;
+    std::u16string text;
+};
+
+/**
+ * Qt-free Search Pattern
+ *
+ * SearchPattern for builds without Qt, matching UTF-16 lines. Plain text
+ * is searched for directly, in lowercased copies of the lines when case
+ * doesn't matter. Regular expressions are a TextRegex, which takes the
+ * common subset of the PCRE syntax that QRegularExpression takes, minus
+ * backreferences and lookaround, and matches in time linear in the line.
+ *
+ * Case folding uses the C library's towlower() per UTF-16 code unit, so
+ * characters outside the BMP only match themselves. For whole words,
+ * every character the C library doesn't call a space or punctuation is
+ * part of a word.
+ */
+class TextPattern {
+public:
+    using Visitor = std::function<bool(int column, int length)>;
+    using ReplacementVisitor = std::function<bool(int column, int length, std::u16string replacement)>;
+
+    TextPattern(std::u16string pattern, const SearchOptions& options);
+
+    bool IsEmpty() const { return m_pattern.empty(); }
+    bool IsValid() const { return m_error.empty(); }
+    const std::string& ErrorString() const { return m_error; }
+    const std::u16string& Pattern() const { return m_pattern; }
+    const SearchOptions& Options() const { return m_options; }
+    
+    // As SearchPattern::Narrows()
+    bool Narrows(const TextPattern& previous) const;
+
+    // The first match in `line` starting at or after `from`; false when there is none
+    bool Find(const std::u16string& line, int from, int& column, int& length) const;
+    
+    // Call visit(column, length) for every non-overlapping match in `line`; stops when it returns false
+    void ForEachMatch(const std::u16string& line, const Visitor& visit) const;
+
+    /**
+     * Like ForEachMatch(), with `replacement` expanded for each match: for
+     * regular expressions, \0 to \9 insert capture groups and \n, \t and
+     * \\ a newline, a tab and a backslash, as SearchPattern::Substitute()
+     */
+    void ForEachReplacement(const std::u16string& line, const std::u16string& replacement,
+                            const ReplacementVisitor& visit) const;
+
+private:
+    // Matches starting at or after `from`
+    void Scan(const std::u16string& line, size_t from, const std::u16string* replacement,
+              const ReplacementVisitor& visit) const;
+    void ScanRegex(const std::u16string& line, size_t from, const std::u16string* replacement,
+                   const ReplacementVisitor& visit) const;
+    bool IsWholeWord(const std::u16string& line, size_t column, size_t length) const;
+
+    std::u16string m_pattern;
+    SearchOptions m_options;
+    std::string m_error;
+
+    // Plain text: the pattern as searched for, lowercased unless case matters
+    std::u16string m_needle;
+
+    TextRegex m_regex;
+};
+
+} // namespace KateNative
+
+#endif // TEXT_PATTERN_H
@@ -0,0 +1,934 @@
+#include "text_regex.h"
+#include <algorithm>
+#include <cwctype>
+
+namespace KateNative {
+
+namespace {
+
+constexpr uint32_t MaxCodePoint = 0x10FFFF;
+
+// Groups may nest this deep; parsing and compiling recurse once per level
+constexpr int MaxNesting = 256;
+
+// Bounds of counted repetition, before the instruction limit applies
+constexpr int MaxRepeat = 1000;
+
+bool IsHighSurrogate(char16_t unit) {
+    return unit >= 0xD800 && unit < 0xDC00;
+}
+
+bool IsLowSurrogate(char16_t unit) {
+    return unit >= 0xDC00 && unit < 0xE000;
+}
+
+// The code point at `position` and how many units it takes
+uint32_t Decode(const std::u16string& text, size_t position, size_t& width) {
+    char16_t unit = text[position];
+    if (IsHighSurrogate(unit) && position + 1 < text.size() && IsLowSurrogate(text[position + 1])) {
+        width = 2;
+        return 0x10000 + ((static_cast<uint32_t>(unit) - 0xD800) << 10) + (text[position + 1] - 0xDC00);
+    }
+    width = 1;
+    return unit;
+}
+
+uint32_t FoldCase(uint32_t character) {
+    if (character < 0x80) {
+        return character >= 'A' && character <= 'Z' ? character + ('a' - 'A') : character;
+    }
+    if (character > 0xFFFF || (character >= 0xD800 && character < 0xE000)) {
+        return character;
+    }
+    wint_t folded = std::towlower(static_cast<wint_t>(character));
+    return folded <= 0xFFFF ? static_cast<uint32_t>(folded) : character;
+}
+
+uint32_t UpperCase(uint32_t character) {
+    if (character < 0x80) {
+        return character >= 'a' && character <= 'z' ? character - ('a' - 'A') : character;
+    }
+    if (character > 0xFFFF || (character >= 0xD800 && character < 0xE000)) {
+        return character;
+    }
+    wint_t upper = std::towupper(static_cast<wint_t>(character));
+    return upper <= 0xFFFF ? static_cast<uint32_t>(upper) : character;
+}
+
+bool IsDigit(uint32_t character) {
+    return character >= '0' && character <= '9';
+}
+
+bool IsWordCharacter(uint32_t character) {
+    return IsDigit(character) || character == '_'
+        || (character >= 'a' && character <= 'z') || (character >= 'A' && character <= 'Z');
+}
+
+bool IsSpace(uint32_t character) {
+    if (character < 0x80) {
+        return character == ' ' || (character >= '\t' && character <= '\r');
+    }
+    return character == 0xA0 || character == 0xFEFF || character == 0x2028 || character == 0x2029
+        || (character <= 0xFFFF && std::iswspace(static_cast<wint_t>(character)));
+}
+
+bool IsLineBreak(uint32_t character) {
+    return character == '\n' || character == '\r' || character == 0x2028 || character == 0x2029;
+}
+
+bool MatchesShorthand(char shorthand, uint32_t character) {
+    switch (shorthand) {
+    case 'd': return IsDigit(character);
+    case 'D': return !IsDigit(character);
+    case 'w': return IsWordCharacter(character);
+    case 'W': return !IsWordCharacter(character);
+    case 's': return IsSpace(character);
+    case 'S': return !IsSpace(character);
+    }
+    return false;
+}
+
+bool IsWordBefore(const std::u16string& text, size_t position) {
+    if (position == 0) {
+        return false;
+    }
+    // Word characters are ASCII, so the unit before is enough
+    return IsWordCharacter(text[position - 1]);
+}
+
+bool IsWordAt(const std::u16string& text, size_t position) {
+    return position < text.size() && IsWordCharacter(text[position]);
+}
+
+int HexValue(uint32_t character) {
+    if (IsDigit(character)) {
+        return static_cast<int>(character - '0');
+    }
+    if (character >= 'a' && character <= 'f') {
+        return static_cast<int>(character - 'a' + 10);
+    }
+    if (character >= 'A' && character <= 'F') {
+        return static_cast<int>(character - 'A' + 10);
+    }
+    return -1;
+}
+
+} // namespace
+
+/**
+ * Parses a pattern into a tree of nodes, then compiles the tree into the
+ * program of a TextRegex. Counted repetition compiles its operand once
+ * per repetition, which is why the tree is kept.
+ */
+class TextRegexCompiler {
+public:
+    TextRegexCompiler(const std::u16string& pattern, TextRegex& regex)
+        : m_regex(regex)
+    {
+        for (size_t i = 0; i < pattern.size(); ) {
+            size_t width = 1;
+            m_pattern.push_back(Decode(pattern, i, width));
+            i += width;
+        }
+    }
+
+    bool Compile(std::string& error) {
+        int root = ParseAlternation(0);
+        if (m_error.empty() && m_position < m_pattern.size()) {
+            m_error = "Unmatched closing parenthesis";
+        }
+        if (m_error.empty()) {
+            Emit({TextRegex::Op::Save, 0, 0, 0});
+            CompileNode(root, 0);
+            Emit({TextRegex::Op::Save, 0, 1, 0});
+            Emit({TextRegex::Op::Match, 0, 0, 0});
+        }
+        if (!m_error.empty()) {
+            error = m_error;
+            return false;
+        }
+        // Loops keep where their iteration started in slots after the groups'
+        int firstHidden = (m_groups + 1) * 2;
+        for (TextRegex::Instruction& instruction : m_regex.m_program) {
+            if ((instruction.op == TextRegex::Op::Save || instruction.op == TextRegex::Op::EmptyCheck) && instruction.x < 0) {
+                instruction.x = firstHidden - 1 - instruction.x;
+            }
+        }
+        m_regex.m_groups = m_groups;
+        m_regex.m_slots = firstHidden + m_hiddenSlots;
+        return true;
+    }
+
+private:
+    enum class Kind {
+        Empty,
+        Char,
+        Any,
+        Class,
+        LineStart,
+        LineEnd,
+        WordBoundary,
+        NotWordBoundary,
+        Concat,
+        Alternation,
+        Repeat,
+        Group
+    };
+
+    struct Node {
+        explicit Node(Kind kind) : kind(kind) {}
+
+        Kind kind;
+        uint32_t character = 0;
+        int index = 0;          // Class: class index; Group: capture group, or -1
+        int min = 0;            // Repeat
+        int max = 0;            // Repeat; -1 for no limit
+        bool greedy = true;     // Repeat
+        std::vector<int> children;
+    };
+
+    bool AtEnd() const { return m_position >= m_pattern.size(); }
+    uint32_t Peek() const { return m_pattern[m_position]; }
+
+    bool Fail(const char* message) {
+        if (m_error.empty()) {
+            m_error = message;
+        }
+        return false;
+    }
+
+    int AddNode(Node node) {
+        m_nodes.push_back(std::move(node));
+        return static_cast<int>(m_nodes.size()) - 1;
+    }
+
+    int ParseAlternation(int depth) {
+        if (depth > MaxNesting) {
+            Fail("The pattern is nested too deeply");
+            return AddNode(Node(Kind::Empty));
+        }
+
+        Node alternation(Kind::Alternation);
+        alternation.children.push_back(ParseConcat(depth));
+        while (m_error.empty() && !AtEnd() && Peek() == '|') {
+            m_position++;
+            alternation.children.push_back(ParseConcat(depth));
+        }
+        if (alternation.children.size() == 1) {
+            return alternation.children[0];
+        }
+        return AddNode(std::move(alternation));
+    }
+
+    int ParseConcat(int depth) {
+        Node concat(Kind::Concat);
+        while (m_error.empty() && !AtEnd() && Peek() != '|' && Peek() != ')') {
+            int atom = ParseAtom(depth);
+            if (!m_error.empty()) {
+                break;
+            }
+            concat.children.push_back(ParseQuantifier(atom));
+        }
+        return AddNode(std::move(concat));
+    }
+
+    // Whether a counted quantifier starts here; a '{' that doesn't start one is a literal
+    bool ParseBraces(int& min, int& max) {
+        size_t position = m_position + 1;
+        auto number = [&](int& value) {
+            size_t start = position;
+            value = 0;
+            while (position < m_pattern.size() && IsDigit(m_pattern[position])) {
+                value = std::min(value * 10 + static_cast<int>(m_pattern[position] - '0'), MaxRepeat + 1);
+                position++;
+            }
+            return position > start;
+        };
+
+        if (!number(min)) {
+            return false;
+        }
+        max = min;
+        if (position < m_pattern.size() && m_pattern[position] == ',') {
+            position++;
+            if (!number(max)) {
+                max = -1;
+            }
+        }
+        if (position >= m_pattern.size() || m_pattern[position] != '}') {
+            return false;
+        }
+        m_position = position + 1;
+        return true;
+    }
+
+    bool StartsBraces() {
+        size_t position = m_position;
+        int min = 0;
+        int max = 0;
+        bool found = Peek() == '{' && ParseBraces(min, max);
+        m_position = position;
+        return found;
+    }
+
+    int ParseQuantifier(int atom) {
+        if (AtEnd()) {
+            return atom;
+        }
+
+        int min = 0;
+        int max = -1;
+        uint32_t next = Peek();
+        if (next == '*') {
+            m_position++;
+        } else if (next == '+') {
+            min = 1;
+            m_position++;
+        } else if (next == '?') {
+            max = 1;
+            m_position++;
+        } else if (next != '{' || !ParseBraces(min, max)) {
+            return atom;
+        }
+
+        if (min > MaxRepeat || max > MaxRepeat) {
+            Fail("A repetition count is too large");
+            return atom;
+        }
+        if (max >= 0 && max < min) {
+            Fail("Numbers out of order in a {} quantifier");
+            return atom;
+        }
+        Kind kind = m_nodes[static_cast<size_t>(atom)].kind;
+        if (kind == Kind::LineStart || kind == Kind::LineEnd || kind == Kind::WordBoundary || kind == Kind::NotWordBoundary) {
+            Fail("Nothing to repeat");
+            return atom;
+        }
+
+        Node repeat(Kind::Repeat);
+        repeat.min = min;
+        repeat.max = max;
+        repeat.children.push_back(atom);
+        if (!AtEnd() && Peek() == '?') {
+            repeat.greedy = false;
+            m_position++;
+        } else if (!AtEnd() && Peek() == '+') {
+            Fail("Possessive quantifiers are not supported");
+        }
+        if (!AtEnd() && (Peek() == '*' || Peek() == '+' || Peek() == '?' || StartsBraces())) {
+            Fail("Nothing to repeat");
+        }
+        return AddNode(std::move(repeat));
+    }
+
+    int ParseAtom(int depth) {
+        uint32_t character = Peek();
+        m_position++;
+        switch (character) {
+        case '(':
+            return ParseGroup(depth);
+        case '[':
+            return ParseClass();
+        case '.':
+            return AddNode(Node(Kind::Any));
+        case '^':
+            return AddNode(Node(Kind::LineStart));
+        case '$':
+            return AddNode(Node(Kind::LineEnd));
+        case '*':
+        case '+':
+        case '?':
+            Fail("Nothing to repeat");
+            return AddNode(Node(Kind::Empty));
+        case '{':
+            m_position--;
+            if (StartsBraces()) {
+                Fail("Nothing to repeat");
+            }
+            m_position++;
+            return CharNode('{');
+        case '\\':
+            return ParseEscape();
+        }
+        return CharNode(character);
+    }
+
+    int CharNode(uint32_t character) {
+        Node node(Kind::Char);
+        node.character = m_regex.m_caseSensitive ? character : FoldCase(character);
+        return AddNode(std::move(node));
+    }
+
+    int ParseGroup(int depth) {
+        int group = -1;
+        if (!AtEnd() && Peek() == '?') {
+            m_position++;
+            uint32_t kind = AtEnd() ? 0 : Peek();
+            if (kind == ':') {
+                m_position++;
+            } else if (kind == '=' || kind == '!') {
+                Fail("Lookahead is not supported");
+            } else if (kind == '<' || kind == 'P') {
+                if (kind == 'P') {
+                    m_position++;
+                }
+                if (AtEnd() || Peek() != '<') {
+                    Fail("Unsupported group syntax");
+                } else if (m_position + 1 < m_pattern.size() && (m_pattern[m_position + 1] == '=' || m_pattern[m_position + 1] == '!')) {
+                    Fail("Lookbehind is not supported");
+                } else {
+                    // Named groups are numbered like the others; the name isn't kept
+                    while (!AtEnd() && Peek() != '>') {
+                        m_position++;
+                    }
+                    if (AtEnd()) {
+                        Fail("Unterminated group name");
+                    } else {
+                        m_position++;
+                        group = ++m_groups;
+                    }
+                }
+            } else {
+                Fail("Unsupported group syntax");
+            }
+        } else {
+            group = ++m_groups;
+        }
+        if (!m_error.empty()) {
+            return AddNode(Node(Kind::Empty));
+        }
+
+        Node node(Kind::Group);
+        node.index = group;
+        node.children.push_back(ParseAlternation(depth + 1));
+        if (m_error.empty()) {
+            if (AtEnd()) {
+                Fail("Missing closing parenthesis");
+            } else {
+                m_position++;
+            }
+        }
+        return AddNode(std::move(node));
+    }
+
+    /**
+     * An escape in a pattern or a class: the character it stands for, or
+     * 0 with `shorthand` set for \d \w \s and their negations. Sets
+     * `assertion` for \b and \B outside classes.
+     */
+    uint32_t ParseEscapeCharacter(bool inClass, char& shorthand, char& assertion) {
+        shorthand = 0;
+        assertion = 0;
+        if (AtEnd()) {
+            Fail("The pattern ends with a backslash");
+            return 0;
+        }
+
+        uint32_t character = Peek();
+        m_position++;
+        switch (character) {
+        case 'd': case 'D': case 'w': case 'W': case 's': case 'S':
+            shorthand = static_cast<char>(character);
+            return 0;
+        case 'b':
+            if (inClass) {
+                return 0x08;
+            }
+            assertion = 'b';
+            return 0;
+        case 'B':
+            if (inClass) {
+                Fail("\\B is not allowed in a class");
+                return 0;
+            }
+            assertion = 'B';
+            return 0;
+        case 't': return '\t';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 'f': return '\f';
+        case 'v': return '\v';
+        case 'a': return 0x07;
+        case 'e': return 0x1B;
+        case '0':
+            if (!AtEnd() && IsDigit(Peek())) {
+                Fail("Octal escapes are not supported");
+            }
+            return 0;
+        case 'c':
+            if (!AtEnd() && ((Peek() >= 'a' && Peek() <= 'z') || (Peek() >= 'A' && Peek() <= 'Z'))) {
+                return m_pattern[m_position++] % 32;
+            }
+            Fail("\\c must be followed by a letter");
+            return 0;
+        case 'x':
+        case 'u':
+            return ParseHexEscape(character == 'x' ? 2 : 4);
+        }
+
+        if (IsDigit(character)) {
+            Fail("Backreferences are not supported");
+            return 0;
+        }
+        if ((character >= 'a' && character <= 'z') || (character >= 'A' && character <= 'Z')) {
+            Fail("Unsupported escape sequence");
+            return 0;
+        }
+        return character;
+    }
+
+    // \xHH, \uHHHH, or either with {H...}
+    uint32_t ParseHexEscape(int digits) {
+        uint32_t value = 0;
+        if (!AtEnd() && Peek() == '{') {
+            m_position++;
+            int count = 0;
+            while (!AtEnd() && HexValue(Peek()) >= 0) {
+                value = value * 16 + static_cast<uint32_t>(HexValue(Peek()));
+                if (value > MaxCodePoint) {
+                    Fail("A character code is too large");
+                    return 0;
+                }
+                m_position++;
+                count++;
+            }
+            if (count == 0 || AtEnd() || Peek() != '}') {
+                Fail("Malformed hexadecimal escape");
+                return 0;
+            }
+            m_position++;
+            return value;
+        }
+
+        for (int i = 0; i < digits; i++) {
+            if (AtEnd() || HexValue(Peek()) < 0) {
+                Fail("Malformed hexadecimal escape");
+                return 0;
+            }
+            value = value * 16 + static_cast<uint32_t>(HexValue(Peek()));
+            m_position++;
+        }
+        return value;
+    }
+
+    int ParseEscape() {
+        char shorthand = 0;
+        char assertion = 0;
+        uint32_t character = ParseEscapeCharacter(false, shorthand, assertion);
+        if (assertion == 'b') {
+            return AddNode(Node(Kind::WordBoundary));
+        }
+        if (assertion == 'B') {
+            return AddNode(Node(Kind::NotWordBoundary));
+        }
+        if (shorthand) {
+            TextRegex::CharacterClass set;
+            set.shorthands.push_back(shorthand);
+            return ClassNode(std::move(set));
+        }
+        return CharNode(character);
+    }
+
+    int ClassNode(TextRegex::CharacterClass set) {
+        m_regex.m_classes.push_back(std::move(set));
+        Node node(Kind::Class);
+        node.index = static_cast<int>(m_regex.m_classes.size()) - 1;
+        return AddNode(std::move(node));
+    }
+
+    // A character of a class, or 0 with `shorthand` set
+    uint32_t ParseClassCharacter(char& shorthand) {
+        shorthand = 0;
+        uint32_t character = Peek();
+        m_position++;
+        if (character != '\\') {
+            return character;
+        }
+        char assertion = 0;
+        return ParseEscapeCharacter(true, shorthand, assertion);
+    }
+
+    int ParseClass() {
+        TextRegex::CharacterClass set;
+        if (!AtEnd() && Peek() == '^') {
+            set.negated = true;
+            m_position++;
+        }
+
+        // As in PCRE, a ']' right at the start is a literal
+        bool first = true;
+        while (m_error.empty()) {
+            if (AtEnd()) {
+                Fail("Missing terminating ] for a character class");
+                break;
+            }
+            if (Peek() == ']' && !first) {
+                m_position++;
+                break;
+            }
+            first = false;
+
+            char shorthand = 0;
+            uint32_t low = ParseClassCharacter(shorthand);
+            if (shorthand) {
+                set.shorthands.push_back(shorthand);
+                continue;
+            }
+            if (m_position + 1 < m_pattern.size() && Peek() == '-' && m_pattern[m_position + 1] != ']') {
+                m_position++;
+                uint32_t high = ParseClassCharacter(shorthand);
+                if (shorthand) {
+                    // A range can't end in a class, so both sides stand for themselves
+                    set.ranges.push_back({low, low});
+                    set.ranges.push_back({'-', '-'});
+                    set.shorthands.push_back(shorthand);
+                    continue;
+                }
+                if (high < low) {
+                    Fail("Range out of order in a character class");
+                    break;
+                }
+                set.ranges.push_back({low, high});
+            } else {
+                set.ranges.push_back({low, low});
+            }
+        }
+        return ClassNode(std::move(set));
+    }
+
+    int Emit(TextRegex::Instruction instruction) {
+        if (m_regex.m_program.size() >= TextRegex::MaxInstructions) {
+            Fail("The pattern is too large");
+            return static_cast<int>(m_regex.m_program.size()) - 1;
+        }
+        m_regex.m_program.push_back(instruction);
+        return static_cast<int>(m_regex.m_program.size()) - 1;
+    }
+
+    int Here() const { return static_cast<int>(m_regex.m_program.size()); }
+
+    void CompileNode(int index, int depth) {
+        if (!m_error.empty()) {
+            return;
+        }
+        const Node& node = m_nodes[static_cast<size_t>(index)];
+        switch (node.kind) {
+        case Kind::Empty:
+            break;
+        case Kind::Char:
+            Emit({TextRegex::Op::Char, node.character, 0, 0});
+            break;
+        case Kind::Any:
+            Emit({TextRegex::Op::Any, 0, 0, 0});
+            break;
+        case Kind::Class:
+            Emit({TextRegex::Op::Class, 0, node.index, 0});
+            break;
+        case Kind::LineStart:
+            Emit({TextRegex::Op::LineStart, 0, 0, 0});
+            break;
+        case Kind::LineEnd:
+            Emit({TextRegex::Op::LineEnd, 0, 0, 0});
+            break;
+        case Kind::WordBoundary:
+            Emit({TextRegex::Op::WordBoundary, 0, 0, 0});
+            break;
+        case Kind::NotWordBoundary:
+            Emit({TextRegex::Op::NotWordBoundary, 0, 0, 0});
+            break;
+        case Kind::Concat:
+            for (int child : node.children) {
+                CompileNode(child, depth + 1);
+            }
+            break;
+        case Kind::Alternation:
+            CompileAlternation(node, depth);
+            break;
+        case Kind::Group:
+            if (node.index >= 0) {
+                Emit({TextRegex::Op::Save, 0, node.index * 2, 0});
+            }
+            CompileNode(node.children[0], depth + 1);
+            if (node.index >= 0) {
+                Emit({TextRegex::Op::Save, 0, node.index * 2 + 1, 0});
+            }
+            break;
+        case Kind::Repeat:
+            CompileRepeat(node, depth);
+            break;
+        }
+    }
+
+    // Each alternative but the last is tried first: split, alternative, jump to the end
+    void CompileAlternation(const Node& node, int depth) {
+        std::vector<int> jumps;
+        for (size_t i = 0; i < node.children.size(); i++) {
+            if (i + 1 == node.children.size()) {
+                CompileNode(node.children[i], depth + 1);
+                break;
+            }
+            int split = Emit({TextRegex::Op::Split, 0, 0, 0});
+            CompileNode(node.children[i], depth + 1);
+            jumps.push_back(Emit({TextRegex::Op::Jump, 0, 0, 0}));
+            if (!m_error.empty()) {
+                return;
+            }
+            m_regex.m_program[static_cast<size_t>(split)].x = split + 1;
+            m_regex.m_program[static_cast<size_t>(split)].y = Here();
+        }
+        for (int jump : jumps) {
+            m_regex.m_program[static_cast<size_t>(jump)].x = Here();
+        }
+    }
+
+    // A split that prefers `taken` when greedy and the other way round when lazy
+    void PatchSplit(int split, int taken, int skipped, bool greedy) {
+        TextRegex::Instruction& instruction = m_regex.m_program[static_cast<size_t>(split)];
+        instruction.x = greedy ? taken : skipped;
+        instruction.y = greedy ? skipped : taken;
+    }
+
+    void CompileRepeat(const Node& node, int depth) {
+        int child = node.children[0];
+        for (int i = 0; i < node.min && m_error.empty(); i++) {
+            CompileNode(child, depth + 1);
+        }
+
+        if (node.max < 0) {
+            // L: split body, end; save where the iteration starts; body; leave
+            // if it matched nothing, as PCRE does; jump L
+            int slot = m_hiddenSlots++;
+            int loop = Emit({TextRegex::Op::Split, 0, 0, 0});
+            Emit({TextRegex::Op::Save, 0, -1 - slot, 0});
+            CompileNode(child, depth + 1);
+            int check = Emit({TextRegex::Op::EmptyCheck, 0, -1 - slot, 0});
+            Emit({TextRegex::Op::Jump, 0, loop, 0});
+            if (m_error.empty()) {
+                PatchSplit(loop, loop + 1, Here(), node.greedy);
+                m_regex.m_program[static_cast<size_t>(check)].y = Here();
+            }
+            return;
+        }
+
+        // Every optional repetition can skip to the end
+        std::vector<int> splits;
+        for (int i = node.min; i < node.max && m_error.empty(); i++) {
+            splits.push_back(Emit({TextRegex::Op::Split, 0, 0, 0}));
+            CompileNode(child, depth + 1);
+        }
+        if (m_error.empty()) {
+            for (int split : splits) {
+                PatchSplit(split, split + 1, Here(), node.greedy);
+            }
+        }
+    }
+
+    TextRegex& m_regex;
+    std::vector<uint32_t> m_pattern;
+    size_t m_position = 0;
+    std::vector<Node> m_nodes;
+    int m_groups = 0;
+    int m_hiddenSlots = 0;
+    std::string m_error;
+};
+
+bool TextRegex::Compile(const std::u16string& pattern, bool caseSensitive, std::string& error) {
+    m_program.clear();
+    m_classes.clear();
+    m_groups = 0;
+    m_slots = 2;
+    m_caseSensitive = caseSensitive;
+
+    TextRegexCompiler compiler(pattern, *this);
+    if (!compiler.Compile(error)) {
+        m_program.clear();
+        m_classes.clear();
+        return false;
+    }
+    return true;
+}
+
+bool TextRegex::ClassMatches(const CharacterClass& set, uint32_t character) const {
+    auto contains = [&set](uint32_t candidate) {
+        for (const Range& range : set.ranges) {
+            if (candidate >= range.first && candidate <= range.last) {
+                return true;
+            }
+        }
+        for (char shorthand : set.shorthands) {
+            if (MatchesShorthand(shorthand, candidate)) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    bool found = contains(character);
+    if (!found && !m_caseSensitive) {
+        uint32_t lower = FoldCase(character);
+        uint32_t upper = UpperCase(character);
+        found = (lower != character && contains(lower)) || (upper != character && contains(upper));
+    }
+    return found != set.negated;
+}
+
+namespace {
+
+/**
+ * The threads of one step: their program counters in priority order,
+ * each with its capture slots in one flat array
+ */
+struct ThreadList {
+    std::vector<int> pcs;
+    std::vector<int> captures;
+
+    void Clear() {
+        pcs.clear();
+        captures.clear();
+    }
+};
+
+} // namespace
+
+bool TextRegex::Search(const std::u16string& text, size_t from, std::vector<int>& captures) const {
+    if (m_program.empty() || from > text.size()) {
+        return false;
+    }
+
+    const size_t slots = static_cast<size_t>(m_slots);
+    ThreadList current;
+    ThreadList next;
+
+    // A program counter is added at most once per step, in the order threads are found
+    std::vector<size_t> visited(m_program.size(), 0);
+    size_t step = 1;
+
+    // Explicit stack for following splits, jumps and saves: a program counter,
+    // or a capture slot to restore when `slot` is set
+    struct Pending {
+        int pc;
+        int slot;
+        int value;
+    };
+    std::vector<Pending> stack;
+    std::vector<int> scratch(slots);
+
+    auto addThread = [&](ThreadList& list, int start, const int* startCaptures, size_t position) {
+        std::copy(startCaptures, startCaptures + slots, scratch.begin());
+        stack.push_back({start, -1, 0});
+        while (!stack.empty()) {
+            Pending pending = stack.back();
+            stack.pop_back();
+            if (pending.slot >= 0) {
+                scratch[static_cast<size_t>(pending.slot)] = pending.value;
+                continue;
+            }
+
+            int pc = pending.pc;
+            if (visited[static_cast<size_t>(pc)] == step) {
+                continue;
+            }
+            visited[static_cast<size_t>(pc)] = step;
+
+            const Instruction& instruction = m_program[static_cast<size_t>(pc)];
+            bool passes = true;
+            switch (instruction.op) {
+            case Op::Jump:
+                stack.push_back({instruction.x, -1, 0});
+                continue;
+            case Op::Split:
+                // The preferred branch is popped, and so followed, first
+                stack.push_back({instruction.y, -1, 0});
+                stack.push_back({instruction.x, -1, 0});
+                continue;
+            case Op::Save:
+                stack.push_back({0, instruction.x, scratch[static_cast<size_t>(instruction.x)]});
+                scratch[static_cast<size_t>(instruction.x)] = static_cast<int>(position);
+                stack.push_back({pc + 1, -1, 0});
+                continue;
+            case Op::EmptyCheck:
+                // An iteration that matched nothing goes on after the loop
+                stack.push_back({static_cast<size_t>(scratch[static_cast<size_t>(instruction.x)]) == position
+                                 ? instruction.y : pc + 1, -1, 0});
+                continue;
+            case Op::LineStart:
+                passes = position == 0;
+                break;
+            case Op::LineEnd:
+                passes = position == text.size();
+                break;
+            case Op::WordBoundary:
+                passes = IsWordBefore(text, position) != IsWordAt(text, position);
+                break;
+            case Op::NotWordBoundary:
+                passes = IsWordBefore(text, position) == IsWordAt(text, position);
+                break;
+            default:
+                // Instructions that consume a character, or Match, wait for the step
+                list.pcs.push_back(pc);
+                list.captures.insert(list.captures.end(), scratch.begin(), scratch.end());
+                continue;
+            }
+            if (passes) {
+                stack.push_back({pc + 1, -1, 0});
+            }
+        }
+    };
+
+    const std::vector<int> unset(slots, -1);
+    bool matched = false;
+    for (size_t position = from; ; ) {
+        // A thread starting here ranks below every thread that started earlier
+        if (!matched) {
+            addThread(current, 0, unset.data(), position);
+        }
+        if (current.pcs.empty() && (matched || position >= text.size())) {
+            break;
+        }
+
+        size_t width = 0;
+        uint32_t character = position < text.size() ? Decode(text, position, width) : 0;
+        uint32_t folded = m_caseSensitive ? character : FoldCase(character);
+        step++;
+        next.Clear();
+
+        for (size_t i = 0; i < current.pcs.size(); i++) {
+            const Instruction& instruction = m_program[static_cast<size_t>(current.pcs[i])];
+            const int* threadCaptures = current.captures.data() + i * slots;
+            bool advances = false;
+            switch (instruction.op) {
+            case Op::Match:
+                matched = true;
+                captures.assign(threadCaptures, threadCaptures + (m_groups + 1) * 2);
+                break;
+            case Op::Char:
+                advances = width > 0 && folded == instruction.character;
+                break;
+            case Op::Any:
+                advances = width > 0 && !IsLineBreak(character);
+                break;
+            case Op::Class:
+                advances = width > 0 && ClassMatches(m_classes[static_cast<size_t>(instruction.x)], character);
+                break;
+            default:
+                break;
+            }
+            if (instruction.op == Op::Match) {
+                // Threads after this one rank lower than the match
+                break;
+            }
+            if (advances) {
+                addThread(next, current.pcs[i] + 1, threadCaptures, position + width);
+            }
+        }
+
+        std::swap(current, next);
+        if (width == 0) {
+            break;
+        }
+        position += width;
+    }
+    return matched;
+}
+
+} // namespace KateNative
@@ -0,0 +1,99 @@
+#ifndef TEXT_REGEX_H
+#define TEXT_REGEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace KateNative {
+
+/**
+ * Text Regular Expression
+ *
+ * A regular expression over UTF-16 text for builds without Qt, matched
+ * by a Pike VM: every thread of the compiled program advances over the
+ * text in lockstep, so the time is linear in the text for a given
+ * pattern and the stack never grows with it. Results are leftmost-first,
+ * like a backtracking engine's.
+ *
+ * The syntax is the part of PCRE and ECMAScript a Pike VM can run:
+ * alternation, capturing, non-capturing and named groups, greedy and
+ * lazy quantifiers, classes with ranges, the \d \w \s classes and their
+ * negations, ^ $ \b \B, and the usual character escapes. Backreferences
+ * and lookaround are reported as errors. Surrogate pairs match as one
+ * character; \w, \d and \b are ASCII, as in ECMAScript.
+ *
+ * Compiled patterns are immutable, so one can be shared by several
+ * threads.
+ */
+class TextRegex {
+public:
+    // Compiled programs larger than this are rejected, which bounds counted repetition
+    static constexpr size_t MaxInstructions = 65536;
+
+    /**
+     * Compile `pattern`; returns false and sets `error` when it is
+     * malformed or uses what the matcher doesn't support
+     */
+    bool Compile(const std::u16string& pattern, bool caseSensitive, std::string& error);
+
+    // Capture groups in the pattern, not counting the whole match
+    int Groups() const { return m_groups; }
+
+    /**
+     * Find the first match starting at or after `from`; text before it
+     * still counts for ^ and \b. `captures` gets the start and end of the
+     * match and of every group, in UTF-16 code units, or -1 for groups
+     * that took no part in it.
+     */
+    bool Search(const std::u16string& text, size_t from, std::vector<int>& captures) const;
+
+private:
+    enum class Op : uint8_t {
+        Char,
+        Any,
+        Class,
+        Split,
+        Jump,
+        Save,
+        LineStart,
+        LineEnd,
+        WordBoundary,
+        NotWordBoundary,
+        EmptyCheck,
+        Match
+    };
+
+    struct Instruction {
+        Op op;
+        uint32_t character; // Char: the code point, folded unless case matters
+        int x;              // Split and Jump: preferred target; Class: index; Save and EmptyCheck: slot
+        int y;              // Split: other target; EmptyCheck: where to go when the slot is here
+    };
+
+    struct Range {
+        uint32_t first;
+        uint32_t last;
+    };
+
+    struct CharacterClass {
+        std::vector<Range> ranges;
+        std::vector<char> shorthands; // 'd', 'w', 's' and their upper-case negations
+        bool negated = false;
+    };
+
+    friend class TextRegexCompiler;
+
+    bool ClassMatches(const CharacterClass& set, uint32_t character) const;
+
+    std::vector<Instruction> m_program;
+    std::vector<CharacterClass> m_classes;
+    int m_groups = 0;
+    int m_slots = 2;    // Capture slots, then one per unbounded loop
+    bool m_caseSensitive = true;
+};
+
+} // namespace KateNative
+
+#endif // TEXT_REGEX_H
@@ -0,0 +1,48 @@
+#include "worker_pool.h"
+#include <algorithm>
+#include <thread>
+
+#ifdef HAVE_KTEXTEDITOR
+#include <QRunnable>
+#include <QThreadPool>
+#endif
+
+namespace KateNative {
+
+#ifdef HAVE_KTEXTEDITOR
+namespace {
+
+class WorkerTask : public QRunnable {
+public:
+    explicit WorkerTask(WorkerPool::Task task) : m_task(std::move(task)) {
+        setAutoDelete(true);
+    }
+    
+    void run() override {
+        m_task();
+    }
+
+private:
+    WorkerPool::Task m_task;
+};
+
+} // namespace
+#endif
+
+void WorkerPool::Post(Task task) {
+#ifdef HAVE_KTEXTEDITOR
+    QThreadPool::globalInstance()->start(new WorkerTask(std::move(task)));
+#else
+    std::thread(std::move(task)).detach();
+#endif
+}
+
+int WorkerPool::ThreadCount() {
+#ifdef HAVE_KTEXTEDITOR
+    return std::max(QThreadPool::globalInstance()->maxThreadCount(), 1);
+#else
+    return std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+#endif
+}
+
+} // namespace KateNative
@@ -0,0 +1,37 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <functional>
+
+namespace KateNative {
+
+/**
+ * Background Worker Pool
+ *
+ * Runs CPU-bound work that only touches plain data (e.g. text snapshots)
+ * off both the JavaScript and the Qt thread. Backed by Qt's global
+ * thread pool when Qt is available, and by detached threads otherwise.
+ * Tasks must never call into KTextEditor.
+ */
+class WorkerPool {
+public:
+    using Task = std::function<void()>;
+    
+    /**
+     * Queue a task for a worker thread
+     */
+    static void Post(Task task);
+    
+    /**
+     * Number of tasks that can run at the same time
+     */
+    static int ThreadCount();
+
+private:
+    WorkerPool() = delete;
+    ~WorkerPool() = delete;
+};
+
+} // namespace KateNative
+
+#endif // WORKER_POOL_H
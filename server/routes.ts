@@ -10,6 +10,7 @@ import { getSettingsManager } from "./services/settings-manager";
 import { getI18nService } from "./services/i18n-service";
 import { aiService } from "./services/ai-service";
 import { KateBridge } from "./services/kate-bridge";
+import { kateService } from "./services/kate-service";
 import type { SettingsScope, SettingsUpdateRequest, SettingsGetRequest } from "../shared/settings-types";
 import type { TranslationRequest } from "../shared/i18n-types";
 import type { ChatCompletionRequest, CodeAssistanceRequest, AIProvider } from "../shared/ai-types";
@@ -69,6 +70,11 @@ export async function registerRoutes(app: Express): Promise<Server> {
     console.warn('[KateBridge] Kate features will be unavailable');
   });
 
+  // Native module metrics for Prometheus; KATE_NATIVE_STATS=1 adds per-method figures
+  app.get("/api/kate/metrics", (req, res) => {
+    res.type("text/plain; version=0.0.4").send(kateService.getPrometheusMetrics());
+  });
+
   // Debug API endpoints
   app.post("/api/debug/sessions", async (req, res) => {
     try {
@@ -224,6 +230,24 @@ export async function registerRoutes(app: Express): Promise<Server> {
     }
   });
 
+  // Hunks from HEAD to an open document, as (base start, base count, start, count) quadruples
+  app.get("/api/git/line-diff/:documentId", async (req, res) => {
+    try {
+      const metadata = kateService.getDocumentMetadata(req.params.documentId);
+      if (!metadata) {
+        return res.status(404).json({ error: "Document not found" });
+      }
+      
+      const baseText = await gitService.getFileAtRevision(metadata.filePath);
+      const hunks = kateService.getLineDiff(req.params.documentId, baseText ?? '', {
+        ignoreWhitespace: req.query.ignoreWhitespace === 'true',
+      });
+      res.json({ hunks: hunks ? Array.from(hunks) : null, tracked: baseText !== null });
+    } catch (error: any) {
+      res.status(500).json({ error: error.message });
+    }
+  });
+
   app.get("/api/git/history", async (req, res) => {
     try {
       const limit = req.query.limit ? parseInt(req.query.limit as string) : 50;
@@ -12,6 +12,9 @@ import * as path from 'path';
 
 const execFileAsync = promisify(execFile);
 
+// Enough for `git show` of large files; the default is 1 MiB
+const MAX_GIT_OUTPUT_BYTES = 256 * 1024 * 1024;
+
 /**
  * File status in git
  */
@@ -172,6 +175,24 @@ export class GitService extends EventEmitter {
     }
   }
 
+  /**
+   * Get a file's content at a revision (HEAD by default), or null when it
+   * doesn't exist there
+   */
+  async getFileAtRevision(filePath: string, revision = 'HEAD'): Promise<string | null> {
+    if (!this.isInitialized) {
+      return null;
+    }
+
+    try {
+      const relativePath = path.relative(this.repoPath, path.resolve(this.repoPath, filePath));
+      const { stdout } = await this.execGit(['show', `${revision}:./${relativePath}`]);
+      return stdout;
+    } catch (error) {
+      return null;
+    }
+  }
+
   /**
    * Stage a file
    */
@@ -360,6 +381,6 @@ export class GitService extends EventEmitter {
    * Execute git command with arguments array (safe from command injection)
    */
   private async execGit(args: string[]): Promise<{ stdout: string; stderr: string }> {
-    return execFileAsync('git', ['-C', this.repoPath, ...args]);
+    return execFileAsync('git', ['-C', this.repoPath, ...args], { maxBuffer: MAX_GIT_OUTPUT_BYTES });
   }
 }
@@ -82,6 +82,11 @@ export class KateBridge {
   
   // TODO: Track open documents and their buffers
   private documents: Map<string, any> = new Map();
+  
+  // Viewport clients: an id per connection and its token subscriptions by document
+  private clientIds: Map<WebSocket, string> = new Map();
+  private tokenSubscriptions: Map<WebSocket, Map<string, () => void>> = new Map();
+  private nextClientId = 1;
 
   constructor(config: KateBridgeConfig = {}) {
     this.config = {
@@ -141,6 +146,7 @@ export class KateBridge {
       ws.on('close', () => {
         console.log('[KateBridge] Client disconnected');
         this.clients.delete(ws);
+        this.releaseViewports(ws);
       });
 
       ws.on('error', (error) => {
@@ -194,6 +200,10 @@ export class KateBridge {
         await this.handleSyntaxRequest(ws, payload);
         break;
 
+      case 'syntax.viewport':
+        await this.handleSyntaxViewport(ws, payload);
+        break;
+
       case 'fold.request':
         // TODO: Request code folding information from Kate engine
         await this.handleFoldRequest(ws, payload);
@@ -303,7 +313,7 @@ export class KateBridge {
     
     try {
       // Get syntax tokens from Kate service
-      const tokens = kateService.getSyntaxTokens(documentId, lineStart, lineEnd);
+      const tokens = await kateService.getSyntaxTokensAsync(documentId, lineStart, lineEnd);
       
       this.send(ws, {
         type: 'syntax.response',
@@ -319,6 +329,64 @@ export class KateBridge {
     }
   }
 
+  /**
+   * Handle a viewport change: its lines are highlighted first and tokens
+   * are pushed as 'syntax.update' messages while the client is connected
+   */
+  private async handleSyntaxViewport(ws: WebSocket, payload: any): Promise<void> {
+    const { documentId, lineStart, lineEnd } = payload;
+    
+    let clientId = this.clientIds.get(ws);
+    if (!clientId) {
+      clientId = `client-${this.nextClientId++}`;
+      this.clientIds.set(ws, clientId);
+    }
+    
+    if (!kateService.setViewport(documentId, clientId, lineStart, lineEnd)) {
+      this.sendError(ws, `Document ${documentId} not found`);
+      return;
+    }
+    
+    let subscriptions = this.tokenSubscriptions.get(ws);
+    if (!subscriptions) {
+      subscriptions = new Map();
+      this.tokenSubscriptions.set(ws, subscriptions);
+    }
+    if (!subscriptions.has(documentId)) {
+      subscriptions.set(documentId, kateService.onTokensChanged(documentId, (delta) => {
+        this.send(ws, {
+          type: 'syntax.update',
+          payload: {
+            documentId,
+            revision: delta.revision,
+            lineCount: delta.lineCount,
+            mode: delta.mode,
+            legend: delta.legend,
+            lines: Array.from(delta.lines),
+            offsets: Array.from(delta.offsets),
+            data: Array.from(delta.data),
+          },
+        });
+      }));
+    }
+  }
+
+  /**
+   * Drop a connection's viewports and token subscriptions
+   */
+  private releaseViewports(ws: WebSocket): void {
+    const clientId = this.clientIds.get(ws);
+    const subscriptions = this.tokenSubscriptions.get(ws);
+    if (clientId && subscriptions) {
+      subscriptions.forEach((unsubscribe, documentId) => {
+        unsubscribe();
+        kateService.clearViewport(documentId, clientId);
+      });
+    }
+    this.clientIds.delete(ws);
+    this.tokenSubscriptions.delete(ws);
+  }
+
   /**
    * Handle code folding request
    */
@@ -329,7 +397,7 @@ export class KateBridge {
     
     try {
       // Get folding regions from Kate service
-      const foldingRegions = kateService.getFoldingRegions(documentId);
+      const foldingRegions = await kateService.getFoldingRegionsAsync(documentId);
       
       this.send(ws, {
         type: 'fold.response',
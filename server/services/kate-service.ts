@@ -15,6 +15,7 @@ import type {
 // Try to import native module - may not be available
 let kateNative: any = null;
 let isNativeAvailable = false;
+let hasKTextEditor = false;
 
 // Use dynamic import for ESM compatibility
 async function loadNativeModule(): Promise<void> {
@@ -22,7 +23,10 @@ async function loadNativeModule(): Promise<void> {
         const nativeModule = await import('@kate-neo/native');
         // Handle both default and named exports
         kateNative = nativeModule.default || nativeModule;
-        isNativeAvailable = kateNative?.isKateAvailable?.() || false;
+        hasKTextEditor = kateNative?.isKateAvailable?.() || false;
+        // Builds without KTextEditor still have native documents, on the fallback engine
+        const engine = kateNative?.getDocumentEngine?.() || (hasKTextEditor ? 'ktexteditor' : 'mock');
+        isNativeAvailable = engine !== 'mock';
     } catch (error) {
         console.warn('[KateService] Native module not available:', (error as Error).message);
         console.warn('[KateService] Running without KTextEditor support');
@@ -37,6 +41,7 @@ loadNativeModule();
  */
 class KateDocument {
     private nativeDoc: any | null = null;
+    private searchSession: any | null = null;
     private metadata: DocumentMetadata;
     private content: string = '';
 
@@ -57,11 +62,11 @@ class KateDocument {
         // Try to create native document
         if (isNativeAvailable && kateNative) {
             try {
-                this.nativeDoc = kateNative.createDocument();
+                // Mode first, so the text is only highlighted once
+                this.nativeDoc = kateNative.createDocument({ mode: language });
                 if (initialContent) {
                     this.nativeDoc.setText(initialContent);
                 }
-                this.nativeDoc.setMode(language);
             } catch (error) {
                 console.error('[KateDocument] Failed to create native document:', error);
                 this.nativeDoc = null;
@@ -179,6 +184,31 @@ class KateDocument {
         }
     }
 
+    /**
+     * Apply several changes, in order
+     * Native documents take them in one call and one editing transaction.
+     */
+    applyChanges(changes: TextChange[]): void {
+        if (this.nativeDoc && this.nativeDoc.applyEdits && kateNative?.encodeEdits) {
+            const edits = changes.map(({ range, text }) => ({
+                op: kateNative.EditOp.Replace,
+                startLine: range.start.line,
+                startColumn: range.start.column,
+                endLine: range.end.line,
+                endColumn: range.end.column,
+                text,
+            }));
+            this.nativeDoc.applyEdits(kateNative.encodeEdits(edits));
+            this.metadata.isDirty = true;
+            this.metadata.version += changes.length;
+            return;
+        }
+        
+        for (const change of changes) {
+            this.applyChange(change);
+        }
+    }
+
     /**
      * Get syntax mode
      */
@@ -280,6 +310,56 @@ class KateDocument {
         return [];
     }
 
+    /**
+     * Get syntax tokens on the Qt thread without blocking the event loop
+     */
+    async getSyntaxTokensAsync(lineStart: number, lineEnd: number): Promise<SyntaxToken[]> {
+        if (this.nativeDoc && this.nativeDoc.getSyntaxTokensAsync) {
+            return this.nativeDoc.getSyntaxTokensAsync(lineStart, lineEnd);
+        }
+        return this.getSyntaxTokens(lineStart, lineEnd);
+    }
+
+    /**
+     * Get folding regions on the Qt thread without blocking the event loop
+     */
+    async getFoldingRegionsAsync(): Promise<any[]> {
+        if (this.nativeDoc && this.nativeDoc.getFoldingRegionsAsync) {
+            return this.nativeDoc.getFoldingRegionsAsync();
+        }
+        return this.getFoldingRegions();
+    }
+
+    /**
+     * Declare the lines a client shows so they are highlighted first
+     */
+    setViewport(clientId: string, lineStart: number, lineEnd: number): void {
+        this.nativeDoc?.setViewport?.(lineStart, lineEnd, clientId);
+    }
+
+    clearViewport(clientId: string): void {
+        this.nativeDoc?.clearViewport?.(clientId);
+    }
+
+    /**
+     * Listen for tokens highlighted in the background; returns a function that stops listening.
+     * Only the KTextEditor engine highlights, so there is nothing to listen for otherwise.
+     */
+    onTokensChanged(listener: (delta: any) => void): () => void {
+        if (!this.nativeDoc || !this.nativeDoc.on || !hasKTextEditor) {
+            return () => {};
+        }
+        this.nativeDoc.on('tokensChanged', listener);
+        return () => this.nativeDoc?.off('tokensChanged', listener);
+    }
+
+    /**
+     * Native document, for module-level calls that take several documents
+     */
+    getNativeDocument(): any | null {
+        return this.nativeDoc;
+    }
+
     /**
      * Search for text in document (Phase 8)
      */
@@ -316,6 +396,31 @@ class KateDocument {
         return results;
     }
 
+    /**
+     * Find matches in a line range as (line, column, length) triples
+     * Reuses one compiled search session, so repeated find-as-you-type
+     * queries don't recompile the pattern or rescan the whole document.
+     */
+    findInRange(query: string, options: { caseSensitive?: boolean; wholeWords?: boolean; regex?: boolean },
+                lineStart: number, lineEnd: number, limit?: number): Int32Array {
+        if (this.nativeDoc && kateNative?.createSearchSession) {
+            if (!this.searchSession) {
+                this.searchSession = kateNative.createSearchSession(this.nativeDoc, query, options);
+            } else {
+                this.searchSession.setPattern(query, options);
+            }
+            return this.searchSession.findInRange(lineStart, lineEnd, limit);
+        }
+        // Fallback: filter the full search
+        const triples: number[] = [];
+        for (const match of this.search(query, options)) {
+            if (match.line >= lineStart && match.line <= lineEnd) {
+                triples.push(match.line, match.column, match.length);
+            }
+        }
+        return Int32Array.from(limit ? triples.slice(0, limit * 3) : triples);
+    }
+
     /**
      * Replace text at specific location (Phase 8)
      */
@@ -381,6 +486,28 @@ class KateDocument {
         return spaces;
     }
 
+    /**
+     * Line diff from `base` to this document, as (base start, base count,
+     * start, count) quadruples; null without the native module
+     */
+    diff(base: string | KateDocument, options: { ignoreWhitespace?: boolean } = {}): Int32Array | null {
+        if (!this.nativeDoc || !this.nativeDoc.diff) {
+            return null;
+        }
+        const other = typeof base === 'string' ? base : base.getNativeDocument();
+        return other ? this.nativeDoc.diff(other, options) : null;
+    }
+
+    /**
+     * Lines changed since the document was opened or saved, as diff() hunks
+     */
+    getDirtyLines(): Int32Array | null {
+        if (!this.nativeDoc || !this.nativeDoc.getDirtyLines) {
+            return null;
+        }
+        return this.nativeDoc.getDirtyLines();
+    }
+
     /**
      * Set indentation of a line (Phase 8)
      */
@@ -440,6 +567,9 @@ class KateDocument {
 export class KateService {
     private documents: Map<string, KateDocument> = new Map();
     private nextDocId = 1;
+    
+    // Trigram index over the native documents, created by the first search
+    private textIndex: any = null;
 
     constructor() {
         console.log('[KateService] Initializing Kate service...');
@@ -454,7 +584,7 @@ export class KateService {
      * Check if native Kate is available
      */
     isKateAvailable(): boolean {
-        return isNativeAvailable;
+        return hasKTextEditor;
     }
 
     /**
@@ -471,6 +601,92 @@ export class KateService {
         };
     }
 
+    /**
+     * Turn the native module's instrumentation on or off
+     */
+    setNativeStatsEnabled(enabled: boolean): void {
+        kateNative?.setStatsEnabled?.(enabled);
+    }
+
+    /**
+     * Native call counts, latencies, conversion counters and Qt queue figures
+     */
+    getNativeStats(): any | null {
+        return kateNative?.getStats ? kateNative.getStats() : null;
+    }
+
+    /**
+     * Native stats in the Prometheus text exposition format
+     * Counters only grow while nothing calls resetStats(), as Prometheus expects.
+     */
+    getPrometheusMetrics(): string {
+        const lines: string[] = [
+            '# HELP kate_documents_open Documents open in the Kate service',
+            '# TYPE kate_documents_open gauge',
+            `kate_documents_open ${this.documents.size}`,
+        ];
+
+        const stats = this.getNativeStats();
+        if (!stats || !stats.enabled) {
+            return lines.join('\n') + '\n';
+        }
+
+        const boundsSeconds: number[] = stats.bucketBoundsMs.map((ms: number) => ms / 1000);
+        const histogram = (name: string, labels: string, value: any) => {
+            let cumulative = 0;
+            boundsSeconds.forEach((bound, i) => {
+                cumulative += value.buckets[i];
+                lines.push(`${name}_bucket{${labels}${labels ? ',' : ''}le="${bound}"} ${cumulative}`);
+            });
+            lines.push(`${name}_bucket{${labels}${labels ? ',' : ''}le="+Inf"} ${value.count}`);
+            lines.push(`${name}_sum${labels ? `{${labels}}` : ''} ${value.sumMs / 1000}`);
+            lines.push(`${name}_count${labels ? `{${labels}}` : ''} ${value.count}`);
+        };
+
+        lines.push('# HELP kate_native_method_calls_total Calls per native document method');
+        lines.push('# TYPE kate_native_method_calls_total counter');
+        for (const [method, entry] of Object.entries<any>(stats.methods)) {
+            lines.push(`kate_native_method_calls_total{method="${method}"} ${entry.calls}`);
+        }
+        for (const phase of ['marshal', 'work', 'settle']) {
+            const name = `kate_native_method_${phase}_seconds`;
+            lines.push(`# HELP ${name} Native method ${phase} time`);
+            lines.push(`# TYPE ${name} histogram`);
+            for (const [method, entry] of Object.entries<any>(stats.methods)) {
+                histogram(name, `method="${method}"`, entry[phase]);
+            }
+        }
+
+        for (const [counter, value] of Object.entries<number>(stats.conversions)) {
+            const name = `kate_native_${counter.replace(/[A-Z]/g, c => '_' + c.toLowerCase())}_total`;
+            lines.push(`# TYPE ${name} counter`);
+            lines.push(`${name} ${value}`);
+        }
+
+        lines.push('# HELP kate_native_qt_queue_depth Tasks waiting for the Qt thread');
+        lines.push('# TYPE kate_native_qt_queue_depth gauge');
+        lines.push(`kate_native_qt_queue_depth ${stats.qt.queueDepth}`);
+        lines.push('# TYPE kate_native_qt_queue_depth_max gauge');
+        lines.push(`kate_native_qt_queue_depth_max ${stats.qt.maxQueueDepth}`);
+        lines.push('# TYPE kate_native_qt_tasks_total counter');
+        lines.push(`kate_native_qt_tasks_total ${stats.qt.tasks}`);
+        lines.push('# HELP kate_native_qt_wait_seconds Time from queueing a task to it starting on the Qt thread');
+        lines.push('# TYPE kate_native_qt_wait_seconds histogram');
+        histogram('kate_native_qt_wait_seconds', '', stats.qt.wait);
+
+        if (this.textIndex) {
+            const index = this.textIndex.stats();
+            lines.push('# HELP kate_native_text_index_memory_bytes Estimated size of the trigram index');
+            lines.push('# TYPE kate_native_text_index_memory_bytes gauge');
+            lines.push(`kate_native_text_index_memory_bytes ${index.memoryBytes}`);
+            lines.push('# TYPE kate_native_text_index_documents gauge');
+            lines.push(`kate_native_text_index_documents{indexed="true"} ${index.indexedDocuments}`);
+            lines.push(`kate_native_text_index_documents{indexed="false"} ${index.documents - index.indexedDocuments}`);
+        }
+
+        return lines.join('\n') + '\n';
+    }
+
     /**
      * Create a new document
      */
@@ -488,6 +704,7 @@ export class KateService {
      */
     async openDocument(documentId: string, filePath: string, language: string): Promise<boolean> {
         const doc = new KateDocument(documentId, filePath, language);
+        this.unindexDocument(documentId);
         
         // Try to open from file if native is available
         if (isNativeAvailable) {
@@ -511,6 +728,7 @@ export class KateService {
     closeDocument(documentId: string): boolean {
         const doc = this.documents.get(documentId);
         if (doc) {
+            this.unindexDocument(documentId);
             this.documents.delete(documentId);
             console.log(`[KateService] Closed document ${documentId}`);
             return true;
@@ -537,9 +755,7 @@ export class KateService {
 
         console.log(`[KateService] Applying ${update.changes.length} changes to ${update.documentId}`);
         
-        for (const change of update.changes) {
-            doc.applyChange(change);
-        }
+        doc.applyChanges(update.changes);
     }
 
     /**
@@ -603,6 +819,59 @@ export class KateService {
         return doc.getFoldingRegions();
     }
 
+    /**
+     * Get syntax tokens without blocking the event loop
+     */
+    async getSyntaxTokensAsync(documentId: string, lineStart: number, lineEnd: number): Promise<SyntaxToken[]> {
+        const doc = this.documents.get(documentId);
+        if (!doc) {
+            console.warn(`[KateService] Document ${documentId} not found`);
+            return [];
+        }
+        
+        return doc.getSyntaxTokensAsync(lineStart, lineEnd);
+    }
+
+    /**
+     * Declare the lines a client shows; they are highlighted ahead of the rest
+     */
+    setViewport(documentId: string, clientId: string, lineStart: number, lineEnd: number): boolean {
+        const doc = this.documents.get(documentId);
+        if (!doc) {
+            console.warn(`[KateService] Document ${documentId} not found`);
+            return false;
+        }
+        
+        doc.setViewport(clientId, lineStart, lineEnd);
+        return true;
+    }
+
+    clearViewport(documentId: string, clientId: string): void {
+        this.documents.get(documentId)?.clearViewport(clientId);
+    }
+
+    /**
+     * Listen for background-highlighted tokens of a document
+     * Returns a function that stops listening.
+     */
+    onTokensChanged(documentId: string, listener: (delta: any) => void): () => void {
+        const doc = this.documents.get(documentId);
+        return doc ? doc.onTokensChanged(listener) : () => {};
+    }
+
+    /**
+     * Get folding regions without blocking the event loop
+     */
+    async getFoldingRegionsAsync(documentId: string): Promise<any[]> {
+        const doc = this.documents.get(documentId);
+        if (!doc) {
+            console.warn(`[KateService] Document ${documentId} not found`);
+            return [];
+        }
+        
+        return doc.getFoldingRegionsAsync();
+    }
+
     /**
      * Search in document (Phase 8)
      */
@@ -616,6 +885,101 @@ export class KateService {
         return doc.search(query, options);
     }
 
+    /**
+     * Search every open document, scanning native ones in parallel
+     */
+    async searchDocuments(query: string, options: any = {}): Promise<Map<string, any[]>> {
+        const results = new Map<string, any[]>();
+        const nativeIds: string[] = [];
+        const nativeDocs: any[] = [];
+        
+        for (const [documentId, doc] of this.documents) {
+            const nativeDoc = doc.getNativeDocument();
+            if (nativeDoc && kateNative?.searchDocuments) {
+                nativeIds.push(documentId);
+                nativeDocs.push(nativeDoc);
+            } else {
+                results.set(documentId, doc.search(query, options));
+            }
+        }
+        
+        // The text index needs KTextEditor
+        if (nativeDocs.length > 0 && hasKTextEditor && kateNative.createTextIndex) {
+            this.searchIndexed(nativeIds, nativeDocs, query, options, results);
+        } else if (nativeDocs.length > 0) {
+            const perDocument: any[][] = await kateNative.searchDocuments(nativeDocs, query, options);
+            nativeIds.forEach((documentId, i) => results.set(documentId, perDocument[i]));
+        }
+        
+        return results;
+    }
+
+    /**
+     * Search native documents through the shared text index, which follows
+     * their edits so repeated queries only verify candidate blocks
+     */
+    private searchIndexed(documentIds: string[], nativeDocs: any[], query: string, options: any,
+                          results: Map<string, any[]>): void {
+        if (!this.textIndex) {
+            this.textIndex = kateNative.createTextIndex();
+        }
+        
+        const byIndexId = new Map<number, { documentId: string; nativeDoc: any }>();
+        documentIds.forEach((documentId, i) => {
+            byIndexId.set(this.textIndex.add(nativeDocs[i]), { documentId, nativeDoc: nativeDocs[i] });
+            results.set(documentId, []);
+        });
+        
+        // Matches come grouped by document id
+        const matches: Int32Array = this.textIndex.search(query, { ...options, limit: 0 });
+        for (let first = 0; first < matches.length; ) {
+            let end = first;
+            let firstLine = matches[first + 1];
+            let lastLine = firstLine;
+            for (; end < matches.length && matches[end] === matches[first]; end += 4) {
+                firstLine = Math.min(firstLine, matches[end + 1]);
+                lastLine = Math.max(lastLine, matches[end + 1]);
+            }
+            const entry = byIndexId.get(matches[first]);
+            if (entry) {
+                // One trip to the document for the lines of all its matches
+                const lines: string[] = entry.nativeDoc.lines(firstLine, lastLine);
+                const documentResults = results.get(entry.documentId)!;
+                for (let i = first; i < end; i += 4) {
+                    const [line, column, length] = [matches[i + 1], matches[i + 2], matches[i + 3]];
+                    documentResults.push({
+                        line, column, length,
+                        text: (lines[line - firstLine] ?? '').substr(column, length),
+                    });
+                }
+            }
+            first = end;
+        }
+    }
+
+    /**
+     * Drop a document from the text index, which otherwise keeps it alive
+     */
+    private unindexDocument(documentId: string): void {
+        const nativeDoc = this.documents.get(documentId)?.getNativeDocument();
+        if (this.textIndex && nativeDoc) {
+            this.textIndex.remove(nativeDoc);
+        }
+    }
+
+    /**
+     * Find matches in a line range using the document's search session
+     */
+    findInRange(documentId: string, query: string, options: any, lineStart: number, lineEnd: number, limit?: number): Int32Array {
+        const doc = this.documents.get(documentId);
+        if (!doc) {
+            console.warn(`[KateService] Document ${documentId} not found`);
+            return new Int32Array(0);
+        }
+        
+        return doc.findInRange(query, options, lineStart, lineEnd, limit);
+    }
+
     /**
      * Replace text in document (Phase 8)
      */
@@ -655,6 +1019,32 @@ export class KateService {
         return doc.getIndentation(line);
     }
 
+    /**
+     * Line diff hunks from `baseText` (e.g. the committed version) to a document
+     */
+    getLineDiff(documentId: string, baseText: string, options: { ignoreWhitespace?: boolean } = {}): Int32Array | null {
+        const doc = this.documents.get(documentId);
+        if (!doc) {
+            console.warn(`[KateService] Document ${documentId} not found`);
+            return null;
+        }
+        
+        return doc.diff(baseText, options);
+    }
+
+    /**
+     * Lines changed since a document was opened or saved, for gutter markers
+     */
+    getDirtyLines(documentId: string): Int32Array | null {
+        const doc = this.documents.get(documentId);
+        if (!doc) {
+            console.warn(`[KateService] Document ${documentId} not found`);
+            return null;
+        }
+        
+        return doc.getDirtyLines();
+    }
+
     /**
      * Set line indentation (Phase 8)
      */
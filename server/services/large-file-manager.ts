@@ -12,6 +12,23 @@ import * as fs from 'fs';
 import * as readline from 'readline';
 import { EventEmitter } from 'events';
 
+// Memory-mapped documents from the native module, when it is built, with or without KTextEditor
+let kateNative: any = null;
+
+async function loadNativeModule(): Promise<void> {
+  try {
+    const nativeModule = await import('@kate-neo/native');
+    const loaded = nativeModule.default || nativeModule;
+    if (loaded?.getDocumentEngine?.() !== 'mock' && loaded?.openLargeDocument) {
+      kateNative = loaded;
+    }
+  } catch (error) {
+    // Fall back to readline indexing
+  }
+}
+
+loadNativeModule();
+
 /**
  * Configuration for large file handling
  */
@@ -64,6 +81,8 @@ export interface FileMetadata {
   lineCount?: number;
   /** Whether file is indexed */
   indexed: boolean;
+  /** Fraction of the file indexed so far, from 0 to 1 */
+  indexProgress?: number;
   /** Encoding */
   encoding: BufferEncoding;
 }
@@ -74,6 +93,7 @@ export interface FileMetadata {
 export class LargeFileManager extends EventEmitter {
   private config: LargeFileConfig;
   private lineOffsets: Map<string, LineIndexEntry[]> = new Map();
+  private nativeDocuments: Map<string, any> = new Map();
   private fileMetadata: Map<string, FileMetadata> = new Map();
 
   constructor(config: Partial<LargeFileConfig> = {}) {
@@ -121,13 +141,34 @@ export class LargeFileManager extends EventEmitter {
    * Build line offset index for fast random access
    */
   async buildLineIndex(filePath: string): Promise<void> {
-    if (this.lineOffsets.has(filePath)) {
+    if (this.lineOffsets.has(filePath) || this.nativeDocuments.has(filePath)) {
       return; // Already indexed
     }
 
     console.log(`[LargeFileManager] Building line index for ${filePath}`);
     const startTime = Date.now();
 
+    const metadata = await this.getFileMetadata(filePath);
+    const reportProgress = (scanned: number, total: number) => {
+      metadata.indexProgress = total > 0 ? scanned / total : 1;
+      this.emit('indexProgress', { filePath, scanned, total });
+    };
+
+    // The native index maps the file instead of reading it through JS strings
+    if (kateNative) {
+      const document = await kateNative.openLargeDocument(filePath, { onProgress: reportProgress });
+      this.nativeDocuments.set(filePath, document);
+
+      metadata.indexed = true;
+      metadata.indexProgress = 1;
+      metadata.lineCount = document.lineCount();
+
+      const elapsed = Date.now() - startTime;
+      console.log(`[LargeFileManager] Indexed ${metadata.lineCount} lines natively in ${elapsed}ms`);
+      this.emit('indexed', { filePath, lineCount: metadata.lineCount, elapsed });
+      return;
+    }
+
     const lineOffsets: LineIndexEntry[] = [];
     let currentOffset = 0;
     let lineNumber = 0;
@@ -138,8 +179,14 @@ export class LargeFileManager extends EventEmitter {
       crlfDelay: Infinity,
     });
 
+    let reportedPercent = 0;
     for await (const line of rl) {
       const lineLength = Buffer.byteLength(line, 'utf-8') + 1; // +1 for newline
+      const percent = Math.floor((currentOffset * 100) / Math.max(metadata.size, 1));
+      if (percent > reportedPercent) {
+        reportedPercent = percent;
+        reportProgress(currentOffset, metadata.size);
+      }
       
       lineOffsets.push({
         line: lineNumber,
@@ -154,8 +201,8 @@ export class LargeFileManager extends EventEmitter {
     this.lineOffsets.set(filePath, lineOffsets);
 
     // Update metadata
-    const metadata = await this.getFileMetadata(filePath);
     metadata.indexed = true;
+    metadata.indexProgress = 1;
     metadata.lineCount = lineOffsets.length;
 
     const elapsed = Date.now() - startTime;
@@ -169,7 +216,7 @@ export class LargeFileManager extends EventEmitter {
    */
   async getChunk(filePath: string, startLine: number, lineCount: number): Promise<TextChunk> {
     // Ensure file is indexed
-    if (!this.lineOffsets.has(filePath)) {
+    if (!this.lineOffsets.has(filePath) && !this.nativeDocuments.has(filePath)) {
       if (this.config.enableIndexing) {
         await this.buildLineIndex(filePath);
       } else {
@@ -177,6 +224,11 @@ export class LargeFileManager extends EventEmitter {
       }
     }
 
+    const nativeDocument = this.nativeDocuments.get(filePath);
+    if (nativeDocument) {
+      return this.getNativeChunk(nativeDocument, startLine, lineCount);
+    }
+
     const offsets = this.lineOffsets.get(filePath)!;
     const totalLines = offsets.length;
 
@@ -212,6 +264,24 @@ export class LargeFileManager extends EventEmitter {
     };
   }
 
+  /**
+   * Get chunk of a memory-mapped file by line range
+   */
+  private getNativeChunk(document: any, startLine: number, lineCount: number): TextChunk {
+    const totalLines = document.lineCount();
+    const actualStartLine = Math.max(0, Math.min(startLine, totalLines - 1));
+    const actualEndLine = Math.min(actualStartLine + lineCount, totalLines);
+    const byteOffset = document.byteOffset(actualStartLine);
+
+    return {
+      startLine: actualStartLine,
+      lineCount: actualEndLine - actualStartLine,
+      content: document.lines(actualStartLine, actualEndLine - 1).join('\n'),
+      byteOffset,
+      byteLength: document.byteOffset(actualEndLine) - byteOffset,
+    };
+  }
+
   /**
    * Read a specific byte range from file
    */
@@ -243,6 +313,11 @@ export class LargeFileManager extends EventEmitter {
    * Find line offset using binary search
    */
   findLineOffset(filePath: string, lineNumber: number): number | null {
+    const nativeDocument = this.nativeDocuments.get(filePath);
+    if (nativeDocument) {
+      return lineNumber >= 0 && lineNumber < nativeDocument.lineCount() ? nativeDocument.byteOffset(lineNumber) : null;
+    }
+
     const offsets = this.lineOffsets.get(filePath);
     if (!offsets || lineNumber < 0 || lineNumber >= offsets.length) {
       return null;
@@ -307,7 +382,7 @@ export class LargeFileManager extends EventEmitter {
     }
 
     const offsets = this.lineOffsets.get(filePath);
-    const lineCount = offsets?.length ?? 0;
+    const lineCount = metadata.lineCount ?? offsets?.length ?? 0;
     const averageLineLength = lineCount > 0 ? metadata.size / lineCount : 0;
 
     return {
@@ -322,6 +397,8 @@ export class LargeFileManager extends EventEmitter {
    * Clear index for file
    */
   clearIndex(filePath: string): void {
+    this.nativeDocuments.get(filePath)?.close();
+    this.nativeDocuments.delete(filePath);
     this.lineOffsets.delete(filePath);
     this.fileMetadata.delete(filePath);
   }
@@ -330,6 +407,10 @@ export class LargeFileManager extends EventEmitter {
    * Clear all indices
    */
   clearAll(): void {
+    for (const document of Array.from(this.nativeDocuments.values())) {
+      document.close();
+    }
+    this.nativeDocuments.clear();
     this.lineOffsets.clear();
     this.fileMetadata.clear();
   }
@@ -348,10 +429,14 @@ export class LargeFileManager extends EventEmitter {
     }
 
     // Rough estimate: each line index entry takes ~24 bytes (3 numbers)
-    const estimatedMemoryBytes = totalLineIndices * 24;
+    let estimatedMemoryBytes = totalLineIndices * 24;
+    for (const document of Array.from(this.nativeDocuments.values())) {
+      totalLineIndices += document.lineCount();
+      estimatedMemoryBytes += document.indexBytes();
+    }
 
     return {
-      indexedFiles: this.lineOffsets.size,
+      indexedFiles: this.lineOffsets.size + this.nativeDocuments.size,
       totalLineIndices,
       estimatedMemoryBytes,
     };
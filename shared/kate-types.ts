@@ -305,6 +305,7 @@ export type MessageType =
   | 'syntax.request'
   | 'syntax.response'
   | 'syntax.update'
+  | 'syntax.viewport'
   
   // Code folding
   | 'fold.request'